@@ -49,10 +49,7 @@ void setup() {
     Serial.println(); 
   }
 
-  flash.enable_writing(); 
-  flash.write_page(0, write_buffer); 
-
-  flash.wait_until_free();
+  flash.write(0, write_buffer, sizeof(write_buffer), true); 
 
   // read back the page 
   byte in_buffer[256]; 
@@ -66,6 +63,13 @@ void setup() {
     }
     Serial.println(); 
   }
+
+#if W25Q64FV_ENABLE_STATS 
+  // operation counts and latency histograms 
+  W25Q64FV_stats_t stats; 
+  flash.get_stats(&stats); 
+  W25Q64FV::print_stats(stats, Serial); 
+#endif 
 }
 
 
@@ -40,6 +40,7 @@
 #define W25Q64FV_INSTRUCTION_ENABLE_QPI                     0x38
 #define W25Q64FV_INSTRUCTION_ENABLE_RESET                   0x66 
 #define W25Q64FV_INSTRUCTION_RESET                          0x99
+#define W25Q64FV_INSTRUCTION_ENTER_4B_ADDRESS_MODE          0xB7 
 // DUAL IO TABLE 
 #define W25Q64FV_INSTRUCTION_FAST_READ_DUAL_OUTPUT          0x3B 
 #define W25Q64FV_INSTRUCTION_FAST_READ_DUAL_IO              0xBB
@@ -54,10 +55,55 @@
 #define W25Q64FV_INSTRUCTION_MANUFACTURER_DEVICE_ID_QUAD_IO 0x94     
 
 /********** SETTINGS **********/ 
-#define W25Q64FV_SPI_SPEED          20000000 // 104 MHz (104 max)
+#define W25Q64FV_COMPARE_CHUNK      32 // Bytes read per step when comparing flash contents 
 
 #define W25Q64FV_DEFAULT_TIMEOUT    5000 // Default timeout for most operations 
+#define W25Q64FV_BACKOFF_MIN        10 // First poll interval after the typical operation time (us) 
+#define W25Q64FV_BACKOFF_MAX        10000 // Longest poll interval (us) 
 #define W25Q64FV_CHIP_ERASE_TIMEOUT 100000 // Chip erase timeout. Per spec, this is typically 20 seconds, at most 100 seconds. 
+#ifndef W25Q64FV_ENABLE_STATS 
+#define W25Q64FV_ENABLE_STATS       0 // Count operations and keep latency histograms. Set in the build flags so every file agrees 
+#endif 
+#define W25Q64FV_STATS_BUCKETS      28 // Log2 latency histogram buckets, the last holds everything from 2^26 us (67 s) 
+
+/********** STATUS REGISTER BITS **********/ 
+#define W25Q64FV_SR1_BUSY           0x01 // Erase/write in progress 
+#define W25Q64FV_SR1_WEL            0x02 // Write enable latch 
+#define W25Q64FV_SR2_QE             0x02 // Quad enable 
+#define W25Q64FV_SR2_SUS            0x80 // Erase/program suspended 
+
+/********** SFDP **********/ 
+#define W25Q64FV_SFDP_SIGNATURE     0x50444653 // "SFDP", little endian 
+#define W25Q64FV_SFDP_MAX_DWORDS    11 // Basic flash parameter table DWORDs used, up to the page program time 
+
+/********** CONTINUOUS READ MODE BITS **********/ 
+#define W25Q64FV_MODE_CONTINUOUS    0x20 // M5-4 = 10, the next read skips the instruction 
+#define W25Q64FV_MODE_EXIT          0xFF // Mode bits to leave continuous read mode 
+
+/********** TIMING (us) **********/ 
+// Typical and maximum datasheet values 
+#define W25Q64FV_TIME_PAGE_PROGRAM_TYP      700 
+#define W25Q64FV_TIME_PAGE_PROGRAM_MAX      3000 
+#define W25Q64FV_TIME_SECTOR_ERASE_TYP      45000 
+#define W25Q64FV_TIME_SECTOR_ERASE_MAX      400000 
+#define W25Q64FV_TIME_BLOCK_32K_ERASE_TYP   120000 
+#define W25Q64FV_TIME_BLOCK_32K_ERASE_MAX   1600000 
+#define W25Q64FV_TIME_BLOCK_64K_ERASE_TYP   150000 
+#define W25Q64FV_TIME_BLOCK_64K_ERASE_MAX   2000000 
+#define W25Q64FV_TIME_CHIP_ERASE_TYP        20000000 
+#define W25Q64FV_TIME_CHIP_ERASE_MAX        100000000 
+#define W25Q64FV_TIME_WRITE_STATUS_TYP      10000 
+#define W25Q64FV_TIME_WRITE_STATUS_MAX      15000 
+#define W25Q64FV_TIME_SUSPEND_MAX           20 
+#define W25Q64FV_TIME_SUSPEND_INTERVAL      20 // Minimum time from a resume to the next suspend 
+#define W25Q64FV_TIME_RESET_MAX             30 
+
+/********** GEOMETRY **********/ 
+#define W25Q64FV_PAGE_SIZE          256 
+#define W25Q64FV_SECTOR_SIZE        4096 
+#define W25Q64FV_BLOCK_32K_SIZE     32768 
+#define W25Q64FV_BLOCK_64K_SIZE     65536 
+#define W25Q64FV_CAPACITY           8388608 // 64 Mbit 
 
 
 
@@ -67,23 +113,125 @@ typedef enum{
     W25Q64FV_COMMUNICATION_FAIL, ///<Communication fail 
     W25Q64FV_BUSY, ///<Chip report busy 
     W25Q64FV_TIMEOUT, ///<Chip timeout on wait operation 
-    W25Q64FV_NOT_VALID ///<Not a valid operation
+    W25Q64FV_NOT_VALID, ///<Not a valid operation
+    W25Q64FV_VERIFY_FAIL, ///<Data read back does not match
+    W25Q64FV_NOT_FOUND ///<Nothing matches the search
 } W25Q64FV_status_t; 
 
+/// Read Data Path Enum 
+typedef enum{ 
+    W25Q64FV_IO_SINGLE = 0, ///<Fast read, 1-1-1 
+    W25Q64FV_IO_DUAL_OUTPUT, ///<Fast read dual output, 1-1-2 
+    W25Q64FV_IO_DUAL_IO, ///<Fast read dual I/O, 1-2-2 
+    W25Q64FV_IO_QUAD_OUTPUT, ///<Fast read quad output and quad page program, 1-1-4 
+    W25Q64FV_IO_QUAD_IO ///<Fast read quad I/O and quad page program, 1-4-4 
+} W25Q64FV_io_mode_t; 
+
+/// Device Operation Enum 
+typedef enum{ 
+    W25Q64FV_OPERATION_NONE = 0, ///<No timed operation 
+    W25Q64FV_OPERATION_PAGE_PROGRAM, ///<Page program 
+    W25Q64FV_OPERATION_SECTOR_ERASE, ///<4kB sector erase 
+    W25Q64FV_OPERATION_BLOCK_32K_ERASE, ///<32kB block erase 
+    W25Q64FV_OPERATION_BLOCK_64K_ERASE, ///<64kB block erase 
+    W25Q64FV_OPERATION_CHIP_ERASE, ///<Chip erase 
+    W25Q64FV_OPERATION_WRITE_STATUS, ///<Status register write 
+    W25Q64FV_OPERATION_RESET ///<Software reset 
+} W25Q64FV_operation_t; 
+
+/// Flash Contents Compare Enum 
+typedef enum{ 
+    W25Q64FV_COMPARE_SAME = 0, ///<Flash already holds the data 
+    W25Q64FV_COMPARE_PROGRAMMABLE, ///<Data only clears bits, can be programmed without an erase 
+    W25Q64FV_COMPARE_ERASE_REQUIRED ///<Data sets bits, an erase is required 
+} W25Q64FV_compare_t; 
+
+/// Smart Mode Statistics 
+typedef struct{ 
+    unsigned long skipped_erases; ///<Sector erases skipped as the sector was blank 
+    unsigned long skipped_pages; ///<Page programs skipped as the page held the data 
+    unsigned long skipped_bytes; ///<Bytes not clocked out as they held the data 
+} W25Q64FV_smart_stats_t; 
+
+/// Latency Histogram Enum 
+typedef enum{ 
+    W25Q64FV_HISTOGRAM_PROGRAM = 0, ///<Page program, issue to observed completion 
+    W25Q64FV_HISTOGRAM_ERASE, ///<Sector, block, and chip erase, issue to observed completion 
+    W25Q64FV_HISTOGRAM_READ, ///<Read, from the instruction to the end of the data phase 
+    W25Q64FV_HISTOGRAM_WAIT, ///<Time spent in wait_until_free() 
+    W25Q64FV_HISTOGRAM_VERIFY, ///<Read back of write_verified(), the cost of verifying 
+    W25Q64FV_HISTOGRAM_COUNT ///<Number of histograms 
+} W25Q64FV_histogram_t; 
+
+/// Driver Statistics, kept when W25Q64FV_ENABLE_STATS is set 
+typedef struct{ 
+    unsigned long operations[W25Q64FV_OPERATION_RESET + 1]; ///<Timed operations issued, indexed by W25Q64FV_operation_t 
+    unsigned long reads; ///<Reads issued 
+    unsigned long bytes; ///<Bytes clocked on the bus 
+    unsigned long selects; ///<Chip select assertions 
+    unsigned long polls; ///<Busy polls of the status register 
+    unsigned long timeouts; ///<Waits that timed out 
+    unsigned long histograms[W25Q64FV_HISTOGRAM_COUNT][W25Q64FV_STATS_BUCKETS]; ///<Bucket 0 counts 0 us, bucket i counts [2^(i-1), 2^i) us 
+} W25Q64FV_stats_t; 
+
+#if W25Q64FV_ENABLE_STATS 
+#define W25Q64FV_STAT(statement)    statement 
+#else 
+#define W25Q64FV_STAT(statement) 
+#endif 
+
 
 #include <Arduino.h>
-#include <SPI.h> 
+#include "W25Q64FV_Transport.hpp" 
+#include "W25Q64FV_Geometry.hpp" 
+#include "W25Q64FV_CRC.hpp" 
+
+/// Scatter-gather segment 
+typedef struct{ 
+    void *base; ///<Start of the segment 
+    size_t length; ///<Length of the segment in bytes 
+} W25Q64FV_iovec_t; 
 
 /**
  * @brief Interface Class for W25Q64FV Flash Chip 
  * 
+ * The bus is supplied by the Transport policy (see W25Q64FV_Transport.hpp) and the part 
+ * by the Geometry policy (see W25Q64FV_Geometry.hpp). Use the W25Q64FV typedef for the 
+ * default Arduino SPI transport and a W25Q64. Custom transports and geometries must also 
+ * include W25Q64FV_impl.hpp to instantiate the driver. 
+ * 
+ * @tparam Transport            Bus transport 
+ * @tparam Geometry             Part geometry 
  */
-class W25Q64FV{
+template<class Transport, class Geometry = W25Q64FV_FixedGeometry<W25Q64FV_CAPACITY> >
+class W25Q64FV_Device{
 public: 
+    /**
+     * @brief Construct a new driver 
+     * 
+     * @param transport             Bus transport to communicate over 
+     */
+    W25Q64FV_Device(const Transport &transport = Transport()) : _bus(transport), _read_pending(false), _resume_time(0), 
+        _io_mode(W25Q64FV_IO_SINGLE), _continuous_mode(false), _continuous_active(false), 
+        _smart_mode(false), _known_idle(false), _write_enabled(false), _suspended(false), 
+        _operation(W25Q64FV_OPERATION_NONE), _operation_start(0), _operation_end(0), _suspend_pending(false), _suspend_time(0), 
+        _suspended_operation(W25Q64FV_OPERATION_NONE), _suspended_remaining(0), 
+        _continuous_status_poll(false) { 
+        memset(&_smart_stats, 0, sizeof(_smart_stats)); 
+#if W25Q64FV_ENABLE_STATS 
+        memset(&_stats, 0, sizeof(_stats)); 
+        _timed = false; 
+        _read_start = 0; 
+#endif 
+    } 
+
     /**
      * @brief Initialize communication with the flash chip
      * 
-     * Begins SPI communication and attempts to check the ID of the device.
+     * Begins SPI communication and attempts to check the ID of the device. Reads the 
+     * SFDP table (or the JEDEC ID on parts without one) and configures the geometry, 
+     * which fails if a fixed geometry does not match the part. Parts above 16MB are 
+     * put in 4 byte address mode. 
      *  
      * @param cs_pin                Chip select pin  
      * @return W25Q64FV_status_t    Status return 
@@ -119,6 +267,52 @@ public:
      */
     W25Q64FV_status_t write_page(uint32_t start_address, byte *buffer); 
 
+    /**
+     * @brief Write an arbitrary length of data to the flash chip 
+     * 
+     * Splits the data at page boundaries, including partial first and last pages. Each 
+     * page is issued as soon as the previous page finishes programming. The last page 
+     * is left programming unless hold is set, so the caller can prepare the next 
+     * buffer while the device is busy. The target area must already be erased. 
+     * 
+     * @param start_address         Start address to write to 
+     * @param buffer                Buffer of data to write 
+     * @param length                Number of bytes to write 
+     * @param hold                  Hold for the device to finish the last page 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t write(uint32_t start_address, const byte *buffer, size_t length, bool hold = false); 
+
+    /**
+     * @brief Write an arbitrary length of data to an area known to be erased 
+     * 
+     * As write(), but never applies the smart mode comparisons, for callers that have 
+     * just erased the area themselves. Leaves the smart mode setting alone. 
+     * 
+     * @param start_address         Start address to write to 
+     * @param buffer                Buffer of data to write 
+     * @param length                Number of bytes to write 
+     * @param hold                  Hold for the device to finish the last page 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t write_erased(uint32_t start_address, const byte *buffer, size_t length, bool hold = false); 
+
+    /**
+     * @brief Write a list of segments as one contiguous run 
+     * 
+     * Streams the segments straight onto the bus, so frames assembled from several 
+     * buffers need no staging copy. The run is split at page boundaries like write(), 
+     * with one page program per page whatever the number of segments. Smart mode 
+     * comparisons are not applied. 
+     * 
+     * @param start_address         Start address to write to 
+     * @param segments              Segments to write, in order 
+     * @param count                 Number of segments 
+     * @param hold                  Hold for the device to finish the last page 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t writev(uint32_t start_address, const W25Q64FV_iovec_t *segments, unsigned int count, bool hold = false); 
+
     /**
      * @brief Read a page from the flash chip 
      * 
@@ -129,6 +323,162 @@ public:
      * @return W25Q64FV_status_t    Status return 
      */
     W25Q64FV_status_t read_page(uint32_t start_address, byte *buffer); 
+
+    /**
+     * @brief Read an arbitrary length of data from the flash chip 
+     * 
+     * Streams data from the flash chip using the fast read instruction. The read 
+     * may cross page, sector, and block boundaries and is performed under a single 
+     * chip select. 
+     * 
+     * @param start_address         Start address to read from 
+     * @param buffer                Buffer of data to read into 
+     * @param length                Number of bytes to read 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t read(uint32_t start_address, byte *buffer, size_t length); 
+
+    /**
+     * @brief Read a contiguous run into a list of segments 
+     * 
+     * Issues a single fast read and fills the segments in order. 
+     * 
+     * @param start_address         Start address to read from 
+     * @param segments              Segments to read into, in order 
+     * @param count                 Number of segments 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t readv(uint32_t start_address, const W25Q64FV_iovec_t *segments, unsigned int count); 
+
+    /**
+     * @brief Start an asynchronous read from the flash chip 
+     * 
+     * Issues a fast read and hands the data phase to the transport's asynchronous 
+     * transfer. No other call may be made until finish_read() returns W25Q64FV_OK. 
+     * 
+     * @param start_address         Start address to read from 
+     * @param buffer                Buffer of data to read into 
+     * @param length                Number of bytes to read 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t start_read(uint32_t start_address, byte *buffer, size_t length); 
+
+    /**
+     * @brief Complete an asynchronous read 
+     * 
+     * @param hold                  Hold for the transfer to complete 
+     * @return W25Q64FV_status_t    Status return (busy if not held and the transfer is still running)
+     */
+    W25Q64FV_status_t finish_read(bool hold = true); 
+
+    /**
+     * @brief Set the read and program data path 
+     * 
+     * Selects the dual or quad read instruction used by read() and start_read(). Quad 
+     * modes set the QE bit (volatile) and use quad page program. The I/O modes may keep 
+     * the device in continuous read mode so back-to-back reads skip the instruction. 
+     * 
+     * @param mode                  Data path to use 
+     * @param continuous            Use continuous read mode (dual and quad I/O only) 
+     * @return W25Q64FV_status_t    Status return (not valid if the transport lacks the data lines) 
+     */
+    W25Q64FV_status_t set_io_mode(W25Q64FV_io_mode_t mode, bool continuous = false); 
+
+    /**
+     * @brief Get the read and program data path 
+     * 
+     * @return W25Q64FV_io_mode_t   Data path in use 
+     */
+    W25Q64FV_io_mode_t io_mode() { return _io_mode; } 
+
+    /**
+     * @brief Enable or disable smart mode 
+     * 
+     * In smart mode erase_sector() skips blank sectors, and write_page() and write() skip 
+     * pages that already hold the data and only program the changed span of a page. 
+     * Pages that would need an erase are rejected with W25Q64FV_NOT_VALID. 
+     * 
+     * @param enable                Enable smart mode 
+     */
+    void set_smart_mode(bool enable) { _smart_mode = enable; } 
+
+    /**
+     * @brief Check if smart mode is enabled 
+     * 
+     * @return true                 Smart mode is enabled 
+     */
+    bool smart_mode() { return _smart_mode; } 
+
+    /**
+     * @brief Get the smart mode statistics 
+     * 
+     * @param stats                 Statistics to fill 
+     * @param reset                 Reset the statistics after reading 
+     * @return (void)
+     */
+    void get_smart_stats(W25Q64FV_smart_stats_t *stats, bool reset = false); 
+
+    /**
+     * @brief Compare flash contents against a buffer 
+     * 
+     * Streams the flash contents under a single chip select 
+     * 
+     * @param start_address         Start address to compare 
+     * @param buffer                Data to compare against 
+     * @param length                Number of bytes to compare 
+     * @param result                Comparison result 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t compare(uint32_t start_address, const byte *buffer, size_t length, W25Q64FV_compare_t *result); 
+
+    /**
+     * @brief Check if a range is erased 
+     * 
+     * @param start_address         Start address to check 
+     * @param length                Number of bytes to check 
+     * @param blank                 Set if every byte is 0xFF 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t is_blank(uint32_t start_address, size_t length, bool *blank); 
+
+    /**
+     * @brief Write an arbitrary length of data and verify it was programmed 
+     * 
+     * Programs like write(), folding each page into a CRC-32 while the device is busy 
+     * programming it, then reads the range back under a single chip select and checks 
+     * its CRC. The read back goes through a small stack chunk, not a second page buffer. 
+     * Always holds for the device. 
+     * 
+     * @param start_address         Start address to write to 
+     * @param buffer                Buffer of data to write 
+     * @param length                Number of bytes to write 
+     * @param crc                   CRC-32 of the data, to store alongside it (may be NULL) 
+     * @return W25Q64FV_status_t    Status return (verify fail if the data read back differs)
+     */
+    W25Q64FV_status_t write_verified(uint32_t start_address, const byte *buffer, size_t length, uint32_t *crc = NULL); 
+
+    /**
+     * @brief Read an arbitrary length of data and check it against a known CRC-32 
+     * 
+     * @param start_address         Start address to read from 
+     * @param buffer                Buffer of data to read into 
+     * @param length                Number of bytes to read 
+     * @param crc                   Expected CRC-32, as returned by write_verified() or crc32() 
+     * @return W25Q64FV_status_t    Status return (verify fail if the CRC differs)
+     */
+    W25Q64FV_status_t read_verified(uint32_t start_address, byte *buffer, size_t length, uint32_t crc); 
+
+    /**
+     * @brief Compute the CRC-32 of a range of flash 
+     * 
+     * Streams the range under a single chip select without a caller buffer 
+     * 
+     * @param start_address         Start address 
+     * @param length                Number of bytes 
+     * @param crc                   CRC-32 of the range 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t crc32(uint32_t start_address, size_t length, uint32_t *crc); 
     
     /**
      * @brief Erase a 4kB sector from the flash chip 
@@ -173,6 +523,54 @@ public:
      */
     W25Q64FV_status_t erase_chip(bool hold = true);
 
+    /**
+     * @brief Erase a range of the flash chip 
+     * 
+     * Erases the range with the mix of 64kB, 32kB, and 4kB erases that takes the least 
+     * typical time for its alignment. A range covering the whole device is erased with 
+     * a chip erase if that is faster. Holds for each erase to finish. 
+     * 
+     * @param start_address         Start address, must be 4kB aligned 
+     * @param length                Length to erase, must be a multiple of 4kB 
+     * @param allow_chip_erase      Allow a chip erase for a range covering the whole device 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t erase_range(uint32_t start_address, uint32_t length, bool allow_chip_erase = true); 
+
+    /**
+     * @brief Estimate the time to erase a range 
+     * 
+     * Returns the typical datasheet time of the plan used by erase_range() 
+     * 
+     * @param start_address         Start address, must be 4kB aligned 
+     * @param length                Length to erase, must be a multiple of 4kB 
+     * @param allow_chip_erase      Allow a chip erase for a range covering the whole device 
+     * @return unsigned long        Typical erase time (ms), 0 if the range is not valid 
+     */
+    unsigned long erase_range_time(uint32_t start_address, uint32_t length, bool allow_chip_erase = true); 
+
+    /**
+     * @brief Get the size of the next erase of a range 
+     * 
+     * Picks the largest erase aligned to the address that fits in the remaining range and 
+     * is faster than the smaller erases it replaces 
+     * 
+     * @param address               Current address, 4kB aligned 
+     * @param remaining             Remaining length, a multiple of 4kB 
+     * @return uint32_t             Erase size (4kB, 32kB, or 64kB) 
+     */
+    uint32_t next_erase_size(uint32_t address, uint32_t remaining); 
+
+    /**
+     * @brief Check if erase_range() would use a chip erase 
+     * 
+     * @param start_address         Start address 
+     * @param length                Length to erase 
+     * @param allow_chip_erase      Allow a chip erase for a range covering the whole device 
+     * @return true                 Chip erase is allowed and faster than the block plan 
+     */
+    bool use_chip_erase(uint32_t start_address, uint32_t length, bool allow_chip_erase); 
+
     /**
      * @brief Get the jedec object id 
      * 
@@ -185,15 +583,38 @@ public:
     /**
      * @brief Checks if the flash chip is busy 
      * 
-     * Checks the status register and returns the state of the flash chip 
+     * Returns the tracked state of the flash chip. The status register is only read when 
+     * the state is unknown: after an operation has been issued and its typical completion 
+     * time has passed. 
      * 
      * @return true     Device is busy (cannot execute new tasks)
      * @return false    Device is free (can execute new tasks)
      */
     bool busy(); 
     
+    /**
+     * @brief Wait for the device to finish the operation in progress 
+     * 
+     * Sleeps until the typical datasheet time of the operation in progress, then polls 
+     * with exponential backoff from W25Q64FV_BACKOFF_MIN up to an eighth of the typical 
+     * time (at most W25Q64FV_BACKOFF_MAX). 
+     * 
+     * @param max_timeout           Maximum time to wait (ms) 
+     * @return W25Q64FV_status_t    Status return 
+     */
     W25Q64FV_status_t wait_until_free(unsigned long max_timeout = W25Q64FV_DEFAULT_TIMEOUT); 
 
+    /**
+     * @brief Enable or disable continuous status polling 
+     * 
+     * When enabled, wait_until_free() polls by streaming status register 1 under a single 
+     * chip select rather than re-issuing the read status instruction. The bus is held 
+     * for the whole wait. 
+     * 
+     * @param enable                Enable continuous status polling 
+     */
+    void set_continuous_status_poll(bool enable) { _continuous_status_poll = enable; } 
+
     /**
      * @brief Reset the flash chip 
      * 
@@ -222,12 +643,280 @@ public:
      */
     W25Q64FV_status_t release_power_down();
 
+    /**
+     * @brief Suspend an erase or program in progress 
+     * 
+     * Waits for the minimum interval since the last resume, issues the suspend, and 
+     * waits for the device to suspend. Reads may be served while suspended, except from 
+     * the area being erased or programmed. Pages outside a suspended erase may also be 
+     * programmed. Chip erases cannot be suspended. 
+     * 
+     * Without hold, returns busy instead of waiting, and the suspend is in progress while 
+     * suspend_pending() is set: call again until it returns something else. 
+     * 
+     * @param hold                  Wait for the interval and for the device to suspend 
+     * @return W25Q64FV_status_t    Status return (ok once the device is suspended or free, 
+     *                              busy if the operation cannot be suspended) 
+     */
+    W25Q64FV_status_t suspend(bool hold = true); 
+
+    /**
+     * @brief Checks if a suspend issued without hold is still taking effect 
+     * 
+     * @return true     suspend() must be called again 
+     * @return false    No suspend in progress 
+     */
+    bool suspend_pending() { return _suspend_pending; } 
+
+    /**
+     * @brief Resume a suspended erase or program 
+     * 
+     * @return W25Q64FV_status_t    Status return (not valid if nothing is suspended, busy if a 
+     *                              program issued during the suspend is still running) 
+     */
+    W25Q64FV_status_t resume(); 
+
+    /**
+     * @brief Checks if an erase or program is suspended 
+     * 
+     * Reads the SUS bit of status register 2. The busy bit is clear while suspended. 
+     * 
+     * @return true     An operation is suspended 
+     * @return false    No operation is suspended 
+     */
+    bool suspended(); 
+
+    /**
+     * @brief Read, suspending an erase or program in progress 
+     * 
+     * Suspends the operation, reads, and resumes it, so the read does not wait out the 
+     * rest of an erase. Waits for the operation instead if it cannot be suspended. The 
+     * read must not overlap the area being erased or programmed. An operation suspended 
+     * by the caller is left suspended. 
+     * 
+     * @param start_address         Start address to read from 
+     * @param buffer                Buffer of data to read into 
+     * @param length                Number of bytes to read 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t suspend_read(uint32_t start_address, byte *buffer, size_t length); 
+
+    /**
+     * @brief Write and wait for it, suspending an erase in progress 
+     * 
+     * As suspend_read(). Only erases are suspended for a write, a program in progress is 
+     * waited for. The write must not overlap the area being erased. 
+     * 
+     * @param start_address         Start address to write to 
+     * @param buffer                Buffer of data to write 
+     * @param length                Number of bytes to write 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t suspend_write(uint32_t start_address, const byte *buffer, size_t length); 
+
+    /**
+     * @brief Get the operation last issued to the device 
+     * 
+     * @return W25Q64FV_operation_t Operation in progress, or W25Q64FV_OPERATION_NONE once the device is known to be free 
+     */
+    W25Q64FV_operation_t operation() { return _known_idle ? W25Q64FV_OPERATION_NONE : _operation; } 
+
+    /**
+     * @brief Get the time of an operation on this part 
+     * 
+     * @param operation             Operation 
+     * @param maximum               Get the maximum rather than the typical time 
+     * @return unsigned long        Operation time (us) 
+     */
+    unsigned long operation_time(W25Q64FV_operation_t operation, bool maximum = false) { return _geometry.operation_time(operation, maximum); } 
+
+    /**
+     * @brief Get the density of the part 
+     * 
+     * @return uint32_t             Capacity in bytes 
+     */
+    uint32_t capacity() { return _geometry.capacity(); } 
+
+    /**
+     * @brief Get the part geometry 
+     * 
+     * @return const Geometry&      Part geometry 
+     */
+    const Geometry &geometry() { return _geometry; } 
+
+    /**
+     * @brief Discover the part parameters 
+     * 
+     * Parses the basic flash parameter table of SFDP for the density, address length, 
+     * erase types and times, page program time, and read data paths. Parts without an 
+     * SFDP table are sized from the JEDEC ID with the W25Q64 times. The device must not 
+     * be in 4 byte address mode. 
+     * 
+     * @param parameters            Parameters to fill 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t read_parameters(W25Q64FV_parameters_t *parameters); 
+
+    /**
+     * @brief Get the driver statistics 
+     * 
+     * Operation and read counts, bus traffic, busy polls, timeouts, and log2 latency 
+     * histograms. Completion times are as observed by the status polls, so they are never 
+     * below the typical time and include the poll interval. Operations that were suspended 
+     * are counted but not timed. All zero unless W25Q64FV_ENABLE_STATS is set. 
+     * 
+     * @param stats                 Statistics to fill 
+     * @param reset                 Reset the statistics after reading 
+     * @return (void)
+     */
+    void get_stats(W25Q64FV_stats_t *stats, bool reset = false); 
+
+    /**
+     * @brief Print a statistics snapshot 
+     * 
+     * Prints the counters and the non-empty histogram buckets, one per line, over Serial 
+     * or any other Print 
+     * 
+     * @param stats                 Statistics from get_stats() 
+     * @param out                   Output to print to 
+     * @return (void)
+     */
+    static void print_stats(const W25Q64FV_stats_t &stats, Print &out); 
+
+    /**
+     * @brief Get the bus transport 
+     * 
+     * @return Transport&           Bus transport 
+     */
+    Transport &transport() { return _bus; } 
 
 
 
 private: 
-    SPISettings _spi_settings;      ///< Flash chip specific SPI settings 
-    int _cs;                        ///< Chip select pin 
+    Transport _bus;                 ///< Bus transport 
+    Geometry _geometry;             ///< Part geometry 
+    bool _read_pending;             ///< Asynchronous read in progress 
+    unsigned long _resume_time;     ///< Time of the last resume (us) 
+    W25Q64FV_io_mode_t _io_mode;    ///< Read and program data path 
+    bool _continuous_mode;          ///< Continuous read mode requested 
+    bool _continuous_active;        ///< Device is in continuous read mode 
+    bool _smart_mode;               ///< Skip redundant erases and programs 
+    W25Q64FV_smart_stats_t _smart_stats; ///< Smart mode statistics 
+    bool _known_idle;               ///< Device is known to be free 
+    bool _write_enabled;            ///< Write enable latch is known to be set 
+    bool _suspended;                ///< An operation is known to be suspended 
+    W25Q64FV_operation_t _operation; ///< Operation last issued 
+    unsigned long _operation_start; ///< Time the operation was issued (us) 
+    unsigned long _operation_end;   ///< Typical completion time of the operation (us) 
+    bool _suspend_pending;          ///< A suspend was issued without waiting for it 
+    unsigned long _suspend_time;    ///< Time of the last suspend (us) 
+    W25Q64FV_operation_t _suspended_operation; ///< Operation that was suspended 
+    unsigned long _suspended_remaining; ///< Typical time left of the suspended operation (us) 
+    bool _continuous_status_poll;   ///< Stream status register 1 while waiting 
+#if W25Q64FV_ENABLE_STATS 
+    W25Q64FV_stats_t _stats;        ///< Driver statistics 
+    bool _timed;                    ///< The operation in progress is timed from its issue 
+    unsigned long _read_start;      ///< Time the asynchronous read was issued (us) 
+#endif 
+
+    /**
+     * @brief Read status register 1 and update the tracked state 
+     * 
+     * @return uint8_t              Status register 1 
+     */
+    uint8_t read_status(); 
+
+    /**
+     * @brief Record that a timed operation has been issued 
+     * 
+     * The device is busy and the write enable latch will be cleared on completion 
+     * 
+     * @param operation             Operation issued 
+     */
+    void start_operation(W25Q64FV_operation_t operation) {
+        _operation = operation; 
+        _known_idle = false; 
+        _write_enabled = false; 
+        _operation_start = micros(); 
+        _operation_end = _operation_start + operation_time(operation); 
+        W25Q64FV_STAT(_stats.operations[operation] ++); 
+        W25Q64FV_STAT(_timed = true); 
+    } 
+
+    /**
+     * @brief Forget the tracked state 
+     * 
+     * Used when the device state cannot be known, the next busy check reads the status register 
+     */
+    void unknown_state() {
+        _known_idle = false; 
+        _write_enabled = false; 
+        _operation = W25Q64FV_OPERATION_NONE; 
+        _operation_start = micros(); 
+        _operation_end = _operation_start; 
+    } 
+
+    /**
+     * @brief Put an address in a buffer, most significant byte first 
+     * 
+     * @param buffer                Buffer to fill 
+     * @param address               Address 
+     * @return uint8_t              Number of address bytes, from the geometry 
+     */
+    uint8_t put_address(uint8_t *buffer, uint32_t address) {
+        uint8_t length = _geometry.address_bytes(); 
+        for(uint8_t i = 0; i < length; i ++) buffer[i] = address >> (8 * (length - 1 - i)); 
+        return length; 
+    } 
+
+    /**
+     * @brief Send an instruction followed by an address 
+     * 
+     * The device must already be selected 
+     * 
+     * @param instruction           Instruction to send 
+     * @param address               Address to send 
+     */
+    void send_instruction(uint8_t instruction, uint32_t address) {
+        uint8_t header[5]; 
+        header[0] = instruction; 
+        bus_transfer(header, NULL, 1 + put_address(header + 1, address)); 
+    } 
+
+    /**
+     * @brief Send an instruction with an address in its own chip select 
+     * 
+     * @param instruction           Instruction to send 
+     * @param address               Address to send 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t write_address(uint8_t instruction, uint32_t address); 
+
+    /**
+     * @brief Read from the SFDP table 
+     * 
+     * SFDP addresses are always 3 bytes 
+     * 
+     * @param address               SFDP address 
+     * @param buffer                Buffer to read into 
+     * @param length                Number of bytes 
+     * @return (void)
+     */
+    void read_sfdp(uint32_t address, uint8_t *buffer, size_t length); 
+
+    /**
+     * @brief Enter 4 byte address mode if the geometry needs it 
+     * 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t set_address_mode(); 
+
+    /**
+     * @brief Reset the device, leaving it in 3 byte address mode 
+     * 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t reset_device(); 
 
     /**
      * @brief Write information to a register 
@@ -239,7 +928,7 @@ private:
      * @param length                Length of the buffer 
      * @return W25Q64FV_status_t    Status return 
      */
-    W25Q64FV_status_t write_reg(uint8_t reg, uint8_t *buffer, unsigned int length); 
+    W25Q64FV_status_t write_reg(uint8_t reg, const uint8_t *buffer, unsigned int length); 
 
     /**
      * @brief Write a single command to the flash chip 
@@ -251,6 +940,148 @@ private:
      */
     W25Q64FV_status_t write_command(uint8_t command); 
 
+    /**
+     * @brief Program data within a single page 
+     * 
+     * Enables writing and issues a page program. The data must not cross a page boundary.
+     * 
+     * @param start_address         Start address to write to 
+     * @param buffer                Buffer of data to write 
+     * @param length                Number of bytes to write 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t program(uint32_t start_address, const byte *buffer, size_t length); 
+
+    /**
+     * @brief Enable writing, select the device, and send a page program header 
+     * 
+     * The device is left selected for the data phase. 
+     * 
+     * @param start_address         Start address to write to 
+     * @param lanes                 Number of data lines for the data phase 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t begin_program(uint32_t start_address, uint8_t *lanes); 
+
+    /**
+     * @brief Get the total length of a list of segments 
+     * 
+     * @param segments              Segments 
+     * @param count                 Number of segments 
+     * @return size_t               Total length in bytes 
+     */
+    static size_t segments_length(const W25Q64FV_iovec_t *segments, unsigned int count); 
+
+    /**
+     * @brief Sleep for a number of microseconds 
+     * 
+     * Splits long sleeps between delay() and delayMicroseconds() 
+     * 
+     * @param time                  Time to sleep (us) 
+     */
+    static void sleep_us(unsigned long time) {
+        if(time >= 1000) delay(time / 1000); 
+        delayMicroseconds(time % 1000); 
+    } 
+
+    /**
+     * @brief Select the device and send a read header for the current data path 
+     * 
+     * Sends the instruction (unless in continuous read mode), address, mode bits, and dummy 
+     * clocks. The device is left selected. 
+     * 
+     * @param address               Address to read from 
+     * @return uint8_t              Number of data lines for the data phase 
+     */
+    uint8_t begin_read(uint32_t address); 
+
+    /**
+     * @brief Stream the flash contents and compare against a buffer 
+     * 
+     * Stops early once an erase is known to be required. The device must be free. 
+     * 
+     * @param start_address         Start address to compare 
+     * @param buffer                Data to compare against, NULL to compare against 0xFF 
+     * @param length                Number of bytes to compare 
+     * @param result                Comparison result 
+     * @param first                 Offset of the first differing byte (may be NULL) 
+     * @param last                  Offset of the last differing byte (may be NULL) 
+     * @return (void)
+     */
+    void stream_compare(uint32_t start_address, const byte *buffer, size_t length, W25Q64FV_compare_t *result, size_t *first, size_t *last); 
+
+    /**
+     * @brief Stream the flash contents into a CRC-32 
+     * 
+     * The device must be free. 
+     * 
+     * @param start_address         Start address 
+     * @param length                Number of bytes 
+     * @return uint32_t             CRC-32 of the range 
+     */
+    uint32_t stream_crc(uint32_t start_address, size_t length); 
+
+    /**
+     * @brief Get the device free for a read or write, suspending the operation if possible 
+     * 
+     * @param paused                Set if this call suspended an operation 
+     * @param program               A program will be issued, so only erases may be suspended 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t pause_operation(bool *paused, bool program); 
+
+    /**
+     * @brief Resume an operation suspended by pause_operation() 
+     * 
+     * @param paused                Set if the operation was suspended 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t resume_operation(bool paused); 
+
+    /**
+     * @brief Write an arbitrary length, split at page boundaries 
+     * 
+     * @param start_address         Start address to write to 
+     * @param buffer                Buffer of data to write 
+     * @param length                Number of bytes to write 
+     * @param hold                  Hold for the device to finish the last page 
+     * @param smart                 Skip unchanged data 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t write_pages(uint32_t start_address, const byte *buffer, size_t length, bool hold, bool smart); 
+
+    /**
+     * @brief Program data within a single page, skipping unchanged data if smart 
+     * 
+     * The device must be free 
+     * 
+     * @param start_address         Start address to write to 
+     * @param buffer                Buffer of data to write 
+     * @param length                Number of bytes to write 
+     * @param smart                 Skip unchanged data, normally the smart mode setting 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t program_page(uint32_t start_address, const byte *buffer, size_t length, bool smart); 
+
+    /**
+     * @brief Take the device out of continuous read mode 
+     * 
+     * Clocks the mode bit reset with the device selected 
+     * 
+     * @return (void)
+     */
+    void exit_continuous_read(); 
+
+    /**
+     * @brief Set the quad enable bit 
+     * 
+     * Writes status register 2 through the volatile write enable, to avoid wearing the 
+     * non-volatile status register on every boot 
+     * 
+     * @return W25Q64FV_status_t    Status return 
+     */
+    W25Q64FV_status_t enable_quad(); 
+
     /**
      * @brief Read multiple bytes from a register 
      * 
@@ -266,29 +1097,120 @@ private:
     /**
      * @brief Select the device for communication
      * 
-     * Selects the device by pulling the chip select low and setting the SPI transaction info
+     * Selects the device through the transport 
      * 
      * @return (void)
      */
     void select_device() {
-        SPI.beginTransaction(_spi_settings);
-        digitalWrite(_cs,LOW);
+        // any other instruction must first take the device out of continuous read mode 
+        if(_continuous_active) exit_continuous_read(); 
+        bus_select(); 
     } 
 
     /**
      * @brief Release the device for communication
      * 
-     * De-selects the device by pulling the chip select high and ending the SPI transaction
+     * De-selects the device through the transport 
      * 
      * @return (void)
      */
     void release_device() {
-        SPI.endTransaction(); 
-        digitalWrite(_cs,HIGH);
+        _bus.deselect(); 
+    } 
+
+    /**
+     * @brief Assert chip select through the transport, counting it 
+     * 
+     * @return (void)
+     */
+    void bus_select() {
+        W25Q64FV_STAT(_stats.selects ++); 
+        _bus.select(); 
+    } 
+
+    /**
+     * @brief Exchange a single byte through the transport, counting it 
+     * 
+     * @param data                  Byte to write 
+     * @return uint8_t              Byte read 
+     */
+    uint8_t bus_transfer(uint8_t data) {
+        W25Q64FV_STAT(_stats.bytes ++); 
+        return _bus.transfer(data); 
+    } 
+
+    /**
+     * @brief Exchange a buffer through the transport, counting it 
+     * 
+     * @param tx                    Data to write, or NULL 
+     * @param rx                    Buffer to read into, or NULL 
+     * @param length                Number of bytes 
+     * @return (void)
+     */
+    void bus_transfer(const uint8_t *tx, uint8_t *rx, size_t length) {
+        W25Q64FV_STAT(_stats.bytes += length); 
+        _bus.transfer(tx, rx, length); 
+    } 
+
+    /**
+     * @brief Exchange a buffer over multiple data lines through the transport, counting it 
+     * 
+     * @param tx                    Data to write, or NULL 
+     * @param rx                    Buffer to read into, or NULL 
+     * @param length                Number of bytes 
+     * @param lanes                 Number of data lines 
+     * @return (void)
+     */
+    void bus_transfer(const uint8_t *tx, uint8_t *rx, size_t length, uint8_t lanes) {
+        W25Q64FV_STAT(_stats.bytes += length); 
+        _bus.transfer(tx, rx, length, lanes); 
     } 
 
+#if W25Q64FV_ENABLE_STATS 
+    /**
+     * @brief Add a latency to a histogram 
+     * 
+     * @param histogram             Histogram to add to 
+     * @param time                  Latency (us) 
+     */
+    void record(W25Q64FV_histogram_t histogram, unsigned long time) {
+        uint8_t bucket = 0; 
+        while(time > 0 && bucket < W25Q64FV_STATS_BUCKETS - 1){
+            time >>= 1; 
+            bucket ++; 
+        }
+        _stats.histograms[histogram][bucket] ++; 
+    } 
+
+    /**
+     * @brief Record the completion of the operation in progress 
+     * 
+     * Called when the device is first seen free after an operation was issued 
+     */
+    void complete_operation() {
+        if(!_timed) return; 
+        _timed = false; 
+        if(_operation == W25Q64FV_OPERATION_PAGE_PROGRAM) record(W25Q64FV_HISTOGRAM_PROGRAM, micros() - _operation_start); 
+        else if(_operation >= W25Q64FV_OPERATION_SECTOR_ERASE && _operation <= W25Q64FV_OPERATION_CHIP_ERASE) record(W25Q64FV_HISTOGRAM_ERASE, micros() - _operation_start); 
+    } 
+#endif 
+
 }; 
 
+/// Driver for a W25Q64 over the default Arduino SPI transport 
+typedef W25Q64FV_Device<W25Q64FV_ArduinoSPI> W25Q64FV; 
+/// Driver for a W25Q128 over the default Arduino SPI transport 
+typedef W25Q64FV_Device<W25Q64FV_ArduinoSPI, W25Q64FV_FixedGeometry<16777216> > W25Q128FV; 
+/// Driver for a W25Q256 over the default Arduino SPI transport, in 4 byte address mode 
+typedef W25Q64FV_Device<W25Q64FV_ArduinoSPI, W25Q64FV_FixedGeometry<33554432> > W25Q256FV; 
+/// Driver for any W25Q part, configured from SFDP by begin() 
+typedef W25Q64FV_Device<W25Q64FV_ArduinoSPI, W25Q64FV_SFDPGeometry> W25QXX; 
+
+extern template class W25Q64FV_Device<W25Q64FV_ArduinoSPI>;
+extern template class W25Q64FV_Device<W25Q64FV_ArduinoSPI, W25Q64FV_FixedGeometry<16777216> >;
+extern template class W25Q64FV_Device<W25Q64FV_ArduinoSPI, W25Q64FV_FixedGeometry<33554432> >;
+extern template class W25Q64FV_Device<W25Q64FV_ArduinoSPI, W25Q64FV_SFDPGeometry>; 
+
 
 
 #endif 
\ No newline at end of file
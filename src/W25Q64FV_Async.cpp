@@ -0,0 +1,18 @@
+/**
+ * @file W25Q64FV_Async.cpp
+ * @author Jeremy Dunne
+ * @brief source file for the W25Q64 non-blocking erase/program engine
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <W25Q64FV_Async.hpp>
+#include "W25Q64FV_Async_impl.hpp"
+
+template class W25Q64FV_BasicAsync<W25Q64FV>;
+template class W25Q64FV_BasicAsync<W25Q128FV>;
+template class W25Q64FV_BasicAsync<W25Q256FV>;
+template class W25Q64FV_BasicAsync<W25QXX>;
@@ -0,0 +1,239 @@
+/**
+ * @file W25Q64FV_Async.hpp
+ * @author Jeremy Dunne
+ * @brief non-blocking erase/program engine for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_ASYNC_HPP_
+#define _W25Q64FV_ASYNC_HPP_
+
+#include "W25Q64FV.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_ASYNC_QUEUE_DEPTH
+#define W25Q64FV_ASYNC_QUEUE_DEPTH  8 // Maximum number of pending operations
+#endif
+
+#define W25Q64FV_ASYNC_INVALID_HANDLE   -1
+
+/// Asynchronous Operation Enum
+typedef enum{
+    W25Q64FV_ASYNC_ERASE_SECTOR = 0, ///<4kB sector erase
+    W25Q64FV_ASYNC_ERASE_BLOCK_32, ///<32kB block erase
+    W25Q64FV_ASYNC_ERASE_BLOCK_64, ///<64kB block erase
+    W25Q64FV_ASYNC_ERASE_CHIP, ///<Chip erase
+    W25Q64FV_ASYNC_PROGRAM, ///<Program of any length
+    W25Q64FV_ASYNC_VERIFY ///<Compare flash contents against a buffer
+} W25Q64FV_async_op_t;
+
+/**
+ * @brief Completion callback
+ *
+ * @param handle                Handle of the completed operation
+ * @param status                Final status of the operation
+ * @param context               Context supplied with the operation
+ */
+typedef void (*W25Q64FV_async_callback_t)(int handle, W25Q64FV_status_t status, void *context);
+
+/**
+ * @brief Non-blocking operation engine for the W25Q64FV
+ *
+ * Operations are queued and return a handle immediately. poll() must be called from
+ * the main loop or a timer; each call checks the device once and issues the next
+ * step (a page program or an erase) when the device is free. Buffers must remain
+ * valid until the operation completes. Use the W25Q64FV_Async typedef with the default
+ * driver, other drivers must also include W25Q64FV_Async_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicAsync{
+public:
+    /**
+     * @brief Construct a new engine
+     *
+     * @param flash                 Initialized flash chip to operate on
+     */
+    W25Q64FV_BasicAsync(Flash &flash);
+
+    /**
+     * @brief Queue a 4kB sector erase
+     *
+     * @param sector_address        Sector start address to erase
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Operation handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int erase_sector(uint32_t sector_address, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Queue a 32kB block erase
+     *
+     * @param block_address         Block start address to erase
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Operation handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int erase_block_32(uint32_t block_address, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Queue a 64kB block erase
+     *
+     * @param block_address         Block start address to erase
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Operation handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int erase_block_64(uint32_t block_address, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Queue a chip erase
+     *
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Operation handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int erase_chip(W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Queue a program of any length
+     *
+     * The data is programmed one page per poll() as the device becomes free
+     *
+     * @param start_address         Start address to write to
+     * @param buffer                Buffer of data to write
+     * @param length                Number of bytes to write
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Operation handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int program(uint32_t start_address, const byte *buffer, size_t length, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Queue a verify of flash contents against a buffer
+     *
+     * Completes with W25Q64FV_VERIFY_FAIL on a mismatch
+     *
+     * @param start_address         Start address to compare
+     * @param buffer                Expected data
+     * @param length                Number of bytes to compare
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Operation handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int verify(uint32_t start_address, const byte *buffer, size_t length, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Read ahead of the queued operations
+     *
+     * Served immediately. If an erase or program is running, it is suspended for the
+     * read and resumed afterwards. Reads overlapping the area being modified, or made
+     * during a chip erase, must wait for the operation to complete.
+     *
+     * @param start_address         Start address to read from
+     * @param buffer                Buffer of data to read into
+     * @param length                Number of bytes to read
+     * @return W25Q64FV_status_t    Status return (busy if the read must wait)
+     */
+    W25Q64FV_status_t read(uint32_t start_address, byte *buffer, size_t length);
+
+    /**
+     * @brief Advance the queued operations
+     *
+     * Never blocks on the device. Completes the running operation if the device is
+     * free and starts the next step.
+     *
+     * @return W25Q64FV_status_t    Status return (busy while operations remain)
+     */
+    W25Q64FV_status_t poll();
+
+    /**
+     * @brief Check if an operation is still pending
+     *
+     * @param handle                Operation handle
+     * @return true                 Operation is queued or running
+     * @return false                Operation has completed
+     */
+    bool pending(int handle);
+
+    /**
+     * @brief Check if the engine has no pending operations
+     *
+     * @return true                 Queue is empty
+     */
+    bool idle() { return _count == 0; }
+
+    /**
+     * @brief Get the number of pending operations
+     *
+     * @return unsigned int         Number of queued or running operations
+     */
+    unsigned int count() { return _count; }
+
+private:
+    /// Queued operation
+    typedef struct{
+        W25Q64FV_async_op_t op;             ///< Operation type
+        uint32_t address;                   ///< Current address
+        const byte *buffer;                 ///< Current buffer position
+        size_t remaining;                   ///< Bytes remaining
+        W25Q64FV_async_callback_t callback; ///< Completion callback
+        void *context;                      ///< Callback context
+        int handle;                         ///< Operation handle
+        bool started;                       ///< Device has been issued a command
+        unsigned long start_time;           ///< Time of the last issued command (ms)
+        uint32_t busy_address;              ///< Start of the area being modified
+        uint32_t busy_length;               ///< Length of the area being modified
+    } operation_t;
+
+    Flash *_flash;                                      ///< Flash chip
+    operation_t _queue[W25Q64FV_ASYNC_QUEUE_DEPTH];     ///< Pending operations
+    unsigned int _head;                                 ///< Index of the running operation
+    unsigned int _count;                                ///< Number of pending operations
+    int _next_handle;                                   ///< Next handle to hand out
+
+    /**
+     * @brief Add an operation to the queue
+     *
+     * @return int                  Operation handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int enqueue(W25Q64FV_async_op_t op, uint32_t address, const byte *buffer, size_t length, W25Q64FV_async_callback_t callback, void *context);
+
+    /**
+     * @brief Issue the next step of the running operation
+     *
+     * @param operation             Running operation
+     * @return W25Q64FV_status_t    Status return (ok once the step is issued, or the operation is done)
+     */
+    W25Q64FV_status_t step(operation_t *operation);
+
+    /**
+     * @brief Remove the running operation and report its status
+     *
+     * @param status                Final status of the operation
+     */
+    void complete(W25Q64FV_status_t status);
+
+    /**
+     * @brief Get the maximum time a single step of an operation may take on this part
+     *
+     * @param op                    Operation type
+     * @return unsigned long        Timeout (ms)
+     */
+    unsigned long timeout(W25Q64FV_async_op_t op);
+};
+
+/// Engine for the default W25Q64 driver
+typedef W25Q64FV_BasicAsync<W25Q64FV> W25Q64FV_Async;
+
+extern template class W25Q64FV_BasicAsync<W25Q64FV>;
+extern template class W25Q64FV_BasicAsync<W25Q128FV>;
+extern template class W25Q64FV_BasicAsync<W25Q256FV>;
+extern template class W25Q64FV_BasicAsync<W25QXX>;
+
+#endif
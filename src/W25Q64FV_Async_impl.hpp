@@ -0,0 +1,225 @@
+/**
+ * @file W25Q64FV_Async_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 non-blocking erase/program engine
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Async.cpp for the default drivers. Include this after
+ * W25Q64FV_Async.hpp in one source file when using the engine with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_ASYNC_IMPL_HPP_
+#define _W25Q64FV_ASYNC_IMPL_HPP_
+
+#include "W25Q64FV_Async.hpp"
+
+#define W25Q64FV_ASYNC_VERIFY_CHUNK 32 // Bytes compared per read, bounded to keep the stack small
+#define W25Q64FV_ASYNC_VERIFY_STEP  W25Q64FV_PAGE_SIZE // Bytes compared per poll
+
+template<class Flash>
+W25Q64FV_BasicAsync<Flash>::W25Q64FV_BasicAsync(Flash &flash){
+    _flash = &flash;
+    _head = 0;
+    _count = 0;
+    _next_handle = 0;
+}
+
+template<class Flash>
+int W25Q64FV_BasicAsync<Flash>::erase_sector(uint32_t sector_address, W25Q64FV_async_callback_t callback, void *context){
+    return enqueue(W25Q64FV_ASYNC_ERASE_SECTOR, sector_address, NULL, 0, callback, context);
+}
+
+template<class Flash>
+int W25Q64FV_BasicAsync<Flash>::erase_block_32(uint32_t block_address, W25Q64FV_async_callback_t callback, void *context){
+    return enqueue(W25Q64FV_ASYNC_ERASE_BLOCK_32, block_address, NULL, 0, callback, context);
+}
+
+template<class Flash>
+int W25Q64FV_BasicAsync<Flash>::erase_block_64(uint32_t block_address, W25Q64FV_async_callback_t callback, void *context){
+    return enqueue(W25Q64FV_ASYNC_ERASE_BLOCK_64, block_address, NULL, 0, callback, context);
+}
+
+template<class Flash>
+int W25Q64FV_BasicAsync<Flash>::erase_chip(W25Q64FV_async_callback_t callback, void *context){
+    return enqueue(W25Q64FV_ASYNC_ERASE_CHIP, 0, NULL, 0, callback, context);
+}
+
+template<class Flash>
+int W25Q64FV_BasicAsync<Flash>::program(uint32_t start_address, const byte *buffer, size_t length, W25Q64FV_async_callback_t callback, void *context){
+    if(start_address + length > _flash->capacity()) return W25Q64FV_ASYNC_INVALID_HANDLE;
+    return enqueue(W25Q64FV_ASYNC_PROGRAM, start_address, buffer, length, callback, context);
+}
+
+template<class Flash>
+int W25Q64FV_BasicAsync<Flash>::verify(uint32_t start_address, const byte *buffer, size_t length, W25Q64FV_async_callback_t callback, void *context){
+    if(start_address + length > _flash->capacity()) return W25Q64FV_ASYNC_INVALID_HANDLE;
+    return enqueue(W25Q64FV_ASYNC_VERIFY, start_address, buffer, length, callback, context);
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicAsync<Flash>::read(uint32_t start_address, byte *buffer, size_t length){
+    // the device is free, read directly
+    if(!_flash->busy()) return _flash->read(start_address, buffer, length);
+    // only the engine's own operations have a known area
+    if(_count == 0 || !_queue[_head].started) return W25Q64FV_BUSY;
+    operation_t *operation = &_queue[_head];
+    if(operation->op == W25Q64FV_ASYNC_ERASE_CHIP) return W25Q64FV_BUSY;
+    if(start_address < operation->busy_address + operation->busy_length && operation->busy_address < start_address + length){
+        return W25Q64FV_BUSY;
+    }
+    // suspend, serve the read, and resume
+    unsigned long suspend_time = millis();
+    W25Q64FV_status_t status = _flash->suspend();
+    if(status != W25Q64FV_OK) return status;
+    status = _flash->read(start_address, buffer, length);
+    if(_flash->suspended()) _flash->resume();
+    // the suspended time does not count towards the timeout
+    operation->start_time += millis() - suspend_time;
+    return status;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicAsync<Flash>::poll(){
+    if(_count == 0) return W25Q64FV_OK;
+    operation_t *operation = &_queue[_head];
+    if(operation->started){
+        // wait for the device to finish the last step
+        if(_flash->busy()){
+            if((millis() - operation->start_time) > timeout(operation->op)) complete(W25Q64FV_TIMEOUT);
+            return W25Q64FV_BUSY;
+        }
+        if(operation->remaining == 0){
+            complete(W25Q64FV_OK);
+            if(_count == 0) return W25Q64FV_OK;
+            operation = &_queue[_head];
+        }
+    }
+    // issue the next step
+    W25Q64FV_status_t status = step(operation);
+    // the device is held elsewhere, retry on the next poll
+    if(status == W25Q64FV_BUSY) return W25Q64FV_BUSY;
+    if(status != W25Q64FV_OK) complete(status);
+    if(_count == 0) return W25Q64FV_OK;
+    return W25Q64FV_BUSY;
+}
+
+template<class Flash>
+bool W25Q64FV_BasicAsync<Flash>::pending(int handle){
+    for(unsigned int i = 0; i < _count; i ++){
+        if(_queue[(_head + i) % W25Q64FV_ASYNC_QUEUE_DEPTH].handle == handle) return true;
+    }
+    return false;
+}
+
+template<class Flash>
+int W25Q64FV_BasicAsync<Flash>::enqueue(W25Q64FV_async_op_t op, uint32_t address, const byte *buffer, size_t length, W25Q64FV_async_callback_t callback, void *context){
+    if(_count >= W25Q64FV_ASYNC_QUEUE_DEPTH) return W25Q64FV_ASYNC_INVALID_HANDLE;
+    operation_t *operation = &_queue[(_head + _count) % W25Q64FV_ASYNC_QUEUE_DEPTH];
+    operation->op = op;
+    operation->address = address;
+    operation->buffer = buffer;
+    operation->remaining = length;
+    operation->callback = callback;
+    operation->context = context;
+    operation->handle = _next_handle;
+    operation->started = false;
+    operation->start_time = 0;
+    operation->busy_address = 0;
+    operation->busy_length = 0;
+    _count ++;
+    // handles wrap, skipping the invalid handle
+    _next_handle ++;
+    if(_next_handle < 0) _next_handle = 0;
+    return operation->handle;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicAsync<Flash>::step(operation_t *operation){
+    W25Q64FV_status_t status = W25Q64FV_OK;
+    switch(operation->op){
+        case W25Q64FV_ASYNC_ERASE_SECTOR:
+            status = _flash->erase_sector(operation->address, false);
+            operation->busy_length = W25Q64FV_SECTOR_SIZE;
+            break;
+        case W25Q64FV_ASYNC_ERASE_BLOCK_32:
+            status = _flash->erase_block_32(operation->address, false);
+            operation->busy_length = W25Q64FV_BLOCK_32K_SIZE;
+            break;
+        case W25Q64FV_ASYNC_ERASE_BLOCK_64:
+            status = _flash->erase_block_64(operation->address, false);
+            operation->busy_length = W25Q64FV_BLOCK_64K_SIZE;
+            break;
+        case W25Q64FV_ASYNC_ERASE_CHIP:
+            status = _flash->erase_chip(false);
+            break;
+        case W25Q64FV_ASYNC_PROGRAM: {
+            // program up to the end of the current page
+            size_t chunk = W25Q64FV_PAGE_SIZE - (operation->address % W25Q64FV_PAGE_SIZE);
+            if(chunk > operation->remaining) chunk = operation->remaining;
+            status = _flash->write(operation->address, operation->buffer, chunk, false);
+            if(status != W25Q64FV_OK) return status;
+            operation->busy_address = operation->address;
+            operation->busy_length = chunk;
+            operation->address += chunk;
+            operation->buffer += chunk;
+            operation->remaining -= chunk;
+            break;
+        }
+        case W25Q64FV_ASYNC_VERIFY: {
+            // compare a bounded amount per poll
+            byte chunk[W25Q64FV_ASYNC_VERIFY_CHUNK];
+            size_t step_length = operation->remaining;
+            if(step_length > W25Q64FV_ASYNC_VERIFY_STEP) step_length = W25Q64FV_ASYNC_VERIFY_STEP;
+            while(step_length > 0){
+                size_t length = step_length;
+                if(length > sizeof(chunk)) length = sizeof(chunk);
+                status = _flash->read(operation->address, chunk, length);
+                if(status != W25Q64FV_OK) return status;
+                if(memcmp(chunk, operation->buffer, length) != 0) return W25Q64FV_VERIFY_FAIL;
+                operation->address += length;
+                operation->buffer += length;
+                operation->remaining -= length;
+                step_length -= length;
+            }
+            break;
+        }
+    }
+    if(status != W25Q64FV_OK) return status;
+    if(operation->op != W25Q64FV_ASYNC_PROGRAM && operation->op != W25Q64FV_ASYNC_VERIFY){
+        // erases cover the aligned area containing the address
+        if(operation->busy_length != 0) operation->busy_address = operation->address - (operation->address % operation->busy_length);
+        operation->remaining = 0;
+    }
+    operation->started = true;
+    operation->start_time = millis();
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+void W25Q64FV_BasicAsync<Flash>::complete(W25Q64FV_status_t status){
+    // pop before the callback so it may queue new operations
+    operation_t operation = _queue[_head];
+    _head = (_head + 1) % W25Q64FV_ASYNC_QUEUE_DEPTH;
+    _count --;
+    if(operation.callback != NULL) operation.callback(operation.handle, status, operation.context);
+}
+
+template<class Flash>
+unsigned long W25Q64FV_BasicAsync<Flash>::timeout(W25Q64FV_async_op_t op){
+    // the geometry's maximum, scaled by density or read from SFDP
+    W25Q64FV_operation_t operation;
+    switch(op){
+        case W25Q64FV_ASYNC_ERASE_SECTOR: operation = W25Q64FV_OPERATION_SECTOR_ERASE; break;
+        case W25Q64FV_ASYNC_ERASE_BLOCK_32: operation = W25Q64FV_OPERATION_BLOCK_32K_ERASE; break;
+        case W25Q64FV_ASYNC_ERASE_BLOCK_64: operation = W25Q64FV_OPERATION_BLOCK_64K_ERASE; break;
+        case W25Q64FV_ASYNC_ERASE_CHIP: operation = W25Q64FV_OPERATION_CHIP_ERASE; break;
+        default: operation = W25Q64FV_OPERATION_PAGE_PROGRAM; break;
+    }
+    return _flash->operation_time(operation, true) / 1000 + 1;
+}
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file W25Q64FV_Atomic.hpp
+ * @author Jeremy Dunne
+ * @brief atomic access shared by the interrupt-safe layers of the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_ATOMIC_HPP_
+#define _W25Q64FV_ATOMIC_HPP_
+
+#include <Arduino.h>
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_NATIVE_ATOMICS
+#if defined(__AVR__) || defined(__ARM_ARCH_6M__)
+#define W25Q64FV_NATIVE_ATOMICS     0 // Read-modify-write in hardware. AVR and Cortex-M0/M0+ have none, their builtins are libatomic calls that do not link
+#else
+#define W25Q64FV_NATIVE_ATOMICS     1
+#endif
+#endif
+
+#if !W25Q64FV_NATIVE_ATOMICS
+/**
+ * @brief Masks interrupts for its lifetime, restoring the mask it found
+ *
+ * Stands in for atomic instructions on a single core. Safe inside an interrupt, other
+ * cores fall back to noInterrupts() and interrupts(), so must not be used from one.
+ *
+ */
+class W25Q64FV_AtomicSection{
+public:
+#if defined(__AVR__)
+    W25Q64FV_AtomicSection() { _mask = SREG; cli(); }
+    ~W25Q64FV_AtomicSection() { SREG = _mask; }
+private:
+    uint8_t _mask;                      ///< Status register on entry
+#elif defined(__ARM_ARCH_6M__)
+    W25Q64FV_AtomicSection() { __asm__ volatile("mrs %0, primask\n cpsid i" : "=r"(_mask) : : "memory"); }
+    ~W25Q64FV_AtomicSection() { __asm__ volatile("msr primask, %0" : : "r"(_mask) : "memory"); }
+private:
+    uint32_t _mask;                     ///< PRIMASK on entry
+#else
+    W25Q64FV_AtomicSection() { noInterrupts(); }
+    ~W25Q64FV_AtomicSection() { interrupts(); }
+#endif
+};
+#endif
+
+/*
+ * Wrappers of the GCC __atomic builtins taking the same memory orders. Without native
+ * atomics every access runs with interrupts masked, which orders it as well, so the
+ * layers are only safe between the main loop and interrupts of one core there.
+ */
+
+/**
+ * @brief Load a value
+ *
+ * @param value                 Value to load
+ * @param order                 Memory order, __ATOMIC_RELAXED or __ATOMIC_ACQUIRE
+ * @return T                    Value loaded
+ */
+template<class T>
+inline T W25Q64FV_atomic_load(const T *value, int order){
+#if W25Q64FV_NATIVE_ATOMICS
+    return __atomic_load_n(value, order);
+#else
+    (void)order;
+    W25Q64FV_AtomicSection section;
+    return *(const volatile T*)value;
+#endif
+}
+
+/**
+ * @brief Store a value
+ *
+ * @param value                 Value to store to
+ * @param desired               New value
+ * @param order                 Memory order, __ATOMIC_RELAXED or __ATOMIC_RELEASE
+ * @return (void)
+ */
+template<class T>
+inline void W25Q64FV_atomic_store(T *value, T desired, int order){
+#if W25Q64FV_NATIVE_ATOMICS
+    __atomic_store_n(value, desired, order);
+#else
+    (void)order;
+    W25Q64FV_AtomicSection section;
+    *(volatile T*)value = desired;
+#endif
+}
+
+/**
+ * @brief Add to a value
+ *
+ * @param value                 Value to add to
+ * @param addend                Amount to add
+ * @param order                 Memory order
+ * @return T                    Value before the addition
+ */
+template<class T>
+inline T W25Q64FV_atomic_fetch_add(T *value, T addend, int order){
+#if W25Q64FV_NATIVE_ATOMICS
+    return __atomic_fetch_add(value, addend, order);
+#else
+    (void)order;
+    W25Q64FV_AtomicSection section;
+    T previous = *(volatile T*)value;
+    *(volatile T*)value = previous + addend;
+    return previous;
+#endif
+}
+
+/**
+ * @brief Subtract from a value
+ *
+ * @param value                 Value to subtract from
+ * @param subtrahend            Amount to subtract
+ * @param order                 Memory order
+ * @return T                    Value before the subtraction
+ */
+template<class T>
+inline T W25Q64FV_atomic_fetch_sub(T *value, T subtrahend, int order){
+#if W25Q64FV_NATIVE_ATOMICS
+    return __atomic_fetch_sub(value, subtrahend, order);
+#else
+    (void)order;
+    W25Q64FV_AtomicSection section;
+    T previous = *(volatile T*)value;
+    *(volatile T*)value = previous - subtrahend;
+    return previous;
+#endif
+}
+
+/**
+ * @brief Replace a value
+ *
+ * @param value                 Value to replace
+ * @param desired               New value
+ * @param order                 Memory order
+ * @return T                    Value before the exchange
+ */
+template<class T>
+inline T W25Q64FV_atomic_exchange(T *value, T desired, int order){
+#if W25Q64FV_NATIVE_ATOMICS
+    return __atomic_exchange_n(value, desired, order);
+#else
+    (void)order;
+    W25Q64FV_AtomicSection section;
+    T previous = *(volatile T*)value;
+    *(volatile T*)value = desired;
+    return previous;
+#endif
+}
+
+/**
+ * @brief Replace a value if it holds the expected one
+ *
+ * A failure loads the value relaxed
+ *
+ * @param value                 Value to replace
+ * @param expected              Expected value, set to the value found on a failure
+ * @param desired               New value
+ * @param order                 Memory order of a success
+ * @return true                 Value replaced
+ * @return false                Value differed
+ */
+template<class T>
+inline bool W25Q64FV_atomic_compare_exchange(T *value, T *expected, T desired, int order){
+#if W25Q64FV_NATIVE_ATOMICS
+    return __atomic_compare_exchange_n(value, expected, desired, false, order, __ATOMIC_RELAXED);
+#else
+    (void)order;
+    W25Q64FV_AtomicSection section;
+    T found = *(volatile T*)value;
+    if(found != *expected){
+        *expected = found;
+        return false;
+    }
+    *(volatile T*)value = desired;
+    return true;
+#endif
+}
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file W25Q64FV_CRC.hpp
+ * @author Jeremy Dunne
+ * @brief CRC-32 for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_CRC_HPP_
+#define _W25Q64FV_CRC_HPP_
+
+#include <Arduino.h>
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_CRC_TABLE_SIZE
+#define W25Q64FV_CRC_TABLE_SIZE     256 // Entries of the CRC lookup table, 256 (1kB, a byte per step) or 16 (64 bytes, a nibble per step)
+#endif
+
+/**
+ * @brief Update a CRC-32 with more data
+ *
+ * The reflected 0x04C11DB7 polynomial used by zlib and Ethernet, so a CRC of a whole
+ * image matches the one computed on the host. Start with 0 and pass the previous
+ * result to continue across calls.
+ *
+ * @param crc                   CRC of the data so far, 0 to start
+ * @param data                  Data to add
+ * @param length                Number of bytes
+ * @return uint32_t             Updated CRC
+ */
+uint32_t W25Q64FV_crc32(uint32_t crc, const byte *data, size_t length);
+
+#endif
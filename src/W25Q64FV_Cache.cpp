@@ -0,0 +1,18 @@
+/**
+ * @file W25Q64FV_Cache.cpp
+ * @author Jeremy Dunne
+ * @brief source file for the W25Q64 write-back sector cache
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <W25Q64FV_Cache.hpp>
+#include "W25Q64FV_Cache_impl.hpp"
+
+template class W25Q64FV_BasicCache<W25Q64FV>;
+template class W25Q64FV_BasicCache<W25Q128FV>;
+template class W25Q64FV_BasicCache<W25Q256FV>;
+template class W25Q64FV_BasicCache<W25QXX>;
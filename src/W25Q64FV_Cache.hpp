@@ -0,0 +1,161 @@
+/**
+ * @file W25Q64FV_Cache.hpp
+ * @author Jeremy Dunne
+ * @brief write-back sector cache for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_CACHE_HPP_
+#define _W25Q64FV_CACHE_HPP_
+
+#include "W25Q64FV.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_CACHE_MAX_SLOTS
+#define W25Q64FV_CACHE_MAX_SLOTS    8 // Maximum number of 4kB sector slots
+#endif
+
+/// Cache Statistics
+typedef struct{
+    unsigned long hits; ///<Accesses served from a cached sector
+    unsigned long misses; ///<Accesses to sectors not in the cache
+    unsigned long flushes; ///<Sectors written back (one erase and program each)
+    unsigned long evictions; ///<Sectors removed to make room
+    unsigned long in_place_flushes; ///<Write backs that needed no erase (flash smart mode)
+} W25Q64FV_cache_stats_t;
+
+/**
+ * @brief Write-back sector cache for the W25Q64FV
+ *
+ * Holds whole 4kB sectors in a caller-provided arena so small in-place updates are
+ * merged in RAM. A dirty sector is written back with a single erase and program when
+ * it is evicted (least recently used) or on flush(). Reads of uncached sectors go
+ * straight to the flash without allocating a slot. With the flash in smart mode, a
+ * sector whose changes only clear bits is programmed in place without an erase. Use
+ * the W25Q64FV_Cache typedef with the default driver, other drivers must also include
+ * W25Q64FV_Cache_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicCache{
+public:
+    /**
+     * @brief Construct a new cache
+     *
+     * @param flash                 Initialized flash chip to cache
+     * @param arena                 Buffer of slots * W25Q64FV_SECTOR_SIZE bytes
+     * @param slots                 Number of sector slots (1 to W25Q64FV_CACHE_MAX_SLOTS, with
+     *                              none every read goes to the flash and writes are not valid)
+     */
+    W25Q64FV_BasicCache(Flash &flash, byte *arena, unsigned int slots);
+
+    /**
+     * @brief Read through the cache
+     *
+     * @param start_address         Start address to read from
+     * @param buffer                Buffer of data to read into
+     * @param length                Number of bytes to read
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t read(uint32_t start_address, byte *buffer, size_t length);
+
+    /**
+     * @brief Write into the cache
+     *
+     * Any data may be written, the sector is erased when written back. May write back
+     * an evicted sector.
+     *
+     * @param start_address         Start address to write to
+     * @param buffer                Buffer of data to write
+     * @param length                Number of bytes to write
+     * @return W25Q64FV_status_t    Status return (not valid without slots)
+     */
+    W25Q64FV_status_t write(uint32_t start_address, const byte *buffer, size_t length);
+
+    /**
+     * @brief Write back all dirty sectors
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t flush();
+
+    /**
+     * @brief Drop all cached sectors without writing them back
+     *
+     * @return (void)
+     */
+    void invalidate();
+
+    /**
+     * @brief Get the cache statistics
+     *
+     * @param stats                 Statistics to fill
+     * @param reset                 Reset the statistics after reading
+     * @return (void)
+     */
+    void get_stats(W25Q64FV_cache_stats_t *stats, bool reset = false);
+
+private:
+    /// Sector slot
+    typedef struct{
+        uint32_t sector;            ///< Sector start address
+        unsigned long last_use;     ///< Access tick of the last use
+        bool valid;                 ///< Slot holds a sector
+        bool dirty;                 ///< Slot differs from the flash
+    } slot_t;
+
+    Flash *_flash;                              ///< Flash chip
+    byte *_arena;                               ///< Sector data
+    slot_t _slots[W25Q64FV_CACHE_MAX_SLOTS];    ///< Slot information
+    unsigned int _slot_count;                   ///< Number of slots
+    unsigned long _tick;                        ///< Access counter for LRU
+    W25Q64FV_cache_stats_t _stats;              ///< Statistics
+
+    /**
+     * @brief Find the slot holding a sector
+     *
+     * @param sector                Sector start address
+     * @return int                  Slot index, -1 if not cached
+     */
+    int find(uint32_t sector);
+
+    /**
+     * @brief Load a sector into a slot, evicting the least recently used
+     *
+     * @param sector                Sector start address
+     * @param slot                  Slot index loaded
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t load(uint32_t sector, int *slot);
+
+    /**
+     * @brief Write back a slot if dirty
+     *
+     * @param slot                  Slot index
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t write_back(int slot);
+
+    /**
+     * @brief Get the data of a slot
+     *
+     * @param slot                  Slot index
+     * @return byte*                Sector data
+     */
+    byte *slot_data(int slot) { return _arena + (size_t)slot * W25Q64FV_SECTOR_SIZE; }
+};
+
+/// Cache for the default W25Q64 driver
+typedef W25Q64FV_BasicCache<W25Q64FV> W25Q64FV_Cache;
+
+extern template class W25Q64FV_BasicCache<W25Q64FV>;
+extern template class W25Q64FV_BasicCache<W25Q128FV>;
+extern template class W25Q64FV_BasicCache<W25Q256FV>;
+extern template class W25Q64FV_BasicCache<W25QXX>;
+
+#endif
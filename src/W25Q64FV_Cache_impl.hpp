@@ -0,0 +1,191 @@
+/**
+ * @file W25Q64FV_Cache_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 write-back sector cache
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Cache.cpp for the default drivers. Include this after
+ * W25Q64FV_Cache.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_CACHE_IMPL_HPP_
+#define _W25Q64FV_CACHE_IMPL_HPP_
+
+#include "W25Q64FV_Cache.hpp"
+
+template<class Flash>
+W25Q64FV_BasicCache<Flash>::W25Q64FV_BasicCache(Flash &flash, byte *arena, unsigned int slots){
+    _flash = &flash;
+    _arena = arena;
+    _slot_count = slots;
+    if(_slot_count > W25Q64FV_CACHE_MAX_SLOTS) _slot_count = W25Q64FV_CACHE_MAX_SLOTS;
+    _tick = 0;
+    invalidate();
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicCache<Flash>::read(uint32_t start_address, byte *buffer, size_t length){
+    if(start_address + length > _flash->capacity()) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status;
+    while(length > 0){
+        // split at sector boundaries
+        uint32_t sector = start_address - (start_address % W25Q64FV_SECTOR_SIZE);
+        size_t offset = start_address - sector;
+        size_t chunk = W25Q64FV_SECTOR_SIZE - offset;
+        if(chunk > length) chunk = length;
+        int slot = find(sector);
+        if(slot >= 0){
+            _stats.hits ++;
+            _slots[slot].last_use = ++ _tick;
+            memcpy(buffer, slot_data(slot) + offset, chunk);
+        }
+        else{
+            // read around the cache
+            _stats.misses ++;
+            status = _flash->read(start_address, buffer, chunk);
+            if(status != W25Q64FV_OK) return status;
+        }
+        start_address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicCache<Flash>::write(uint32_t start_address, const byte *buffer, size_t length){
+    if(start_address + length > _flash->capacity()) return W25Q64FV_NOT_VALID;
+    // nowhere to stage the sector
+    if(_slot_count == 0) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status;
+    while(length > 0){
+        // split at sector boundaries
+        uint32_t sector = start_address - (start_address % W25Q64FV_SECTOR_SIZE);
+        size_t offset = start_address - sector;
+        size_t chunk = W25Q64FV_SECTOR_SIZE - offset;
+        if(chunk > length) chunk = length;
+        int slot = find(sector);
+        if(slot >= 0){
+            _stats.hits ++;
+        }
+        else{
+            _stats.misses ++;
+            status = load(sector, &slot);
+            if(status != W25Q64FV_OK) return status;
+        }
+        _slots[slot].last_use = ++ _tick;
+        memcpy(slot_data(slot) + offset, buffer, chunk);
+        _slots[slot].dirty = true;
+        start_address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicCache<Flash>::flush(){
+    for(unsigned int i = 0; i < _slot_count; i ++){
+        W25Q64FV_status_t status = write_back(i);
+        if(status != W25Q64FV_OK) return status;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+void W25Q64FV_BasicCache<Flash>::invalidate(){
+    for(unsigned int i = 0; i < W25Q64FV_CACHE_MAX_SLOTS; i ++){
+        _slots[i].valid = false;
+        _slots[i].dirty = false;
+        _slots[i].sector = 0;
+        _slots[i].last_use = 0;
+    }
+}
+
+template<class Flash>
+void W25Q64FV_BasicCache<Flash>::get_stats(W25Q64FV_cache_stats_t *stats, bool reset){
+    *stats = _stats;
+    if(reset) memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+int W25Q64FV_BasicCache<Flash>::find(uint32_t sector){
+    for(unsigned int i = 0; i < _slot_count; i ++){
+        if(_slots[i].valid && _slots[i].sector == sector) return i;
+    }
+    return -1;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicCache<Flash>::load(uint32_t sector, int *slot){
+    if(_slot_count == 0) return W25Q64FV_NOT_VALID;
+    // pick a free slot, or the least recently used
+    int victim = 0;
+    for(unsigned int i = 0; i < _slot_count; i ++){
+        if(!_slots[i].valid){
+            victim = i;
+            break;
+        }
+        if(_slots[i].last_use < _slots[victim].last_use) victim = i;
+    }
+    if(_slots[victim].valid){
+        W25Q64FV_status_t status = write_back(victim);
+        if(status != W25Q64FV_OK) return status;
+        _slots[victim].valid = false;
+        _stats.evictions ++;
+    }
+    // fill the slot from the flash
+    W25Q64FV_status_t status = _flash->read(sector, slot_data(victim), W25Q64FV_SECTOR_SIZE);
+    if(status != W25Q64FV_OK) return status;
+    _slots[victim].sector = sector;
+    _slots[victim].valid = true;
+    _slots[victim].dirty = false;
+    *slot = victim;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicCache<Flash>::write_back(int slot){
+    if(!_slots[slot].valid || !_slots[slot].dirty) return W25Q64FV_OK;
+    byte *data = slot_data(slot);
+    W25Q64FV_status_t status;
+    if(_flash->smart_mode()){
+        // changes that only clear bits are programmed in place
+        W25Q64FV_compare_t result;
+        status = _flash->compare(_slots[slot].sector, data, W25Q64FV_SECTOR_SIZE, &result);
+        if(status != W25Q64FV_OK) return status;
+        if(result != W25Q64FV_COMPARE_ERASE_REQUIRED){
+            status = _flash->write(_slots[slot].sector, data, W25Q64FV_SECTOR_SIZE, true);
+            if(status != W25Q64FV_OK) return status;
+            _slots[slot].dirty = false;
+            _stats.flushes ++;
+            _stats.in_place_flushes ++;
+            return W25Q64FV_OK;
+        }
+    }
+    status = _flash->erase_sector(_slots[slot].sector, true);
+    if(status != W25Q64FV_OK) return status;
+    // erased pages need no program, and the sector is known blank so the smart mode
+    // compares are skipped
+    for(uint32_t page = 0; page < W25Q64FV_SECTOR_SIZE; page += W25Q64FV_PAGE_SIZE){
+        bool blank = true;
+        for(unsigned int i = 0; i < W25Q64FV_PAGE_SIZE && blank; i ++){
+            if(data[page + i] != 0xFF) blank = false;
+        }
+        if(blank) continue;
+        status = _flash->write_erased(_slots[slot].sector + page, data + page, W25Q64FV_PAGE_SIZE, false);
+        if(status != W25Q64FV_OK) return status;
+    }
+    status = _flash->wait_until_free();
+    if(status != W25Q64FV_OK) return status;
+    _slots[slot].dirty = false;
+    _stats.flushes ++;
+    return W25Q64FV_OK;
+}
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file W25Q64FV_FTL.cpp
+ * @author Jeremy Dunne
+ * @brief source file for the W25Q64 wear-leveling flash translation layer
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <W25Q64FV_FTL.hpp>
+#include "W25Q64FV_FTL_impl.hpp"
+
+template class W25Q64FV_BasicFTL<W25Q64FV>;
+template class W25Q64FV_BasicFTL<W25Q128FV>;
+template class W25Q64FV_BasicFTL<W25Q256FV>;
+template class W25Q64FV_BasicFTL<W25QXX>;
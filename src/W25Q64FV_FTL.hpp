@@ -0,0 +1,314 @@
+/**
+ * @file W25Q64FV_FTL.hpp
+ * @author Jeremy Dunne
+ * @brief wear-leveling flash translation layer for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_FTL_HPP_
+#define _W25Q64FV_FTL_HPP_
+
+#include "W25Q64FV.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_FTL_RESERVE
+#define W25Q64FV_FTL_RESERVE        4 // Physical sectors held back from the logical space
+#endif
+#ifndef W25Q64FV_FTL_FREE_TARGET
+#define W25Q64FV_FTL_FREE_TARGET    2 // Free sectors kept erased by service()
+#endif
+#ifndef W25Q64FV_FTL_STATIC_INTERVAL
+#define W25Q64FV_FTL_STATIC_INTERVAL 64 // Erases between static wear leveling checks
+#endif
+#ifndef W25Q64FV_FTL_STATIC_THRESHOLD
+#define W25Q64FV_FTL_STATIC_THRESHOLD 16 // Wear difference (in W25Q64FV_FTL_WEAR_SHIFT units) that moves cold data
+#endif
+
+#define W25Q64FV_FTL_MAGIC          0x4C54465F // "_FTL"
+#define W25Q64FV_FTL_HEADER_SIZE    16 // Sector header: magic, erase count, sequence, logical sector, state
+#define W25Q64FV_FTL_SECTOR_SIZE    (W25Q64FV_SECTOR_SIZE - W25Q64FV_FTL_HEADER_SIZE) // Logical sector size
+#define W25Q64FV_FTL_WEAR_SHIFT     3 // Erase counts are held in RAM in units of 8 erases
+#define W25Q64FV_FTL_UNMAPPED       0xFFFF // Logical sector with no physical sector
+
+/// Words of arena needed for a region of length bytes: one per physical and one per logical sector
+#define W25Q64FV_FTL_ARENA_SIZE(length) (2 * ((length) / W25Q64FV_SECTOR_SIZE))
+
+// Sector states in the header, each clears more bits than the last
+#define W25Q64FV_FTL_STATE_FREE     0xFFFF // Erased, header holds the erase count
+#define W25Q64FV_FTL_STATE_WRITING  0x7FFF // Allocated, data being programmed
+#define W25Q64FV_FTL_STATE_LIVE     0x3FFF // Holds the logical sector
+#define W25Q64FV_FTL_STATE_STALE    0x1FFF // Superseded, to be erased
+
+/// FTL Statistics
+typedef struct{
+    unsigned long writes; ///<Logical sector writes
+    unsigned long pages; ///<Pages programmed, including headers and relocations
+    unsigned long erases; ///<Physical sectors erased
+    unsigned long relocations; ///<Cold sectors moved by static wear leveling
+    unsigned long waits; ///<Writes that waited on an erase
+    unsigned long min_wear; ///<Lowest erase count (rounded down to W25Q64FV_FTL_WEAR_SHIFT units)
+    unsigned long max_wear; ///<Highest erase count (rounded down to W25Q64FV_FTL_WEAR_SHIFT units)
+} W25Q64FV_ftl_stats_t;
+
+/**
+ * @brief Wear-leveling flash translation layer for the W25Q64FV
+ *
+ * Maps logical sectors of W25Q64FV_FTL_SECTOR_SIZE bytes onto the 4kB physical sectors
+ * of a region. Every write goes to a fresh physical sector, the least worn free one,
+ * and the old copy is marked stale. The first 16 bytes of each physical sector hold its
+ * erase count, a sequence number, the logical sector it holds, and a state that is
+ * committed only once the data is programmed, so a write interrupted by power loss
+ * leaves the previous copy in place.
+ *
+ * The mapping lives in a caller-provided arena of one word per logical and physical
+ * sector (8kB for the whole chip), rebuilt at mount() from the headers. service()
+ * erases stale sectors in the background to keep W25Q64FV_FTL_FREE_TARGET free, and
+ * periodically moves cold data off lightly worn sectors so they rejoin the pool. Use the
+ * W25Q64FV_FTL typedef with the default driver, other drivers must also include
+ * W25Q64FV_FTL_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicFTL{
+public:
+    /**
+     * @brief Construct a new flash translation layer
+     *
+     * @param flash                 Initialized flash chip to map
+     * @param start_address         Start of the region, 4kB aligned
+     * @param length                Length of the region, a multiple of 4kB
+     * @param arena                 Buffer of W25Q64FV_FTL_ARENA_SIZE(length) words
+     */
+    W25Q64FV_BasicFTL(Flash &flash, uint32_t start_address, uint32_t length, uint16_t *arena);
+
+    /**
+     * @brief Rebuild the mapping from the sector headers
+     *
+     * A blank region mounts with every logical sector unmapped
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t mount();
+
+    /**
+     * @brief Discard all logical sectors, keeping the erase counts
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t format();
+
+    /**
+     * @brief Read from a logical sector
+     *
+     * Unmapped sectors read as erased (0xFF)
+     *
+     * @param logical               Logical sector
+     * @param offset                Offset within the logical sector
+     * @param buffer                Buffer of data to read into
+     * @param length                Number of bytes to read
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t read(uint32_t logical, uint32_t offset, byte *buffer, size_t length);
+
+    /**
+     * @brief Write to a logical sector
+     *
+     * The rest of the sector is copied from its previous physical sector
+     *
+     * @param logical               Logical sector
+     * @param offset                Offset within the logical sector
+     * @param buffer                Buffer of data to write
+     * @param length                Number of bytes to write
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t write(uint32_t logical, uint32_t offset, const byte *buffer, size_t length);
+
+    /**
+     * @brief Discard a logical sector
+     *
+     * @param logical               Logical sector
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t trim(uint32_t logical);
+
+    /**
+     * @brief Advance background work
+     *
+     * Call from the main loop. Starts erases of stale sectors without waiting, and may
+     * copy one cold sector for static wear leveling.
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t service();
+
+    /**
+     * @brief Get the number of logical sectors
+     *
+     * @return uint32_t             Number of logical sectors
+     */
+    uint32_t logical_count() { return _logical_count; }
+
+    /**
+     * @brief Get the FTL statistics
+     *
+     * @param stats                 Statistics to fill
+     * @param reset                 Reset the counters after reading
+     * @return (void)
+     */
+    void get_stats(W25Q64FV_ftl_stats_t *stats, bool reset = false);
+
+private:
+    /// Sector header
+    typedef struct{
+        uint32_t magic;             ///< W25Q64FV_FTL_MAGIC
+        uint32_t erase_count;       ///< Erases of this physical sector
+        uint32_t sequence;          ///< Write sequence number
+        uint16_t logical;           ///< Logical sector held
+        uint16_t state;             ///< W25Q64FV_FTL_STATE_*
+    } header_t;
+
+    // Physical sector states in RAM, held in the top two bits of the physical word
+    enum{
+        PHYSICAL_NEW = 0,           ///< No header, may not be blank
+        PHYSICAL_FREE = 1,          ///< Erased with a header
+        PHYSICAL_LIVE = 2,          ///< Holds a logical sector
+        PHYSICAL_DIRTY = 3          ///< Needs an erase
+    };
+
+    Flash *_flash;                              ///< Flash chip
+    uint32_t _start_address;                    ///< Start of the region
+    uint32_t _physical_count;                   ///< Physical sectors in the region
+    uint32_t _logical_count;                    ///< Logical sectors exposed
+    uint16_t *_physical;                        ///< Per physical sector state and wear
+    uint16_t *_map;                             ///< Logical to physical sector map
+    uint32_t _sequence;                         ///< Next write sequence number
+    bool _erase_in_progress;                    ///< Background erase running
+    uint32_t _erase_sector;                     ///< Physical sector being erased
+    uint32_t _erase_count;                      ///< Erase count of the sector once erased
+    unsigned int _static_countdown;             ///< Erases until the next static wear leveling check
+    byte _page[W25Q64FV_PAGE_SIZE];             ///< Page buffer for copies
+    W25Q64FV_ftl_stats_t _stats;                ///< Statistics
+
+    /**
+     * @brief Get the address of a physical sector
+     *
+     * @param physical              Physical sector
+     * @return uint32_t             Flash address
+     */
+    uint32_t sector_address(uint32_t physical) { return _start_address + physical * W25Q64FV_SECTOR_SIZE; }
+
+    /**
+     * @brief Get the RAM state of a physical sector
+     *
+     * @param physical              Physical sector
+     * @return uint8_t              PHYSICAL_* state
+     */
+    uint8_t state(uint32_t physical) { return _physical[physical] >> 14; }
+
+    /**
+     * @brief Get the wear of a physical sector
+     *
+     * @param physical              Physical sector
+     * @return uint16_t             Erase count in W25Q64FV_FTL_WEAR_SHIFT units
+     */
+    uint16_t wear(uint32_t physical) { return _physical[physical] & 0x3FFF; }
+
+    /**
+     * @brief Set the RAM state of a physical sector
+     *
+     * @param physical              Physical sector
+     * @param state                 PHYSICAL_* state
+     * @param erase_count           Erase count of the sector
+     * @return (void)
+     */
+    void set_physical(uint32_t physical, uint8_t state, uint32_t erase_count);
+
+    /**
+     * @brief Find the physical sector in a state with the least or most wear
+     *
+     * @param state                 PHYSICAL_* state
+     * @param most                  Find the most worn rather than the least
+     * @return uint32_t             Physical sector, or _physical_count if none
+     */
+    uint32_t find(uint8_t state, bool most = false);
+
+    /**
+     * @brief Get a free physical sector, erasing one if none is free
+     *
+     * @param physical              Free physical sector
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t allocate(uint32_t *physical);
+
+    /**
+     * @brief Give a sector without a header its free header
+     *
+     * Erases the sector first unless it is blank
+     *
+     * @param physical              Physical sector in the PHYSICAL_NEW state
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t prepare(uint32_t physical);
+
+    /**
+     * @brief Start erasing a physical sector
+     *
+     * @param physical              Physical sector
+     * @param hold                  Wait for the erase and program the free header
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t reclaim(uint32_t physical, bool hold);
+
+    /**
+     * @brief Wait for the background erase and program the free header
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t finish_erase();
+
+    /**
+     * @brief Copy a logical sector to a free physical sector with new data merged in
+     *
+     * @param logical               Logical sector
+     * @param destination           Free physical sector
+     * @param offset                Offset of the new data within the logical sector
+     * @param buffer                New data, or NULL
+     * @param length                Length of the new data
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t move(uint32_t logical, uint32_t destination, uint32_t offset, const byte *buffer, size_t length);
+
+    /**
+     * @brief Program the state field of a sector header
+     *
+     * @param physical              Physical sector
+     * @param value                 W25Q64FV_FTL_STATE_* value
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t write_state(uint32_t physical, uint16_t value);
+
+    /**
+     * @brief Program and count pages, suspending a background erase if needed
+     *
+     * @param address               Flash address
+     * @param buffer                Data to program
+     * @param length                Number of bytes
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t program(uint32_t address, const byte *buffer, size_t length);
+};
+
+/// Flash translation layer on the default W25Q64 driver
+typedef W25Q64FV_BasicFTL<W25Q64FV> W25Q64FV_FTL;
+
+extern template class W25Q64FV_BasicFTL<W25Q64FV>;
+extern template class W25Q64FV_BasicFTL<W25Q128FV>;
+extern template class W25Q64FV_BasicFTL<W25Q256FV>;
+extern template class W25Q64FV_BasicFTL<W25QXX>;
+
+#endif
@@ -0,0 +1,352 @@
+/**
+ * @file W25Q64FV_FTL_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 wear-leveling flash translation layer
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_FTL.cpp for the default drivers. Include this after
+ * W25Q64FV_FTL.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_FTL_IMPL_HPP_
+#define _W25Q64FV_FTL_IMPL_HPP_
+
+#include "W25Q64FV_FTL.hpp"
+
+template<class Flash>
+W25Q64FV_BasicFTL<Flash>::W25Q64FV_BasicFTL(Flash &flash, uint32_t start_address, uint32_t length, uint16_t *arena){
+    _flash = &flash;
+    _start_address = start_address;
+    _physical_count = length / W25Q64FV_SECTOR_SIZE;
+    _logical_count = _physical_count > W25Q64FV_FTL_RESERVE ? _physical_count - W25Q64FV_FTL_RESERVE : 0;
+    _physical = arena;
+    _map = arena + _physical_count;
+    _sequence = 0;
+    _erase_in_progress = false;
+    _erase_sector = 0;
+    _erase_count = 0;
+    _static_countdown = W25Q64FV_FTL_STATIC_INTERVAL;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::mount(){
+    if(_start_address % W25Q64FV_SECTOR_SIZE != 0) return W25Q64FV_NOT_VALID;
+    if(_logical_count == 0 || _physical_count >= W25Q64FV_FTL_UNMAPPED) return W25Q64FV_NOT_VALID;
+    if(_start_address + _physical_count * W25Q64FV_SECTOR_SIZE > _flash->capacity()) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    // an erase issued before a reset may still be running somewhere in the region
+    status = _flash->wait_until_free();
+    if(status != W25Q64FV_OK) return status;
+    for(uint32_t i = 0; i < _logical_count; i ++) _map[i] = W25Q64FV_FTL_UNMAPPED;
+    _sequence = 0;
+    // one header read per physical sector
+    for(uint32_t i = 0; i < _physical_count; i ++){
+        header_t header;
+        status = _flash->suspend_read(sector_address(i), (byte*)&header, sizeof(header));
+        if(status != W25Q64FV_OK) return status;
+        if(header.magic != W25Q64FV_FTL_MAGIC){
+            // blank headers are checked before use, anything else is erased
+            bool blank = true;
+            for(size_t j = 0; j < sizeof(header); j ++){
+                if(((byte*)&header)[j] != 0xFF) blank = false;
+            }
+            set_physical(i, blank ? PHYSICAL_NEW : PHYSICAL_DIRTY, 0);
+            continue;
+        }
+        if(header.state == W25Q64FV_FTL_STATE_FREE){
+            set_physical(i, PHYSICAL_FREE, header.erase_count);
+            continue;
+        }
+        if(header.state != W25Q64FV_FTL_STATE_LIVE || header.logical >= _logical_count){
+            // interrupted writes and stale copies
+            set_physical(i, PHYSICAL_DIRTY, header.erase_count);
+            continue;
+        }
+        if(header.sequence >= _sequence) _sequence = header.sequence + 1;
+        uint16_t other = _map[header.logical];
+        if(other != W25Q64FV_FTL_UNMAPPED){
+            // power was lost before the old copy was marked stale, keep the newer one
+            header_t previous;
+            status = _flash->suspend_read(sector_address(other), (byte*)&previous, sizeof(previous));
+            if(status != W25Q64FV_OK) return status;
+            if(previous.sequence > header.sequence){
+                set_physical(i, PHYSICAL_DIRTY, header.erase_count);
+                continue;
+            }
+            set_physical(other, PHYSICAL_DIRTY, (uint32_t)wear(other) << W25Q64FV_FTL_WEAR_SHIFT);
+        }
+        _map[header.logical] = i;
+        set_physical(i, PHYSICAL_LIVE, header.erase_count);
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::format(){
+    W25Q64FV_status_t status;
+    for(uint32_t i = 0; i < _logical_count; i ++){
+        status = trim(i);
+        if(status != W25Q64FV_OK) return status;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::read(uint32_t logical, uint32_t offset, byte *buffer, size_t length){
+    if(logical >= _logical_count || offset + length > W25Q64FV_FTL_SECTOR_SIZE) return W25Q64FV_NOT_VALID;
+    uint16_t physical = _map[logical];
+    if(physical == W25Q64FV_FTL_UNMAPPED){
+        memset(buffer, 0xFF, length);
+        return W25Q64FV_OK;
+    }
+    return _flash->suspend_read(sector_address(physical) + W25Q64FV_FTL_HEADER_SIZE + offset, buffer, length);
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::write(uint32_t logical, uint32_t offset, const byte *buffer, size_t length){
+    if(logical >= _logical_count || offset + length > W25Q64FV_FTL_SECTOR_SIZE) return W25Q64FV_NOT_VALID;
+    _stats.writes ++;
+    uint32_t destination;
+    W25Q64FV_status_t status = allocate(&destination);
+    if(status != W25Q64FV_OK) return status;
+    return move(logical, destination, offset, buffer, length);
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::trim(uint32_t logical){
+    if(logical >= _logical_count) return W25Q64FV_NOT_VALID;
+    uint16_t physical = _map[logical];
+    if(physical == W25Q64FV_FTL_UNMAPPED) return W25Q64FV_OK;
+    W25Q64FV_status_t status = write_state(physical, W25Q64FV_FTL_STATE_STALE);
+    if(status != W25Q64FV_OK) return status;
+    _map[logical] = W25Q64FV_FTL_UNMAPPED;
+    set_physical(physical, PHYSICAL_DIRTY, (uint32_t)wear(physical) << W25Q64FV_FTL_WEAR_SHIFT);
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::service(){
+    W25Q64FV_status_t status;
+    if(_erase_in_progress){
+        if(_flash->busy()) return W25Q64FV_OK;
+        status = finish_erase();
+        if(status != W25Q64FV_OK) return status;
+    }
+    if(_flash->busy()) return W25Q64FV_OK;
+    // keep the free pool topped up, erasing the least worn stale sector first
+    uint32_t free_count = 0;
+    for(uint32_t i = 0; i < _physical_count; i ++){
+        if(state(i) == PHYSICAL_FREE) free_count ++;
+    }
+    if(free_count < W25Q64FV_FTL_FREE_TARGET){
+        uint32_t physical = find(PHYSICAL_DIRTY);
+        if(physical != _physical_count) return reclaim(physical, false);
+        physical = find(PHYSICAL_NEW);
+        if(physical != _physical_count) return prepare(physical);
+        return W25Q64FV_OK;
+    }
+    // static wear leveling, park the coldest data on the most worn free sector
+    if(_static_countdown > 0) return W25Q64FV_OK;
+    _static_countdown = W25Q64FV_FTL_STATIC_INTERVAL;
+    uint32_t cold = find(PHYSICAL_LIVE);
+    uint32_t worn = find(PHYSICAL_FREE, true);
+    if(cold == _physical_count || worn == _physical_count) return W25Q64FV_OK;
+    if(wear(worn) < wear(cold) + W25Q64FV_FTL_STATIC_THRESHOLD) return W25Q64FV_OK;
+    header_t header;
+    status = _flash->suspend_read(sector_address(cold), (byte*)&header, sizeof(header));
+    if(status != W25Q64FV_OK) return status;
+    if(header.logical >= _logical_count || _map[header.logical] != cold) return W25Q64FV_OK;
+    _stats.relocations ++;
+    return move(header.logical, worn, 0, NULL, 0);
+}
+
+template<class Flash>
+void W25Q64FV_BasicFTL<Flash>::get_stats(W25Q64FV_ftl_stats_t *stats, bool reset){
+    _stats.min_wear = 0;
+    _stats.max_wear = 0;
+    for(uint32_t i = 0; i < _physical_count; i ++){
+        unsigned long count = (unsigned long)wear(i) << W25Q64FV_FTL_WEAR_SHIFT;
+        if(i == 0 || count < _stats.min_wear) _stats.min_wear = count;
+        if(count > _stats.max_wear) _stats.max_wear = count;
+    }
+    memcpy(stats, &_stats, sizeof(_stats));
+    if(reset) memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+void W25Q64FV_BasicFTL<Flash>::set_physical(uint32_t physical, uint8_t state, uint32_t erase_count){
+    uint32_t level = erase_count >> W25Q64FV_FTL_WEAR_SHIFT;
+    if(level > 0x3FFF) level = 0x3FFF;
+    _physical[physical] = ((uint16_t)state << 14) | level;
+}
+
+template<class Flash>
+uint32_t W25Q64FV_BasicFTL<Flash>::find(uint8_t state, bool most){
+    uint32_t best = _physical_count;
+    for(uint32_t i = 0; i < _physical_count; i ++){
+        if(this->state(i) != state) continue;
+        if(best == _physical_count || (most ? wear(i) > wear(best) : wear(i) < wear(best))) best = i;
+    }
+    return best;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::allocate(uint32_t *physical){
+    W25Q64FV_status_t status;
+    // dynamic wear leveling, the least worn free sector
+    *physical = find(PHYSICAL_FREE);
+    if(*physical != _physical_count) return W25Q64FV_OK;
+    uint32_t candidate = find(PHYSICAL_NEW);
+    if(candidate != _physical_count){
+        status = prepare(candidate);
+        if(status != W25Q64FV_OK) return status;
+    }
+    else{
+        // the write has to wait on an erase
+        _stats.waits ++;
+        if(!_erase_in_progress){
+            candidate = find(PHYSICAL_DIRTY);
+            if(candidate == _physical_count) return W25Q64FV_NOT_VALID;
+            status = reclaim(candidate, false);
+            if(status != W25Q64FV_OK) return status;
+        }
+    }
+    status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    *physical = find(PHYSICAL_FREE);
+    if(*physical == _physical_count) return W25Q64FV_NOT_VALID;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::prepare(uint32_t physical){
+    bool blank;
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    status = _flash->is_blank(sector_address(physical), W25Q64FV_SECTOR_SIZE, &blank);
+    if(status != W25Q64FV_OK) return status;
+    if(!blank) return reclaim(physical, true);
+    header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = W25Q64FV_FTL_MAGIC;
+    header.erase_count = 0;
+    status = program(sector_address(physical), (const byte*)&header, sizeof(header));
+    if(status != W25Q64FV_OK) return status;
+    set_physical(physical, PHYSICAL_FREE, 0);
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::reclaim(uint32_t physical, bool hold){
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    // carry the exact erase count over from the header when there is one
+    header_t header;
+    status = _flash->suspend_read(sector_address(physical), (byte*)&header, sizeof(header));
+    if(status != W25Q64FV_OK) return status;
+    if(header.magic == W25Q64FV_FTL_MAGIC) _erase_count = header.erase_count + 1;
+    else _erase_count = ((uint32_t)wear(physical) << W25Q64FV_FTL_WEAR_SHIFT) + 1;
+    status = _flash->erase_sector(sector_address(physical), false);
+    if(status != W25Q64FV_OK) return status;
+    _erase_sector = physical;
+    _erase_in_progress = true;
+    _stats.erases ++;
+    set_physical(physical, PHYSICAL_DIRTY, _erase_count);
+    if(hold) return finish_erase();
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::finish_erase(){
+    if(!_erase_in_progress) return W25Q64FV_OK;
+    W25Q64FV_status_t status = _flash->wait_until_free();
+    if(status != W25Q64FV_OK) return status;
+    _erase_in_progress = false;
+    // the header keeps the erase count while the sector is free
+    header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = W25Q64FV_FTL_MAGIC;
+    header.erase_count = _erase_count;
+    status = program(sector_address(_erase_sector), (const byte*)&header, sizeof(header));
+    if(status != W25Q64FV_OK) return status;
+    set_physical(_erase_sector, PHYSICAL_FREE, _erase_count);
+    if(_static_countdown > 0) _static_countdown --;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::move(uint32_t logical, uint32_t destination, uint32_t offset, const byte *buffer, size_t length){
+    uint16_t source = _map[logical];
+    W25Q64FV_status_t status = write_state(destination, W25Q64FV_FTL_STATE_WRITING);
+    if(status != W25Q64FV_OK) return status;
+    set_physical(destination, PHYSICAL_DIRTY, (uint32_t)wear(destination) << W25Q64FV_FTL_WEAR_SHIFT);
+    for(uint32_t page = 0; page < W25Q64FV_SECTOR_SIZE; page += W25Q64FV_PAGE_SIZE){
+        // the first page starts with the header
+        uint32_t start = page == 0 ? W25Q64FV_FTL_HEADER_SIZE : 0;
+        uint32_t position = page + start - W25Q64FV_FTL_HEADER_SIZE;
+        size_t count = W25Q64FV_PAGE_SIZE - start;
+        bool covered = buffer != NULL && offset <= position && offset + length >= position + count;
+        if(covered){
+            memcpy(_page + start, buffer + (position - offset), count);
+        }
+        else{
+            // merge the new data into the old copy
+            if(source != W25Q64FV_FTL_UNMAPPED){
+                status = _flash->suspend_read(sector_address(source) + page + start, _page + start, count);
+                if(status != W25Q64FV_OK) return status;
+            }
+            else{
+                memset(_page + start, 0xFF, count);
+            }
+            if(buffer != NULL && offset < position + count && offset + length > position){
+                uint32_t from = offset > position ? offset : position;
+                uint32_t to = offset + length < position + count ? offset + length : position + count;
+                memcpy(_page + start + (from - position), buffer + (from - offset), to - from);
+            }
+        }
+        // erased data needs no program
+        bool blank = true;
+        for(size_t i = start; i < W25Q64FV_PAGE_SIZE && blank; i ++){
+            if(_page[i] != 0xFF) blank = false;
+        }
+        if(blank) continue;
+        status = program(sector_address(destination) + page + start, _page + start, count);
+        if(status != W25Q64FV_OK) return status;
+    }
+    // commit with the sequence, logical sector, and state in one program
+    header_t header;
+    header.sequence = _sequence;
+    header.logical = logical;
+    header.state = W25Q64FV_FTL_STATE_LIVE;
+    status = program(sector_address(destination) + 8, (const byte*)&header.sequence, 8);
+    if(status != W25Q64FV_OK) return status;
+    _sequence ++;
+    if(source != W25Q64FV_FTL_UNMAPPED){
+        status = write_state(source, W25Q64FV_FTL_STATE_STALE);
+        if(status != W25Q64FV_OK) return status;
+        set_physical(source, PHYSICAL_DIRTY, (uint32_t)wear(source) << W25Q64FV_FTL_WEAR_SHIFT);
+    }
+    _map[logical] = destination;
+    set_physical(destination, PHYSICAL_LIVE, (uint32_t)wear(destination) << W25Q64FV_FTL_WEAR_SHIFT);
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::write_state(uint32_t physical, uint16_t value){
+    return program(sector_address(physical) + W25Q64FV_FTL_HEADER_SIZE - sizeof(value), (const byte*)&value, sizeof(value));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicFTL<Flash>::program(uint32_t address, const byte *buffer, size_t length){
+    _stats.pages += (address % W25Q64FV_PAGE_SIZE + length + W25Q64FV_PAGE_SIZE - 1) / W25Q64FV_PAGE_SIZE;
+    // program into a suspended erase rather than wait out the rest of it
+    return _flash->suspend_write(address, buffer, length);
+}
+
+#endif
@@ -0,0 +1,224 @@
+/**
+ * @file W25Q64FV_Geometry.hpp
+ * @author Jeremy Dunne
+ * @brief part geometries for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * A geometry is any class providing the following members. The driver is
+ * templated on the geometry, so a fixed geometry folds the address math and
+ * bounds checks into constants.
+ *
+ *  - uint32_t capacity()                                               Density in bytes
+ *  - uint8_t address_bytes()                                           Address length, 3, or 4 above 16MB
+ *  - uint8_t erase_instruction(W25Q64FV_operation_t operation)         Instruction of a sector or block erase,
+ *                                                                      0 if the part does not support it
+ *  - unsigned long operation_time(W25Q64FV_operation_t operation,      Typical or maximum time of an operation (us)
+ *                                 bool maximum)
+ *  - bool supports(W25Q64FV_io_mode_t mode)                            Check the part supports a read data path
+ *  - W25Q64FV_status_t configure(const W25Q64FV_parameters_t &)        Take the parameters discovered by begin()
+ *
+ * Page, sector, and block sizes are common to the W25Q family and stay fixed.
+ */
+
+#ifndef _W25Q64FV_GEOMETRY_HPP_
+#define _W25Q64FV_GEOMETRY_HPP_
+
+#include <Arduino.h>
+
+/********** SETTINGS **********/
+#define W25Q64FV_3B_ADDRESS_LIMIT   16777216 // Largest density reachable with 3 byte addresses
+
+/// Part Parameters, from SFDP or the JEDEC ID
+typedef struct{
+    uint32_t capacity; ///<Density in bytes
+    uint16_t page_size; ///<Page program size in bytes
+    uint8_t address_bytes; ///<Address length, 3, or 4 above 16MB
+    uint8_t io_modes; ///<Supported read data paths, bit n set for W25Q64FV_io_mode_t n
+    uint8_t erase_instructions[3]; ///<4kB, 32kB, and 64kB erase instructions, 0 if not supported
+    unsigned long times[W25Q64FV_OPERATION_RESET + 1]; ///<Typical operation times (us), indexed by W25Q64FV_operation_t
+    unsigned long max_times[W25Q64FV_OPERATION_RESET + 1]; ///<Maximum operation times (us), indexed by W25Q64FV_operation_t
+} W25Q64FV_parameters_t;
+
+/**
+ * @brief Geometry of a part known at compile time
+ *
+ * Uses the W25Q64 datasheet times, with the chip erase time scaled by density
+ *
+ * @tparam Capacity             Density in bytes
+ */
+template<uint32_t Capacity>
+class W25Q64FV_FixedGeometry{
+public:
+    /**
+     * @brief Get the density
+     *
+     * @return uint32_t             Density in bytes
+     */
+    static constexpr uint32_t capacity() { return Capacity; }
+
+    /**
+     * @brief Get the address length
+     *
+     * @return uint8_t              Address bytes
+     */
+    static constexpr uint8_t address_bytes() { return Capacity > W25Q64FV_3B_ADDRESS_LIMIT ? 4 : 3; }
+
+    /**
+     * @brief Get the instruction of a sector or block erase
+     *
+     * @param operation             Erase operation
+     * @return uint8_t              Instruction, 0 if not an erase
+     */
+    static constexpr uint8_t erase_instruction(W25Q64FV_operation_t operation) {
+        return operation == W25Q64FV_OPERATION_SECTOR_ERASE ? W25Q64FV_INSTRUCTION_SECTOR_4K_ERASE :
+            operation == W25Q64FV_OPERATION_BLOCK_32K_ERASE ? W25Q64FV_INSTRUCTION_BLOCK_32K_ERASE :
+            operation == W25Q64FV_OPERATION_BLOCK_64K_ERASE ? W25Q64FV_INSTRUCTION_BLOCK_64K_ERASE : 0;
+    }
+
+    /**
+     * @brief Get the datasheet time of an operation
+     *
+     * @param operation             Operation
+     * @param maximum               Get the maximum rather than the typical time
+     * @return unsigned long        Operation time (us)
+     */
+    static constexpr unsigned long operation_time(W25Q64FV_operation_t operation, bool maximum) {
+        return operation == W25Q64FV_OPERATION_PAGE_PROGRAM ? (maximum ? W25Q64FV_TIME_PAGE_PROGRAM_MAX : W25Q64FV_TIME_PAGE_PROGRAM_TYP) :
+            operation == W25Q64FV_OPERATION_SECTOR_ERASE ? (maximum ? W25Q64FV_TIME_SECTOR_ERASE_MAX : W25Q64FV_TIME_SECTOR_ERASE_TYP) :
+            operation == W25Q64FV_OPERATION_BLOCK_32K_ERASE ? (maximum ? W25Q64FV_TIME_BLOCK_32K_ERASE_MAX : W25Q64FV_TIME_BLOCK_32K_ERASE_TYP) :
+            operation == W25Q64FV_OPERATION_BLOCK_64K_ERASE ? (maximum ? W25Q64FV_TIME_BLOCK_64K_ERASE_MAX : W25Q64FV_TIME_BLOCK_64K_ERASE_TYP) :
+            // scaled in 64kB units to stay within 32 bits
+            operation == W25Q64FV_OPERATION_CHIP_ERASE ? (maximum ? W25Q64FV_TIME_CHIP_ERASE_MAX : W25Q64FV_TIME_CHIP_ERASE_TYP) / (W25Q64FV_CAPACITY >> 16) * (Capacity >> 16) :
+            operation == W25Q64FV_OPERATION_WRITE_STATUS ? (maximum ? W25Q64FV_TIME_WRITE_STATUS_MAX : W25Q64FV_TIME_WRITE_STATUS_TYP) :
+            operation == W25Q64FV_OPERATION_RESET ? W25Q64FV_TIME_RESET_MAX : 0;
+    }
+
+    /**
+     * @brief Check the part supports a read data path
+     *
+     * @return true                 Every W25Q part supports every data path
+     */
+    static constexpr bool supports(W25Q64FV_io_mode_t) { return true; }
+
+    /**
+     * @brief Check the discovered part matches
+     *
+     * @param parameters            Discovered parameters
+     * @return W25Q64FV_status_t    Status return (not valid if the part differs)
+     */
+    static W25Q64FV_status_t configure(const W25Q64FV_parameters_t &parameters) {
+        if(parameters.capacity != Capacity || parameters.page_size != W25Q64FV_PAGE_SIZE) return W25Q64FV_NOT_VALID;
+        return W25Q64FV_OK;
+    }
+};
+
+/**
+ * @brief Fill in the parameters of a W25Q part of a given density
+ *
+ * Used for parts without an SFDP table and for the fields an older table lacks
+ *
+ * @param parameters            Parameters to fill
+ * @param capacity              Density in bytes
+ * @return (void)
+ */
+inline void W25Q64FV_default_parameters(W25Q64FV_parameters_t *parameters, uint32_t capacity){
+    typedef W25Q64FV_FixedGeometry<W25Q64FV_CAPACITY> Default;
+    parameters->capacity = capacity;
+    parameters->page_size = W25Q64FV_PAGE_SIZE;
+    parameters->address_bytes = capacity > W25Q64FV_3B_ADDRESS_LIMIT ? 4 : 3;
+    parameters->io_modes = 0xFF;
+    parameters->erase_instructions[0] = W25Q64FV_INSTRUCTION_SECTOR_4K_ERASE;
+    parameters->erase_instructions[1] = W25Q64FV_INSTRUCTION_BLOCK_32K_ERASE;
+    parameters->erase_instructions[2] = W25Q64FV_INSTRUCTION_BLOCK_64K_ERASE;
+    for(uint8_t i = 0; i <= W25Q64FV_OPERATION_RESET; i ++){
+        parameters->times[i] = Default::operation_time((W25Q64FV_operation_t)i, false);
+        parameters->max_times[i] = Default::operation_time((W25Q64FV_operation_t)i, true);
+    }
+    parameters->times[W25Q64FV_OPERATION_CHIP_ERASE] = W25Q64FV_TIME_CHIP_ERASE_TYP / (W25Q64FV_CAPACITY >> 16) * (capacity >> 16);
+    parameters->max_times[W25Q64FV_OPERATION_CHIP_ERASE] = W25Q64FV_TIME_CHIP_ERASE_MAX / (W25Q64FV_CAPACITY >> 16) * (capacity >> 16);
+}
+
+/**
+ * @brief Geometry discovered by begin()
+ *
+ * Holds the W25Q64 parameters until configured
+ *
+ */
+class W25Q64FV_SFDPGeometry{
+public:
+    /**
+     * @brief Construct a new geometry
+     */
+    W25Q64FV_SFDPGeometry() { W25Q64FV_default_parameters(&_parameters, W25Q64FV_CAPACITY); }
+
+    /**
+     * @brief Get the density
+     *
+     * @return uint32_t             Density in bytes
+     */
+    uint32_t capacity() const { return _parameters.capacity; }
+
+    /**
+     * @brief Get the address length
+     *
+     * @return uint8_t              Address bytes
+     */
+    uint8_t address_bytes() const { return _parameters.address_bytes; }
+
+    /**
+     * @brief Get the instruction of a sector or block erase
+     *
+     * @param operation             Erase operation
+     * @return uint8_t              Instruction, 0 if not supported
+     */
+    uint8_t erase_instruction(W25Q64FV_operation_t operation) const {
+        if(operation < W25Q64FV_OPERATION_SECTOR_ERASE || operation > W25Q64FV_OPERATION_BLOCK_64K_ERASE) return 0;
+        return _parameters.erase_instructions[operation - W25Q64FV_OPERATION_SECTOR_ERASE];
+    }
+
+    /**
+     * @brief Get the time of an operation
+     *
+     * @param operation             Operation
+     * @param maximum               Get the maximum rather than the typical time
+     * @return unsigned long        Operation time (us)
+     */
+    unsigned long operation_time(W25Q64FV_operation_t operation, bool maximum) const {
+        return maximum ? _parameters.max_times[operation] : _parameters.times[operation];
+    }
+
+    /**
+     * @brief Check the part supports a read data path
+     *
+     * @param mode                  Data path
+     * @return true                 Supported
+     */
+    bool supports(W25Q64FV_io_mode_t mode) const { return _parameters.io_modes & (1 << mode); }
+
+    /**
+     * @brief Take the discovered parameters
+     *
+     * @param parameters            Discovered parameters
+     * @return W25Q64FV_status_t    Status return (not valid if the page size is not supported)
+     */
+    W25Q64FV_status_t configure(const W25Q64FV_parameters_t &parameters) {
+        if(parameters.page_size != W25Q64FV_PAGE_SIZE) return W25Q64FV_NOT_VALID;
+        _parameters = parameters;
+        return W25Q64FV_OK;
+    }
+
+    /**
+     * @brief Get the discovered parameters
+     *
+     * @return const W25Q64FV_parameters_t&     Parameters
+     */
+    const W25Q64FV_parameters_t &parameters() const { return _parameters; }
+
+private:
+    W25Q64FV_parameters_t _parameters;  ///< Part parameters
+};
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file W25Q64FV_Image.cpp
+ * @author Jeremy Dunne
+ * @brief source file for the W25Q64 delta image updates
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <W25Q64FV_Image.hpp>
+#include "W25Q64FV_Image_impl.hpp"
+
+template class W25Q64FV_BasicImage<W25Q64FV>;
+template class W25Q64FV_BasicImage<W25Q128FV>;
+template class W25Q64FV_BasicImage<W25Q256FV>;
+template class W25Q64FV_BasicImage<W25QXX>;
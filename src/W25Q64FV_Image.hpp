@@ -0,0 +1,160 @@
+/**
+ * @file W25Q64FV_Image.hpp
+ * @author Jeremy Dunne
+ * @brief delta image updates for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_IMAGE_HPP_
+#define _W25Q64FV_IMAGE_HPP_
+
+#include "W25Q64FV.hpp"
+
+/// Bytes of buffer needed: one sector being filled and one being flashed
+#define W25Q64FV_IMAGE_BUFFER_SIZE  (2 * W25Q64FV_SECTOR_SIZE)
+
+/// Image Update Statistics
+typedef struct{
+    unsigned long sectors; ///<Sectors of the image
+    unsigned long unchanged; ///<Sectors that already held the data
+    unsigned long programmed; ///<Sectors programmed without an erase
+    unsigned long erased; ///<Sectors erased and programmed
+    unsigned long blocks; ///<64kB blocks erased in one go
+    unsigned long pages; ///<Pages programmed
+} W25Q64FV_image_stats_t;
+
+/**
+ * @brief Delta updater for whole images
+ *
+ * The new image is streamed in with write() in chunks of any size and staged a sector at
+ * a time. Each complete sector is compared against the flash page by page with streaming
+ * reads: sectors that already hold the data are skipped, sectors whose changes only clear
+ * bits are programmed in place, and only the rest are erased. Unchanged pages are never
+ * programmed.
+ *
+ * Changed sectors are counted per 64kB block. Changes come in runs, so when the previous
+ * block needed more sector erases than one block erase takes, a block starting with a
+ * sector to erase is erased whole and its later sectors are programmed without comparing
+ * them. Only blocks inside the image length given to begin() are erased this way.
+ *
+ * The erase of a sector is issued without waiting, and its pages are programmed from
+ * later write() calls once the device is free, so the erase overlaps the transfer of
+ * the next sector. The two staging sectors live in a caller-provided buffer of
+ * W25Q64FV_IMAGE_BUFFER_SIZE bytes. Use the W25Q64FV_Image typedef with the default driver,
+ * other drivers must also include W25Q64FV_Image_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicImage{
+public:
+    /**
+     * @brief Construct a new image updater
+     *
+     * @param flash                 Initialized flash chip to update
+     * @param start_address         Start of the image region, 4kB aligned
+     * @param length                Length of the image region
+     * @param buffer                Staging buffer of W25Q64FV_IMAGE_BUFFER_SIZE bytes
+     */
+    W25Q64FV_BasicImage(Flash &flash, uint32_t start_address, uint32_t length, byte *buffer);
+
+    /**
+     * @brief Start a new image at the start of the region
+     *
+     * The flash past the end of the image is kept only when its length is given
+     *
+     * @param image_length          Length of the new image, 0 for the whole region
+     * @return W25Q64FV_status_t    Status return (not valid if the region is not 4kB aligned)
+     */
+    W25Q64FV_status_t begin(uint32_t image_length = 0);
+
+    /**
+     * @brief Stream the next chunk of the image
+     *
+     * Only waits on the device when both staging sectors are in use
+     *
+     * @param data                  Image data
+     * @param length                Number of bytes
+     * @return W25Q64FV_status_t    Status return (not valid past the end of the region)
+     */
+    W25Q64FV_status_t write(const byte *data, size_t length);
+
+    /**
+     * @brief Flash the last partial sector and wait for the update to complete
+     *
+     * The rest of the last sector keeps its flash contents, unless its block was erased whole
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t finish();
+
+    /**
+     * @brief Get the number of image bytes written so far
+     *
+     * @return uint32_t             Image position
+     */
+    uint32_t position() { return _position; }
+
+    /**
+     * @brief Get the update statistics
+     *
+     * @param stats                 Statistics to fill
+     * @param reset                 Reset the counters after reading
+     * @return (void)
+     */
+    void get_stats(W25Q64FV_image_stats_t *stats, bool reset = false);
+
+private:
+    Flash *_flash;                              ///< Flash chip
+    uint32_t _start_address;                    ///< Start of the region
+    uint32_t _length;                           ///< Length of the region
+    byte *_buffer;                              ///< Two staging sectors
+    uint32_t _position;                         ///< Image bytes written
+    uint8_t _fill;                              ///< Staging sector being filled
+    uint32_t _pending_address;                  ///< Sector being flashed from the other staging sector
+    uint16_t _pending_pages;                    ///< Pages of the pending sector left to program, one bit each
+    uint32_t _image_length;                     ///< Length of the image being written
+    uint8_t _block_changes;                     ///< Sectors of the current 64kB block that needed an erase
+    bool _block_erased;                         ///< The current 64kB block was erased whole
+    W25Q64FV_image_stats_t _stats;              ///< Statistics
+
+    /**
+     * @brief Compare a staged sector and start flashing it
+     *
+     * @param address               Sector address
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t commit(uint32_t address);
+
+    /**
+     * @brief Decide whether to erase a whole 64kB block starting with a sector to erase
+     *
+     * @param address               Block address
+     * @param changes               Sectors of the previous block that needed an erase
+     * @return true                 The block erase is worth it
+     * @return false                Erase the sectors one at a time
+     */
+    bool block_erase(uint32_t address, uint8_t changes);
+
+    /**
+     * @brief Move the pending sector along
+     *
+     * @param hold                  Wait until the pending sector is flashed
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t advance(bool hold);
+};
+
+/// Delta image updater on the default W25Q64 driver
+typedef W25Q64FV_BasicImage<W25Q64FV> W25Q64FV_Image;
+
+extern template class W25Q64FV_BasicImage<W25Q64FV>;
+extern template class W25Q64FV_BasicImage<W25Q128FV>;
+extern template class W25Q64FV_BasicImage<W25Q256FV>;
+extern template class W25Q64FV_BasicImage<W25QXX>;
+
+#endif
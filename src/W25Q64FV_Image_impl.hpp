@@ -0,0 +1,193 @@
+/**
+ * @file W25Q64FV_Image_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 delta image updates
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Image.cpp for the default drivers. Include this after
+ * W25Q64FV_Image.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_IMAGE_IMPL_HPP_
+#define _W25Q64FV_IMAGE_IMPL_HPP_
+
+#include "W25Q64FV_Image.hpp"
+
+template<class Flash>
+W25Q64FV_BasicImage<Flash>::W25Q64FV_BasicImage(Flash &flash, uint32_t start_address, uint32_t length, byte *buffer){
+    _flash = &flash;
+    _start_address = start_address;
+    _length = length;
+    _buffer = buffer;
+    _position = 0;
+    _fill = 0;
+    _pending_address = 0;
+    _pending_pages = 0;
+    _image_length = length;
+    _block_changes = 0;
+    _block_erased = false;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicImage<Flash>::begin(uint32_t image_length){
+    if(_start_address % W25Q64FV_SECTOR_SIZE != 0) return W25Q64FV_NOT_VALID;
+    if(_start_address + _length > _flash->capacity()) return W25Q64FV_NOT_VALID;
+    if(image_length > _length) return W25Q64FV_NOT_VALID;
+    // finish anything left from an abandoned update
+    W25Q64FV_status_t status = advance(true);
+    if(status != W25Q64FV_OK) return status;
+    _position = 0;
+    _image_length = image_length == 0 ? _length : image_length;
+    _block_changes = 0;
+    _block_erased = false;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicImage<Flash>::write(const byte *data, size_t length){
+    if(_position + length > _length) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status = advance(false);
+    if(status != W25Q64FV_OK) return status;
+    while(length > 0){
+        size_t offset = _position % W25Q64FV_SECTOR_SIZE;
+        size_t chunk = W25Q64FV_SECTOR_SIZE - offset;
+        if(chunk > length) chunk = length;
+        memcpy(_buffer + _fill * W25Q64FV_SECTOR_SIZE + offset, data, chunk);
+        _position += chunk;
+        data += chunk;
+        length -= chunk;
+        if(offset + chunk < W25Q64FV_SECTOR_SIZE) break;
+        // the staged sector is complete, the other one must be flashed before it is reused
+        status = advance(true);
+        if(status != W25Q64FV_OK) return status;
+        status = commit(_start_address + _position - W25Q64FV_SECTOR_SIZE);
+        if(status != W25Q64FV_OK) return status;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicImage<Flash>::finish(){
+    W25Q64FV_status_t status = advance(true);
+    if(status != W25Q64FV_OK) return status;
+    size_t offset = _position % W25Q64FV_SECTOR_SIZE;
+    if(offset != 0){
+        // keep the flash contents past the end of the image
+        uint32_t address = _start_address + _position - offset;
+        status = _flash->read(address + offset, _buffer + _fill * W25Q64FV_SECTOR_SIZE + offset, W25Q64FV_SECTOR_SIZE - offset);
+        if(status != W25Q64FV_OK) return status;
+        status = commit(address);
+        if(status != W25Q64FV_OK) return status;
+    }
+    return advance(true);
+}
+
+template<class Flash>
+void W25Q64FV_BasicImage<Flash>::get_stats(W25Q64FV_image_stats_t *stats, bool reset){
+    *stats = _stats;
+    if(reset) memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicImage<Flash>::commit(uint32_t address){
+    W25Q64FV_status_t status;
+    byte *sector = _buffer + _fill * W25Q64FV_SECTOR_SIZE;
+    uint16_t pages = 0;
+    bool erase = false;
+    bool block_start = address % W25Q64FV_BLOCK_64K_SIZE == 0;
+    uint8_t changes = _block_changes;
+    if(block_start){
+        _block_changes = 0;
+        _block_erased = false;
+    }
+    // one page at a time, so the pages that differ are known without reading them again
+    for(uint8_t page = 0; page < W25Q64FV_SECTOR_SIZE / W25Q64FV_PAGE_SIZE && !erase && !_block_erased; page ++){
+        W25Q64FV_compare_t result;
+        status = _flash->compare(address + page * W25Q64FV_PAGE_SIZE, sector + page * W25Q64FV_PAGE_SIZE, W25Q64FV_PAGE_SIZE, &result);
+        if(status != W25Q64FV_OK) return status;
+        if(result == W25Q64FV_COMPARE_ERASE_REQUIRED) erase = true;
+        else if(result == W25Q64FV_COMPARE_PROGRAMMABLE) pages |= 1 << page;
+    }
+    _stats.sectors ++;
+    if(erase || _block_erased){
+        // after the erase only the pages with data need programming
+        pages = 0;
+        for(uint8_t page = 0; page < W25Q64FV_SECTOR_SIZE / W25Q64FV_PAGE_SIZE; page ++){
+            const byte *data = sector + page * W25Q64FV_PAGE_SIZE;
+            for(size_t i = 0; i < W25Q64FV_PAGE_SIZE; i ++){
+                if(data[i] != 0xFF){
+                    pages |= 1 << page;
+                    break;
+                }
+            }
+        }
+        if(_block_erased){
+            // already erased with the rest of its block
+        }
+        else if(block_start && block_erase(address, changes)){
+            // changes come in runs: the previous block needed enough sector erases to pay
+            // for one block erase, so this block takes one, and its later sectors are
+            // programmed without comparing them
+            status = _flash->erase_block_64(address, false);
+            if(status != W25Q64FV_OK) return status;
+            _block_erased = true;
+            _stats.blocks ++;
+        }
+        else{
+            status = _flash->erase_sector(address, false);
+            if(status != W25Q64FV_OK) return status;
+        }
+        _block_changes ++;
+        _stats.erased ++;
+    }
+    else if(pages != 0){
+        _stats.programmed ++;
+    }
+    else{
+        // nothing to flash, the staging sector can be refilled
+        _stats.unchanged ++;
+        return W25Q64FV_OK;
+    }
+    // hand the sector to advance() and fill the other one
+    _pending_address = address;
+    _pending_pages = pages;
+    _fill = 1 - _fill;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+bool W25Q64FV_BasicImage<Flash>::block_erase(uint32_t address, uint8_t changes){
+    // every sector of the block is rewritten from the image, so it must lie inside it
+    if(address + W25Q64FV_BLOCK_64K_SIZE > _start_address + _image_length) return false;
+    if(_flash->next_erase_size(address, W25Q64FV_BLOCK_64K_SIZE) != W25Q64FV_BLOCK_64K_SIZE) return false;
+    // break-even on the driver's typical erase times
+    return changes * _flash->erase_range_time(address, W25Q64FV_SECTOR_SIZE, false) > _flash->erase_range_time(address, W25Q64FV_BLOCK_64K_SIZE, false);
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicImage<Flash>::advance(bool hold){
+    W25Q64FV_status_t status;
+    const byte *sector = _buffer + (1 - _fill) * W25Q64FV_SECTOR_SIZE;
+    while(_pending_pages != 0){
+        if(_flash->busy()){
+            if(!hold) return W25Q64FV_OK;
+            status = _flash->wait_until_free();
+            if(status != W25Q64FV_OK) return status;
+        }
+        uint8_t page = 0;
+        while(!(_pending_pages & (1 << page))) page ++;
+        _pending_pages &= ~(1 << page);
+        status = _flash->write(_pending_address + page * W25Q64FV_PAGE_SIZE, sector + page * W25Q64FV_PAGE_SIZE, W25Q64FV_PAGE_SIZE, false);
+        if(status != W25Q64FV_OK) return status;
+        _stats.pages ++;
+    }
+    if(hold) return _flash->wait_until_free();
+    return W25Q64FV_OK;
+}
+
+#endif
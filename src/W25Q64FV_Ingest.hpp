@@ -0,0 +1,156 @@
+/**
+ * @file W25Q64FV_Ingest.hpp
+ * @author Jeremy Dunne
+ * @brief interrupt-safe ingest pipeline for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_INGEST_HPP_
+#define _W25Q64FV_INGEST_HPP_
+
+#include "W25Q64FV.hpp"
+#include "W25Q64FV_Atomic.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_INGEST_ERASE_AHEAD
+#define W25Q64FV_INGEST_ERASE_AHEAD 2 // Sectors drain() keeps erased from the sector of the write address on
+#endif
+
+/// Ingest Statistics
+typedef struct{
+    unsigned long high_water; ///<Most bytes held in the ring at once
+    unsigned long dropped; ///<Bytes pushed while the ring was full
+    unsigned long pages; ///<Page programs issued
+    unsigned long erases; ///<Sectors erased ahead of the write address
+} W25Q64FV_ingest_stats_t;
+
+/**
+ * @brief Interrupt-safe RAM to flash ingest pipeline
+ *
+ * A single producer, typically an ISR, push()es into a lock-free ring in a caller-provided
+ * buffer. A single consumer calls drain() from the main loop, which never blocks: it
+ * programs a full page straight out of the ring with writev() (two segments across the
+ * wrap) whenever the device is free, so the producer keeps filling the rest of the ring
+ * while that page programs. The ring is the double buffer, no page is copied. Ahead of
+ * the pages, drain() keeps W25Q64FV_INGEST_ERASE_AHEAD sectors erased from the sector of
+ * the write address on, whatever the ring holds. Past the first sectors the ring only
+ * has to absorb one sector erase.
+ *
+ * The ring is shared through W25Q64FV_Atomic.hpp. On cores without atomic
+ * read-modify-write (AVR, Cortex-M0/M0+) push() masks interrupts for a few instructions
+ * instead, and the producer must be an interrupt or the main loop of the same core.
+ *
+ * Backpressure shows up as the high-water mark and the dropped byte count. Use the
+ * W25Q64FV_Ingest typedef with the default driver, other drivers must also include
+ * W25Q64FV_Ingest_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicIngest{
+public:
+    /**
+     * @brief Construct a new ingest pipeline
+     *
+     * @param flash                 Initialized flash chip to write to
+     * @param ring                  Ring buffer
+     * @param ring_size             Size of the ring, a power of two of at least W25Q64FV_PAGE_SIZE,
+     *                              drain() and flush() return not valid otherwise
+     * @param start_address         Start of the region to fill, 4kB aligned
+     * @param length                Length of the region
+     */
+    W25Q64FV_BasicIngest(Flash &flash, byte *ring, size_t ring_size, uint32_t start_address, uint32_t length);
+
+    /**
+     * @brief Push data into the ring
+     *
+     * Safe to call from an interrupt while drain() runs in the main loop, as long as
+     * there is only one producer
+     *
+     * @param data                  Data to push
+     * @param length                Number of bytes
+     * @return size_t               Number of bytes accepted, the rest are dropped
+     */
+    size_t push(const byte *data, size_t length);
+
+    /**
+     * @brief Move data from the ring to the flash
+     *
+     * Issues at most one page program or sector erase and returns without waiting on it
+     *
+     * @return W25Q64FV_status_t    Status return (busy if the next page had to start its own
+     *                              erase, not valid once the region is full)
+     */
+    W25Q64FV_status_t drain();
+
+    /**
+     * @brief Program everything in the ring, including a partial page
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t flush();
+
+    /**
+     * @brief Get the number of bytes waiting in the ring
+     *
+     * @return size_t               Bytes in the ring
+     */
+    size_t level();
+
+    /**
+     * @brief Get the address the next byte will be programmed at
+     *
+     * @return uint32_t             Flash address
+     */
+    uint32_t address() { return _address; }
+
+    /**
+     * @brief Get the pipeline statistics
+     *
+     * @param stats                 Statistics to fill
+     * @param reset                 Reset the counters after reading
+     * @return (void)
+     */
+    void get_stats(W25Q64FV_ingest_stats_t *stats, bool reset = false);
+
+private:
+    Flash *_flash;                              ///< Flash chip
+    byte *_ring;                                ///< Ring buffer
+    size_t _mask;                               ///< Ring size - 1
+    size_t _head;                               ///< Producer index, free running
+    size_t _tail;                               ///< Consumer index, free running
+    uint32_t _address;                          ///< Next flash address to program
+    uint32_t _erased_to;                        ///< End of the erased part of the region
+    uint32_t _end_address;                      ///< End of the region
+    bool _valid;                                ///< Ring and region are usable
+    W25Q64FV_ingest_stats_t _stats;             ///< Statistics
+
+    /**
+     * @brief Program up to one page from the ring
+     *
+     * @param partial               Program a partial page if that is all there is
+     * @return W25Q64FV_status_t    Status return (busy if the page's sector erase was started)
+     */
+    W25Q64FV_status_t program(bool partial);
+
+    /**
+     * @brief Start the erase of the next sector of the region without waiting on it
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t erase_ahead();
+};
+
+/// Ingest pipeline on the default W25Q64 driver
+typedef W25Q64FV_BasicIngest<W25Q64FV> W25Q64FV_Ingest;
+
+extern template class W25Q64FV_BasicIngest<W25Q64FV>;
+extern template class W25Q64FV_BasicIngest<W25Q128FV>;
+extern template class W25Q64FV_BasicIngest<W25Q256FV>;
+extern template class W25Q64FV_BasicIngest<W25QXX>;
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * @file W25Q64FV_Ingest_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 interrupt-safe ingest pipeline
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Ingest.cpp for the default drivers. Include this after
+ * W25Q64FV_Ingest.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_INGEST_IMPL_HPP_
+#define _W25Q64FV_INGEST_IMPL_HPP_
+
+#include "W25Q64FV_Ingest.hpp"
+
+template<class Flash>
+W25Q64FV_BasicIngest<Flash>::W25Q64FV_BasicIngest(Flash &flash, byte *ring, size_t ring_size, uint32_t start_address, uint32_t length){
+    _flash = &flash;
+    _ring = ring;
+    _mask = ring_size - 1;
+    _head = 0;
+    _tail = 0;
+    _address = start_address;
+    _erased_to = start_address;
+    _end_address = start_address + length;
+    // the indices wrap with a mask, and a page must fit in the ring
+    _valid = ring != NULL && ring_size >= W25Q64FV_PAGE_SIZE && (ring_size & (ring_size - 1)) == 0
+        && start_address % W25Q64FV_SECTOR_SIZE == 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+size_t W25Q64FV_BasicIngest<Flash>::push(const byte *data, size_t length){
+    if(!_valid) return 0;
+    // only the producer writes the head, the consumer's tail is loaded with acquire so its
+    // reads of the ring are complete before the space is reused
+    size_t head = W25Q64FV_atomic_load(&_head, __ATOMIC_RELAXED);
+    size_t tail = W25Q64FV_atomic_load(&_tail, __ATOMIC_ACQUIRE);
+    size_t space = _mask + 1 - (head - tail);
+    size_t accepted = length < space ? length : space;
+    if(accepted < length) W25Q64FV_atomic_fetch_add(&_stats.dropped, (unsigned long)(length - accepted), __ATOMIC_RELAXED);
+    // copy in up to two pieces around the wrap
+    size_t index = head & _mask;
+    size_t first = _mask + 1 - index;
+    if(first > accepted) first = accepted;
+    memcpy(_ring + index, data, first);
+    memcpy(_ring, data + first, accepted - first);
+    W25Q64FV_atomic_store(&_head, head + accepted, __ATOMIC_RELEASE);
+    // the consumer may reset the mark at any time, only ever raise it
+    unsigned long used = head + accepted - tail;
+    unsigned long high_water = W25Q64FV_atomic_load(&_stats.high_water, __ATOMIC_RELAXED);
+    while(used > high_water && !W25Q64FV_atomic_compare_exchange(&_stats.high_water, &high_water, used, __ATOMIC_RELAXED));
+    return accepted;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicIngest<Flash>::drain(){
+    if(!_valid) return W25Q64FV_NOT_VALID;
+    // one operation at a time, never wait on the device
+    if(_flash->busy()) return W25Q64FV_OK;
+    // keep the erase ahead whatever the fill level, so a page never waits on its sector
+    uint32_t sector = _address - _address % W25Q64FV_SECTOR_SIZE;
+    if(_erased_to < _end_address && _erased_to < sector + W25Q64FV_INGEST_ERASE_AHEAD * W25Q64FV_SECTOR_SIZE){
+        return erase_ahead();
+    }
+    if(level() >= W25Q64FV_PAGE_SIZE - (_address % W25Q64FV_PAGE_SIZE)) return program(false);
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicIngest<Flash>::flush(){
+    if(!_valid) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status;
+    while(level() > 0){
+        status = _flash->wait_until_free();
+        if(status != W25Q64FV_OK) return status;
+        // busy while the page's sector erases
+        status = program(true);
+        if(status != W25Q64FV_OK && status != W25Q64FV_BUSY) return status;
+    }
+    return _flash->wait_until_free();
+}
+
+template<class Flash>
+size_t W25Q64FV_BasicIngest<Flash>::level(){
+    return W25Q64FV_atomic_load(&_head, __ATOMIC_ACQUIRE) - _tail;
+}
+
+template<class Flash>
+void W25Q64FV_BasicIngest<Flash>::get_stats(W25Q64FV_ingest_stats_t *stats, bool reset){
+    // the producer updates the high-water mark and drops from its interrupt or thread
+    if(reset){
+        stats->high_water = W25Q64FV_atomic_exchange(&_stats.high_water, 0UL, __ATOMIC_RELAXED);
+        stats->dropped = W25Q64FV_atomic_exchange(&_stats.dropped, 0UL, __ATOMIC_RELAXED);
+    }
+    else{
+        stats->high_water = W25Q64FV_atomic_load(&_stats.high_water, __ATOMIC_RELAXED);
+        stats->dropped = W25Q64FV_atomic_load(&_stats.dropped, __ATOMIC_RELAXED);
+    }
+    // the rest belong to the consumer
+    stats->pages = _stats.pages;
+    stats->erases = _stats.erases;
+    if(reset){
+        _stats.pages = 0;
+        _stats.erases = 0;
+    }
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicIngest<Flash>::program(bool partial){
+    W25Q64FV_status_t status;
+    size_t chunk = W25Q64FV_PAGE_SIZE - (_address % W25Q64FV_PAGE_SIZE);
+    size_t available = level();
+    if(available < chunk){
+        if(!partial || available == 0) return W25Q64FV_OK;
+        chunk = available;
+    }
+    if(_address + chunk > _end_address) return W25Q64FV_NOT_VALID;
+    // the erase ahead fell behind, start the page's erase rather than wait on it
+    if(_address + chunk > _erased_to){
+        status = erase_ahead();
+        if(status != W25Q64FV_OK) return status;
+        return W25Q64FV_BUSY;
+    }
+    // program straight out of the ring, in two segments across the wrap
+    size_t index = _tail & _mask;
+    size_t first = _mask + 1 - index;
+    if(first > chunk) first = chunk;
+    W25Q64FV_iovec_t segments[2] = {
+        {_ring + index, first},
+        {_ring, chunk - first}
+    };
+    status = _flash->writev(_address, segments, 2, false);
+    if(status != W25Q64FV_OK) return status;
+    // hand the space back to the producer once the data is on the bus
+    W25Q64FV_atomic_store(&_tail, _tail + chunk, __ATOMIC_RELEASE);
+    _address += chunk;
+    _stats.pages ++;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicIngest<Flash>::erase_ahead(){
+    W25Q64FV_status_t status = _flash->erase_sector(_erased_to, false);
+    if(status != W25Q64FV_OK) return status;
+    _erased_to += W25Q64FV_SECTOR_SIZE;
+    _stats.erases ++;
+    return W25Q64FV_OK;
+}
+
+#endif
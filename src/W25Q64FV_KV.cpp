@@ -0,0 +1,18 @@
+/**
+ * @file W25Q64FV_KV.cpp
+ * @author Jeremy Dunne
+ * @brief source file for the W25Q64 key-value store
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <W25Q64FV_KV.hpp>
+#include "W25Q64FV_KV_impl.hpp"
+
+template class W25Q64FV_BasicKV<W25Q64FV>;
+template class W25Q64FV_BasicKV<W25Q128FV>;
+template class W25Q64FV_BasicKV<W25Q256FV>;
+template class W25Q64FV_BasicKV<W25QXX>;
@@ -0,0 +1,272 @@
+/**
+ * @file W25Q64FV_KV.hpp
+ * @author Jeremy Dunne
+ * @brief key-value store for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_KV_HPP_
+#define _W25Q64FV_KV_HPP_
+
+#include "W25Q64FV.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_KV_MAX_KEY
+#define W25Q64FV_KV_MAX_KEY         32 // Longest key in bytes
+#endif
+#ifndef W25Q64FV_KV_FREE_TARGET
+#define W25Q64FV_KV_FREE_TARGET     3 // Erased sectors service() keeps by compacting ahead of time
+#endif
+
+#define W25Q64FV_KV_MAGIC           0x53564B57 // "WKVS"
+#define W25Q64FV_KV_HEADER_SIZE     8 // Sector header: magic and sequence number
+#define W25Q64FV_KV_RECORD_HEADER   4 // Record header: key length, flags, value length
+#define W25Q64FV_KV_MAX_VALUE       (W25Q64FV_SECTOR_SIZE - W25Q64FV_KV_HEADER_SIZE - W25Q64FV_KV_RECORD_HEADER - W25Q64FV_KV_MAX_KEY)
+
+// Record flags, cleared bits mark the record
+#define W25Q64FV_KV_FLAG_UNCOMMITTED 0x80 // Cleared once the record is fully programmed
+#define W25Q64FV_KV_FLAG_VALUE      0x40 // Cleared for a removal
+
+// Index entries: top 9 bits of the key hash and the 23 bit offset of the record in the region
+#define W25Q64FV_KV_INDEX_EMPTY     0xFFFFFFFF
+#define W25Q64FV_KV_INDEX_REMOVED   0xFFFFFFFE
+#define W25Q64FV_KV_INDEX_TAG       0xFF800000
+
+/**
+ * @brief Key-value store on the W25Q64FV
+ *
+ * Puts and removals are appended as records to a ring of 4kB sectors. A record is
+ * committed by clearing its flag bit once fully programmed, so a put cut short by
+ * power loss is ignored at mount and the previous value stays. A RAM hash index in a
+ * caller-provided table maps each key to its latest record, and is rebuilt at mount()
+ * by one pass over the records from the oldest sector to the newest. get() and put()
+ * take a fixed number of flash operations.
+ *
+ * When few erased sectors remain, the oldest sector is compacted: its live records
+ * are copied to the head and it is erased. service() does this ahead of time with a
+ * background erase, otherwise put() compacts when it needs a new sector. Use the
+ * W25Q64FV_KV typedef with the default driver, other drivers must also include
+ * W25Q64FV_KV_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicKV{
+public:
+    /**
+     * @brief Construct a new key-value store
+     *
+     * @param flash                 Initialized flash chip to store to
+     * @param start_address         Start of the region, 4kB aligned
+     * @param length                Length of the region, a multiple of 4kB and at least 3 sectors
+     * @param index                 Hash index table of slots entries
+     * @param slots                 Number of index entries, more than the number of keys
+     */
+    W25Q64FV_BasicKV(Flash &flash, uint32_t start_address, uint32_t length, uint32_t *index, unsigned int slots);
+
+    /**
+     * @brief Rebuild the index from the records
+     *
+     * Formats the region if it holds no store
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t mount();
+
+    /**
+     * @brief Erase the region and start an empty store
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t format();
+
+    /**
+     * @brief Get the value of a key
+     *
+     * @param key                   Key string
+     * @param value                 Buffer to read the value into
+     * @param max_length            Size of the buffer, longer values are truncated
+     * @param length                Length of the value
+     * @return W25Q64FV_status_t    Status return (not found if the key is not stored, not valid
+     *                              if the key is empty or too long)
+     */
+    W25Q64FV_status_t get(const char *key, byte *value, size_t max_length, size_t *length);
+
+    /**
+     * @brief Store a value for a key
+     *
+     * @param key                   Key string, 1 to W25Q64FV_KV_MAX_KEY bytes
+     * @param value                 Value data
+     * @param length                Length of the value
+     * @return W25Q64FV_status_t    Status return (not valid if the store or index is full)
+     */
+    W25Q64FV_status_t put(const char *key, const byte *value, size_t length);
+
+    /**
+     * @brief Remove a key
+     *
+     * @param key                   Key string
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t remove(const char *key);
+
+    /**
+     * @brief Advance background work
+     *
+     * Call from the main loop. Compacts the oldest sector and starts its erase without
+     * waiting once few erased sectors remain.
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t service();
+
+    /**
+     * @brief Get the number of stored keys
+     *
+     * @return unsigned int         Number of keys
+     */
+    unsigned int count() { return _count; }
+
+private:
+    /// Sector header
+    typedef struct{
+        uint32_t magic;             ///< W25Q64FV_KV_MAGIC
+        uint32_t sequence;          ///< Sector sequence number
+    } header_t;
+
+    /// Record header
+    typedef struct{
+        uint8_t key_length;         ///< Key length, 0xFF past the last record
+        uint8_t flags;              ///< W25Q64FV_KV_FLAG_* bits
+        uint16_t value_length;      ///< Value length
+    } record_t;
+
+    Flash *_flash;                              ///< Flash chip
+    uint32_t _start_address;                    ///< Start of the region
+    uint32_t _sector_count;                     ///< Sectors in the region
+    uint32_t *_index;                           ///< Hash index table
+    unsigned int _slots;                        ///< Hash index entries
+    unsigned int _count;                        ///< Stored keys
+    uint32_t _head_sector;                      ///< Sector being appended to
+    uint32_t _head_offset;                      ///< Offset of the next record in the head sector
+    uint32_t _head_sequence;                    ///< Sequence number of the head sector
+    uint32_t _tail_sector;                      ///< Oldest sector
+    uint32_t _erased;                           ///< Erased sectors after the head
+    bool _erase_in_progress;                    ///< Background erase running on the sector after the erased ones
+    bool _stalled;                              ///< Last compaction freed no sector
+    byte _page[W25Q64FV_PAGE_SIZE];             ///< Buffer for record copies
+
+    /**
+     * @brief Get the address of a sector of the region
+     *
+     * @param sector                Sector index
+     * @return uint32_t             Flash address
+     */
+    uint32_t sector_address(uint32_t sector) { return _start_address + sector * W25Q64FV_SECTOR_SIZE; }
+
+    /**
+     * @brief Hash a key
+     *
+     * @param key                   Key string
+     * @param length                Key length
+     * @return uint32_t             FNV-1a hash
+     */
+    static uint32_t hash(const char *key, size_t length);
+
+    /**
+     * @brief Find a key in the index
+     *
+     * Entries with a matching tag are confirmed against the key in flash
+     *
+     * @param key                   Key string
+     * @param length                Key length
+     * @param key_hash              Hash of the key
+     * @param found                 Slot holding the key, or -1
+     * @param empty                 First slot the key could be inserted in, or -1
+     * @param record                Header of the record found
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t lookup(const char *key, size_t length, uint32_t key_hash, int *found, int *empty, record_t *record);
+
+    /**
+     * @brief Point the index at a record, or remove the key
+     *
+     * @param key                   Key string
+     * @param length                Key length
+     * @param offset                Offset of the record in the region
+     * @param removal               Remove the key instead
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t index_record(const char *key, size_t length, uint32_t offset, bool removal);
+
+    /**
+     * @brief Read a record header and its key
+     *
+     * @param offset                Offset of the record in the region
+     * @param record                Record header
+     * @param key                   Buffer of W25Q64FV_KV_MAX_KEY bytes for the key
+     * @param valid                 Set if the header is well formed
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t read_record(uint32_t offset, record_t *record, char *key, bool *valid);
+
+    /**
+     * @brief Append a record at the head and commit it
+     *
+     * @param key                   Key string
+     * @param length                Key length
+     * @param value                 Value data, or NULL to copy from source
+     * @param value_length          Value length
+     * @param flags                 Record flags without the commit bit cleared
+     * @param source                Flash address to copy the value from if value is NULL
+     * @param offset                Offset of the new record in the region
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t append(const char *key, size_t length, const byte *value, size_t value_length, uint8_t flags, uint32_t source, uint32_t *offset);
+
+    /**
+     * @brief Make room for a record at the head
+     *
+     * Moves to the next sector, compacting old sectors to keep one erased for compaction
+     *
+     * @param size                  Size of the record
+     * @return W25Q64FV_status_t    Status return (not valid if the store is full)
+     */
+    W25Q64FV_status_t reserve(size_t size);
+
+    /**
+     * @brief Start using the next erased sector as the head
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t open_sector();
+
+    /**
+     * @brief Copy the live records of the oldest sector to the head and erase it
+     *
+     * @param hold                  Wait for the erase
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t compact(bool hold);
+
+    /**
+     * @brief Wait for the background erase to finish
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t finish_erase();
+};
+
+/// Key-value store on the default W25Q64 driver
+typedef W25Q64FV_BasicKV<W25Q64FV> W25Q64FV_KV;
+
+extern template class W25Q64FV_BasicKV<W25Q64FV>;
+extern template class W25Q64FV_BasicKV<W25Q128FV>;
+extern template class W25Q64FV_BasicKV<W25Q256FV>;
+extern template class W25Q64FV_BasicKV<W25QXX>;
+
+#endif
@@ -0,0 +1,437 @@
+/**
+ * @file W25Q64FV_KV_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 key-value store
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_KV.cpp for the default drivers. Include this after
+ * W25Q64FV_KV.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_KV_IMPL_HPP_
+#define _W25Q64FV_KV_IMPL_HPP_
+
+#include "W25Q64FV_KV.hpp"
+
+template<class Flash>
+W25Q64FV_BasicKV<Flash>::W25Q64FV_BasicKV(Flash &flash, uint32_t start_address, uint32_t length, uint32_t *index, unsigned int slots){
+    _flash = &flash;
+    _start_address = start_address;
+    _sector_count = length / W25Q64FV_SECTOR_SIZE;
+    _index = index;
+    _slots = slots;
+    _count = 0;
+    _head_sector = 0;
+    _head_offset = W25Q64FV_SECTOR_SIZE;
+    _head_sequence = 0;
+    _tail_sector = 0;
+    _erased = 0;
+    _erase_in_progress = false;
+    _stalled = false;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::mount(){
+    if(_start_address % W25Q64FV_SECTOR_SIZE != 0) return W25Q64FV_NOT_VALID;
+    if(_sector_count < 3 || _slots == 0) return W25Q64FV_NOT_VALID;
+    if(_start_address + _sector_count * W25Q64FV_SECTOR_SIZE > _flash->capacity()) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    // an erase issued before a reset may still be running somewhere in the region
+    status = _flash->wait_until_free();
+    if(status != W25Q64FV_OK) return status;
+    // the head holds the highest sequence number
+    header_t header;
+    bool found = false;
+    for(uint32_t i = 0; i < _sector_count; i ++){
+        status = _flash->suspend_read(sector_address(i), (byte*)&header, sizeof(header));
+        if(status != W25Q64FV_OK) return status;
+        if(header.magic != W25Q64FV_KV_MAGIC) continue;
+        if(!found || header.sequence > _head_sequence){
+            found = true;
+            _head_sector = i;
+            _head_sequence = header.sequence;
+        }
+    }
+    if(!found) return format();
+    // the tail is the oldest of the sectors with contiguous sequence numbers before the head
+    _tail_sector = _head_sector;
+    for(uint32_t i = 1; i < _sector_count; i ++){
+        uint32_t sector = (_head_sector + _sector_count - i) % _sector_count;
+        status = _flash->suspend_read(sector_address(sector), (byte*)&header, sizeof(header));
+        if(status != W25Q64FV_OK) return status;
+        if(header.magic != W25Q64FV_KV_MAGIC || header.sequence != _head_sequence - i) break;
+        _tail_sector = sector;
+    }
+    // everything between the head and the tail is erased, finishing interrupted erases
+    _erased = (_tail_sector + _sector_count - _head_sector - 1) % _sector_count;
+    if(_tail_sector == _head_sector) _erased = _sector_count - 1;
+    for(uint32_t i = 1; i <= _erased; i ++){
+        uint32_t sector = (_head_sector + i) % _sector_count;
+        bool blank;
+        status = _flash->is_blank(sector_address(sector), W25Q64FV_SECTOR_SIZE, &blank);
+        if(status != W25Q64FV_OK) return status;
+        if(blank) continue;
+        status = _flash->erase_sector(sector_address(sector), true);
+        if(status != W25Q64FV_OK) return status;
+    }
+    // one pass over the records from the oldest sector to the newest
+    for(unsigned int i = 0; i < _slots; i ++) _index[i] = W25Q64FV_KV_INDEX_EMPTY;
+    _count = 0;
+    uint32_t sector = _tail_sector;
+    while(true){
+        uint32_t offset = W25Q64FV_KV_HEADER_SIZE;
+        while(offset + W25Q64FV_KV_RECORD_HEADER <= W25Q64FV_SECTOR_SIZE){
+            record_t record;
+            char key[W25Q64FV_KV_MAX_KEY];
+            bool valid;
+            uint32_t position = sector * W25Q64FV_SECTOR_SIZE + offset;
+            status = read_record(position, &record, key, &valid);
+            if(status != W25Q64FV_OK) return status;
+            if(record.key_length == 0xFF) break;
+            if(!valid){
+                // torn record header, nothing more is appended to this sector
+                offset = W25Q64FV_SECTOR_SIZE;
+                break;
+            }
+            // uncommitted records were cut short by power loss
+            if(!(record.flags & W25Q64FV_KV_FLAG_UNCOMMITTED)){
+                status = index_record(key, record.key_length, position, !(record.flags & W25Q64FV_KV_FLAG_VALUE));
+                if(status != W25Q64FV_OK) return status;
+            }
+            offset += W25Q64FV_KV_RECORD_HEADER + record.key_length + record.value_length;
+        }
+        if(sector == _head_sector){
+            _head_offset = offset;
+            break;
+        }
+        sector = (sector + 1) % _sector_count;
+    }
+    _stalled = false;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::format(){
+    if(_start_address % W25Q64FV_SECTOR_SIZE != 0) return W25Q64FV_NOT_VALID;
+    if(_sector_count < 3 || _slots == 0) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    status = _flash->erase_range(_start_address, _sector_count * W25Q64FV_SECTOR_SIZE);
+    if(status != W25Q64FV_OK) return status;
+    for(unsigned int i = 0; i < _slots; i ++) _index[i] = W25Q64FV_KV_INDEX_EMPTY;
+    _count = 0;
+    // open the first sector as the head
+    _head_sector = _sector_count - 1;
+    _head_sequence = 0;
+    _tail_sector = 0;
+    _erased = _sector_count;
+    _stalled = false;
+    return open_sector();
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::get(const char *key, byte *value, size_t max_length, size_t *length){
+    size_t key_length = strlen(key);
+    if(key_length == 0 || key_length > W25Q64FV_KV_MAX_KEY) return W25Q64FV_NOT_VALID;
+    int found, empty;
+    record_t record;
+    W25Q64FV_status_t status = lookup(key, key_length, hash(key, key_length), &found, &empty, &record);
+    if(status != W25Q64FV_OK) return status;
+    if(found < 0) return W25Q64FV_NOT_FOUND;
+    *length = record.value_length;
+    if(max_length > record.value_length) max_length = record.value_length;
+    uint32_t offset = _index[found] & ~W25Q64FV_KV_INDEX_TAG;
+    return _flash->suspend_read(_start_address + offset + W25Q64FV_KV_RECORD_HEADER + key_length, value, max_length);
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::put(const char *key, const byte *value, size_t length){
+    size_t key_length = strlen(key);
+    if(key_length == 0 || key_length > W25Q64FV_KV_MAX_KEY) return W25Q64FV_NOT_VALID;
+    if(length > W25Q64FV_KV_MAX_VALUE) return W25Q64FV_NOT_VALID;
+    uint32_t key_hash = hash(key, key_length);
+    int found, empty;
+    record_t record;
+    W25Q64FV_status_t status = lookup(key, key_length, key_hash, &found, &empty, &record);
+    if(status != W25Q64FV_OK) return status;
+    if(found < 0 && empty < 0) return W25Q64FV_NOT_VALID;
+    status = reserve(W25Q64FV_KV_RECORD_HEADER + key_length + length);
+    if(status != W25Q64FV_OK) return status;
+    uint32_t offset;
+    status = append(key, key_length, value, length, 0xFF, 0, &offset);
+    if(status != W25Q64FV_OK) return status;
+    // compaction only moves existing entries, the slots found are still in place
+    if(found >= 0){
+        _index[found] = (key_hash & W25Q64FV_KV_INDEX_TAG) | offset;
+    }
+    else{
+        _index[empty] = (key_hash & W25Q64FV_KV_INDEX_TAG) | offset;
+        _count ++;
+    }
+    _stalled = false;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::remove(const char *key){
+    size_t key_length = strlen(key);
+    if(key_length == 0 || key_length > W25Q64FV_KV_MAX_KEY) return W25Q64FV_NOT_VALID;
+    int found, empty;
+    record_t record;
+    W25Q64FV_status_t status = lookup(key, key_length, hash(key, key_length), &found, &empty, &record);
+    if(status != W25Q64FV_OK) return status;
+    if(found < 0) return W25Q64FV_OK;
+    // a removal record hides the older values at mount
+    status = reserve(W25Q64FV_KV_RECORD_HEADER + key_length);
+    if(status != W25Q64FV_OK) return status;
+    uint32_t offset;
+    status = append(key, key_length, NULL, 0, (uint8_t)~W25Q64FV_KV_FLAG_VALUE, 0, &offset);
+    if(status != W25Q64FV_OK) return status;
+    _index[found] = W25Q64FV_KV_INDEX_REMOVED;
+    _count --;
+    _stalled = false;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::service(){
+    W25Q64FV_status_t status;
+    if(_erase_in_progress){
+        if(_flash->busy()) return W25Q64FV_OK;
+        status = finish_erase();
+        if(status != W25Q64FV_OK) return status;
+    }
+    // compacting again frees nothing until more records are superseded
+    if(_erased >= W25Q64FV_KV_FREE_TARGET || _stalled) return W25Q64FV_OK;
+    if(_flash->busy()) return W25Q64FV_OK;
+    return compact(false);
+}
+
+template<class Flash>
+uint32_t W25Q64FV_BasicKV<Flash>::hash(const char *key, size_t length){
+    uint32_t value = 2166136261UL;
+    for(size_t i = 0; i < length; i ++){
+        value ^= (uint8_t)key[i];
+        value *= 16777619UL;
+    }
+    return value;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::lookup(const char *key, size_t length, uint32_t key_hash, int *found, int *empty, record_t *record){
+    *found = -1;
+    *empty = -1;
+    uint32_t tag = key_hash & W25Q64FV_KV_INDEX_TAG;
+    unsigned int slot = key_hash % _slots;
+    // linear probing, the chain ends at an empty entry
+    for(unsigned int i = 0; i < _slots; i ++){
+        uint32_t entry = _index[slot];
+        if(entry == W25Q64FV_KV_INDEX_EMPTY){
+            if(*empty < 0) *empty = slot;
+            return W25Q64FV_OK;
+        }
+        if(entry == W25Q64FV_KV_INDEX_REMOVED){
+            if(*empty < 0) *empty = slot;
+        }
+        else if((entry & W25Q64FV_KV_INDEX_TAG) == tag){
+            char stored[W25Q64FV_KV_MAX_KEY];
+            bool valid;
+            W25Q64FV_status_t status = read_record(entry & ~W25Q64FV_KV_INDEX_TAG, record, stored, &valid);
+            if(status != W25Q64FV_OK) return status;
+            if(valid && record->key_length == length && memcmp(stored, key, length) == 0){
+                *found = slot;
+                return W25Q64FV_OK;
+            }
+        }
+        slot ++;
+        if(slot == _slots) slot = 0;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::index_record(const char *key, size_t length, uint32_t offset, bool removal){
+    uint32_t key_hash = hash(key, length);
+    int found, empty;
+    record_t record;
+    W25Q64FV_status_t status = lookup(key, length, key_hash, &found, &empty, &record);
+    if(status != W25Q64FV_OK) return status;
+    if(removal){
+        if(found >= 0){
+            _index[found] = W25Q64FV_KV_INDEX_REMOVED;
+            _count --;
+        }
+        return W25Q64FV_OK;
+    }
+    if(found >= 0){
+        _index[found] = (key_hash & W25Q64FV_KV_INDEX_TAG) | offset;
+        return W25Q64FV_OK;
+    }
+    if(empty < 0) return W25Q64FV_NOT_VALID;
+    _index[empty] = (key_hash & W25Q64FV_KV_INDEX_TAG) | offset;
+    _count ++;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::read_record(uint32_t offset, record_t *record, char *key, bool *valid){
+    // header and key in one read, not past the end of the sector
+    byte buffer[W25Q64FV_KV_RECORD_HEADER + W25Q64FV_KV_MAX_KEY];
+    uint32_t position = offset % W25Q64FV_SECTOR_SIZE;
+    size_t length = sizeof(buffer);
+    if(position + length > W25Q64FV_SECTOR_SIZE) length = W25Q64FV_SECTOR_SIZE - position;
+    W25Q64FV_status_t status = _flash->suspend_read(_start_address + offset, buffer, length);
+    if(status != W25Q64FV_OK) return status;
+    memcpy(record, buffer, sizeof(record_t));
+    *valid = record->key_length > 0 && record->key_length <= W25Q64FV_KV_MAX_KEY &&
+        position + W25Q64FV_KV_RECORD_HEADER + record->key_length + record->value_length <= W25Q64FV_SECTOR_SIZE;
+    if(*valid) memcpy(key, buffer + W25Q64FV_KV_RECORD_HEADER, record->key_length);
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::append(const char *key, size_t length, const byte *value, size_t value_length, uint8_t flags, uint32_t source, uint32_t *offset){
+    W25Q64FV_status_t status;
+    uint32_t address = sector_address(_head_sector) + _head_offset;
+    size_t size = W25Q64FV_KV_RECORD_HEADER + length + value_length;
+    record_t record;
+    record.key_length = length;
+    record.flags = flags;
+    record.value_length = value_length;
+    if(size <= W25Q64FV_PAGE_SIZE){
+        // small records are programmed in one go
+        memcpy(_page, &record, sizeof(record));
+        memcpy(_page + W25Q64FV_KV_RECORD_HEADER, key, length);
+        if(value != NULL){
+            memcpy(_page + W25Q64FV_KV_RECORD_HEADER + length, value, value_length);
+        }
+        else if(value_length > 0){
+            status = _flash->suspend_read(source, _page + W25Q64FV_KV_RECORD_HEADER + length, value_length);
+            if(status != W25Q64FV_OK) return status;
+        }
+        status = _flash->suspend_write(address, _page, size);
+        if(status != W25Q64FV_OK) return status;
+    }
+    else{
+        memcpy(_page, &record, sizeof(record));
+        memcpy(_page + W25Q64FV_KV_RECORD_HEADER, key, length);
+        status = _flash->suspend_write(address, _page, W25Q64FV_KV_RECORD_HEADER + length);
+        if(status != W25Q64FV_OK) return status;
+        uint32_t destination = address + W25Q64FV_KV_RECORD_HEADER + length;
+        if(value != NULL){
+            status = _flash->suspend_write(destination, value, value_length);
+            if(status != W25Q64FV_OK) return status;
+        }
+        else{
+            // copy through the page buffer
+            for(size_t i = 0; i < value_length; i += W25Q64FV_PAGE_SIZE){
+                size_t chunk = value_length - i;
+                if(chunk > W25Q64FV_PAGE_SIZE) chunk = W25Q64FV_PAGE_SIZE;
+                status = _flash->suspend_read(source + i, _page, chunk);
+                if(status != W25Q64FV_OK) return status;
+                status = _flash->suspend_write(destination + i, _page, chunk);
+                if(status != W25Q64FV_OK) return status;
+            }
+        }
+    }
+    // commit once the whole record is programmed
+    uint8_t commit = flags & ~W25Q64FV_KV_FLAG_UNCOMMITTED;
+    status = _flash->suspend_write(address + 1, &commit, 1);
+    if(status != W25Q64FV_OK) return status;
+    *offset = address - _start_address;
+    _head_offset += size;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::reserve(size_t size){
+    if(_head_offset + size <= W25Q64FV_SECTOR_SIZE) return W25Q64FV_OK;
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    // keep an erased sector spare for compaction to copy into
+    for(uint32_t i = 0; i < _sector_count && _erased < 2; i ++){
+        status = compact(true);
+        if(status != W25Q64FV_OK) return status;
+    }
+    if(_erased < 2) return W25Q64FV_NOT_VALID;
+    return open_sector();
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::open_sector(){
+    if(_erased == 0) return W25Q64FV_NOT_VALID;
+    _head_sector = (_head_sector + 1) % _sector_count;
+    _head_sequence ++;
+    _erased --;
+    header_t header;
+    header.magic = W25Q64FV_KV_MAGIC;
+    header.sequence = _head_sequence;
+    W25Q64FV_status_t status = _flash->suspend_write(sector_address(_head_sector), (const byte*)&header, sizeof(header));
+    if(status != W25Q64FV_OK) return status;
+    _head_offset = W25Q64FV_KV_HEADER_SIZE;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::compact(bool hold){
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    if(_tail_sector == _head_sector) return W25Q64FV_OK;
+    if(_erased == 0) return W25Q64FV_NOT_VALID;
+    uint32_t sector = _tail_sector;
+    uint32_t offset = W25Q64FV_KV_HEADER_SIZE;
+    while(offset + W25Q64FV_KV_RECORD_HEADER <= W25Q64FV_SECTOR_SIZE){
+        record_t record;
+        char key[W25Q64FV_KV_MAX_KEY];
+        bool valid;
+        uint32_t position = sector * W25Q64FV_SECTOR_SIZE + offset;
+        status = read_record(position, &record, key, &valid);
+        if(status != W25Q64FV_OK) return status;
+        if(record.key_length == 0xFF || !valid) break;
+        size_t size = W25Q64FV_KV_RECORD_HEADER + record.key_length + record.value_length;
+        offset += size;
+        // removals in the oldest sector hide nothing older, only live values are kept
+        if(record.flags & (W25Q64FV_KV_FLAG_UNCOMMITTED)) continue;
+        if(!(record.flags & W25Q64FV_KV_FLAG_VALUE)) continue;
+        int found, empty;
+        record_t current;
+        status = lookup(key, record.key_length, hash(key, record.key_length), &found, &empty, &current);
+        if(status != W25Q64FV_OK) return status;
+        if(found < 0 || (_index[found] & ~W25Q64FV_KV_INDEX_TAG) != position) continue;
+        if(_head_offset + size > W25Q64FV_SECTOR_SIZE){
+            // the live records of one sector always fit in the head and one erased sector
+            status = open_sector();
+            if(status != W25Q64FV_OK) return status;
+            _stalled = true;
+        }
+        uint32_t moved;
+        uint32_t value = _start_address + position + W25Q64FV_KV_RECORD_HEADER + record.key_length;
+        status = append(key, record.key_length, NULL, record.value_length, record.flags | W25Q64FV_KV_FLAG_UNCOMMITTED, value, &moved);
+        if(status != W25Q64FV_OK) return status;
+        _index[found] = (_index[found] & W25Q64FV_KV_INDEX_TAG) | moved;
+    }
+    // every live record has a newer copy, the sector can go
+    _tail_sector = (sector + 1) % _sector_count;
+    status = _flash->erase_sector(sector_address(sector), false);
+    if(status != W25Q64FV_OK) return status;
+    _erase_in_progress = true;
+    if(hold) return finish_erase();
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicKV<Flash>::finish_erase(){
+    if(!_erase_in_progress) return W25Q64FV_OK;
+    W25Q64FV_status_t status = _flash->wait_until_free();
+    if(status != W25Q64FV_OK) return status;
+    _erase_in_progress = false;
+    _erased ++;
+    return W25Q64FV_OK;
+}
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * @file W25Q64FV_Log.hpp
+ * @author Jeremy Dunne
+ * @brief append-only log for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_LOG_HPP_
+#define _W25Q64FV_LOG_HPP_
+
+#include "W25Q64FV.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_LOG_ERASE_AHEAD
+#define W25Q64FV_LOG_ERASE_AHEAD    2 // Sectors kept erased ahead of the write head
+#endif
+
+#define W25Q64FV_LOG_MAGIC          0x474F4C57 // "WLOG"
+#define W25Q64FV_LOG_HEADER_SIZE    8 // Sector header: magic and sequence number
+#define W25Q64FV_LOG_RECORD_HEADER  2 // Record header: length
+#define W25Q64FV_LOG_MAX_RECORD     (W25Q64FV_SECTOR_SIZE - W25Q64FV_LOG_HEADER_SIZE - W25Q64FV_LOG_RECORD_HEADER)
+
+/**
+ * @brief Append-only circular log on the W25Q64FV
+ *
+ * Each 4kB sector of the region starts with a header holding a sequence number that
+ * increases by one per sector. Variable length records are packed after it, across
+ * page boundaries, and never span sectors. Appends are staged in a page buffer and
+ * programmed a page at a time.
+ *
+ * mount() finds the write head with a binary search over the sector headers. service()
+ * keeps W25Q64FV_LOG_ERASE_AHEAD sectors erased ahead of the head in the background,
+ * dropping the oldest sectors once the region is full. A page program that lands
+ * during a background erase suspends the erase rather than waiting for it. Use the
+ * W25Q64FV_Log typedef with the default driver, other drivers must also include
+ * W25Q64FV_Log_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicLog{
+public:
+    /**
+     * @brief Construct a new log
+     *
+     * @param flash                 Initialized flash chip to log to
+     * @param start_address         Start of the log region, 4kB aligned
+     * @param length                Length of the log region, a multiple of 4kB
+     */
+    W25Q64FV_BasicLog(Flash &flash, uint32_t start_address, uint32_t length);
+
+    /**
+     * @brief Find the head and tail of the log
+     *
+     * Formats the region if it holds no log
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t mount();
+
+    /**
+     * @brief Erase the region and start an empty log
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t format();
+
+    /**
+     * @brief Append a record
+     *
+     * The record is staged in the page buffer and programmed once its page fills, or
+     * on sync()
+     *
+     * @param buffer                Record data
+     * @param length                Record length, 1 to W25Q64FV_LOG_MAX_RECORD bytes
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t append(const byte *buffer, size_t length);
+
+    /**
+     * @brief Program any staged records
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t sync();
+
+    /**
+     * @brief Advance background work
+     *
+     * Call from the main loop. Never waits on the device; starts the next erase ahead
+     * of the head once the device is free.
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t service();
+
+    /**
+     * @brief Move the read cursor to the oldest record
+     *
+     * @return (void)
+     */
+    void rewind();
+
+    /**
+     * @brief Move the read cursor to the first record of a sector
+     *
+     * Records never span sectors, so every sector starts on a record
+     *
+     * @param index                 Sector, counted from the oldest (0 to used_sectors() - 1)
+     * @return W25Q64FV_status_t    Status return (not valid past the head)
+     */
+    W25Q64FV_status_t seek_sector(uint32_t index);
+
+    /**
+     * @brief Read the record at the read cursor and advance
+     *
+     * Records still staged in the page buffer are not visible until programmed
+     *
+     * @param buffer                Buffer to read the record into
+     * @param max_length            Size of the buffer, longer records are truncated
+     * @param length                Length of the record, 0 at the end of the log
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t read_next(byte *buffer, size_t max_length, size_t *length);
+
+    /**
+     * @brief Get the address of the next record to be appended
+     *
+     * @return uint32_t             Flash address of the write head
+     */
+    uint32_t head_address() { return sector_address(_head_sector) + _head_offset; }
+
+    /**
+     * @brief Get the number of sectors holding records
+     *
+     * @return uint32_t             Number of sectors from the tail to the head
+     */
+    uint32_t used_sectors() { return (_head_sector + _sector_count - _tail_sector) % _sector_count + 1; }
+
+private:
+    /// Sector header
+    typedef struct{
+        uint32_t magic;             ///< W25Q64FV_LOG_MAGIC
+        uint32_t sequence;          ///< Sector sequence number
+    } header_t;
+
+    Flash *_flash;                              ///< Flash chip
+    uint32_t _start_address;                    ///< Start of the log region
+    uint32_t _sector_count;                     ///< Sectors in the log region
+    uint32_t _head_sector;                      ///< Sector being appended to
+    uint32_t _head_offset;                      ///< Offset of the next record in the head sector
+    uint32_t _head_sequence;                    ///< Sequence number of the head sector
+    uint32_t _tail_sector;                      ///< Sector holding the oldest records
+    uint32_t _erased_ahead;                     ///< Erased sectors after the head
+    bool _erase_in_progress;                    ///< Background erase running on the next sector to erase
+    byte _page[W25Q64FV_PAGE_SIZE];             ///< Page buffer
+    uint32_t _page_address;                     ///< Flash address of the page buffer
+    uint32_t _page_start;                       ///< Offset of the first staged byte
+    uint32_t _page_end;                         ///< Offset after the last staged byte
+    uint32_t _read_sector;                      ///< Read cursor sector
+    uint32_t _read_offset;                      ///< Read cursor offset
+    uint32_t _read_sequence;                    ///< Sequence number of the read cursor sector
+
+    /**
+     * @brief Get the address of a sector of the region
+     *
+     * @param sector                Sector index
+     * @return uint32_t             Flash address
+     */
+    uint32_t sector_address(uint32_t sector) { return _start_address + sector * W25Q64FV_SECTOR_SIZE; }
+
+    /**
+     * @brief Read a sector header
+     *
+     * @param sector                Sector index
+     * @param sequence              Sequence number of the sector
+     * @param valid                 Set if the sector holds a header
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t read_header(uint32_t sector, uint32_t *sequence, bool *valid);
+
+    /**
+     * @brief Program the staged bytes of the page buffer
+     *
+     * Suspends a background erase rather than waiting for it
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t flush_page();
+
+    /**
+     * @brief Stage bytes at the write head
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t stage(const byte *buffer, size_t length);
+
+    /**
+     * @brief Move the write head to the next sector
+     *
+     * Erases the sector first if the background erase has not reached it
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t advance_sector();
+
+    /**
+     * @brief Wait for the background erase to finish
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t finish_erase();
+
+    /**
+     * @brief Start using a sector as the write head
+     *
+     * @param sector                Erased sector index
+     * @param sequence              Sequence number of the sector
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t open_sector(uint32_t sector, uint32_t sequence);
+
+    /**
+     * @brief Drop the oldest sector ahead of erasing it
+     *
+     * @param sector                Sector index about to be erased
+     * @return (void)
+     */
+    void drop_sector(uint32_t sector);
+};
+
+/// Log on the default W25Q64 driver
+typedef W25Q64FV_BasicLog<W25Q64FV> W25Q64FV_Log;
+
+extern template class W25Q64FV_BasicLog<W25Q64FV>;
+extern template class W25Q64FV_BasicLog<W25Q128FV>;
+extern template class W25Q64FV_BasicLog<W25Q256FV>;
+extern template class W25Q64FV_BasicLog<W25QXX>;
+
+#endif
@@ -0,0 +1,330 @@
+/**
+ * @file W25Q64FV_Log_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 append-only log
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Log.cpp for the default drivers. Include this after
+ * W25Q64FV_Log.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_LOG_IMPL_HPP_
+#define _W25Q64FV_LOG_IMPL_HPP_
+
+#include "W25Q64FV_Log.hpp"
+
+template<class Flash>
+W25Q64FV_BasicLog<Flash>::W25Q64FV_BasicLog(Flash &flash, uint32_t start_address, uint32_t length){
+    _flash = &flash;
+    _start_address = start_address;
+    _sector_count = length / W25Q64FV_SECTOR_SIZE;
+    _head_sector = 0;
+    _head_offset = 0;
+    _head_sequence = 0;
+    _tail_sector = 0;
+    _erased_ahead = 0;
+    _erase_in_progress = false;
+    _page_address = 0;
+    _page_start = 0;
+    _page_end = 0;
+    _read_sector = 0;
+    _read_offset = W25Q64FV_LOG_HEADER_SIZE;
+    _read_sequence = 0;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::mount(){
+    // the region must hold the head, the erased sectors ahead of it, and the tail
+    if(_start_address % W25Q64FV_SECTOR_SIZE != 0) return W25Q64FV_NOT_VALID;
+    if(_sector_count < W25Q64FV_LOG_ERASE_AHEAD + 2) return W25Q64FV_NOT_VALID;
+    if(_start_address + _sector_count * W25Q64FV_SECTOR_SIZE > _flash->capacity()) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    // an erase issued before a reset may still be running somewhere in the region
+    status = _flash->wait_until_free();
+    if(status != W25Q64FV_OK) return status;
+    _page_start = _page_end = 0;
+    // the erased run ahead of the head is at most the erase-ahead sectors, a torn erase,
+    // and a head whose header was never programmed, so a header is found right after it
+    uint32_t first = _sector_count;
+    uint32_t first_sequence = 0;
+    uint32_t sequence;
+    bool valid;
+    uint32_t limit = W25Q64FV_LOG_ERASE_AHEAD + 3;
+    if(limit > _sector_count) limit = _sector_count;
+    for(uint32_t i = 0; i < limit; i ++){
+        status = read_header(i, &first_sequence, &valid);
+        if(status != W25Q64FV_OK) return status;
+        if(valid){
+            first = i;
+            break;
+        }
+    }
+    if(first == _sector_count) return format();
+    // sequence numbers climb by one from the first header up to the head, binary search the end
+    uint32_t low = first;
+    uint32_t high = _sector_count - 1;
+    while(low < high){
+        uint32_t mid = low + (high - low + 1) / 2;
+        status = read_header(mid, &sequence, &valid);
+        if(status != W25Q64FV_OK) return status;
+        if(valid && sequence - first_sequence == mid - first) low = mid;
+        else high = mid - 1;
+    }
+    _head_sector = low;
+    _head_sequence = first_sequence + (low - first);
+    // the tail follows the erased run, which wraps past the end of the region if first > 0
+    _tail_sector = first;
+    if(first == 0){
+        for(uint32_t i = 1; i <= limit && _head_sector + i < _sector_count; i ++){
+            status = read_header(_head_sector + i, &sequence, &valid);
+            if(status != W25Q64FV_OK) return status;
+            if(valid){
+                _tail_sector = _head_sector + i;
+                break;
+            }
+        }
+    }
+    // count the sectors already erased ahead of the head
+    _erased_ahead = 0;
+    while(_erased_ahead < W25Q64FV_LOG_ERASE_AHEAD){
+        uint32_t sector = (_head_sector + _erased_ahead + 1) % _sector_count;
+        if(sector == _tail_sector) break;
+        bool blank;
+        status = _flash->is_blank(sector_address(sector), W25Q64FV_SECTOR_SIZE, &blank);
+        if(status != W25Q64FV_OK) return status;
+        if(!blank) break;
+        _erased_ahead ++;
+    }
+    // walk the records of the head sector to find the write offset
+    _head_offset = W25Q64FV_LOG_HEADER_SIZE;
+    while(_head_offset + W25Q64FV_LOG_RECORD_HEADER <= W25Q64FV_SECTOR_SIZE){
+        uint16_t record;
+        status = _flash->read(sector_address(_head_sector) + _head_offset, (byte*)&record, sizeof(record));
+        if(status != W25Q64FV_OK) return status;
+        if(record == 0xFFFF) break;
+        if(record == 0 || _head_offset + W25Q64FV_LOG_RECORD_HEADER + record > W25Q64FV_SECTOR_SIZE){
+            // torn record, start the next append in a fresh sector
+            _head_offset = W25Q64FV_SECTOR_SIZE;
+            break;
+        }
+        _head_offset += W25Q64FV_LOG_RECORD_HEADER + record;
+    }
+    rewind();
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::format(){
+    if(_start_address % W25Q64FV_SECTOR_SIZE != 0) return W25Q64FV_NOT_VALID;
+    if(_sector_count < W25Q64FV_LOG_ERASE_AHEAD + 2) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status = finish_erase();
+    if(status != W25Q64FV_OK) return status;
+    status = _flash->erase_range(_start_address, _sector_count * W25Q64FV_SECTOR_SIZE);
+    if(status != W25Q64FV_OK) return status;
+    _page_start = _page_end = 0;
+    _tail_sector = 0;
+    _erased_ahead = W25Q64FV_LOG_ERASE_AHEAD;
+    status = open_sector(0, 0);
+    if(status != W25Q64FV_OK) return status;
+    rewind();
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::append(const byte *buffer, size_t length){
+    if(length == 0 || length > W25Q64FV_LOG_MAX_RECORD) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status;
+    // records never span sectors
+    if(_head_offset + W25Q64FV_LOG_RECORD_HEADER + length > W25Q64FV_SECTOR_SIZE){
+        status = advance_sector();
+        if(status != W25Q64FV_OK) return status;
+    }
+    uint16_t record = length;
+    status = stage((const byte*)&record, sizeof(record));
+    if(status != W25Q64FV_OK) return status;
+    return stage(buffer, length);
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::sync(){
+    return flush_page();
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::service(){
+    W25Q64FV_status_t status;
+    if(_erase_in_progress){
+        if(_flash->busy()) return W25Q64FV_OK;
+        _erase_in_progress = false;
+        _erased_ahead ++;
+    }
+    if(_erased_ahead >= W25Q64FV_LOG_ERASE_AHEAD) return W25Q64FV_OK;
+    if(_flash->busy()) return W25Q64FV_OK;
+    // start erasing the next sector ahead of the head, dropping it if it is the oldest
+    uint32_t sector = (_head_sector + _erased_ahead + 1) % _sector_count;
+    drop_sector(sector);
+    status = _flash->erase_sector(sector_address(sector), false);
+    if(status != W25Q64FV_OK) return status;
+    _erase_in_progress = true;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+void W25Q64FV_BasicLog<Flash>::rewind(){
+    // the tail sequence follows from the head, the tail header may not be programmed yet
+    _read_sector = _tail_sector;
+    _read_sequence = _head_sequence - (used_sectors() - 1);
+    _read_offset = W25Q64FV_LOG_HEADER_SIZE;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::seek_sector(uint32_t index){
+    if(index >= used_sectors()) return W25Q64FV_NOT_VALID;
+    rewind();
+    _read_sector = (_tail_sector + index) % _sector_count;
+    _read_sequence += index;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::read_next(byte *buffer, size_t max_length, size_t *length){
+    W25Q64FV_status_t status;
+    *length = 0;
+    while(true){
+        // records in the head sector are visible once programmed
+        uint32_t end = W25Q64FV_SECTOR_SIZE;
+        if(_read_sector == _head_sector) end = _head_offset - (_page_end - _page_start);
+        uint16_t record = 0xFFFF;
+        if(_read_offset + W25Q64FV_LOG_RECORD_HEADER <= end){
+            status = _flash->suspend_read(sector_address(_read_sector) + _read_offset, (byte*)&record, sizeof(record));
+            if(status != W25Q64FV_OK) return status;
+        }
+        if(record != 0xFFFF && record != 0 && _read_offset + W25Q64FV_LOG_RECORD_HEADER + record <= end){
+            size_t chunk = record;
+            if(chunk > max_length) chunk = max_length;
+            status = _flash->suspend_read(sector_address(_read_sector) + _read_offset + W25Q64FV_LOG_RECORD_HEADER, buffer, chunk);
+            if(status != W25Q64FV_OK) return status;
+            _read_offset += W25Q64FV_LOG_RECORD_HEADER + record;
+            *length = record;
+            return W25Q64FV_OK;
+        }
+        // end of the sector, stop at the head
+        if(_read_sector == _head_sector) return W25Q64FV_OK;
+        uint32_t next = (_read_sector + 1) % _sector_count;
+        uint32_t sequence;
+        bool valid;
+        status = read_header(next, &sequence, &valid);
+        if(status != W25Q64FV_OK) return status;
+        if(!valid || sequence != _read_sequence + 1) return W25Q64FV_OK;
+        _read_sector = next;
+        _read_sequence = sequence;
+        _read_offset = W25Q64FV_LOG_HEADER_SIZE;
+    }
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::read_header(uint32_t sector, uint32_t *sequence, bool *valid){
+    header_t header;
+    W25Q64FV_status_t status = _flash->suspend_read(sector_address(sector), (byte*)&header, sizeof(header));
+    if(status != W25Q64FV_OK) return status;
+    *valid = (header.magic == W25Q64FV_LOG_MAGIC);
+    *sequence = header.sequence;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::flush_page(){
+    if(_page_start == _page_end) return W25Q64FV_OK;
+    // program into a suspended erase rather than wait out the rest of it
+    W25Q64FV_status_t status = _flash->suspend_write(_page_address + _page_start, _page + _page_start, _page_end - _page_start);
+    if(status != W25Q64FV_OK) return status;
+    _page_start = _page_end;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::stage(const byte *buffer, size_t length){
+    W25Q64FV_status_t status;
+    while(length > 0){
+        uint32_t address = head_address();
+        // restart the buffer at the head once empty
+        if(_page_start == _page_end){
+            _page_address = address - (address % W25Q64FV_PAGE_SIZE);
+            _page_start = _page_end = address - _page_address;
+        }
+        size_t chunk = W25Q64FV_PAGE_SIZE - _page_end;
+        if(chunk > length) chunk = length;
+        memcpy(_page + _page_end, buffer, chunk);
+        _page_end += chunk;
+        _head_offset += chunk;
+        buffer += chunk;
+        length -= chunk;
+        if(_page_end == W25Q64FV_PAGE_SIZE){
+            status = flush_page();
+            if(status != W25Q64FV_OK) return status;
+        }
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::advance_sector(){
+    W25Q64FV_status_t status = flush_page();
+    if(status != W25Q64FV_OK) return status;
+    uint32_t sector = (_head_sector + 1) % _sector_count;
+    if(_erased_ahead == 0){
+        // the background erase is on the next sector if running
+        status = finish_erase();
+        if(status != W25Q64FV_OK) return status;
+    }
+    if(_erased_ahead == 0){
+        // appending faster than service() erases ahead
+        drop_sector(sector);
+        status = _flash->erase_sector(sector_address(sector), true);
+        if(status != W25Q64FV_OK) return status;
+    }
+    else{
+        _erased_ahead --;
+    }
+    return open_sector(sector, _head_sequence + 1);
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::finish_erase(){
+    if(!_erase_in_progress) return W25Q64FV_OK;
+    W25Q64FV_status_t status = _flash->wait_until_free();
+    if(status != W25Q64FV_OK) return status;
+    _erase_in_progress = false;
+    _erased_ahead ++;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicLog<Flash>::open_sector(uint32_t sector, uint32_t sequence){
+    _head_sector = sector;
+    _head_sequence = sequence;
+    _head_offset = 0;
+    header_t header;
+    header.magic = W25Q64FV_LOG_MAGIC;
+    header.sequence = sequence;
+    return stage((const byte*)&header, sizeof(header));
+}
+
+template<class Flash>
+void W25Q64FV_BasicLog<Flash>::drop_sector(uint32_t sector){
+    if(sector != _tail_sector) return;
+    _tail_sector = (sector + 1) % _sector_count;
+    // move a reader off the dropped sector
+    if(_read_sector == sector){
+        _read_sector = _tail_sector;
+        _read_sequence ++;
+        _read_offset = W25Q64FV_LOG_HEADER_SIZE;
+    }
+}
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * @file W25Q64FV_Reader.hpp
+ * @author Jeremy Dunne
+ * @brief read-ahead cursor for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_READER_HPP_
+#define _W25Q64FV_READER_HPP_
+
+#include "W25Q64FV.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_READER_MAX_GAP
+#define W25Q64FV_READER_MAX_GAP     8 // Widest gap between strided records still read as one stream, about the cost of a read header
+#endif
+
+/// Reader Statistics
+typedef struct{
+    unsigned long hits; ///<Accesses served entirely from the windows
+    unsigned long misses; ///<Accesses that had to wait for a flash read
+    unsigned long prefetches; ///<Windows read ahead of the consumer
+    unsigned long transactions; ///<Flash reads issued
+    unsigned long bytes; ///<Bytes read from the flash
+} W25Q64FV_reader_stats_t;
+
+/**
+ * @brief Read-ahead cursor over the flash address space
+ *
+ * Serves small reads out of two windows held in a caller-provided buffer, each filled
+ * by one long fast read. Sequential access (each read starting where the last ended)
+ * and fixed-stride access with gaps of up to W25Q64FV_READER_MAX_GAP bytes are read as
+ * a stream: the window the consumer will need next is read ahead into the other half
+ * of the buffer. Wider strides and unpatterned access read only the bytes asked for.
+ * With asynchronous prefetch the read ahead goes through start_read(), so on a
+ * transport with DMA it overlaps the consumer's processing of the current window, and
+ * the next record of a wide stride is read ahead too.
+ *
+ * The windows are not updated by writes: call invalidate() after modifying the flash.
+ * While an asynchronous prefetch is in flight the bus belongs to the reader; call
+ * release() before using the flash elsewhere. A miss while a prefetch is in flight
+ * waits for the bus but keeps the prefetched window, reading into the other one. Use the W25Q64FV_Reader typedef
+ * with the default driver, other drivers must also include W25Q64FV_Reader_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicReader{
+public:
+    /**
+     * @brief Construct a new reader
+     *
+     * @param flash                 Initialized flash chip to read
+     * @param buffer                Buffer for the two windows
+     * @param buffer_size           Size of the buffer, each window is half of it
+     * @param asynchronous          Prefetch with start_read() rather than read()
+     */
+    W25Q64FV_BasicReader(Flash &flash, byte *buffer, size_t buffer_size, bool asynchronous = false);
+
+    /**
+     * @brief Read at the cursor and advance it
+     *
+     * @param buffer                Buffer of data to read into
+     * @param length                Number of bytes to read
+     * @return W25Q64FV_status_t    Status return (not valid past the end of the flash)
+     */
+    W25Q64FV_status_t read(byte *buffer, size_t length);
+
+    /**
+     * @brief Read at an address without moving the cursor
+     *
+     * @param start_address         Start address to read from
+     * @param buffer                Buffer of data to read into
+     * @param length                Number of bytes to read
+     * @return W25Q64FV_status_t    Status return (not valid past the end of the flash)
+     */
+    W25Q64FV_status_t read(uint32_t start_address, byte *buffer, size_t length);
+
+    /**
+     * @brief Read a single byte
+     *
+     * @param address               Address to read
+     * @return byte                 Byte at the address, 0xFF if it could not be read
+     */
+    byte operator[](uint32_t address);
+
+    /**
+     * @brief Move the cursor
+     *
+     * @param address               New cursor address
+     * @return (void)
+     */
+    void seek(uint32_t address) { _position = address; }
+
+    /**
+     * @brief Get the cursor
+     *
+     * @return uint32_t             Cursor address
+     */
+    uint32_t tell() { return _position; }
+
+    /**
+     * @brief Drop the windows after the flash was modified
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t invalidate();
+
+    /**
+     * @brief Complete any prefetch in flight so the flash may be used elsewhere
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t release();
+
+    /**
+     * @brief Get the reader statistics
+     *
+     * @param stats                 Statistics to fill
+     * @param reset                 Reset the counters after reading
+     * @return (void)
+     */
+    void get_stats(W25Q64FV_reader_stats_t *stats, bool reset = false);
+
+private:
+    /// Buffered window of the flash
+    typedef struct{
+        uint32_t address;                   ///< Flash address of the first byte
+        size_t length;                      ///< Bytes held, 0 if empty
+        bool filling;                       ///< Asynchronous read in progress
+    } window_t;
+
+    Flash *_flash;                          ///< Flash chip
+    byte *_buffer;                          ///< Window storage
+    size_t _window_size;                    ///< Bytes per window
+    bool _asynchronous;                     ///< Prefetch with start_read()
+    window_t _windows[2];                   ///< Windows, in the two halves of the buffer
+    int _recent;                            ///< Window of the last access
+    uint32_t _position;                     ///< Cursor
+    uint32_t _last_address;                 ///< Start of the last access
+    uint32_t _last_end;                     ///< End of the last access
+    int32_t _stride;                        ///< Distance between the last two accesses
+    W25Q64FV_reader_stats_t _stats;         ///< Statistics
+
+    /**
+     * @brief Serve an access and read ahead of it
+     *
+     * @param start_address         Start address to read from
+     * @param buffer                Buffer of data to read into
+     * @param length                Number of bytes to read
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t access(uint32_t start_address, byte *buffer, size_t length);
+
+    /**
+     * @brief Fill a window
+     *
+     * Settles the window first if it is being filled. The other window must not be, there
+     * is one read on the bus at a time.
+     *
+     * @param index                 Window to fill
+     * @param address               Flash address of the window
+     * @param length                Bytes to read, clamped to the window and the flash
+     * @param prefetch              Read ahead of the consumer, asynchronously if enabled
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t fill(int index, uint32_t address, size_t length, bool prefetch);
+
+    /**
+     * @brief Wait for a window being filled asynchronously
+     *
+     * @param index                 Window to wait on
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t settle(int index);
+
+    /**
+     * @brief Find the window holding an address
+     *
+     * @param address               Flash address
+     * @return int                  Window index, -1 if none
+     */
+    int find(uint32_t address);
+};
+
+/// Read-ahead cursor on the default W25Q64 driver
+typedef W25Q64FV_BasicReader<W25Q64FV> W25Q64FV_Reader;
+
+extern template class W25Q64FV_BasicReader<W25Q64FV>;
+extern template class W25Q64FV_BasicReader<W25Q128FV>;
+extern template class W25Q64FV_BasicReader<W25Q256FV>;
+extern template class W25Q64FV_BasicReader<W25QXX>;
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * @file W25Q64FV_Reader_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 read-ahead cursor
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Reader.cpp for the default drivers. Include this after
+ * W25Q64FV_Reader.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_READER_IMPL_HPP_
+#define _W25Q64FV_READER_IMPL_HPP_
+
+#include "W25Q64FV_Reader.hpp"
+
+template<class Flash>
+W25Q64FV_BasicReader<Flash>::W25Q64FV_BasicReader(Flash &flash, byte *buffer, size_t buffer_size, bool asynchronous){
+    _flash = &flash;
+    _buffer = buffer;
+    _window_size = buffer_size / 2;
+    _asynchronous = asynchronous;
+    memset(_windows, 0, sizeof(_windows));
+    _recent = 1;
+    _position = 0;
+    // no access yet, so nothing looks sequential
+    _last_address = 0xFFFFFFFF;
+    _last_end = 0xFFFFFFFF;
+    _stride = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicReader<Flash>::read(byte *buffer, size_t length){
+    W25Q64FV_status_t status = access(_position, buffer, length);
+    if(status != W25Q64FV_OK) return status;
+    _position += length;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicReader<Flash>::read(uint32_t start_address, byte *buffer, size_t length){
+    return access(start_address, buffer, length);
+}
+
+template<class Flash>
+byte W25Q64FV_BasicReader<Flash>::operator[](uint32_t address){
+    byte value;
+    if(access(address, &value, 1) != W25Q64FV_OK) return 0xFF;
+    return value;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicReader<Flash>::invalidate(){
+    W25Q64FV_status_t status = release();
+    _windows[0].length = 0;
+    _windows[1].length = 0;
+    return status;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicReader<Flash>::release(){
+    W25Q64FV_status_t status = settle(0);
+    if(status != W25Q64FV_OK) return status;
+    return settle(1);
+}
+
+template<class Flash>
+void W25Q64FV_BasicReader<Flash>::get_stats(W25Q64FV_reader_stats_t *stats, bool reset){
+    memcpy(stats, &_stats, sizeof(_stats));
+    if(reset) memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicReader<Flash>::access(uint32_t start_address, byte *buffer, size_t length){
+    if(start_address + length > _flash->capacity()) return W25Q64FV_NOT_VALID;
+    if(length == 0) return W25Q64FV_OK;
+    W25Q64FV_status_t status;
+    // classify the access against the last one, narrow strides are streamed through
+    bool sequential = (start_address == _last_end);
+    int32_t delta = (int32_t)(start_address - _last_address);
+    bool strided = !sequential && delta > 0 && delta == _stride;
+    bool stream = sequential || (strided && delta - (int32_t)length <= W25Q64FV_READER_MAX_GAP);
+    _stride = delta;
+    _last_address = start_address;
+    _last_end = start_address + length;
+    // copy out of the windows, filling them on a miss
+    bool hit = true;
+    size_t done = 0;
+    int index = _recent;
+    while(done < length){
+        uint32_t address = start_address + done;
+        index = find(address);
+        if(index < 0){
+            hit = false;
+            if(!stream){
+                // off the stream only the bytes asked for are read, straight into the
+                // caller's buffer, so both windows are kept for when the stream comes back
+                status = release();
+                if(status != W25Q64FV_OK) return status;
+                status = _flash->read(address, buffer + done, length - done);
+                if(status != W25Q64FV_OK) return status;
+                _stats.transactions ++;
+                _stats.bytes += length - done;
+                done = length;
+                index = _recent;
+                break;
+            }
+            index = 1 - _recent;
+            status = fill(index, address, _window_size, false);
+            if(status != W25Q64FV_OK) return status;
+        }
+        else{
+            status = settle(index);
+            if(status != W25Q64FV_OK) return status;
+        }
+        window_t *window = &_windows[index];
+        size_t offset = address - window->address;
+        size_t count = window->length - offset;
+        if(count > length - done) count = length - done;
+        memcpy(buffer + done, _buffer + index * _window_size + offset, count);
+        done += count;
+        _recent = index;
+    }
+    if(hit) _stats.hits ++;
+    else _stats.misses ++;
+    // read ahead: the window following this one for a stream, the next record of a
+    // wide stride when it can overlap the consumer
+    uint32_t next;
+    size_t next_length = _window_size;
+    if(stream){
+        next = _windows[index].address + _windows[index].length;
+    }
+    else if(strided && _asynchronous){
+        next = start_address + _stride;
+        next_length = length;
+    }
+    else return W25Q64FV_OK;
+    if(next >= _flash->capacity() || find(next) >= 0) return W25Q64FV_OK;
+    status = fill(1 - index, next, next_length, true);
+    // the flash is held elsewhere, skip the read ahead
+    if(status == W25Q64FV_BUSY) return W25Q64FV_OK;
+    return status;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicReader<Flash>::fill(int index, uint32_t address, size_t length, bool prefetch){
+    // one read on the bus at a time, and only the window being overwritten can hold it
+    W25Q64FV_status_t status = settle(index);
+    if(status != W25Q64FV_OK) return status;
+    if(length > _window_size) length = _window_size;
+    if(address + length > _flash->capacity()) length = _flash->capacity() - address;
+    window_t *window = &_windows[index];
+    window->address = address;
+    window->length = 0;
+    byte *target = _buffer + index * _window_size;
+    if(prefetch && _asynchronous){
+        status = _flash->start_read(address, target, length);
+        if(status != W25Q64FV_OK) return status;
+        window->filling = true;
+    }
+    else{
+        status = _flash->read(address, target, length);
+        if(status != W25Q64FV_OK) return status;
+    }
+    window->length = length;
+    _stats.transactions ++;
+    _stats.bytes += length;
+    if(prefetch) _stats.prefetches ++;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicReader<Flash>::settle(int index){
+    window_t *window = &_windows[index];
+    if(!window->filling) return W25Q64FV_OK;
+    window->filling = false;
+    W25Q64FV_status_t status = _flash->finish_read(true);
+    if(status != W25Q64FV_OK) window->length = 0;
+    return status;
+}
+
+template<class Flash>
+int W25Q64FV_BasicReader<Flash>::find(uint32_t address){
+    for(int i = 0; i < 2; i ++){
+        const window_t *window = &_windows[i];
+        if(window->length != 0 && address >= window->address && address - window->address < window->length) return i;
+    }
+    return -1;
+}
+
+#endif
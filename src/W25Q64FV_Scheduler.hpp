@@ -0,0 +1,320 @@
+/**
+ * @file W25Q64FV_Scheduler.hpp
+ * @author Jeremy Dunne
+ * @brief prioritized request queue for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_SCHEDULER_HPP_
+#define _W25Q64FV_SCHEDULER_HPP_
+
+#include "W25Q64FV_Async.hpp"
+#include "W25Q64FV_Atomic.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_SCHEDULER_QUEUE_DEPTH
+#define W25Q64FV_SCHEDULER_QUEUE_DEPTH  16 // Maximum number of pending requests
+#endif
+#ifndef W25Q64FV_SCHEDULER_PRIORITIES
+#define W25Q64FV_SCHEDULER_PRIORITIES   4 // Number of priority levels, 0 is the most urgent
+#endif
+#ifndef W25Q64FV_SCHEDULER_STARVATION_MS
+#define W25Q64FV_SCHEDULER_STARVATION_MS    500 // Requests waiting longer are served oldest first, whatever their priority
+#endif
+#define W25Q64FV_SCHEDULER_MAX_MERGE    8 // Most requests served by one read or one page program
+
+/// Scheduled Request Enum
+typedef enum{
+    W25Q64FV_SCHEDULER_READ = 0, ///<Read of any length
+    W25Q64FV_SCHEDULER_PROGRAM, ///<Program of any length
+    W25Q64FV_SCHEDULER_ERASE_SECTOR, ///<4kB sector erase
+    W25Q64FV_SCHEDULER_ERASE_BLOCK_64 ///<64kB block erase
+} W25Q64FV_scheduler_op_t;
+
+/// Scheduler Statistics
+typedef struct{
+    unsigned long served[W25Q64FV_SCHEDULER_PRIORITIES]; ///<Requests completed, by priority
+    unsigned long max_latency[W25Q64FV_SCHEDULER_PRIORITIES]; ///<Longest time from submission to completion (us), by priority
+    unsigned long merged_reads; ///<Reads served under another read's chip select
+    unsigned long merged_programs; ///<Programs sharing a page program with another request
+    unsigned long suspends; ///<Erases suspended to serve a more urgent read
+    unsigned long aged; ///<Requests that waited past the starvation bound
+} W25Q64FV_scheduler_stats_t;
+
+/**
+ * @brief Prioritized request queue in front of a shared W25Q64FV
+ *
+ * Subsystems sharing one chip submit requests at their own priority and get a handle
+ * back, with the same completion callback as W25Q64FV_Async. poll() must be called from
+ * the main loop; it never waits on the device. Once every access goes through the
+ * scheduler, nobody sees W25Q64FV_BUSY.
+ *
+ * The most urgent request is served first, oldest first within a priority. A request
+ * waiting longer than W25Q64FV_SCHEDULER_STARVATION_MS is served ahead of every priority.
+ * Programs are issued a page at a time, so a read waits for at most one page program,
+ * and a read more urgent than a running erase suspends it. Requests never pass an
+ * earlier request they overlap when either one writes.
+ *
+ * Reads of adjacent ranges are served by one streaming read, and programs that continue
+ * one another within a page share one page program. Buffers must remain valid until
+ * the request completes.
+ *
+ * Requests may be submitted from several threads or interrupts at once: each producer
+ * claims a free slot with a compare-and-swap and publishes it once filled, without a
+ * lock. On cores without atomic read-modify-write (AVR, Cortex-M0/M0+) W25Q64FV_Atomic.hpp
+ * masks interrupts around the claim and the counters instead, so producers must be
+ * interrupts or the main loop of that one core. Overlapping requests keep their order
+ * only when one was submitted before the other. poll(), pending(), and get_stats() belong to one consumer, which also runs the
+ * callbacks. A suspend for an urgent read is issued on one poll and the read served on a
+ * later one, so poll() never waits out the suspend time. A program or erase that outlasts
+ * its maximum time fails every request the device holds with a timeout. Use the
+ * W25Q64FV_Scheduler typedef with the default driver, other drivers must also include
+ * W25Q64FV_Scheduler_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicScheduler{
+public:
+    /**
+     * @brief Construct a new scheduler
+     *
+     * @param flash                 Initialized flash chip to operate on
+     */
+    W25Q64FV_BasicScheduler(Flash &flash);
+
+    /**
+     * @brief Queue a read
+     *
+     * @param start_address         Start address to read from
+     * @param buffer                Buffer of data to read into
+     * @param length                Number of bytes to read
+     * @param priority              Priority, 0 is the most urgent
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Request handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int read(uint32_t start_address, byte *buffer, size_t length, uint8_t priority, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Queue a program of any length
+     *
+     * The target area must already be erased
+     *
+     * @param start_address         Start address to write to
+     * @param buffer                Buffer of data to write
+     * @param length                Number of bytes to write
+     * @param priority              Priority, 0 is the most urgent
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Request handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int program(uint32_t start_address, const byte *buffer, size_t length, uint8_t priority, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Queue a 4kB sector erase
+     *
+     * @param sector_address        Sector start address to erase
+     * @param priority              Priority, 0 is the most urgent
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Request handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int erase_sector(uint32_t sector_address, uint8_t priority, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Queue a 64kB block erase
+     *
+     * @param block_address         Block start address to erase
+     * @param priority              Priority, 0 is the most urgent
+     * @param callback              Optional completion callback
+     * @param context               Context passed to the callback
+     * @return int                  Request handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int erase_block_64(uint32_t block_address, uint8_t priority, W25Q64FV_async_callback_t callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Advance the queued requests
+     *
+     * Never blocks on the device. Completes the requests the device has finished, serves
+     * ready reads, and issues the next page program or erase.
+     *
+     * @return W25Q64FV_status_t    Status return (busy while requests remain)
+     */
+    W25Q64FV_status_t poll();
+
+    /**
+     * @brief Check if a request is still pending
+     *
+     * @param handle                Request handle
+     * @return true                 Request is queued or running
+     * @return false                Request has completed
+     */
+    bool pending(int handle);
+
+    /**
+     * @brief Check if the scheduler has no pending requests
+     *
+     * @return true                 Queue is empty
+     */
+    bool idle() { return count() == 0; }
+
+    /**
+     * @brief Get the number of pending requests
+     *
+     * @return unsigned int         Number of queued or running requests
+     */
+    unsigned int count() { return W25Q64FV_atomic_load(&_count, __ATOMIC_RELAXED); }
+
+    /**
+     * @brief Get the scheduler statistics
+     *
+     * @param stats                 Statistics to fill
+     * @param reset                 Reset the counters after reading
+     * @return (void)
+     */
+    void get_stats(W25Q64FV_scheduler_stats_t *stats, bool reset = false);
+
+private:
+    /// Request slot states, a producer owns a claimed slot and poll() a ready one
+    enum{
+        SLOT_FREE = 0,
+        SLOT_CLAIMED,
+        SLOT_READY
+    };
+
+    /// Queued request
+    typedef struct{
+        W25Q64FV_scheduler_op_t op;         ///< Request type
+        uint8_t priority;                   ///< Priority, 0 is the most urgent
+        uint8_t state;                      ///< Slot state, changed atomically
+        bool issued;                        ///< Every byte is with the device, waiting to complete
+        bool started;                       ///< Some of its bytes are with the device
+        uint32_t address;                   ///< Current address
+        byte *buffer;                       ///< Current buffer position
+        size_t remaining;                   ///< Bytes remaining
+        unsigned long sequence;             ///< Submission order
+        unsigned long queued_time;          ///< Time of submission (us)
+        W25Q64FV_async_callback_t callback; ///< Completion callback
+        void *context;                      ///< Callback context
+        int handle;                         ///< Request handle
+    } request_t;
+
+    Flash *_flash;                                          ///< Flash chip
+    request_t _queue[W25Q64FV_SCHEDULER_QUEUE_DEPTH];       ///< Request slots
+    unsigned int _count;                                    ///< Number of pending requests, changed atomically
+    unsigned long _sequence;                                ///< Next submission number, changed atomically
+    unsigned int _next_handle;                              ///< Next handle to hand out, changed atomically
+    int _erasing;                                           ///< Slot of the erase the device is busy with, -1 if none
+    bool _suspending;                                       ///< A suspend for an urgent read is taking effect
+    unsigned long _suspend_start;                           ///< Time the suspend was issued (ms)
+    unsigned long _step_time;                               ///< Time the last program or erase was issued (ms)
+    unsigned long _step_timeout;                            ///< Maximum time of the last program or erase (ms)
+    W25Q64FV_scheduler_stats_t _stats;                      ///< Statistics
+
+    /**
+     * @brief Add a request to the queue
+     *
+     * @return int                  Request handle, W25Q64FV_ASYNC_INVALID_HANDLE if the queue is full
+     */
+    int enqueue(W25Q64FV_scheduler_op_t op, uint32_t address, byte *buffer, size_t length, uint8_t priority, W25Q64FV_async_callback_t callback, void *context);
+
+    /**
+     * @brief Check if a slot holds a published request
+     *
+     * @param index                 Slot
+     * @return true                 The slot is ready for poll()
+     */
+    bool ready(int index) { return W25Q64FV_atomic_load(&_queue[index].state, __ATOMIC_ACQUIRE) == SLOT_READY; }
+
+    /**
+     * @brief Get the area a request touches
+     *
+     * @param request               Request
+     * @param start                 Start of the area
+     * @param end                   End of the area, exclusive
+     * @return (void)
+     */
+    static void extent(const request_t *request, uint32_t *start, uint32_t *end);
+
+    /**
+     * @brief Check if a request must wait for an earlier overlapping request
+     *
+     * @param index                 Slot of the request
+     * @return true                 An earlier request overlaps it and one of them writes
+     */
+    bool blocked(int index);
+
+    /**
+     * @brief Pick the next request to serve
+     *
+     * @param reads_only            Only consider reads
+     * @return int                  Slot of the request, -1 if none is ready
+     */
+    int select(bool reads_only);
+
+    /**
+     * @brief Find a ready request of a type starting or ending at an address
+     *
+     * @param op                    Request type
+     * @param address               Address the request must start at, or end at
+     * @param ending                Match the end of the request rather than its start
+     * @return int                  Slot of the request, -1 if none
+     */
+    int find_adjacent(W25Q64FV_scheduler_op_t op, uint32_t address, bool ending);
+
+    /**
+     * @brief Serve a read and every ready read adjacent to it with one streaming read
+     *
+     * @param index                 Slot of the read
+     * @return (void)
+     */
+    void serve_read(int index);
+
+    /**
+     * @brief Serve the urgent read once the erase is suspended, then resume it
+     *
+     * @return (void)
+     */
+    void serve_suspended();
+
+    /**
+     * @brief Issue the next page of a program, or an erase
+     *
+     * @param index                 Slot of the request
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t issue(int index);
+
+    /**
+     * @brief Remove a request and report its status
+     *
+     * @param index                 Slot of the request
+     * @param status                Final status of the request
+     * @return (void)
+     */
+    void complete(int index, W25Q64FV_status_t status);
+
+    /**
+     * @brief Complete every request the device has finished
+     *
+     * @param status                Final status of the requests
+     * @param started               Also complete programs with pages still to issue
+     * @return (void)
+     */
+    void complete_issued(W25Q64FV_status_t status, bool started = false);
+};
+
+/// Prioritized request queue on the default W25Q64 driver
+typedef W25Q64FV_BasicScheduler<W25Q64FV> W25Q64FV_Scheduler;
+
+extern template class W25Q64FV_BasicScheduler<W25Q64FV>;
+extern template class W25Q64FV_BasicScheduler<W25Q128FV>;
+extern template class W25Q64FV_BasicScheduler<W25Q256FV>;
+extern template class W25Q64FV_BasicScheduler<W25QXX>;
+
+#endif
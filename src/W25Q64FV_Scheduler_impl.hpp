@@ -0,0 +1,351 @@
+/**
+ * @file W25Q64FV_Scheduler_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 prioritized request queue
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Scheduler.cpp for the default drivers. Include this after
+ * W25Q64FV_Scheduler.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_SCHEDULER_IMPL_HPP_
+#define _W25Q64FV_SCHEDULER_IMPL_HPP_
+
+#include "W25Q64FV_Scheduler.hpp"
+#include <limits.h>
+
+template<class Flash>
+W25Q64FV_BasicScheduler<Flash>::W25Q64FV_BasicScheduler(Flash &flash){
+    _flash = &flash;
+    memset(_queue, 0, sizeof(_queue));
+    _count = 0;
+    _sequence = 0;
+    _next_handle = 0;
+    _erasing = -1;
+    _suspending = false;
+    _suspend_start = 0;
+    _step_time = 0;
+    _step_timeout = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+int W25Q64FV_BasicScheduler<Flash>::read(uint32_t start_address, byte *buffer, size_t length, uint8_t priority, W25Q64FV_async_callback_t callback, void *context){
+    if(start_address + length > _flash->capacity()) return W25Q64FV_ASYNC_INVALID_HANDLE;
+    return enqueue(W25Q64FV_SCHEDULER_READ, start_address, buffer, length, priority, callback, context);
+}
+
+template<class Flash>
+int W25Q64FV_BasicScheduler<Flash>::program(uint32_t start_address, const byte *buffer, size_t length, uint8_t priority, W25Q64FV_async_callback_t callback, void *context){
+    if(start_address + length > _flash->capacity()) return W25Q64FV_ASYNC_INVALID_HANDLE;
+    return enqueue(W25Q64FV_SCHEDULER_PROGRAM, start_address, (byte*)buffer, length, priority, callback, context);
+}
+
+template<class Flash>
+int W25Q64FV_BasicScheduler<Flash>::erase_sector(uint32_t sector_address, uint8_t priority, W25Q64FV_async_callback_t callback, void *context){
+    return enqueue(W25Q64FV_SCHEDULER_ERASE_SECTOR, sector_address, NULL, 0, priority, callback, context);
+}
+
+template<class Flash>
+int W25Q64FV_BasicScheduler<Flash>::erase_block_64(uint32_t block_address, uint8_t priority, W25Q64FV_async_callback_t callback, void *context){
+    return enqueue(W25Q64FV_SCHEDULER_ERASE_BLOCK_64, block_address, NULL, 0, priority, callback, context);
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicScheduler<Flash>::poll(){
+    if(count() == 0) return W25Q64FV_OK;
+    // a suspend issued on an earlier poll is taking effect
+    if(_suspending){
+        W25Q64FV_status_t status = _flash->suspend(false);
+        if(_flash->suspend_pending()) return W25Q64FV_BUSY;
+        _suspending = false;
+        if(status == W25Q64FV_OK) serve_suspended();
+        return W25Q64FV_BUSY;
+    }
+    if(_flash->busy()){
+        if((millis() - _step_time) > _step_timeout){
+            // fail everything the device holds, programs with pages left included
+            complete_issued(W25Q64FV_TIMEOUT, true);
+            _step_time = millis();
+            return W25Q64FV_BUSY;
+        }
+        // a read more urgent than the running erase suspends it
+        if(_erasing < 0) return W25Q64FV_BUSY;
+        int index = select(true);
+        if(index < 0 || _queue[index].priority >= _queue[_erasing].priority) return W25Q64FV_BUSY;
+        _suspend_start = millis();
+        W25Q64FV_status_t status = _flash->suspend(false);
+        if(_flash->suspend_pending()){
+            // the device takes a few microseconds to stop, serve the read on a later poll
+            _suspending = true;
+            return W25Q64FV_BUSY;
+        }
+        if(status == W25Q64FV_OK) serve_suspended();
+        return W25Q64FV_BUSY;
+    }
+    complete_issued(W25Q64FV_OK);
+    // serve ready reads back to back, then start the next page program or erase
+    int index;
+    while((index = select(false)) >= 0){
+        if(_queue[index].op == W25Q64FV_SCHEDULER_READ){
+            serve_read(index);
+            continue;
+        }
+        W25Q64FV_status_t status = issue(index);
+        // the device is held elsewhere, retry on the next poll
+        if(status == W25Q64FV_BUSY) break;
+        if(status == W25Q64FV_OK) break;
+        complete(index, status);
+    }
+    if(count() == 0) return W25Q64FV_OK;
+    return W25Q64FV_BUSY;
+}
+
+template<class Flash>
+bool W25Q64FV_BasicScheduler<Flash>::pending(int handle){
+    for(int i = 0; i < W25Q64FV_SCHEDULER_QUEUE_DEPTH; i ++){
+        if(ready(i) && _queue[i].handle == handle) return true;
+    }
+    return false;
+}
+
+template<class Flash>
+void W25Q64FV_BasicScheduler<Flash>::get_stats(W25Q64FV_scheduler_stats_t *stats, bool reset){
+    memcpy(stats, &_stats, sizeof(_stats));
+    if(reset) memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+int W25Q64FV_BasicScheduler<Flash>::enqueue(W25Q64FV_scheduler_op_t op, uint32_t address, byte *buffer, size_t length, uint8_t priority, W25Q64FV_async_callback_t callback, void *context){
+    if(priority >= W25Q64FV_SCHEDULER_PRIORITIES) return W25Q64FV_ASYNC_INVALID_HANDLE;
+    // producers race for a free slot, the one that swaps it to claimed owns it
+    int index = 0;
+    while(index < W25Q64FV_SCHEDULER_QUEUE_DEPTH){
+        uint8_t expected = SLOT_FREE;
+        if(W25Q64FV_atomic_compare_exchange(&_queue[index].state, &expected, (uint8_t)SLOT_CLAIMED, __ATOMIC_ACQUIRE)) break;
+        index ++;
+    }
+    if(index == W25Q64FV_SCHEDULER_QUEUE_DEPTH) return W25Q64FV_ASYNC_INVALID_HANDLE;
+    request_t *request = &_queue[index];
+    request->op = op;
+    request->priority = priority;
+    request->issued = false;
+    request->started = false;
+    request->address = address;
+    request->buffer = buffer;
+    request->remaining = length;
+    request->sequence = W25Q64FV_atomic_fetch_add(&_sequence, 1UL, __ATOMIC_RELAXED);
+    request->queued_time = micros();
+    request->callback = callback;
+    request->context = context;
+    // handles wrap, skipping the invalid handle
+    request->handle = (int)(W25Q64FV_atomic_fetch_add(&_next_handle, 1U, __ATOMIC_RELAXED) & INT_MAX);
+    int handle = request->handle;
+    W25Q64FV_atomic_fetch_add(&_count, 1U, __ATOMIC_RELAXED);
+    // publish the filled slot to poll()
+    W25Q64FV_atomic_store(&request->state, (uint8_t)SLOT_READY, __ATOMIC_RELEASE);
+    return handle;
+}
+
+template<class Flash>
+void W25Q64FV_BasicScheduler<Flash>::extent(const request_t *request, uint32_t *start, uint32_t *end){
+    uint32_t size = 0;
+    if(request->op == W25Q64FV_SCHEDULER_ERASE_SECTOR) size = W25Q64FV_SECTOR_SIZE;
+    if(request->op == W25Q64FV_SCHEDULER_ERASE_BLOCK_64) size = W25Q64FV_BLOCK_64K_SIZE;
+    if(size != 0){
+        // erases cover the aligned area containing the address
+        *start = request->address - (request->address % size);
+        *end = *start + size;
+        return;
+    }
+    *start = request->address;
+    *end = request->address + request->remaining;
+}
+
+template<class Flash>
+bool W25Q64FV_BasicScheduler<Flash>::blocked(int index){
+    const request_t *request = &_queue[index];
+    uint32_t start, end;
+    extent(request, &start, &end);
+    for(int i = 0; i < W25Q64FV_SCHEDULER_QUEUE_DEPTH; i ++){
+        const request_t *other = &_queue[i];
+        if(!ready(i) || i == index || other->sequence > request->sequence) continue;
+        // reads may pass each other
+        if(request->op == W25Q64FV_SCHEDULER_READ && other->op == W25Q64FV_SCHEDULER_READ) continue;
+        uint32_t other_start, other_end;
+        extent(other, &other_start, &other_end);
+        if(other_start < end && start < other_end) return true;
+    }
+    return false;
+}
+
+template<class Flash>
+int W25Q64FV_BasicScheduler<Flash>::select(bool reads_only){
+    unsigned long now = micros();
+    int best = -1;
+    bool best_aged = false;
+    for(int i = 0; i < W25Q64FV_SCHEDULER_QUEUE_DEPTH; i ++){
+        const request_t *request = &_queue[i];
+        if(!ready(i) || request->issued) continue;
+        if(reads_only && request->op != W25Q64FV_SCHEDULER_READ) continue;
+        if(blocked(i)) continue;
+        bool aged = (now - request->queued_time) > W25Q64FV_SCHEDULER_STARVATION_MS * 1000UL;
+        if(best >= 0){
+            const request_t *current = &_queue[best];
+            // starved requests go first, oldest first, then by priority
+            if(aged != best_aged){
+                if(!aged) continue;
+            }
+            else if(!aged && request->priority != current->priority){
+                if(request->priority > current->priority) continue;
+            }
+            else if(request->sequence > current->sequence) continue;
+        }
+        best = i;
+        best_aged = aged;
+    }
+    return best;
+}
+
+template<class Flash>
+int W25Q64FV_BasicScheduler<Flash>::find_adjacent(W25Q64FV_scheduler_op_t op, uint32_t address, bool ending){
+    for(int i = 0; i < W25Q64FV_SCHEDULER_QUEUE_DEPTH; i ++){
+        const request_t *request = &_queue[i];
+        if(!ready(i) || request->issued || request->op != op || request->remaining == 0) continue;
+        uint32_t edge = ending ? request->address + request->remaining : request->address;
+        if(edge == address && !blocked(i)) return i;
+    }
+    return -1;
+}
+
+template<class Flash>
+void W25Q64FV_BasicScheduler<Flash>::serve_read(int index){
+    int members[W25Q64FV_SCHEDULER_MAX_MERGE];
+    W25Q64FV_iovec_t segments[W25Q64FV_SCHEDULER_MAX_MERGE];
+    unsigned int count = 1;
+    members[0] = index;
+    uint32_t start = _queue[index].address;
+    uint32_t end = start + _queue[index].remaining;
+    // extend the run forwards, then backwards
+    while(count < W25Q64FV_SCHEDULER_MAX_MERGE){
+        int next = find_adjacent(W25Q64FV_SCHEDULER_READ, end, false);
+        if(next < 0) break;
+        members[count ++] = next;
+        end += _queue[next].remaining;
+    }
+    while(count < W25Q64FV_SCHEDULER_MAX_MERGE){
+        int previous = find_adjacent(W25Q64FV_SCHEDULER_READ, start, true);
+        if(previous < 0) break;
+        memmove(&members[1], &members[0], count * sizeof(members[0]));
+        members[0] = previous;
+        count ++;
+        start = _queue[previous].address;
+    }
+    for(unsigned int i = 0; i < count; i ++){
+        segments[i].base = _queue[members[i]].buffer;
+        segments[i].length = _queue[members[i]].remaining;
+    }
+    W25Q64FV_status_t status = _flash->readv(start, segments, count);
+    _stats.merged_reads += count - 1;
+    for(unsigned int i = 0; i < count; i ++) complete(members[i], status);
+}
+
+template<class Flash>
+void W25Q64FV_BasicScheduler<Flash>::serve_suspended(){
+    // the erase may have finished instead, the read is served either way
+    int index = select(true);
+    if(index >= 0 && (_erasing < 0 || _queue[index].priority < _queue[_erasing].priority)) serve_read(index);
+    if(_flash->suspended()){
+        _flash->resume();
+        _stats.suspends ++;
+    }
+    // the suspended time does not count towards the timeout
+    _step_time += millis() - _suspend_start;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicScheduler<Flash>::issue(int index){
+    request_t *request = &_queue[index];
+    W25Q64FV_status_t status;
+    W25Q64FV_operation_t operation;
+    switch(request->op){
+        case W25Q64FV_SCHEDULER_ERASE_SECTOR:
+            status = _flash->erase_sector(request->address, false);
+            operation = W25Q64FV_OPERATION_SECTOR_ERASE;
+            break;
+        case W25Q64FV_SCHEDULER_ERASE_BLOCK_64:
+            status = _flash->erase_block_64(request->address, false);
+            operation = W25Q64FV_OPERATION_BLOCK_64K_ERASE;
+            break;
+        default: {
+            // fill the rest of the page from programs continuing this one
+            int members[W25Q64FV_SCHEDULER_MAX_MERGE];
+            W25Q64FV_iovec_t segments[W25Q64FV_SCHEDULER_MAX_MERGE];
+            unsigned int count = 0;
+            uint32_t end = request->address;
+            int next = index;
+            do{
+                size_t piece = W25Q64FV_PAGE_SIZE - (end % W25Q64FV_PAGE_SIZE);
+                if(piece > _queue[next].remaining) piece = _queue[next].remaining;
+                members[count] = next;
+                segments[count].base = _queue[next].buffer;
+                segments[count].length = piece;
+                count ++;
+                end += piece;
+                if(end % W25Q64FV_PAGE_SIZE == 0) break;
+                next = find_adjacent(W25Q64FV_SCHEDULER_PROGRAM, end, false);
+            } while(next >= 0 && count < W25Q64FV_SCHEDULER_MAX_MERGE);
+            status = _flash->writev(request->address, segments, count, false);
+            if(status != W25Q64FV_OK) return status;
+            for(unsigned int i = 0; i < count; i ++){
+                request_t *member = &_queue[members[i]];
+                member->address += segments[i].length;
+                member->buffer += segments[i].length;
+                member->remaining -= segments[i].length;
+                member->started = true;
+                if(member->remaining == 0) member->issued = true;
+            }
+            _stats.merged_programs += count - 1;
+            operation = W25Q64FV_OPERATION_PAGE_PROGRAM;
+            break;
+        }
+    }
+    if(status != W25Q64FV_OK) return status;
+    if(operation != W25Q64FV_OPERATION_PAGE_PROGRAM){
+        request->issued = true;
+        _erasing = index;
+    }
+    _step_time = millis();
+    _step_timeout = _flash->operation_time(operation, true) / 1000 + 1;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+void W25Q64FV_BasicScheduler<Flash>::complete(int index, W25Q64FV_status_t status){
+    request_t *request = &_queue[index];
+    unsigned long latency = micros() - request->queued_time;
+    _stats.served[request->priority] ++;
+    if(latency > _stats.max_latency[request->priority]) _stats.max_latency[request->priority] = latency;
+    if(latency > W25Q64FV_SCHEDULER_STARVATION_MS * 1000UL) _stats.aged ++;
+    // free the slot before the callback so it may queue new requests
+    W25Q64FV_async_callback_t callback = request->callback;
+    void *context = request->context;
+    int handle = request->handle;
+    if(index == _erasing) _erasing = -1;
+    W25Q64FV_atomic_store(&request->state, (uint8_t)SLOT_FREE, __ATOMIC_RELEASE);
+    W25Q64FV_atomic_fetch_sub(&_count, 1U, __ATOMIC_RELAXED);
+    if(callback != NULL) callback(handle, status, context);
+}
+
+template<class Flash>
+void W25Q64FV_BasicScheduler<Flash>::complete_issued(W25Q64FV_status_t status, bool started){
+    for(int i = 0; i < W25Q64FV_SCHEDULER_QUEUE_DEPTH; i ++){
+        if(ready(i) && (_queue[i].issued || (started && _queue[i].started))) complete(i, status);
+    }
+}
+
+#endif
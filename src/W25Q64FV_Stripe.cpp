@@ -0,0 +1,18 @@
+/**
+ * @file W25Q64FV_Stripe.cpp
+ * @author Jeremy Dunne
+ * @brief source file for the W25Q64 multi-chip striping
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <W25Q64FV_Stripe.hpp>
+#include "W25Q64FV_Stripe_impl.hpp"
+
+template class W25Q64FV_BasicStripe<W25Q64FV>;
+template class W25Q64FV_BasicStripe<W25Q128FV>;
+template class W25Q64FV_BasicStripe<W25Q256FV>;
+template class W25Q64FV_BasicStripe<W25QXX>;
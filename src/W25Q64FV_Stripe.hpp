@@ -0,0 +1,153 @@
+/**
+ * @file W25Q64FV_Stripe.hpp
+ * @author Jeremy Dunne
+ * @brief multi-chip striping for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_STRIPE_HPP_
+#define _W25Q64FV_STRIPE_HPP_
+
+#include "W25Q64FV.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_STRIPE_MAX_CHIPS
+#define W25Q64FV_STRIPE_MAX_CHIPS   4 // Maximum number of striped chips
+#endif
+
+/**
+ * @brief Striped device over several W25Q64FV chips
+ *
+ * Consecutive 256 byte pages go to consecutive chips, so page p is page p / count of
+ * chip p % count. A write issues each page program on its chip and moves on to the next
+ * chip without waiting, so up to count programs run at once. Erase units are count times
+ * larger than on one chip and are erased on every chip in parallel.
+ *
+ * Each chip is a separate driver, begun on its own chip select and sharing the bus. Use
+ * the W25Q64FV_Stripe typedef with the default driver, other drivers must also include
+ * W25Q64FV_Stripe_impl.hpp.
+ *
+ * @tparam Flash                Driver of each chip
+ */
+template<class Flash>
+class W25Q64FV_BasicStripe{
+public:
+    /**
+     * @brief Construct a new striped device
+     *
+     * @param chips                 Initialized chips, in stripe order
+     * @param count                 Number of chips, at most W25Q64FV_STRIPE_MAX_CHIPS
+     */
+    W25Q64FV_BasicStripe(Flash *const *chips, uint8_t count);
+
+    /**
+     * @brief Write an arbitrary length
+     *
+     * Waits only for the chip of each page to be free
+     *
+     * @param start_address         Start address to write to
+     * @param buffer                Buffer of data to write
+     * @param length                Number of bytes to write
+     * @param hold                  Wait for all chips to finish programming
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t write(uint32_t start_address, const byte *buffer, size_t length, bool hold = false);
+
+    /**
+     * @brief Read an arbitrary length
+     *
+     * @param start_address         Start address to read from
+     * @param buffer                Buffer of data to read into
+     * @param length                Number of bytes to read
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t read(uint32_t start_address, byte *buffer, size_t length);
+
+    /**
+     * @brief Erase a stripe sector, one 4kB sector on every chip
+     *
+     * @param sector_address        Address within the stripe sector
+     * @param hold                  Wait for the erases to complete
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t erase_sector(uint32_t sector_address, bool hold = true);
+
+    /**
+     * @brief Erase a range on all chips in parallel
+     *
+     * Each chip erases its share with its own erase_range() plan, a chip erase included,
+     * and moves on to its next erase as soon as it is free.
+     *
+     * @param start_address         Start address, aligned to sector_size()
+     * @param length                Length, a multiple of sector_size()
+     * @param allow_chip_erase      Allow chip erases for a range covering the whole device
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t erase_range(uint32_t start_address, uint32_t length, bool allow_chip_erase = true);
+
+    /**
+     * @brief Check if any chip is busy
+     *
+     * @return true                 At least one chip is busy
+     */
+    bool busy();
+
+    /**
+     * @brief Wait for every chip to be free
+     *
+     * @param max_timeout           Max time to wait per chip (ms)
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t wait_until_free(unsigned long max_timeout = W25Q64FV_DEFAULT_TIMEOUT);
+
+    /**
+     * @brief Get the size of the striped device
+     *
+     * @return uint32_t             Capacity in bytes
+     */
+    uint32_t capacity() { return _count * _chips[0]->capacity(); }
+
+    /**
+     * @brief Get the erase unit of erase_sector()
+     *
+     * @return uint32_t             Stripe sector size in bytes
+     */
+    uint32_t sector_size() { return _count * (uint32_t)W25Q64FV_SECTOR_SIZE; }
+
+private:
+    Flash *_chips[W25Q64FV_STRIPE_MAX_CHIPS];       ///< Striped chips
+    uint8_t _count;                                 ///< Number of chips
+
+    /**
+     * @brief Erase the same unit on every chip
+     *
+     * @param chip_address          Address of the unit on each chip
+     * @param size                  Erase size, 4kB, 32kB, or 64kB
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t erase_all(uint32_t chip_address, uint32_t size);
+
+    /**
+     * @brief Start one erase on a chip without waiting for it
+     *
+     * @param chip                  Free chip
+     * @param chip_address          Address of the unit on the chip
+     * @param size                  Erase size, 4kB, 32kB, or 64kB
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t erase_unit(Flash *chip, uint32_t chip_address, uint32_t size);
+};
+
+/// Striped device over chips on the default W25Q64 driver
+typedef W25Q64FV_BasicStripe<W25Q64FV> W25Q64FV_Stripe;
+
+extern template class W25Q64FV_BasicStripe<W25Q64FV>;
+extern template class W25Q64FV_BasicStripe<W25Q128FV>;
+extern template class W25Q64FV_BasicStripe<W25Q256FV>;
+extern template class W25Q64FV_BasicStripe<W25QXX>;
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * @file W25Q64FV_Stripe_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 multi-chip striping
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Stripe.cpp for the default drivers. Include this after
+ * W25Q64FV_Stripe.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_STRIPE_IMPL_HPP_
+#define _W25Q64FV_STRIPE_IMPL_HPP_
+
+#include "W25Q64FV_Stripe.hpp"
+
+template<class Flash>
+W25Q64FV_BasicStripe<Flash>::W25Q64FV_BasicStripe(Flash *const *chips, uint8_t count){
+    _count = count;
+    if(_count > W25Q64FV_STRIPE_MAX_CHIPS) _count = W25Q64FV_STRIPE_MAX_CHIPS;
+    if(_count == 0) _count = 1;
+    for(uint8_t i = 0; i < _count; i ++) _chips[i] = chips[i];
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicStripe<Flash>::write(uint32_t start_address, const byte *buffer, size_t length, bool hold){
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status;
+    while(length > 0){
+        uint32_t page = start_address / W25Q64FV_PAGE_SIZE;
+        size_t offset = start_address % W25Q64FV_PAGE_SIZE;
+        size_t chunk = W25Q64FV_PAGE_SIZE - offset;
+        if(chunk > length) chunk = length;
+        // only this chip has to be free, the others keep programming
+        Flash *chip = _chips[page % _count];
+        status = chip->write((page / _count) * W25Q64FV_PAGE_SIZE + offset, buffer, chunk, false);
+        if(status != W25Q64FV_OK) return status;
+        start_address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    if(hold) return wait_until_free();
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicStripe<Flash>::read(uint32_t start_address, byte *buffer, size_t length){
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status;
+    while(length > 0){
+        uint32_t page = start_address / W25Q64FV_PAGE_SIZE;
+        size_t offset = start_address % W25Q64FV_PAGE_SIZE;
+        size_t chunk = W25Q64FV_PAGE_SIZE - offset;
+        if(chunk > length) chunk = length;
+        Flash *chip = _chips[page % _count];
+        status = chip->wait_until_free();
+        if(status != W25Q64FV_OK) return status;
+        status = chip->read((page / _count) * W25Q64FV_PAGE_SIZE + offset, buffer, chunk);
+        if(status != W25Q64FV_OK) return status;
+        start_address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicStripe<Flash>::erase_sector(uint32_t sector_address, bool hold){
+    if(sector_address >= capacity()) return W25Q64FV_NOT_VALID;
+    uint32_t chip_address = sector_address / _count;
+    chip_address -= chip_address % W25Q64FV_SECTOR_SIZE;
+    W25Q64FV_status_t status = erase_all(chip_address, W25Q64FV_SECTOR_SIZE);
+    if(status != W25Q64FV_OK) return status;
+    if(hold) return wait_until_free();
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicStripe<Flash>::erase_range(uint32_t start_address, uint32_t length, bool allow_chip_erase){
+    if(start_address % sector_size() != 0 || length % sector_size() != 0) return W25Q64FV_NOT_VALID;
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status;
+    // every chip holds the same share of the range, each follows its own erase plan
+    uint32_t chip_address = start_address / _count;
+    uint32_t share = length / _count;
+    uint32_t done[W25Q64FV_STRIPE_MAX_CHIPS];
+    for(uint8_t i = 0; i < _count; i ++){
+        done[i] = 0;
+        if(share == 0 || !_chips[i]->use_chip_erase(chip_address, share, allow_chip_erase)) continue;
+        status = _chips[i]->wait_until_free();
+        if(status != W25Q64FV_OK) return status;
+        status = _chips[i]->erase_chip(false);
+        if(status != W25Q64FV_OK) return status;
+        done[i] = share;
+    }
+    while(true){
+        // issue the next erase on every free chip with some of its share left
+        int next = -1;
+        for(uint8_t i = 0; i < _count; i ++){
+            if(done[i] == share) continue;
+            if(next < 0) next = i;
+            if(_chips[i]->busy()) continue;
+            uint32_t size = _chips[i]->next_erase_size(chip_address + done[i], share - done[i]);
+            status = erase_unit(_chips[i], chip_address + done[i], size);
+            if(status != W25Q64FV_OK) return status;
+            done[i] += size;
+        }
+        if(next < 0) break;
+        // then wait on the first chip with more to do
+        status = _chips[next]->wait_until_free();
+        if(status != W25Q64FV_OK) return status;
+    }
+    return wait_until_free();
+}
+
+template<class Flash>
+bool W25Q64FV_BasicStripe<Flash>::busy(){
+    for(uint8_t i = 0; i < _count; i ++){
+        if(_chips[i]->busy()) return true;
+    }
+    return false;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicStripe<Flash>::wait_until_free(unsigned long max_timeout){
+    // the chips run in parallel, so the slowest sets the total
+    for(uint8_t i = 0; i < _count; i ++){
+        W25Q64FV_status_t status = _chips[i]->wait_until_free(max_timeout);
+        if(status != W25Q64FV_OK) return status;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicStripe<Flash>::erase_all(uint32_t chip_address, uint32_t size){
+    W25Q64FV_status_t status;
+    // issue on every chip before waiting on any
+    for(uint8_t i = 0; i < _count; i ++){
+        status = _chips[i]->wait_until_free();
+        if(status != W25Q64FV_OK) return status;
+        status = erase_unit(_chips[i], chip_address, size);
+        if(status != W25Q64FV_OK) return status;
+    }
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicStripe<Flash>::erase_unit(Flash *chip, uint32_t chip_address, uint32_t size){
+    if(size == W25Q64FV_BLOCK_64K_SIZE) return chip->erase_block_64(chip_address, false);
+    if(size == W25Q64FV_BLOCK_32K_SIZE) return chip->erase_block_32(chip_address, false);
+    return chip->erase_sector(chip_address, false);
+}
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file W25Q64FV_Telemetry.cpp
+ * @author Jeremy Dunne
+ * @brief source file for the W25Q64 compressed telemetry records
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <W25Q64FV_Telemetry.hpp>
+#include "W25Q64FV_Telemetry_impl.hpp"
+
+template class W25Q64FV_BasicTelemetry<W25Q64FV>;
+template class W25Q64FV_BasicTelemetry<W25Q128FV>;
+template class W25Q64FV_BasicTelemetry<W25Q256FV>;
+template class W25Q64FV_BasicTelemetry<W25QXX>;
@@ -0,0 +1,180 @@
+/**
+ * @file W25Q64FV_Telemetry.hpp
+ * @author Jeremy Dunne
+ * @brief compressed telemetry records for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_TELEMETRY_HPP_
+#define _W25Q64FV_TELEMETRY_HPP_
+
+#include "W25Q64FV_Log.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_TELEMETRY_MAX_CHANNELS
+#define W25Q64FV_TELEMETRY_MAX_CHANNELS 16 // Maximum number of channels per frame
+#endif
+#ifndef W25Q64FV_TELEMETRY_BLOCK_SIZE
+#define W25Q64FV_TELEMETRY_BLOCK_SIZE   256 // Bytes per encoded block, one log record each. Twice this is held in RAM
+#endif
+#define W25Q64FV_TELEMETRY_VARINT_MAX   5 // Longest varint of a 32 bit value
+
+#if W25Q64FV_TELEMETRY_BLOCK_SIZE > W25Q64FV_LOG_MAX_RECORD
+#error "W25Q64FV_TELEMETRY_BLOCK_SIZE must fit in a log record"
+#endif
+
+/// Telemetry Statistics
+typedef struct{
+    unsigned long frames; ///<Frames appended
+    unsigned long blocks; ///<Blocks written, one keyframe each
+    unsigned long raw_bytes; ///<Size of the appended frames as 32 bit values
+    unsigned long encoded_bytes; ///<Size of the written blocks, including record headers
+} W25Q64FV_telemetry_stats_t;
+
+/**
+ * @brief Compressed frames of integer channels over a W25Q64FV_Log
+ *
+ * Frames are encoded into blocks of up to W25Q64FV_TELEMETRY_BLOCK_SIZE bytes, each
+ * appended to the log as one record. A block starts with a keyframe of the absolute
+ * values. Each later frame stores per-channel differences from the previous frame as
+ * zigzag varints, behind a bitmask of the channels that changed, so unchanged channels
+ * cost one bit. Channel 0 is the key, normally a timestamp: it must not decrease, and it
+ * is stored as the change in its step, so a fixed sample rate costs nothing.
+ *
+ * Every block decodes on its own and a block is closed early to fit the rest of a log
+ * sector, so every sector starts on a keyframe. seek() binary searches the sectors on
+ * their first key. All state lives in the object; nothing is allocated. Use the
+ * W25Q64FV_Telemetry typedef with the default driver, other drivers must also include
+ * W25Q64FV_Telemetry_impl.hpp.
+ *
+ * @tparam Flash                Driver of the device
+ */
+template<class Flash>
+class W25Q64FV_BasicTelemetry{
+public:
+    /**
+     * @brief Construct a new telemetry stream
+     *
+     * @param log                   Mounted log to write to and read from
+     * @param channels              Values per frame, 1 to W25Q64FV_TELEMETRY_MAX_CHANNELS
+     */
+    W25Q64FV_BasicTelemetry(W25Q64FV_BasicLog<Flash> &log, uint8_t channels);
+
+    /**
+     * @brief Append a frame
+     *
+     * Writes the current block to the log once the frame would not fit
+     *
+     * @param values                Value of each channel
+     * @return W25Q64FV_status_t    Status return (not valid if the key decreased)
+     */
+    W25Q64FV_status_t append(const int32_t *values);
+
+    /**
+     * @brief Write the current block and program it
+     *
+     * The next frame starts a new block with a keyframe, so syncing often costs ratio
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t sync();
+
+    /**
+     * @brief Move the read cursor to the oldest frame
+     *
+     * @return (void)
+     */
+    void rewind();
+
+    /**
+     * @brief Move the read cursor to the first frame with a key at or after a value
+     *
+     * @param key                   Key to find
+     * @return W25Q64FV_status_t    Status return (not found if every frame has a smaller key,
+     *                              with the cursor at the end of the log)
+     */
+    W25Q64FV_status_t seek(int32_t key);
+
+    /**
+     * @brief Read the frame at the read cursor and advance
+     *
+     * Frames in the current block are not visible until it is written
+     *
+     * @param values                Value of each channel
+     * @param valid                 Set if a frame was read, clear at the end of the log
+     * @return W25Q64FV_status_t    Status return (not valid if a block is malformed)
+     */
+    W25Q64FV_status_t read_next(int32_t *values, bool *valid);
+
+    /**
+     * @brief Get the telemetry statistics
+     *
+     * @param stats                 Statistics to fill
+     * @param reset                 Reset the counters after reading
+     * @return (void)
+     */
+    void get_stats(W25Q64FV_telemetry_stats_t *stats, bool reset = false);
+
+private:
+    W25Q64FV_BasicLog<Flash> *_log;                             ///< Log to write to
+    uint8_t _channels;                                          ///< Values per frame
+    uint8_t _mask_bytes;                                        ///< Bytes of the changed channel bitmask
+    byte _block[W25Q64FV_TELEMETRY_BLOCK_SIZE];                 ///< Block being encoded
+    size_t _block_length;                                       ///< Bytes encoded
+    size_t _block_limit;                                        ///< Bytes the block may grow to
+    int32_t _last[W25Q64FV_TELEMETRY_MAX_CHANNELS];             ///< Last appended frame
+    int32_t _last_step;                                         ///< Last step of the key
+    byte _read_block[W25Q64FV_TELEMETRY_BLOCK_SIZE];            ///< Block being decoded
+    size_t _read_length;                                        ///< Bytes in the decoded block
+    size_t _read_offset;                                        ///< Offset of the next frame
+    int32_t _read_values[W25Q64FV_TELEMETRY_MAX_CHANNELS];      ///< Last decoded frame
+    int32_t _read_step;                                         ///< Last decoded step of the key
+    bool _held;                                                 ///< Last decoded frame is returned next, after a seek
+    W25Q64FV_telemetry_stats_t _stats;                          ///< Statistics
+
+    /**
+     * @brief Append the current block to the log
+     *
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t close_block();
+
+    /**
+     * @brief Decode the next frame of the log
+     *
+     * @param valid                 Set if a frame was decoded
+     * @return W25Q64FV_status_t    Status return
+     */
+    W25Q64FV_status_t decode(bool *valid);
+
+    /**
+     * @brief Add a zigzag varint to the current block
+     *
+     * @param value                 Value to encode
+     * @return (void)
+     */
+    void put_varint(int32_t value);
+
+    /**
+     * @brief Take a zigzag varint from the decoded block
+     *
+     * @param value                 Decoded value
+     * @return true                 Value decoded
+     * @return false                Block ended mid varint
+     */
+    bool get_varint(int32_t *value);
+};
+
+/// Compressed telemetry on the default W25Q64 driver
+typedef W25Q64FV_BasicTelemetry<W25Q64FV> W25Q64FV_Telemetry;
+
+extern template class W25Q64FV_BasicTelemetry<W25Q64FV>;
+extern template class W25Q64FV_BasicTelemetry<W25Q128FV>;
+extern template class W25Q64FV_BasicTelemetry<W25Q256FV>;
+extern template class W25Q64FV_BasicTelemetry<W25QXX>;
+
+#endif
@@ -0,0 +1,228 @@
+/**
+ * @file W25Q64FV_Telemetry_impl.hpp
+ * @author Jeremy Dunne
+ * @brief implementation of the W25Q64 compressed telemetry records
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Included by W25Q64FV_Telemetry.cpp for the default drivers. Include this after
+ * W25Q64FV_Telemetry.hpp in one source file when using it with another driver.
+ *
+ */
+
+#ifndef _W25Q64FV_TELEMETRY_IMPL_HPP_
+#define _W25Q64FV_TELEMETRY_IMPL_HPP_
+
+#include "W25Q64FV_Telemetry.hpp"
+#include "W25Q64FV_Log_impl.hpp"
+
+template<class Flash>
+W25Q64FV_BasicTelemetry<Flash>::W25Q64FV_BasicTelemetry(W25Q64FV_BasicLog<Flash> &log, uint8_t channels){
+    _log = &log;
+    if(channels > W25Q64FV_TELEMETRY_MAX_CHANNELS) channels = W25Q64FV_TELEMETRY_MAX_CHANNELS;
+    if(channels == 0) channels = 1;
+    _channels = channels;
+    _mask_bytes = (channels + 7) / 8;
+    _block_length = 0;
+    _block_limit = W25Q64FV_TELEMETRY_BLOCK_SIZE;
+    memset(_last, 0, sizeof(_last));
+    // any first key is accepted
+    _last[0] = INT32_MIN;
+    _last_step = 0;
+    _read_length = 0;
+    _read_offset = 0;
+    memset(_read_values, 0, sizeof(_read_values));
+    _read_step = 0;
+    _held = false;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicTelemetry<Flash>::append(const int32_t *values){
+    if(values[0] < _last[0]) return W25Q64FV_NOT_VALID;
+    W25Q64FV_status_t status;
+    size_t keyframe = _channels * W25Q64FV_TELEMETRY_VARINT_MAX;
+    if(_block_length != 0 && _block_length + _mask_bytes + keyframe > _block_limit){
+        status = close_block();
+        if(status != W25Q64FV_OK) return status;
+    }
+    if(_block_length == 0){
+        // end the block with the log sector when a keyframe fits in what is left
+        _block_limit = W25Q64FV_TELEMETRY_BLOCK_SIZE;
+        uint32_t used = _log->head_address() % W25Q64FV_SECTOR_SIZE;
+        if(used + W25Q64FV_LOG_RECORD_HEADER + keyframe <= W25Q64FV_SECTOR_SIZE){
+            size_t room = W25Q64FV_SECTOR_SIZE - used - W25Q64FV_LOG_RECORD_HEADER;
+            if(room < _block_limit) _block_limit = room;
+        }
+        for(uint8_t i = 0; i < _channels; i ++) put_varint(values[i]);
+        _last_step = 0;
+    }
+    else{
+        // bitmask of the changed channels, then their residuals
+        byte *mask = _block + _block_length;
+        memset(mask, 0, _mask_bytes);
+        _block_length += _mask_bytes;
+        int32_t step = (int32_t)((uint32_t)values[0] - (uint32_t)_last[0]);
+        for(uint8_t i = 0; i < _channels; i ++){
+            int32_t residual;
+            if(i == 0) residual = (int32_t)((uint32_t)step - (uint32_t)_last_step);
+            else residual = (int32_t)((uint32_t)values[i] - (uint32_t)_last[i]);
+            if(residual == 0) continue;
+            mask[i / 8] |= 1 << (i % 8);
+            put_varint(residual);
+        }
+        _last_step = step;
+    }
+    memcpy(_last, values, _channels * sizeof(int32_t));
+    _stats.frames ++;
+    _stats.raw_bytes += _channels * sizeof(int32_t);
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicTelemetry<Flash>::sync(){
+    W25Q64FV_status_t status = close_block();
+    if(status != W25Q64FV_OK) return status;
+    return _log->sync();
+}
+
+template<class Flash>
+void W25Q64FV_BasicTelemetry<Flash>::rewind(){
+    _log->rewind();
+    _read_length = 0;
+    _read_offset = 0;
+    _held = false;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicTelemetry<Flash>::seek(int32_t key){
+    W25Q64FV_status_t status;
+    bool valid;
+    // find the first sector starting at or after the key
+    uint32_t low = 0;
+    uint32_t high = _log->used_sectors();
+    while(low < high){
+        uint32_t middle = (low + high) / 2;
+        status = _log->seek_sector(middle);
+        if(status != W25Q64FV_OK) return status;
+        _read_length = 0;
+        _read_offset = 0;
+        status = decode(&valid);
+        if(status != W25Q64FV_OK) return status;
+        if(valid && _read_values[0] < key) low = middle + 1;
+        else high = middle;
+    }
+    // the frame may be in the sector before it
+    status = _log->seek_sector(low > 0 ? low - 1 : 0);
+    if(status != W25Q64FV_OK) return status;
+    _read_length = 0;
+    _read_offset = 0;
+    _held = false;
+    while(true){
+        status = decode(&valid);
+        if(status != W25Q64FV_OK) return status;
+        // every frame has a smaller key, the cursor is left at the end of the log
+        if(!valid) return W25Q64FV_NOT_FOUND;
+        if(_read_values[0] >= key){
+            _held = true;
+            return W25Q64FV_OK;
+        }
+    }
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicTelemetry<Flash>::read_next(int32_t *values, bool *valid){
+    if(_held){
+        _held = false;
+        *valid = true;
+    }
+    else{
+        W25Q64FV_status_t status = decode(valid);
+        if(status != W25Q64FV_OK || !*valid) return status;
+    }
+    memcpy(values, _read_values, _channels * sizeof(int32_t));
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+void W25Q64FV_BasicTelemetry<Flash>::get_stats(W25Q64FV_telemetry_stats_t *stats, bool reset){
+    memcpy(stats, &_stats, sizeof(_stats));
+    if(reset) memset(&_stats, 0, sizeof(_stats));
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicTelemetry<Flash>::close_block(){
+    if(_block_length == 0) return W25Q64FV_OK;
+    W25Q64FV_status_t status = _log->append(_block, _block_length);
+    if(status != W25Q64FV_OK) return status;
+    _stats.blocks ++;
+    _stats.encoded_bytes += _block_length + W25Q64FV_LOG_RECORD_HEADER;
+    _block_length = 0;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+W25Q64FV_status_t W25Q64FV_BasicTelemetry<Flash>::decode(bool *valid){
+    W25Q64FV_status_t status;
+    *valid = false;
+    if(_read_offset >= _read_length){
+        // the next block starts with a keyframe
+        size_t length;
+        status = _log->read_next(_read_block, sizeof(_read_block), &length);
+        if(status != W25Q64FV_OK) return status;
+        if(length == 0) return W25Q64FV_OK;
+        if(length > sizeof(_read_block)) return W25Q64FV_NOT_VALID;
+        _read_length = length;
+        _read_offset = 0;
+        for(uint8_t i = 0; i < _channels; i ++){
+            if(!get_varint(&_read_values[i])) return W25Q64FV_NOT_VALID;
+        }
+        _read_step = 0;
+        *valid = true;
+        return W25Q64FV_OK;
+    }
+    if(_read_offset + _mask_bytes > _read_length) return W25Q64FV_NOT_VALID;
+    const byte *mask = _read_block + _read_offset;
+    _read_offset += _mask_bytes;
+    for(uint8_t i = 0; i < _channels; i ++){
+        int32_t residual = 0;
+        if((mask[i / 8] & (1 << (i % 8))) && !get_varint(&residual)) return W25Q64FV_NOT_VALID;
+        if(i == 0){
+            _read_step = (int32_t)((uint32_t)_read_step + (uint32_t)residual);
+            residual = _read_step;
+        }
+        _read_values[i] = (int32_t)((uint32_t)_read_values[i] + (uint32_t)residual);
+    }
+    *valid = true;
+    return W25Q64FV_OK;
+}
+
+template<class Flash>
+void W25Q64FV_BasicTelemetry<Flash>::put_varint(int32_t value){
+    // zigzag keeps small negative values short
+    uint32_t encoded = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    while(encoded >= 0x80){
+        _block[_block_length ++] = (byte)(encoded | 0x80);
+        encoded >>= 7;
+    }
+    _block[_block_length ++] = (byte)encoded;
+}
+
+template<class Flash>
+bool W25Q64FV_BasicTelemetry<Flash>::get_varint(int32_t *value){
+    uint32_t encoded = 0;
+    for(uint8_t shift = 0; shift < 7 * W25Q64FV_TELEMETRY_VARINT_MAX; shift += 7){
+        if(_read_offset >= _read_length) return false;
+        byte next = _read_block[_read_offset ++];
+        encoded |= (uint32_t)(next & 0x7F) << shift;
+        if(!(next & 0x80)){
+            *value = (int32_t)((encoded >> 1) ^ (0U - (encoded & 1)));
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
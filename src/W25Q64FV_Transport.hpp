@@ -0,0 +1,172 @@
+/**
+ * @file W25Q64FV_Transport.hpp
+ * @author Jeremy Dunne
+ * @brief bus transports for the W25Q64 Flash Chip interface library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * A transport is any class providing the following members. The driver is
+ * templated on the transport, so every call resolves at compile time.
+ *
+ *  - void begin(int cs_pin)                                            Initialize the bus and chip select
+ *  - void select()                                                     Assert chip select
+ *  - void deselect()                                                   Release chip select
+ *  - uint8_t transfer(uint8_t data)                                    Exchange a single byte
+ *  - void transfer(const uint8_t *tx, uint8_t *rx, size_t length)      Exchange a buffer. tx or rx may be NULL,
+ *                                                                      a NULL tx clocks out don't-care data
+ *  - void transfer(const uint8_t *tx, uint8_t *rx, size_t length,      Exchange a buffer over 1, 2, or 4 data lines
+ *                  uint8_t lanes)
+ *  - void start_transfer(const uint8_t *tx, uint8_t *rx, size_t length, Begin an asynchronous buffer exchange
+ *                        uint8_t lanes)
+ *  - bool transfer_complete()                                          Check if the asynchronous exchange is done
+ *  - static const uint8_t max_lanes                                    Widest supported transfer (1, 2, or 4).
+ *                                                                      Multi-line transfers are only issued when wired
+ */
+
+#ifndef _W25Q64FV_TRANSPORT_HPP_
+#define _W25Q64FV_TRANSPORT_HPP_
+
+#include <Arduino.h>
+#include <SPI.h>
+
+/********** SETTINGS **********/
+#define W25Q64FV_SPI_SPEED          20000000 // 104 MHz (104 max)
+
+/**
+ * @brief Transport over an Arduino SPIClass peripheral
+ *
+ * Uses the bulk SPI.transfer(buffer, length) where possible. Asynchronous transfers
+ * complete immediately.
+ *
+ */
+class W25Q64FV_ArduinoSPI{
+public:
+    static const uint8_t max_lanes = 1;    ///< Single data line only
+
+    /**
+     * @brief Construct a new transport
+     *
+     * @param spi                   SPI peripheral to use
+     * @param clock                 SPI clock speed
+     */
+    W25Q64FV_ArduinoSPI(SPIClass &spi = SPI, uint32_t clock = W25Q64FV_SPI_SPEED) : _spi(&spi), _clock(clock), _cs(-1) {}
+
+    /**
+     * @brief Initialize the chip select pin and the SPI peripheral
+     *
+     * @param cs_pin                Chip select pin
+     */
+    void begin(int cs_pin){
+        // initialize the cs pin
+        _cs = cs_pin;
+        pinMode(_cs,OUTPUT);
+        digitalWrite(_cs,HIGH); // deselect
+        // initialize SPI
+        _spi->begin();
+        _spi_settings = SPISettings(_clock, MSBFIRST, SPI_MODE_0);
+    }
+
+    /**
+     * @brief Select the device for communication
+     *
+     * Sets the SPI transaction info and pulls the chip select low
+     */
+    void select(){
+        _spi->beginTransaction(_spi_settings);
+        digitalWrite(_cs,LOW);
+    }
+
+    /**
+     * @brief Release the device for communication
+     *
+     * Ends the SPI transaction and pulls the chip select high
+     */
+    void deselect(){
+        _spi->endTransaction();
+        digitalWrite(_cs,HIGH);
+    }
+
+    /**
+     * @brief Exchange a single byte
+     *
+     * @param data                  Byte to write
+     * @return uint8_t              Byte read
+     */
+    uint8_t transfer(uint8_t data){
+        return _spi->transfer(data);
+    }
+
+    /**
+     * @brief Exchange a buffer
+     *
+     * @param tx                    Data to write, or NULL to clock out don't-care data
+     * @param rx                    Buffer to read into, or NULL to discard
+     * @param length                Number of bytes
+     */
+    void transfer(const uint8_t *tx, uint8_t *rx, size_t length){
+        if(rx != NULL){
+            // SPIClass exchanges in place
+            if(tx != NULL && tx != rx) memcpy(rx, tx, length);
+            _spi->transfer(rx, length);
+            return;
+        }
+        while(length > 0){
+            if(tx == NULL){
+                _spi->transfer(0);
+            }
+            else{
+                _spi->transfer(*tx);
+                tx ++;
+            }
+            length --;
+        }
+    }
+
+    /**
+     * @brief Exchange a buffer over multiple data lines
+     *
+     * Only a single line is supported, the driver never requests more than max_lanes
+     *
+     * @param tx                    Data to write, or NULL to clock out don't-care data
+     * @param rx                    Buffer to read into, or NULL to discard
+     * @param length                Number of bytes
+     * @param lanes                 Number of data lines
+     */
+    void transfer(const uint8_t *tx, uint8_t *rx, size_t length, uint8_t lanes){
+        (void)lanes;
+        transfer(tx, rx, length);
+    }
+
+    /**
+     * @brief Begin an asynchronous buffer exchange
+     *
+     * The Arduino SPI API is blocking, so the exchange completes before returning
+     *
+     * @param tx                    Data to write, or NULL to clock out don't-care data
+     * @param rx                    Buffer to read into, or NULL to discard
+     * @param length                Number of bytes
+     * @param lanes                 Number of data lines
+     */
+    void start_transfer(const uint8_t *tx, uint8_t *rx, size_t length, uint8_t lanes){
+        transfer(tx, rx, length, lanes);
+    }
+
+    /**
+     * @brief Check if the asynchronous exchange is done
+     *
+     * @return true                 Exchange complete
+     */
+    bool transfer_complete(){
+        return true;
+    }
+
+private:
+    SPIClass *_spi;                 ///< SPI peripheral
+    SPISettings _spi_settings;      ///< Flash chip specific SPI settings
+    uint32_t _clock;                ///< SPI clock speed
+    int _cs;                        ///< Chip select pin
+};
+
+#endif
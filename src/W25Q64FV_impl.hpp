@@ -0,0 +1,1154 @@
+/**
+ * @file W25Q64FV_impl.hpp
+ * @author Jeremy Dunne 
+ * @brief implementation of the W25Q64 Flash Chip interface library 
+ * @version 0.1
+ * @date 2022-05-27
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * Included by W25Q64FV.cpp for the default transport. Include this after W25Q64FV.hpp 
+ * in one source file when instantiating the driver with a custom transport. 
+ * 
+ */
+
+#ifndef _W25Q64FV_IMPL_HPP_
+#define _W25Q64FV_IMPL_HPP_
+
+#include "W25Q64FV.hpp"
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::begin(int cs_pin){
+    // initialize the bus 
+    _bus.begin(cs_pin); 
+    _read_pending = false; 
+    _io_mode = W25Q64FV_IO_SINGLE; 
+    _continuous_mode = false; 
+    _continuous_active = false; 
+    _suspended = false; 
+    unknown_state(); 
+    // // check the device id 
+    // Serial.println("Checking Dev ID"); 
+    uint8_t buffer[5] = {0}; 
+    W25Q64FV_status_t status = read_reg(W25Q64FV_INSTRUCTION_MANUFACTURER_DEVICE_ID, buffer, 5); 
+    if(status != W25Q64FV_OK) return status; 
+    // for now, check that they're not all 0s 
+    if(buffer[4] == 0){
+        return W25Q64FV_COMMUNICATION_FAIL; 
+    }
+    // reset the device 
+    status = reset_device(); 
+    if(status != W25Q64FV_OK) return status; 
+    // size the part, the parameters are read in 3 byte address mode 
+    W25Q64FV_parameters_t parameters; 
+    status = read_parameters(&parameters); 
+    if(status != W25Q64FV_OK) return status; 
+    status = _geometry.configure(parameters); 
+    if(status != W25Q64FV_OK) return status; 
+    return set_address_mode(); 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::enable_writing(){
+    // enable writing on the device 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // the latch is still set from the last enable 
+    if(_write_enabled) return W25Q64FV_OK; 
+    // write the enable command 
+    W25Q64FV_status_t status = write_command(W25Q64FV_INSTRUCTION_WRITE_ENABLE); 
+    if(status != W25Q64FV_OK) return status; 
+    _write_enabled = true; 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::disable_writing(){
+    // disable writing to the device 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // write the enable command 
+    W25Q64FV_status_t status = write_command(W25Q64FV_INSTRUCTION_WRITE_DISABLE); 
+    if(status != W25Q64FV_OK) return status; 
+    _write_enabled = false; 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::write_page(uint32_t start_address, byte *buffer){
+    // write a single page to the flash chip 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    return program_page(start_address, buffer, W25Q64FV_PAGE_SIZE, _smart_mode); 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::write(uint32_t start_address, const byte *buffer, size_t length, bool hold){
+    return write_pages(start_address, buffer, length, hold, _smart_mode); 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::write_erased(uint32_t start_address, const byte *buffer, size_t length, bool hold){
+    return write_pages(start_address, buffer, length, hold, false); 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::write_pages(uint32_t start_address, const byte *buffer, size_t length, bool hold, bool smart){
+    // write an arbitrary length, split at page boundaries 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    W25Q64FV_status_t status; 
+    while(length > 0){
+        // size the chunk up to the end of the current page 
+        size_t chunk = W25Q64FV_PAGE_SIZE - (start_address % W25Q64FV_PAGE_SIZE); 
+        if(chunk > length) chunk = length; 
+        // wait for the previous page to finish programming 
+        status = wait_until_free(); 
+        if(status != W25Q64FV_OK) return status; 
+        status = program_page(start_address, buffer, chunk, smart); 
+        if(status != W25Q64FV_OK) return status; 
+        start_address += chunk; 
+        buffer += chunk; 
+        length -= chunk; 
+    }
+    // check for a hold 
+    if(hold) return wait_until_free(); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::writev(uint32_t start_address, const W25Q64FV_iovec_t *segments, unsigned int count, bool hold){
+    // write a list of segments, split at page boundaries 
+    size_t length = segments_length(segments, count); 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    W25Q64FV_status_t status; 
+    unsigned int segment = 0; 
+    size_t offset = 0; 
+    while(length > 0){
+        size_t chunk = W25Q64FV_PAGE_SIZE - (start_address % W25Q64FV_PAGE_SIZE); 
+        if(chunk > length) chunk = length; 
+        // wait for the previous page to finish programming 
+        status = wait_until_free(); 
+        if(status != W25Q64FV_OK) return status; 
+        uint8_t lanes; 
+        status = begin_program(start_address, &lanes); 
+        if(status != W25Q64FV_OK) return status; 
+        // stream the segments straight onto the bus 
+        size_t remaining = chunk; 
+        while(remaining > 0){
+            size_t piece = segments[segment].length - offset; 
+            if(piece > remaining) piece = remaining; 
+            bus_transfer((const byte*)segments[segment].base + offset, NULL, piece, lanes); 
+            offset += piece; 
+            remaining -= piece; 
+            if(offset == segments[segment].length){
+                segment ++; 
+                offset = 0; 
+            }
+        }
+        release_device(); 
+        start_operation(W25Q64FV_OPERATION_PAGE_PROGRAM); 
+        start_address += chunk; 
+        length -= chunk; 
+    }
+    // check for a hold 
+    if(hold) return wait_until_free(); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::read_page(uint32_t start_address, byte *buffer){
+    // read a single page from the flash chip 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // read the page 
+    W25Q64FV_STAT(unsigned long start_time = micros()); 
+    select_device(); 
+    send_instruction(W25Q64FV_INSTRUCTION_READ_DATA, start_address); 
+    bus_transfer(NULL, buffer, W25Q64FV_PAGE_SIZE); 
+    release_device();
+    W25Q64FV_STAT(_stats.reads ++); 
+    W25Q64FV_STAT(record(W25Q64FV_HISTOGRAM_READ, micros() - start_time)); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::read(uint32_t start_address, byte *buffer, size_t length){
+    // stream an arbitrary length from the flash chip 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    if(length == 0) return W25Q64FV_OK; 
+    // check if busy, nothing can have been issued while in continuous read mode 
+    if(!_continuous_active && busy()) return W25Q64FV_BUSY; 
+    // the address counter auto-increments across pages, so one fast read covers the whole range 
+    W25Q64FV_STAT(unsigned long start_time = micros()); 
+    uint8_t lanes = begin_read(start_address); 
+    bus_transfer(NULL, buffer, length, lanes); 
+    release_device(); 
+    W25Q64FV_STAT(_stats.reads ++); 
+    W25Q64FV_STAT(record(W25Q64FV_HISTOGRAM_READ, micros() - start_time)); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::readv(uint32_t start_address, const W25Q64FV_iovec_t *segments, unsigned int count){
+    // stream a contiguous run into a list of segments 
+    size_t length = segments_length(segments, count); 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    if(length == 0) return W25Q64FV_OK; 
+    // check if busy, nothing can have been issued while in continuous read mode 
+    if(!_continuous_active && busy()) return W25Q64FV_BUSY; 
+    // one fast read, each segment takes the next part of the data phase 
+    W25Q64FV_STAT(unsigned long start_time = micros()); 
+    uint8_t lanes = begin_read(start_address); 
+    for(unsigned int i = 0; i < count; i ++){
+        if(segments[i].length > 0) bus_transfer(NULL, (byte*)segments[i].base, segments[i].length, lanes); 
+    }
+    release_device(); 
+    W25Q64FV_STAT(_stats.reads ++); 
+    W25Q64FV_STAT(record(W25Q64FV_HISTOGRAM_READ, micros() - start_time)); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::start_read(uint32_t start_address, byte *buffer, size_t length){
+    // start an asynchronous stream from the flash chip 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    // check if busy, nothing can have been issued while in continuous read mode 
+    if(!_continuous_active && busy()) return W25Q64FV_BUSY; 
+    uint8_t lanes = begin_read(start_address); 
+    _bus.start_transfer(NULL, buffer, length, lanes); 
+    _read_pending = true; 
+    W25Q64FV_STAT(_stats.reads ++); 
+    W25Q64FV_STAT(_stats.bytes += length); 
+    W25Q64FV_STAT(_read_start = micros()); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::set_io_mode(W25Q64FV_io_mode_t mode, bool continuous){
+    // set the read and program data path 
+    uint8_t lanes = 1; 
+    if(mode == W25Q64FV_IO_DUAL_OUTPUT || mode == W25Q64FV_IO_DUAL_IO) lanes = 2; 
+    if(mode == W25Q64FV_IO_QUAD_OUTPUT || mode == W25Q64FV_IO_QUAD_IO) lanes = 4; 
+    if(lanes > Transport::max_lanes || !_geometry.supports(mode)) return W25Q64FV_NOT_VALID; 
+    // only the I/O instructions take mode bits 
+    if(continuous && mode != W25Q64FV_IO_DUAL_IO && mode != W25Q64FV_IO_QUAD_IO) return W25Q64FV_NOT_VALID; 
+    if(_read_pending) return W25Q64FV_BUSY; 
+    // leave continuous read mode of the previous data path 
+    if(_continuous_active) exit_continuous_read(); 
+    if(lanes == 4){
+        W25Q64FV_status_t status = enable_quad(); 
+        if(status != W25Q64FV_OK) return status; 
+    }
+    _io_mode = mode; 
+    _continuous_mode = continuous; 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::finish_read(bool hold){
+    // complete an asynchronous stream 
+    if(!_read_pending) return W25Q64FV_NOT_VALID; 
+    while(!_bus.transfer_complete()){
+        if(!hold) return W25Q64FV_BUSY; 
+    }
+    release_device(); 
+    _read_pending = false; 
+    W25Q64FV_STAT(record(W25Q64FV_HISTOGRAM_READ, micros() - _read_start)); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::erase_chip(bool hold){
+    // erase the entire chip 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // check that writing is enables 
+    enable_writing(); 
+    // write the command to erase 
+    W25Q64FV_status_t status = write_command(W25Q64FV_INSTRUCTION_CHIP_ERASE); 
+    if(status != W25Q64FV_OK) return status; 
+    start_operation(W25Q64FV_OPERATION_CHIP_ERASE); 
+    // check for the hold 
+    if(hold) return wait_until_free(operation_time(W25Q64FV_OPERATION_CHIP_ERASE, true) / 1000); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::erase_sector(uint32_t sector_address, bool hold){
+    // erase the entire chip 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // skip blank sectors in smart mode 
+    if(_smart_mode){
+        W25Q64FV_compare_t result; 
+        sector_address -= sector_address % W25Q64FV_SECTOR_SIZE; 
+        stream_compare(sector_address, NULL, W25Q64FV_SECTOR_SIZE, &result, NULL, NULL); 
+        if(result == W25Q64FV_COMPARE_SAME){
+            _smart_stats.skipped_erases ++; 
+            return W25Q64FV_OK; 
+        }
+    }
+    // the part may not support this erase 
+    uint8_t instruction = _geometry.erase_instruction(W25Q64FV_OPERATION_SECTOR_ERASE); 
+    if(instruction == 0) return W25Q64FV_NOT_VALID; 
+    // check that writing is enables 
+    enable_writing(); 
+    // write the command to erase 
+    W25Q64FV_status_t status = write_address(instruction, sector_address); 
+    if(status != W25Q64FV_OK) return status; 
+    start_operation(W25Q64FV_OPERATION_SECTOR_ERASE); 
+    //check for a hold 
+    if(hold) return wait_until_free(); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::erase_block_32(uint32_t sector_address, bool hold){
+    // erase the entire chip 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // the part may not support this erase 
+    uint8_t instruction = _geometry.erase_instruction(W25Q64FV_OPERATION_BLOCK_32K_ERASE); 
+    if(instruction == 0) return W25Q64FV_NOT_VALID; 
+    // check that writing is enables 
+    enable_writing(); 
+    // write the command to erase 
+    W25Q64FV_status_t status = write_address(instruction, sector_address); 
+    if(status != W25Q64FV_OK) return status; 
+    start_operation(W25Q64FV_OPERATION_BLOCK_32K_ERASE); 
+    //check for a hold 
+    if(hold) return wait_until_free(); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::erase_block_64(uint32_t sector_address, bool hold){
+    // erase the entire chip 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // the part may not support this erase 
+    uint8_t instruction = _geometry.erase_instruction(W25Q64FV_OPERATION_BLOCK_64K_ERASE); 
+    if(instruction == 0) return W25Q64FV_NOT_VALID; 
+    // check that writing is enables 
+    enable_writing(); 
+    // write the command to erase 
+    W25Q64FV_status_t status = write_address(instruction, sector_address); 
+    if(status != W25Q64FV_OK) return status; 
+    start_operation(W25Q64FV_OPERATION_BLOCK_64K_ERASE); 
+    //check for a hold 
+    if(hold) return wait_until_free(); 
+    return W25Q64FV_OK; 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::erase_range(uint32_t start_address, uint32_t length, bool allow_chip_erase){
+    // erase a range with the fastest mix of erase sizes 
+    if(erase_range_time(start_address, length, allow_chip_erase) == 0 && length != 0) return W25Q64FV_NOT_VALID; 
+    if(use_chip_erase(start_address, length, allow_chip_erase)) return erase_chip(true); 
+    W25Q64FV_status_t status; 
+    while(length > 0){
+        uint32_t size = next_erase_size(start_address, length); 
+        if(size == W25Q64FV_BLOCK_64K_SIZE) status = erase_block_64(start_address, true); 
+        else if(size == W25Q64FV_BLOCK_32K_SIZE) status = erase_block_32(start_address, true); 
+        else status = erase_sector(start_address, true); 
+        if(status != W25Q64FV_OK) return status; 
+        start_address += size; 
+        length -= size; 
+    }
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+unsigned long W25Q64FV_Device<Transport, Geometry>::erase_range_time(uint32_t start_address, uint32_t length, bool allow_chip_erase){
+    // sum the typical times of the erase plan 
+    if((start_address % W25Q64FV_SECTOR_SIZE) != 0 || (length % W25Q64FV_SECTOR_SIZE) != 0) return 0; 
+    if(start_address + length > capacity() || start_address + length < start_address) return 0; 
+    if(use_chip_erase(start_address, length, allow_chip_erase)) return operation_time(W25Q64FV_OPERATION_CHIP_ERASE) / 1000; 
+    unsigned long time = 0; 
+    while(length > 0){
+        uint32_t size = next_erase_size(start_address, length); 
+        if(size == W25Q64FV_BLOCK_64K_SIZE) time += operation_time(W25Q64FV_OPERATION_BLOCK_64K_ERASE) / 1000; 
+        else if(size == W25Q64FV_BLOCK_32K_SIZE) time += operation_time(W25Q64FV_OPERATION_BLOCK_32K_ERASE) / 1000; 
+        else time += operation_time(W25Q64FV_OPERATION_SECTOR_ERASE) / 1000; 
+        start_address += size; 
+        length -= size; 
+    }
+    return time; 
+}
+
+
+template<class Transport, class Geometry>
+void W25Q64FV_Device<Transport, Geometry>::get_smart_stats(W25Q64FV_smart_stats_t *stats, bool reset){
+    *stats = _smart_stats; 
+    if(reset) memset(&_smart_stats, 0, sizeof(_smart_stats)); 
+}
+
+template<class Transport, class Geometry>
+void W25Q64FV_Device<Transport, Geometry>::get_stats(W25Q64FV_stats_t *stats, bool reset){
+#if W25Q64FV_ENABLE_STATS 
+    *stats = _stats; 
+    if(reset) memset(&_stats, 0, sizeof(_stats)); 
+#else 
+    (void)reset; 
+    memset(stats, 0, sizeof(*stats)); 
+#endif 
+}
+
+template<class Transport, class Geometry>
+void W25Q64FV_Device<Transport, Geometry>::print_stats(const W25Q64FV_stats_t &stats, Print &out){
+    static const char *const operation_names[] = {"none", "page program", "sector erase", "32k erase", "64k erase", "chip erase", "write status", "reset"}; 
+    static const char *const histogram_names[] = {"program", "erase", "read", "wait", "verify"}; 
+    // counters 
+    for(uint8_t i = W25Q64FV_OPERATION_PAGE_PROGRAM; i <= W25Q64FV_OPERATION_RESET; i ++){
+        out.print(operation_names[i]); 
+        out.print(": "); 
+        out.println(stats.operations[i]); 
+    }
+    out.print("reads: "); 
+    out.println(stats.reads); 
+    out.print("bytes: "); 
+    out.println(stats.bytes); 
+    out.print("selects: "); 
+    out.println(stats.selects); 
+    out.print("polls: "); 
+    out.println(stats.polls); 
+    out.print("timeouts: "); 
+    out.println(stats.timeouts); 
+    // histograms, by the upper bound of each bucket 
+    for(uint8_t h = 0; h < W25Q64FV_HISTOGRAM_COUNT; h ++){
+        for(uint8_t b = 0; b < W25Q64FV_STATS_BUCKETS; b ++){
+            if(stats.histograms[h][b] == 0) continue; 
+            out.print(histogram_names[h]); 
+            if(b == W25Q64FV_STATS_BUCKETS - 1){
+                out.print(" >= "); 
+                out.print(1UL << (b - 1)); 
+            }
+            else{
+                out.print(" < "); 
+                out.print(1UL << b); 
+            }
+            out.print(" us: "); 
+            out.println(stats.histograms[h][b]); 
+        }
+    }
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::compare(uint32_t start_address, const byte *buffer, size_t length, W25Q64FV_compare_t *result){
+    // compare the flash contents against a buffer 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    // check if busy, nothing can have been issued while in continuous read mode 
+    if(!_continuous_active && busy()) return W25Q64FV_BUSY; 
+    stream_compare(start_address, buffer, length, result, NULL, NULL); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::is_blank(uint32_t start_address, size_t length, bool *blank){
+    // compare the flash contents against the erased state 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    // check if busy, nothing can have been issued while in continuous read mode 
+    if(!_continuous_active && busy()) return W25Q64FV_BUSY; 
+    W25Q64FV_compare_t result; 
+    stream_compare(start_address, NULL, length, &result, NULL, NULL); 
+    *blank = (result == W25Q64FV_COMPARE_SAME); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::write_verified(uint32_t start_address, const byte *buffer, size_t length, uint32_t *crc){
+    // write an arbitrary length, then read it back against the CRC of the data 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    W25Q64FV_status_t status; 
+    uint32_t address = start_address; 
+    uint32_t expected = 0; 
+    size_t remaining = length; 
+    while(remaining > 0){
+        size_t chunk = W25Q64FV_PAGE_SIZE - (address % W25Q64FV_PAGE_SIZE); 
+        if(chunk > remaining) chunk = remaining; 
+        status = wait_until_free(); 
+        if(status != W25Q64FV_OK) return status; 
+        status = program_page(address, buffer, chunk, _smart_mode); 
+        if(status != W25Q64FV_OK) return status; 
+        // fold the page in while it programs 
+        expected = W25Q64FV_crc32(expected, buffer, chunk); 
+        address += chunk; 
+        buffer += chunk; 
+        remaining -= chunk; 
+    }
+    if(crc != NULL) *crc = expected; 
+    status = wait_until_free(); 
+    if(status != W25Q64FV_OK) return status; 
+    if(length == 0) return W25Q64FV_OK; 
+    W25Q64FV_STAT(unsigned long start_time = micros()); 
+    uint32_t actual = stream_crc(start_address, length); 
+    W25Q64FV_STAT(record(W25Q64FV_HISTOGRAM_VERIFY, micros() - start_time)); 
+    if(actual != expected) return W25Q64FV_VERIFY_FAIL; 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::read_verified(uint32_t start_address, byte *buffer, size_t length, uint32_t crc){
+    // read, then check the data against the expected CRC 
+    W25Q64FV_status_t status = read(start_address, buffer, length); 
+    if(status != W25Q64FV_OK) return status; 
+    if(W25Q64FV_crc32(0, buffer, length) != crc) return W25Q64FV_VERIFY_FAIL; 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::crc32(uint32_t start_address, size_t length, uint32_t *crc){
+    // stream a range into a CRC 
+    if(start_address + length > capacity()) return W25Q64FV_NOT_VALID; 
+    // check if busy, nothing can have been issued while in continuous read mode 
+    if(!_continuous_active && busy()) return W25Q64FV_BUSY; 
+    *crc = (length == 0) ? 0 : stream_crc(start_address, length); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::get_jedec(byte *manufacture_id, byte *memory_type, byte *capacity){
+    // read the jedec id and information 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // get the jedec info 
+    byte buffer[3]; 
+    W25Q64FV_status_t status = read_reg(W25Q64FV_INSTRUCTION_JEDEC_ID, buffer, 3); 
+    if(status != W25Q64FV_OK) return status; 
+    *manufacture_id = buffer[0]; 
+    *memory_type = buffer[1]; 
+    *capacity = buffer[2];
+    return W25Q64FV_OK; 
+}
+
+
+template<class Transport, class Geometry>
+bool W25Q64FV_Device<Transport, Geometry>::busy(){
+    // the bus is held by an asynchronous read 
+    if(_read_pending) return true; 
+    if(_known_idle) return false; 
+    // not worth a status read before the operation is expected to finish 
+    if((long)(micros() - _operation_end) < 0) return true; 
+    if((read_status()&W25Q64FV_SR1_BUSY)) return true; 
+    return false; 
+}
+
+template<class Transport, class Geometry>
+uint8_t W25Q64FV_Device<Transport, Geometry>::read_status(){
+    uint8_t status; 
+    select_device(); 
+    bus_transfer(W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_1); 
+    status = bus_transfer(0); 
+    release_device(); 
+    W25Q64FV_STAT(_stats.polls ++); 
+    W25Q64FV_STAT(if(!_known_idle && !(status&W25Q64FV_SR1_BUSY)) complete_operation()); 
+    _known_idle = !(status&W25Q64FV_SR1_BUSY); 
+    _write_enabled = (status&W25Q64FV_SR1_WEL); 
+    return status; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::wait_until_free(unsigned long max_timeout){
+    // get the current time 
+    unsigned long start_time = micros(); 
+    unsigned long timeout = max_timeout * 1000UL; 
+    if(_known_idle) return W25Q64FV_OK; 
+    if(_read_pending) return W25Q64FV_BUSY; 
+    // sleep through the typical time of the operation, no poll can succeed before then 
+    long remaining = (long)(_operation_end - start_time); 
+    if(remaining > 0){
+        if((unsigned long)remaining > timeout) remaining = timeout; 
+        sleep_us(remaining); 
+    }
+    // poll with exponential backoff, bounded by the operation length 
+    unsigned long backoff = W25Q64FV_BACKOFF_MIN; 
+    unsigned long backoff_max = operation_time(_operation) / 8; 
+    if(backoff_max > W25Q64FV_BACKOFF_MAX) backoff_max = W25Q64FV_BACKOFF_MAX; 
+    if(backoff_max < W25Q64FV_BACKOFF_MIN) backoff_max = W25Q64FV_BACKOFF_MIN; 
+    if(_continuous_status_poll){
+        // stream status register 1 under one chip select 
+        bool free = false; 
+        select_device(); 
+        bus_transfer(W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_1); 
+        while(true){
+            W25Q64FV_STAT(_stats.polls ++); 
+            if(!(bus_transfer(0)&W25Q64FV_SR1_BUSY)){
+                free = true; 
+                break; 
+            }
+            if((micros() - start_time) >= timeout) break; 
+            sleep_us(backoff); 
+            if(backoff < backoff_max) backoff *= 2; 
+        }
+        release_device(); 
+        W25Q64FV_STAT(record(W25Q64FV_HISTOGRAM_WAIT, micros() - start_time)); 
+        if(!free){
+            W25Q64FV_STAT(_stats.timeouts ++); 
+            return W25Q64FV_TIMEOUT; 
+        }
+        W25Q64FV_STAT(complete_operation()); 
+        _known_idle = true; 
+        _write_enabled = false; 
+        return W25Q64FV_OK; 
+    }
+    while(busy()){
+        if((micros() - start_time) >= timeout){
+            W25Q64FV_STAT(_stats.timeouts ++); 
+            W25Q64FV_STAT(record(W25Q64FV_HISTOGRAM_WAIT, micros() - start_time)); 
+            return W25Q64FV_TIMEOUT; 
+        }
+        sleep_us(backoff); 
+        if(backoff < backoff_max) backoff *= 2; 
+    }
+    W25Q64FV_STAT(record(W25Q64FV_HISTOGRAM_WAIT, micros() - start_time)); 
+    return W25Q64FV_OK; 
+}
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::reset(){
+    // reset the device, the reset drops 4 byte address mode 
+    W25Q64FV_status_t status = reset_device(); 
+    if(status != W25Q64FV_OK) return status; 
+    return set_address_mode(); 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::reset_device(){
+    // requires writing the reset enable followed by reset command to complete 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // write the reset enable command 
+    W25Q64FV_status_t status = write_command(W25Q64FV_INSTRUCTION_ENABLE_RESET); 
+    if(status != W25Q64FV_OK) return status; 
+    status = write_command(W25Q64FV_INSTRUCTION_RESET); 
+    // delay 
+    delayMicroseconds(W25Q64FV_TIME_RESET_MAX + 5); // typical reset time 30 us 
+    // the device comes out of reset free, with the latch and suspend cleared 
+    _known_idle = true; 
+    _write_enabled = false; 
+    _suspended = false; 
+    _continuous_active = false; 
+    _operation = W25Q64FV_OPERATION_NONE; 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::power_down(){
+    // power down the device 
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // write the power down command 
+    W25Q64FV_status_t status = write_command(W25Q64FV_INSTRUCTION_POWER_DOWN); 
+    if(status != W25Q64FV_OK) return status; 
+    delayMicroseconds(10); 
+    return W25Q64FV_OK;
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::release_power_down(){
+    // release the device from the power down state 
+    // cannot use the status register here 
+    select_device(); 
+    bus_transfer(W25Q64FV_INSTRUCTION_RELEASE_POWERDOWN);
+    release_device(); 
+    delayMicroseconds(10); // delay for the device to turn on 
+    unknown_state(); 
+    return W25Q64FV_OK; 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::suspend(bool hold){
+    // suspend an erase or program in progress 
+    if(_suspended) return W25Q64FV_OK; 
+    if(!_suspend_pending){
+        // nothing to suspend 
+        if(_known_idle || !(read_status()&W25Q64FV_SR1_BUSY)) return W25Q64FV_OK; 
+        // a suspend too soon after a resume is not allowed 
+        if(!hold && (micros() - _resume_time) < W25Q64FV_TIME_SUSPEND_INTERVAL) return W25Q64FV_BUSY; 
+        while((micros() - _resume_time) < W25Q64FV_TIME_SUSPEND_INTERVAL); 
+        // the busy check in write_command cannot be used here 
+        select_device(); 
+        bus_transfer(W25Q64FV_INSTRUCTION_ERASE_PROGRAM_SUSPEND); 
+        release_device(); 
+        _suspend_pending = true; 
+        _suspend_time = micros(); 
+    }
+    // the device takes up to the suspend time to stop 
+    unsigned long elapsed = micros() - _suspend_time; 
+    if(elapsed < W25Q64FV_TIME_SUSPEND_MAX){
+        if(!hold) return W25Q64FV_BUSY; 
+        delayMicroseconds(W25Q64FV_TIME_SUSPEND_MAX - elapsed); 
+    }
+    _suspend_pending = false; 
+    // the operation may have finished instead, either way the device is free 
+    if(suspended()){
+        // the device is free for reads and programs until resumed 
+        _suspended = true; 
+        _suspend_time = micros(); 
+        _suspended_operation = _operation; 
+        long remaining = (long)(_operation_end - _suspend_time); 
+        _suspended_remaining = remaining > 0 ? remaining : 0; 
+        _known_idle = true; 
+        // the latch is cleared by the suspend, a program in it needs a new enable 
+        _write_enabled = false; 
+        return W25Q64FV_OK; 
+    }
+    if(!(read_status()&W25Q64FV_SR1_BUSY)) return W25Q64FV_OK; 
+    return W25Q64FV_BUSY; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::resume(){
+    // resume a suspended erase or program 
+    if(!_suspended && !suspended()) return W25Q64FV_NOT_VALID; 
+    // a program issued during the suspend must finish first 
+    if(busy()) return W25Q64FV_BUSY; 
+    select_device(); 
+    bus_transfer(W25Q64FV_INSTRUCTION_ERASE_PROGRAM_RESUME); 
+    release_device(); 
+    _resume_time = micros(); 
+    _suspend_pending = false; 
+    // the time from the issue is lost, the completion is not timed 
+    W25Q64FV_STAT(_timed = false); 
+    // restore the suspended operation with its remaining time 
+    if(_suspended){
+        _operation = _suspended_operation; 
+        _operation_start = _resume_time; 
+        _operation_end = _resume_time + _suspended_remaining; 
+    }
+    else{
+        unknown_state(); 
+    }
+    _suspended = false; 
+    _known_idle = false; 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+bool W25Q64FV_Device<Transport, Geometry>::suspended(){
+    uint8_t status; 
+    // the bus is held by an asynchronous read 
+    if(_read_pending) return false; 
+    select_device(); 
+    bus_transfer(W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_2); 
+    status = bus_transfer(0); 
+    release_device(); 
+    if((status&W25Q64FV_SR2_SUS)) return true; 
+    return false; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::suspend_read(uint32_t start_address, byte *buffer, size_t length){
+    bool paused; 
+    W25Q64FV_status_t status = pause_operation(&paused, false); 
+    if(status != W25Q64FV_OK) return status; 
+    status = read(start_address, buffer, length); 
+    if(status != W25Q64FV_OK) return status; 
+    return resume_operation(paused); 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::suspend_write(uint32_t start_address, const byte *buffer, size_t length){
+    bool paused; 
+    W25Q64FV_status_t status = pause_operation(&paused, true); 
+    if(status != W25Q64FV_OK) return status; 
+    status = write(start_address, buffer, length, true); 
+    if(status != W25Q64FV_OK) return status; 
+    return resume_operation(paused); 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::pause_operation(bool *paused, bool program){
+    *paused = false; 
+    // suspended by the caller, or nothing running 
+    if(_suspended || !busy()) return W25Q64FV_OK; 
+    // a program cannot be issued in a program suspend 
+    bool erase = _operation >= W25Q64FV_OPERATION_SECTOR_ERASE && _operation <= W25Q64FV_OPERATION_BLOCK_64K_ERASE; 
+    if((erase || !program) && suspend() == W25Q64FV_OK){
+        // the operation may have finished instead 
+        *paused = _suspended; 
+        return W25Q64FV_OK; 
+    }
+    return wait_until_free(); 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::resume_operation(bool paused){
+    if(!paused) return W25Q64FV_OK; 
+    W25Q64FV_status_t status = resume(); 
+    if(status == W25Q64FV_NOT_VALID) return W25Q64FV_OK; 
+    return status; 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::write_reg(uint8_t reg, const uint8_t *buffer, unsigned int length){
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // select 
+    select_device(); 
+    // write instruction 
+    bus_transfer(reg); 
+    // write accompyning data 
+    bus_transfer(buffer, NULL, length); 
+    release_device(); 
+    return W25Q64FV_OK; 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::write_command(uint8_t command){
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // write the command 
+    select_device(); 
+    bus_transfer(command);
+    release_device(); 
+    return W25Q64FV_OK;
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::write_address(uint8_t instruction, uint32_t address){
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    select_device(); 
+    send_instruction(instruction, address); 
+    release_device(); 
+    return W25Q64FV_OK; 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::set_address_mode(){
+    // parts above 16MB are addressed with 4 bytes 
+    if(_geometry.address_bytes() != 4) return W25Q64FV_OK; 
+    return write_command(W25Q64FV_INSTRUCTION_ENTER_4B_ADDRESS_MODE); 
+}
+
+
+template<class Transport, class Geometry>
+void W25Q64FV_Device<Transport, Geometry>::read_sfdp(uint32_t address, uint8_t *buffer, size_t length){
+    // 3 byte address and 8 dummy clocks, whatever the address mode 
+    uint8_t header[5]; 
+    header[0] = W25Q64FV_INSTRUCTION_READ_SFDP_REGISTER; 
+    header[1] = address >> 16; 
+    header[2] = address >> 8; 
+    header[3] = address; 
+    header[4] = 0x00; 
+    select_device(); 
+    bus_transfer(header, NULL, 5); 
+    bus_transfer(NULL, buffer, length); 
+    release_device(); 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::read_parameters(W25Q64FV_parameters_t *parameters){
+    if(busy()) return W25Q64FV_BUSY; 
+    // size from the JEDEC ID, the capacity byte is log2 of the density 
+    byte manufacturer_id, memory_type, capacity_id; 
+    W25Q64FV_status_t status = get_jedec(&manufacturer_id, &memory_type, &capacity_id); 
+    if(status != W25Q64FV_OK) return status; 
+    if(capacity_id < 16 || capacity_id > 31) return W25Q64FV_COMMUNICATION_FAIL; 
+    W25Q64FV_default_parameters(parameters, 1UL << capacity_id); 
+    // SFDP header and the first parameter header, which is the basic flash parameter table 
+    uint8_t header[16]; 
+    read_sfdp(0, header, sizeof(header)); 
+    uint32_t signature = header[0] | ((uint32_t)header[1] << 8) | ((uint32_t)header[2] << 16) | ((uint32_t)header[3] << 24); 
+    if(signature != W25Q64FV_SFDP_SIGNATURE || header[8] != 0x00) return W25Q64FV_OK; 
+    uint8_t count = header[11]; 
+    if(count > W25Q64FV_SFDP_MAX_DWORDS) count = W25Q64FV_SFDP_MAX_DWORDS; 
+    if(count < 9) return W25Q64FV_OK; 
+    uint32_t pointer = header[12] | ((uint32_t)header[13] << 8) | ((uint32_t)header[14] << 16); 
+    uint32_t table[W25Q64FV_SFDP_MAX_DWORDS]; 
+    uint8_t raw[4 * W25Q64FV_SFDP_MAX_DWORDS]; 
+    read_sfdp(pointer, raw, 4 * count); 
+    for(uint8_t i = 0; i < count; i ++){
+        table[i] = raw[4*i] | ((uint32_t)raw[4*i + 1] << 8) | ((uint32_t)raw[4*i + 2] << 16) | ((uint32_t)raw[4*i + 3] << 24); 
+    }
+    // 1st DWORD: read data paths and address length 
+    parameters->io_modes = 1 << W25Q64FV_IO_SINGLE; 
+    if(table[0] & (1UL << 16)) parameters->io_modes |= 1 << W25Q64FV_IO_DUAL_OUTPUT; 
+    if(table[0] & (1UL << 20)) parameters->io_modes |= 1 << W25Q64FV_IO_DUAL_IO; 
+    if(table[0] & (1UL << 21)) parameters->io_modes |= 1 << W25Q64FV_IO_QUAD_IO; 
+    if(table[0] & (1UL << 22)) parameters->io_modes |= 1 << W25Q64FV_IO_QUAD_OUTPUT; 
+    // 2nd DWORD: density in bits, as N - 1 or as 2^N 
+    uint32_t density = table[1]; 
+    if(density & 0x80000000UL){
+        density &= 0x7FFFFFFFUL; 
+        if(density < 3 || density > 34) return W25Q64FV_COMMUNICATION_FAIL; 
+        parameters->capacity = 1UL << (density - 3); 
+    }
+    else parameters->capacity = (density >> 3) + 1; 
+    uint8_t address_mode = (table[0] >> 17) & 0x03; 
+    parameters->address_bytes = (address_mode == 2 || (address_mode == 1 && parameters->capacity > W25Q64FV_3B_ADDRESS_LIMIT)) ? 4 : 3; 
+    // 8th and 9th DWORDs: up to four erase types, as size 2^N and instruction 
+    // 10th DWORD: typical erase times, and the multiplier to the maximum 
+    memset(parameters->erase_instructions, 0, sizeof(parameters->erase_instructions)); 
+    static const unsigned long erase_units[4] = {1000UL, 16000UL, 128000UL, 1000000UL}; 
+    for(uint8_t i = 0; i < 4; i ++){
+        uint16_t type = table[7 + i / 2] >> (16 * (i % 2)); 
+        W25Q64FV_operation_t operation; 
+        switch(type & 0xFF){
+            case 12: operation = W25Q64FV_OPERATION_SECTOR_ERASE; break; 
+            case 15: operation = W25Q64FV_OPERATION_BLOCK_32K_ERASE; break; 
+            case 16: operation = W25Q64FV_OPERATION_BLOCK_64K_ERASE; break; 
+            default: continue; 
+        }
+        parameters->erase_instructions[operation - W25Q64FV_OPERATION_SECTOR_ERASE] = type >> 8; 
+        if(count < 10) continue; 
+        uint8_t time = table[9] >> (4 + 7 * i); 
+        parameters->times[operation] = ((time & 0x1F) + 1) * erase_units[(time >> 5) & 0x03]; 
+        parameters->max_times[operation] = parameters->times[operation] * 2 * ((table[9] & 0x0F) + 1); 
+    }
+    // 11th DWORD: page size, typical page program and chip erase times 
+    if(count >= 11){
+        static const unsigned long chip_units[4] = {16000UL, 256000UL, 4000000UL, 64000000UL}; 
+        parameters->page_size = 1 << ((table[10] >> 4) & 0x0F); 
+        uint8_t time = table[10] >> 8; 
+        parameters->times[W25Q64FV_OPERATION_PAGE_PROGRAM] = ((time & 0x1F) + 1) * ((time & 0x20) ? 64 : 8); 
+        parameters->max_times[W25Q64FV_OPERATION_PAGE_PROGRAM] = parameters->times[W25Q64FV_OPERATION_PAGE_PROGRAM] * 2 * ((table[10] & 0x0F) + 1); 
+        time = table[10] >> 24; 
+        parameters->times[W25Q64FV_OPERATION_CHIP_ERASE] = ((time & 0x1F) + 1) * chip_units[(time >> 5) & 0x03]; 
+        // saturate rather than overflow 
+        unsigned long multiplier = 2 * ((table[9] & 0x0F) + 1); 
+        unsigned long chip_time = parameters->times[W25Q64FV_OPERATION_CHIP_ERASE]; 
+        parameters->max_times[W25Q64FV_OPERATION_CHIP_ERASE] = (chip_time > 0xFFFFFFFFUL / multiplier) ? 0xFFFFFFFFUL : chip_time * multiplier; 
+    }
+    return W25Q64FV_OK; 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::program(uint32_t start_address, const byte *buffer, size_t length){
+    uint8_t lanes; 
+    W25Q64FV_status_t status = begin_program(start_address, &lanes); 
+    if(status != W25Q64FV_OK) return status; 
+    // write the page 
+    bus_transfer(buffer, NULL, length, lanes); 
+    release_device();
+    start_operation(W25Q64FV_OPERATION_PAGE_PROGRAM); 
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::begin_program(uint32_t start_address, uint8_t *lanes){
+    // check that writing is enabled 
+    W25Q64FV_status_t status = enable_writing(); 
+    if(status != W25Q64FV_OK) return status; 
+    select_device(); 
+    if(_io_mode == W25Q64FV_IO_QUAD_OUTPUT || _io_mode == W25Q64FV_IO_QUAD_IO){
+        send_instruction(W25Q64FV_INSTRUCTION_QUAD_PAGE_PROGRAM, start_address); 
+        *lanes = 4; 
+    }
+    else{
+        send_instruction(W25Q64FV_INSTRUCTION_PAGE_PROGRAM, start_address); 
+        *lanes = 1; 
+    }
+    return W25Q64FV_OK; 
+}
+
+template<class Transport, class Geometry>
+size_t W25Q64FV_Device<Transport, Geometry>::segments_length(const W25Q64FV_iovec_t *segments, unsigned int count){
+    size_t length = 0; 
+    for(unsigned int i = 0; i < count; i ++) length += segments[i].length; 
+    return length; 
+}
+
+
+
+template<class Transport, class Geometry>
+uint32_t W25Q64FV_Device<Transport, Geometry>::next_erase_size(uint32_t address, uint32_t remaining){
+    unsigned long sector_time = operation_time(W25Q64FV_OPERATION_SECTOR_ERASE); 
+    // an unsupported 32kB block costs its eight sectors 
+    bool block_32 = _geometry.erase_instruction(W25Q64FV_OPERATION_BLOCK_32K_ERASE) != 0; 
+    unsigned long block_32_time = block_32 ? operation_time(W25Q64FV_OPERATION_BLOCK_32K_ERASE) : 8UL * sector_time; 
+    // 64kB block, if supported, aligned, and faster than two 32kB blocks or sixteen sectors 
+    if(_geometry.erase_instruction(W25Q64FV_OPERATION_BLOCK_64K_ERASE) != 0 
+            && (address % W25Q64FV_BLOCK_64K_SIZE) == 0 && remaining >= W25Q64FV_BLOCK_64K_SIZE 
+            && operation_time(W25Q64FV_OPERATION_BLOCK_64K_ERASE) < 2UL * block_32_time
+            && operation_time(W25Q64FV_OPERATION_BLOCK_64K_ERASE) < 16UL * sector_time){
+        return W25Q64FV_BLOCK_64K_SIZE; 
+    }
+    // 32kB block, if supported, aligned, and faster than eight sectors 
+    if(block_32 && (address % W25Q64FV_BLOCK_32K_SIZE) == 0 && remaining >= W25Q64FV_BLOCK_32K_SIZE 
+            && block_32_time < 8UL * sector_time){
+        return W25Q64FV_BLOCK_32K_SIZE; 
+    }
+    return W25Q64FV_SECTOR_SIZE; 
+}
+
+
+template<class Transport, class Geometry>
+bool W25Q64FV_Device<Transport, Geometry>::use_chip_erase(uint32_t start_address, uint32_t length, bool allow_chip_erase){
+    // only for the whole device 
+    if(!allow_chip_erase || start_address != 0 || length != capacity()) return false; 
+    // compare against the block plan 
+    unsigned long block_time = erase_range_time(start_address, length, false); 
+    return (operation_time(W25Q64FV_OPERATION_CHIP_ERASE) / 1000) <= block_time; 
+}
+
+
+template<class Transport, class Geometry>
+uint8_t W25Q64FV_Device<Transport, Geometry>::begin_read(uint32_t address){
+    // address, then the mode bits or dummy byte, then two dummy bytes for quad I/O 
+    uint8_t header[7]; 
+    uint8_t length = put_address(header, address); 
+    header[length] = _continuous_mode ? W25Q64FV_MODE_CONTINUOUS : 0x00; 
+    header[length + 1] = 0x00; 
+    header[length + 2] = 0x00; 
+    // in continuous read mode the instruction is skipped 
+    bool skip_instruction = _continuous_active; 
+    _continuous_active = false; 
+    bus_select(); 
+    switch(_io_mode){
+        case W25Q64FV_IO_DUAL_OUTPUT: 
+            // instruction and address on one line, 8 dummy clocks 
+            bus_transfer(W25Q64FV_INSTRUCTION_FAST_READ_DUAL_OUTPUT); 
+            bus_transfer(header, NULL, length + 1); 
+            return 2; 
+        case W25Q64FV_IO_QUAD_OUTPUT: 
+            bus_transfer(W25Q64FV_INSTRUCTION_FAST_READ_QUAD_OUTPUT); 
+            bus_transfer(header, NULL, length + 1); 
+            return 4; 
+        case W25Q64FV_IO_DUAL_IO: 
+            // address and mode bits on two lines 
+            if(!skip_instruction) bus_transfer(W25Q64FV_INSTRUCTION_FAST_READ_DUAL_IO); 
+            bus_transfer(header, NULL, length + 1, 2); 
+            _continuous_active = _continuous_mode; 
+            return 2; 
+        case W25Q64FV_IO_QUAD_IO: 
+            // address and mode bits on four lines, 4 dummy clocks 
+            if(!skip_instruction) bus_transfer(W25Q64FV_INSTRUCTION_FAST_READ_QUAD_IO); 
+            bus_transfer(header, NULL, length + 3, 4); 
+            _continuous_active = _continuous_mode; 
+            return 4; 
+        default: 
+            bus_transfer(W25Q64FV_INSTRUCTION_FAST_READ); 
+            bus_transfer(header, NULL, length + 1); 
+            return 1; 
+    }
+}
+
+
+template<class Transport, class Geometry>
+void W25Q64FV_Device<Transport, Geometry>::stream_compare(uint32_t start_address, const byte *buffer, size_t length, W25Q64FV_compare_t *result, size_t *first, size_t *last){
+    byte chunk[W25Q64FV_COMPARE_CHUNK]; 
+    *result = W25Q64FV_COMPARE_SAME; 
+    if(length == 0) return; 
+    size_t offset = 0; 
+    uint8_t lanes = begin_read(start_address); 
+    W25Q64FV_STAT(_stats.reads ++); 
+    while(offset < length){
+        size_t count = length - offset; 
+        if(count > sizeof(chunk)) count = sizeof(chunk); 
+        bus_transfer(NULL, chunk, count, lanes); 
+        for(size_t i = 0; i < count; i ++){
+            byte expected = (buffer == NULL) ? 0xFF : buffer[offset + i]; 
+            if(chunk[i] == expected) continue; 
+            // programming can only clear bits 
+            if((chunk[i] & expected) != expected){
+                *result = W25Q64FV_COMPARE_ERASE_REQUIRED; 
+                release_device(); 
+                return; 
+            }
+            if(*result == W25Q64FV_COMPARE_SAME && first != NULL) *first = offset + i; 
+            if(last != NULL) *last = offset + i; 
+            *result = W25Q64FV_COMPARE_PROGRAMMABLE; 
+        }
+        offset += count; 
+    }
+    release_device(); 
+}
+
+
+template<class Transport, class Geometry>
+uint32_t W25Q64FV_Device<Transport, Geometry>::stream_crc(uint32_t start_address, size_t length){
+    byte chunk[W25Q64FV_COMPARE_CHUNK]; 
+    uint32_t crc = 0; 
+    uint8_t lanes = begin_read(start_address); 
+    W25Q64FV_STAT(_stats.reads ++); 
+    while(length > 0){
+        size_t count = length; 
+        if(count > sizeof(chunk)) count = sizeof(chunk); 
+        bus_transfer(NULL, chunk, count, lanes); 
+        crc = W25Q64FV_crc32(crc, chunk, count); 
+        length -= count; 
+    }
+    release_device(); 
+    return crc; 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::program_page(uint32_t start_address, const byte *buffer, size_t length, bool smart){
+    if(!smart) return program(start_address, buffer, length); 
+    // only program the span that changes 
+    W25Q64FV_compare_t result; 
+    size_t first = 0; 
+    size_t last = 0; 
+    stream_compare(start_address, buffer, length, &result, &first, &last); 
+    if(result == W25Q64FV_COMPARE_ERASE_REQUIRED) return W25Q64FV_NOT_VALID; 
+    if(result == W25Q64FV_COMPARE_SAME){
+        _smart_stats.skipped_pages ++; 
+        _smart_stats.skipped_bytes += length; 
+        return W25Q64FV_OK; 
+    }
+    _smart_stats.skipped_bytes += length - (last - first + 1); 
+    return program(start_address + first, buffer + first, last - first + 1); 
+}
+
+
+template<class Transport, class Geometry>
+void W25Q64FV_Device<Transport, Geometry>::exit_continuous_read(){
+    // 16 clocks of 1s on IO0 reset the mode bits in both dual and quad I/O 
+    const uint8_t reset[2] = {W25Q64FV_MODE_EXIT, W25Q64FV_MODE_EXIT}; 
+    _continuous_active = false; 
+    bus_select(); 
+    bus_transfer(reset, NULL, 2); 
+    _bus.deselect(); 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::enable_quad(){
+    // read both status registers 
+    uint8_t status_registers[2]; 
+    W25Q64FV_status_t status = read_reg(W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_1, &status_registers[0], 1); 
+    if(status != W25Q64FV_OK) return status; 
+    status = read_reg(W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_2, &status_registers[1], 1); 
+    if(status != W25Q64FV_OK) return status; 
+    if(status_registers[1] & W25Q64FV_SR2_QE) return W25Q64FV_OK; 
+    // set the quad enable bit 
+    status_registers[1] |= W25Q64FV_SR2_QE; 
+    status = write_command(W25Q64FV_INSTRUCTION_VOLATILE_SR_WRITE_ENABLE); 
+    if(status != W25Q64FV_OK) return status; 
+    status = write_reg(W25Q64FV_INSTRUCTION_WRITE_STATUS_REGISTER, status_registers, 2); 
+    if(status != W25Q64FV_OK) return status; 
+    // volatile writes complete without a write cycle, check the status register 
+    unknown_state(); 
+    status = wait_until_free(); 
+    if(status != W25Q64FV_OK) return status; 
+    // check the bit took 
+    status = read_reg(W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_2, &status_registers[1], 1); 
+    if(status != W25Q64FV_OK) return status; 
+    if(!(status_registers[1] & W25Q64FV_SR2_QE)) return W25Q64FV_COMMUNICATION_FAIL; 
+    return W25Q64FV_OK; 
+}
+
+
+template<class Transport, class Geometry>
+W25Q64FV_status_t W25Q64FV_Device<Transport, Geometry>::read_reg(uint8_t reg, uint8_t *buffer, unsigned int length){
+    // check if busy 
+    if(busy()) return W25Q64FV_BUSY; 
+    // select 
+    select_device(); 
+    bus_transfer(reg); 
+    bus_transfer(NULL, buffer, length); 
+    release_device(); 
+    return W25Q64FV_OK; 
+}
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @file W25Q64FV_Baseline.hpp
+ * @author Jeremy Dunne
+ * @brief the original page at a time driver, replayed on a transport for the benchmarks
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_BASELINE_HPP_
+#define _W25Q64FV_BASELINE_HPP_
+
+#include <Arduino.h>
+#include "W25Q64FV.hpp"
+
+/**
+ * @brief Transactions of the first release of the driver
+ *
+ * Issues the same instructions, status polls, and waits as the first release did, one
+ * byte per transfer, so the benchmarks can set the current driver against it on the
+ * same simulated bus
+ *
+ * @tparam Transport            Bus the instructions are clocked on
+ */
+template<class Transport>
+class W25Q64FV_Baseline{
+public:
+    /**
+     * @brief Construct a new baseline driver
+     *
+     * @param bus                   Bus of the device
+     */
+    W25Q64FV_Baseline(Transport &bus) : _bus(bus) {}
+
+    /**
+     * @brief Poll status register 1 once
+     *
+     * @return true                 The device is busy
+     * @return false                The device is free
+     */
+    bool busy(){
+        _bus.select();
+        _bus.transfer(W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_1);
+        uint8_t status = _bus.transfer(0);
+        _bus.deselect();
+        return status & 0b00000001;
+    }
+
+    /**
+     * @brief Poll the device every millisecond until it is free
+     *
+     * @param max_timeout           Timeout (ms)
+     * @return W25Q64FV_status_t    W25Q64FV_TIMEOUT if it is still busy
+     */
+    W25Q64FV_status_t wait_until_free(unsigned long max_timeout = W25Q64FV_DEFAULT_TIMEOUT){
+        unsigned long start_time = millis();
+        while(busy() & ((millis() - start_time) < max_timeout)){
+            delay(1);
+        }
+        if(busy()) return W25Q64FV_TIMEOUT;
+        return W25Q64FV_OK;
+    }
+
+    /**
+     * @brief Set the write enable latch and wait for the device
+     *
+     * @return W25Q64FV_status_t    W25Q64FV_BUSY if the device is busy
+     */
+    W25Q64FV_status_t enable_writing(){
+        if(busy()) return W25Q64FV_BUSY;
+        if(busy()) return W25Q64FV_BUSY;
+        _bus.select();
+        _bus.transfer(W25Q64FV_INSTRUCTION_WRITE_ENABLE);
+        _bus.deselect();
+        return wait_until_free();
+    }
+
+    /**
+     * @brief Program a page without waiting for it
+     *
+     * @param start_address         Page address
+     * @param buffer                256 bytes to program
+     * @return W25Q64FV_status_t    W25Q64FV_BUSY if the device is busy
+     */
+    W25Q64FV_status_t write_page(uint32_t start_address, const byte *buffer){
+        if(busy()) return W25Q64FV_BUSY;
+        enable_writing();
+        _bus.select();
+        _bus.transfer(W25Q64FV_INSTRUCTION_PAGE_PROGRAM);
+        _bus.transfer(start_address >> 16);
+        _bus.transfer(start_address >> 8);
+        _bus.transfer(start_address);
+        for(int i = 0; i < 256; i ++) _bus.transfer(buffer[i]);
+        _bus.deselect();
+        return W25Q64FV_OK;
+    }
+
+    /**
+     * @brief Read a page one byte per transfer
+     *
+     * @param start_address         Page address
+     * @param buffer                256 bytes to read into
+     * @return W25Q64FV_status_t    W25Q64FV_BUSY if the device is busy
+     */
+    W25Q64FV_status_t read_page(uint32_t start_address, byte *buffer){
+        if(busy()) return W25Q64FV_BUSY;
+        _bus.select();
+        _bus.transfer(W25Q64FV_INSTRUCTION_READ_DATA);
+        _bus.transfer(start_address >> 16);
+        _bus.transfer(start_address >> 8);
+        _bus.transfer(start_address);
+        for(int i = 0; i < 256; i ++) buffer[i] = _bus.transfer(0x00);
+        _bus.deselect();
+        return W25Q64FV_OK;
+    }
+
+    /**
+     * @brief Erase a sector
+     *
+     * @param sector_address        Sector address
+     * @param hold                  Wait for the erase
+     * @return W25Q64FV_status_t    W25Q64FV_BUSY if the device is busy
+     */
+    W25Q64FV_status_t erase_sector(uint32_t sector_address, bool hold = true){
+        if(busy()) return W25Q64FV_BUSY;
+        enable_writing();
+        if(busy()) return W25Q64FV_BUSY;
+        _bus.select();
+        _bus.transfer(W25Q64FV_INSTRUCTION_SECTOR_4K_ERASE);
+        _bus.transfer(sector_address >> 16);
+        _bus.transfer(sector_address >> 8);
+        _bus.transfer(sector_address);
+        _bus.deselect();
+        if(hold) return wait_until_free();
+        return W25Q64FV_OK;
+    }
+
+private:
+    Transport &_bus; ///<Bus of the device
+};
+
+#endif
@@ -0,0 +1,531 @@
+/**
+ * @file W25Q64FV_Simulator.cpp
+ * @author Jeremy Dunne
+ * @brief source file for the behavioral flash model of host builds of the W25Q64 library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Simulator.hpp"
+
+void W25Q64FV_sim_default_timing(W25Q64FV_sim_timing_t *timing, uint32_t capacity, bool maximum){
+    timing->page_program = maximum ? W25Q64FV_TIME_PAGE_PROGRAM_MAX : W25Q64FV_TIME_PAGE_PROGRAM_TYP;
+    timing->sector_erase = maximum ? W25Q64FV_TIME_SECTOR_ERASE_MAX : W25Q64FV_TIME_SECTOR_ERASE_TYP;
+    timing->block_32k_erase = maximum ? W25Q64FV_TIME_BLOCK_32K_ERASE_MAX : W25Q64FV_TIME_BLOCK_32K_ERASE_TYP;
+    timing->block_64k_erase = maximum ? W25Q64FV_TIME_BLOCK_64K_ERASE_MAX : W25Q64FV_TIME_BLOCK_64K_ERASE_TYP;
+    // scaled by density, like the fixed geometries
+    unsigned long chip_erase = maximum ? W25Q64FV_TIME_CHIP_ERASE_MAX : W25Q64FV_TIME_CHIP_ERASE_TYP;
+    timing->chip_erase = chip_erase / (W25Q64FV_CAPACITY >> 16) * (capacity >> 16);
+    timing->write_status = maximum ? W25Q64FV_TIME_WRITE_STATUS_MAX : W25Q64FV_TIME_WRITE_STATUS_TYP;
+    timing->suspend = W25Q64FV_TIME_SUSPEND_MAX;
+    timing->suspend_interval = W25Q64FV_TIME_SUSPEND_INTERVAL;
+    timing->reset = W25Q64FV_TIME_RESET_MAX;
+    timing->release_power_down = 3;
+}
+
+W25Q64FV_SimulatedFlash::W25Q64FV_SimulatedFlash(uint32_t capacity, bool sfdp) : _memory(capacity, 0xFF), _capacity(capacity){
+    W25Q64FV_sim_default_timing(&_timing, capacity);
+    memset(&_counters, 0, sizeof(_counters));
+    _last_violation = "";
+    _verbose = false;
+    _write_enabled = false;
+    _status_1 = 0;
+    _status_2 = 0;
+    _status_2_nv = 0;
+    _address_4b = false;
+    _volatile_enable = false;
+    _reset_enable = false;
+    _powered_down = false;
+    _continuous = 0;
+    _ready_time = 0;
+    _operation = W25Q64FV_OPERATION_NONE;
+    _operation_end = 0;
+    _area_start = 0;
+    _area_length = 0;
+    _suspending = false;
+    _suspend_time = 0;
+    _suspended = false;
+    _remaining = 0;
+    _resume_time = 0;
+    _nested = false;
+    _nested_end = 0;
+    _selected = false;
+    _instruction = 0;
+    _index = 0;
+    _address = 0;
+    _mode = 0;
+    _mode_reset = false;
+    _busy_at_start = false;
+    memset(_latch, 0xFF, sizeof(_latch));
+    _latched = 0;
+    memset(_register_data, 0, sizeof(_register_data));
+    _read_violation = false;
+    if(sfdp) build_sfdp();
+    else memset(_sfdp, 0xFF, sizeof(_sfdp));
+}
+
+void W25Q64FV_SimulatedFlash::select(){
+    if(_selected) violation("chip select asserted twice");
+    _selected = true;
+    _counters.selects ++;
+    _instruction = 0;
+    _index = 0;
+    _address = 0;
+    _mode = 0;
+    _mode_reset = false;
+    memset(_latch, 0xFF, sizeof(_latch));
+    _latched = 0;
+    _read_violation = false;
+    // in continuous read mode the transaction starts at the address
+    if(_continuous){
+        _instruction = _continuous;
+        _index = 1;
+        _busy_at_start = busy();
+    }
+}
+
+void W25Q64FV_SimulatedFlash::deselect(){
+    if(!_selected){
+        violation("chip select released twice");
+        return;
+    }
+    _selected = false;
+    uint64_t now = host_clock_ns();
+    update(now);
+    if(_index == 0) return;
+    execute(now);
+}
+
+uint8_t W25Q64FV_SimulatedFlash::exchange(uint8_t data, uint8_t lanes){
+    _counters.bytes ++;
+    if(!_selected){
+        violation("clocked without chip select");
+        return 0xFF;
+    }
+    size_t index = _index ++;
+    if(index == 0){
+        _instruction = data;
+        _busy_at_start = busy();
+        if(lanes != 1) violation("instruction on more than one line");
+        if(!_powered_down && !(_status_2 & W25Q64FV_SR2_QE) && (data == W25Q64FV_INSTRUCTION_FAST_READ_QUAD_OUTPUT
+                || data == W25Q64FV_INSTRUCTION_FAST_READ_QUAD_IO || data == W25Q64FV_INSTRUCTION_QUAD_PAGE_PROGRAM)){
+            violation("quad instruction without QE");
+        }
+        return 0xFF;
+    }
+    if(_powered_down) return 0xFF;
+    // ones on IO0 reset the mode bits of continuous read mode
+    if(_continuous && index == 1 && lanes == 1 && data == W25Q64FV_MODE_EXIT) _mode_reset = true;
+    if(_mode_reset) return 0xFF;
+    if(lanes != expected_lanes(index)) violation("data on the wrong number of lines");
+    uint8_t address_length = address_bytes(_instruction);
+    switch(_instruction){
+        case W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_1: {
+            // BUSY may change while streaming
+            _counters.polls ++;
+            bool running = busy();
+            return _status_1 | (running ? W25Q64FV_SR1_BUSY : 0) | (_write_enabled ? W25Q64FV_SR1_WEL : 0);
+        }
+        case W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_2:
+            _counters.polls ++;
+            return _status_2 | (suspended() ? W25Q64FV_SR2_SUS : 0);
+        case W25Q64FV_INSTRUCTION_JEDEC_ID: {
+            uint8_t density = 0;
+            while((1UL << density) < _capacity) density ++;
+            if(index == 1) return 0xEF;
+            if(index == 2) return 0x40;
+            if(index == 3) return density;
+            return 0xFF;
+        }
+        case W25Q64FV_INSTRUCTION_MANUFACTURER_DEVICE_ID: {
+            uint8_t density = 0;
+            while((1UL << density) < _capacity) density ++;
+            if(index <= 3) return 0xFF;
+            return ((index - 4) % 2 == 0) ? 0xEF : density - 1;
+        }
+        case W25Q64FV_INSTRUCTION_READ_UNIQUE_ID:
+            if(index <= 4 || index > 12) return 0xFF;
+            return (uint8_t)(W25Q64FV_SIM_UNIQUE_ID >> (8 * (12 - index)));
+        case W25Q64FV_INSTRUCTION_READ_SFDP_REGISTER:
+            if(index <= 3){
+                _address = (_address << 8) | data;
+                return 0xFF;
+            }
+            if(index == 4) return 0xFF;
+            return _sfdp[(_address + index - 5) % W25Q64FV_SIM_SFDP_SIZE];
+        case W25Q64FV_INSTRUCTION_WRITE_STATUS_REGISTER:
+            if(index <= 2) _register_data[index - 1] = data;
+            return 0xFF;
+        case W25Q64FV_INSTRUCTION_PAGE_PROGRAM:
+        case W25Q64FV_INSTRUCTION_QUAD_PAGE_PROGRAM:
+            if(index <= address_length){
+                _address = (_address << 8) | data;
+                return 0xFF;
+            }
+            // the address wraps within the page
+            _latch[(_address + _latched) % W25Q64FV_PAGE_SIZE] = data;
+            _latched ++;
+            return 0xFF;
+        case W25Q64FV_INSTRUCTION_SECTOR_4K_ERASE:
+        case W25Q64FV_INSTRUCTION_BLOCK_32K_ERASE:
+        case W25Q64FV_INSTRUCTION_BLOCK_64K_ERASE:
+            if(index <= address_length) _address = (_address << 8) | data;
+            return 0xFF;
+        case W25Q64FV_INSTRUCTION_READ_DATA:
+        case W25Q64FV_INSTRUCTION_FAST_READ:
+        case W25Q64FV_INSTRUCTION_FAST_READ_DUAL_OUTPUT:
+        case W25Q64FV_INSTRUCTION_FAST_READ_QUAD_OUTPUT:
+        case W25Q64FV_INSTRUCTION_FAST_READ_DUAL_IO:
+        case W25Q64FV_INSTRUCTION_FAST_READ_QUAD_IO: {
+            size_t header = read_header(_instruction);
+            if(index <= address_length){
+                _address = (_address << 8) | data;
+                return 0xFF;
+            }
+            if(index == (size_t)address_length + 1) _mode = data;
+            if(index < header) return 0xFF;
+            if(index == header){
+                _counters.reads ++;
+                if(_busy_at_start || busy()){
+                    violation("read while busy");
+                    _read_violation = true;
+                }
+            }
+            uint32_t address = (_address + (index - header)) % _capacity;
+            if(!_read_violation && in_area(address)){
+                violation("read of an area being erased or programmed");
+                _read_violation = true;
+            }
+            _counters.read_bytes ++;
+            return _memory[address];
+        }
+        default:
+            return 0xFF;
+    }
+}
+
+bool W25Q64FV_SimulatedFlash::busy(){
+    uint64_t now = host_clock_ns();
+    update(now);
+    if(now < _ready_time) return true;
+    if(_nested) return true;
+    return _operation != W25Q64FV_OPERATION_NONE && !_suspended;
+}
+
+bool W25Q64FV_SimulatedFlash::suspended(){
+    update(host_clock_ns());
+    return _suspended;
+}
+
+void W25Q64FV_SimulatedFlash::update(uint64_t now){
+    if(_suspending && now >= _suspend_time){
+        _suspending = false;
+        // the operation may have finished first
+        if(_operation != W25Q64FV_OPERATION_NONE && _operation_end > _suspend_time){
+            _suspended = true;
+            _remaining = _operation_end - _suspend_time;
+            _write_enabled = false;
+            _counters.suspends ++;
+        }
+    }
+    if(_operation != W25Q64FV_OPERATION_NONE && !_suspended && now >= _operation_end){
+        _operation = W25Q64FV_OPERATION_NONE;
+        _write_enabled = false;
+    }
+    if(_nested && now >= _nested_end){
+        _nested = false;
+        _write_enabled = false;
+    }
+}
+
+uint8_t W25Q64FV_SimulatedFlash::address_bytes(uint8_t instruction) const{
+    // SFDP and the IDs always take 3 bytes
+    if(instruction == W25Q64FV_INSTRUCTION_READ_SFDP_REGISTER || instruction == W25Q64FV_INSTRUCTION_MANUFACTURER_DEVICE_ID) return 3;
+    return _address_4b ? 4 : 3;
+}
+
+size_t W25Q64FV_SimulatedFlash::read_header(uint8_t instruction) const{
+    size_t address_length = address_bytes(instruction);
+    switch(instruction){
+        case W25Q64FV_INSTRUCTION_READ_DATA: return 1 + address_length;
+        // mode bits and 4 dummy clocks, two bytes on four lines
+        case W25Q64FV_INSTRUCTION_FAST_READ_QUAD_IO: return 1 + address_length + 3;
+        // a dummy byte, or the mode bits of dual I/O
+        default: return 1 + address_length + 1;
+    }
+}
+
+uint8_t W25Q64FV_SimulatedFlash::expected_lanes(size_t index) const{
+    size_t address_length = address_bytes(_instruction);
+    switch(_instruction){
+        case W25Q64FV_INSTRUCTION_FAST_READ_DUAL_OUTPUT: return index > address_length + 1 ? 2 : 1;
+        case W25Q64FV_INSTRUCTION_FAST_READ_QUAD_OUTPUT: return index > address_length + 1 ? 4 : 1;
+        case W25Q64FV_INSTRUCTION_FAST_READ_DUAL_IO: return 2;
+        case W25Q64FV_INSTRUCTION_FAST_READ_QUAD_IO: return 4;
+        case W25Q64FV_INSTRUCTION_QUAD_PAGE_PROGRAM: return index > address_length ? 4 : 1;
+        default: return 1;
+    }
+}
+
+void W25Q64FV_SimulatedFlash::start(W25Q64FV_operation_t operation, uint32_t start, uint32_t length, uint64_t now){
+    unsigned long time;
+    switch(operation){
+        case W25Q64FV_OPERATION_PAGE_PROGRAM: time = _timing.page_program; break;
+        case W25Q64FV_OPERATION_SECTOR_ERASE: time = _timing.sector_erase; break;
+        case W25Q64FV_OPERATION_BLOCK_32K_ERASE: time = _timing.block_32k_erase; break;
+        case W25Q64FV_OPERATION_BLOCK_64K_ERASE: time = _timing.block_64k_erase; break;
+        case W25Q64FV_OPERATION_CHIP_ERASE: time = _timing.chip_erase; break;
+        case W25Q64FV_OPERATION_WRITE_STATUS: time = _timing.write_status; break;
+        default: time = 0; break;
+    }
+    _operation = operation;
+    _operation_end = now + (uint64_t)time * 1000;
+    _area_start = start;
+    _area_length = length;
+    _counters.operations[operation] ++;
+}
+
+bool W25Q64FV_SimulatedFlash::in_area(uint32_t address) const{
+    if(_operation == W25Q64FV_OPERATION_NONE) return false;
+    return address - _area_start < _area_length;
+}
+
+void W25Q64FV_SimulatedFlash::execute(uint64_t now){
+    uint8_t instruction = _instruction;
+    uint8_t address_length = address_bytes(instruction);
+    // the enables only apply to the next instruction
+    bool volatile_enable = _volatile_enable;
+    bool reset_enable = _reset_enable;
+    _volatile_enable = false;
+    _reset_enable = false;
+    if(_continuous){
+        // continuous read mode holds only while the mode bits keep it
+        bool complete = _index > (size_t)address_length + 1;
+        _continuous = (!_mode_reset && complete && (_mode & 0x30) == W25Q64FV_MODE_CONTINUOUS) ? instruction : 0;
+        return;
+    }
+    if(_powered_down){
+        if(instruction == W25Q64FV_INSTRUCTION_RELEASE_POWERDOWN){
+            _powered_down = false;
+            _ready_time = now + (uint64_t)_timing.release_power_down * 1000;
+        }
+        else violation("instruction in power down");
+        return;
+    }
+    bool allowed_busy = instruction == W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_1
+        || instruction == W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_2
+        || instruction == W25Q64FV_INSTRUCTION_ERASE_PROGRAM_SUSPEND
+        || instruction == W25Q64FV_INSTRUCTION_ENABLE_RESET
+        || instruction == W25Q64FV_INSTRUCTION_RESET;
+    if(_busy_at_start && !allowed_busy){
+        // a read was already reported by its data phase
+        if(!_read_violation) violation("instruction while busy");
+        return;
+    }
+    switch(instruction){
+        case W25Q64FV_INSTRUCTION_WRITE_ENABLE:
+            _write_enabled = true;
+            break;
+        case W25Q64FV_INSTRUCTION_WRITE_DISABLE:
+            _write_enabled = false;
+            break;
+        case W25Q64FV_INSTRUCTION_VOLATILE_SR_WRITE_ENABLE:
+            _volatile_enable = true;
+            break;
+        case W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_1:
+        case W25Q64FV_INSTRUCTION_READ_STATUS_REGISTER_2:
+        case W25Q64FV_INSTRUCTION_JEDEC_ID:
+        case W25Q64FV_INSTRUCTION_MANUFACTURER_DEVICE_ID:
+        case W25Q64FV_INSTRUCTION_READ_UNIQUE_ID:
+        case W25Q64FV_INSTRUCTION_READ_SFDP_REGISTER:
+        case W25Q64FV_INSTRUCTION_READ_DATA:
+        case W25Q64FV_INSTRUCTION_FAST_READ:
+        case W25Q64FV_INSTRUCTION_FAST_READ_DUAL_OUTPUT:
+        case W25Q64FV_INSTRUCTION_FAST_READ_QUAD_OUTPUT:
+        case W25Q64FV_INSTRUCTION_RELEASE_POWERDOWN:
+            break;
+        case W25Q64FV_INSTRUCTION_FAST_READ_DUAL_IO:
+        case W25Q64FV_INSTRUCTION_FAST_READ_QUAD_IO:
+            // the mode bits decide if the next transaction skips the instruction
+            _continuous = (_index > (size_t)address_length + 1 && (_mode & 0x30) == W25Q64FV_MODE_CONTINUOUS) ? instruction : 0;
+            break;
+        case W25Q64FV_INSTRUCTION_WRITE_STATUS_REGISTER:
+            if(_index < 2){
+                violation("status register write without data");
+                break;
+            }
+            if(_suspended){
+                violation("status register write in a suspend");
+                break;
+            }
+            if(!volatile_enable && !_write_enabled){
+                violation("status register write without WEL");
+                break;
+            }
+            _status_1 = _register_data[0] & ~(W25Q64FV_SR1_BUSY | W25Q64FV_SR1_WEL);
+            if(_index > 2) _status_2 = _register_data[1] & ~W25Q64FV_SR2_SUS;
+            if(volatile_enable) break;
+            _status_2_nv = _status_2;
+            start(W25Q64FV_OPERATION_WRITE_STATUS, 0, 0, now);
+            break;
+        case W25Q64FV_INSTRUCTION_PAGE_PROGRAM:
+        case W25Q64FV_INSTRUCTION_QUAD_PAGE_PROGRAM: {
+            if(_latched == 0){
+                violation("page program without data");
+                break;
+            }
+            if(!_write_enabled){
+                violation("page program without WEL");
+                break;
+            }
+            uint32_t page = (_address % _capacity) - (_address % W25Q64FV_PAGE_SIZE);
+            if(_suspended && (_operation == W25Q64FV_OPERATION_PAGE_PROGRAM || page - _area_start < _area_length)){
+                violation("page program in the suspended area");
+                break;
+            }
+            // programming only clears bits
+            for(size_t i = 0; i < W25Q64FV_PAGE_SIZE; i ++) _memory[page + i] &= _latch[i];
+            _counters.programmed_bytes += _latched < W25Q64FV_PAGE_SIZE ? _latched : W25Q64FV_PAGE_SIZE;
+            if(_suspended){
+                _nested = true;
+                _nested_end = now + (uint64_t)_timing.page_program * 1000;
+                _counters.operations[W25Q64FV_OPERATION_PAGE_PROGRAM] ++;
+            }
+            else start(W25Q64FV_OPERATION_PAGE_PROGRAM, page, W25Q64FV_PAGE_SIZE, now);
+            break;
+        }
+        case W25Q64FV_INSTRUCTION_SECTOR_4K_ERASE:
+        case W25Q64FV_INSTRUCTION_BLOCK_32K_ERASE:
+        case W25Q64FV_INSTRUCTION_BLOCK_64K_ERASE: {
+            // chip select must rise right after the address
+            if(_index != (size_t)address_length + 1){
+                violation("erase without exactly an address");
+                break;
+            }
+            if(!_write_enabled){
+                violation("erase without WEL");
+                break;
+            }
+            if(_suspended){
+                violation("erase in a suspend");
+                break;
+            }
+            uint32_t size = W25Q64FV_SECTOR_SIZE;
+            W25Q64FV_operation_t operation = W25Q64FV_OPERATION_SECTOR_ERASE;
+            if(instruction == W25Q64FV_INSTRUCTION_BLOCK_32K_ERASE){
+                size = W25Q64FV_BLOCK_32K_SIZE;
+                operation = W25Q64FV_OPERATION_BLOCK_32K_ERASE;
+            }
+            else if(instruction == W25Q64FV_INSTRUCTION_BLOCK_64K_ERASE){
+                size = W25Q64FV_BLOCK_64K_SIZE;
+                operation = W25Q64FV_OPERATION_BLOCK_64K_ERASE;
+            }
+            uint32_t base = (_address % _capacity) & ~(size - 1);
+            memset(&_memory[base], 0xFF, size);
+            start(operation, base, size, now);
+            break;
+        }
+        case W25Q64FV_INSTRUCTION_CHIP_ERASE:
+        case 0x60:
+            if(_index != 1){
+                violation("chip erase with extra bytes");
+                break;
+            }
+            if(!_write_enabled){
+                violation("erase without WEL");
+                break;
+            }
+            if(_suspended){
+                violation("erase in a suspend");
+                break;
+            }
+            memset(&_memory[0], 0xFF, _capacity);
+            start(W25Q64FV_OPERATION_CHIP_ERASE, 0, _capacity, now);
+            break;
+        case W25Q64FV_INSTRUCTION_ERASE_PROGRAM_SUSPEND:
+            // ignored unless a program or sector or block erase is running
+            if(_suspended || _suspending || !_busy_at_start) break;
+            if(_operation < W25Q64FV_OPERATION_PAGE_PROGRAM || _operation > W25Q64FV_OPERATION_BLOCK_64K_ERASE) break;
+            if(_counters.resumes > 0 && now - _resume_time < (uint64_t)_timing.suspend_interval * 1000){
+                violation("suspend too soon after a resume");
+                break;
+            }
+            _suspending = true;
+            _suspend_time = now + (uint64_t)_timing.suspend * 1000;
+            break;
+        case W25Q64FV_INSTRUCTION_ERASE_PROGRAM_RESUME:
+            if(!_suspended) break;
+            _suspended = false;
+            _operation_end = now + _remaining;
+            _resume_time = now;
+            _counters.resumes ++;
+            break;
+        case W25Q64FV_INSTRUCTION_ENABLE_RESET:
+            _reset_enable = true;
+            break;
+        case W25Q64FV_INSTRUCTION_RESET:
+            if(!reset_enable){
+                violation("reset without reset enable");
+                break;
+            }
+            // an operation in progress is abandoned
+            _operation = W25Q64FV_OPERATION_NONE;
+            _suspending = false;
+            _suspended = false;
+            _nested = false;
+            _write_enabled = false;
+            _address_4b = false;
+            _continuous = 0;
+            _status_2 = _status_2_nv;
+            _ready_time = now + (uint64_t)_timing.reset * 1000;
+            break;
+        case W25Q64FV_INSTRUCTION_ENTER_4B_ADDRESS_MODE:
+            _address_4b = true;
+            break;
+        case 0xE9:
+            _address_4b = false;
+            break;
+        case W25Q64FV_INSTRUCTION_POWER_DOWN:
+            _powered_down = true;
+            break;
+        default:
+            violation("unsupported instruction");
+            break;
+    }
+}
+
+void W25Q64FV_SimulatedFlash::build_sfdp(){
+    memset(_sfdp, 0xFF, sizeof(_sfdp));
+    // header: signature, revision 1.6, one parameter header
+    const byte header[8] = {'S', 'F', 'D', 'P', 0x06, 0x01, 0x00, 0xFF};
+    memcpy(_sfdp, header, sizeof(header));
+    // basic flash parameter table, 16 DWORDs at 0x80
+    const byte parameter_header[8] = {0x00, 0x06, 0x01, 16, 0x80, 0x00, 0x00, 0xFF};
+    memcpy(_sfdp + 8, parameter_header, sizeof(parameter_header));
+    uint32_t table[16];
+    for(uint8_t i = 0; i < 16; i ++) table[i] = 0xFFFFFFFFUL;
+    // 4kB erase with 0x20, every fast read, 3 byte or 3 and 4 byte addressing
+    table[0] = _capacity > W25Q64FV_3B_ADDRESS_LIMIT ? 0xFFFB20E5UL : 0xFFF920E5UL;
+    table[1] = _capacity * 8 - 1;
+    // erase types: 4kB 0x20, 32kB 0x52, 64kB 0xD8
+    table[7] = 0x520F200CUL;
+    table[8] = 0xFF00D810UL;
+    // typical erase times, 48ms, 128ms, 160ms, maximum 6 times typical
+    table[9] = 2UL | ((2UL | (1UL << 5)) << 4) | ((0UL | (2UL << 5)) << 11) | ((9UL | (1UL << 5)) << 18);
+    // 256 byte pages, 704us typical program, 20s chip erase per 8MB in 4s units
+    uint32_t chip_units = 5 * (_capacity / W25Q64FV_CAPACITY);
+    if(chip_units == 0) chip_units = 1;
+    table[10] = 2UL | (8UL << 4) | ((10UL | (1UL << 5)) << 8) | (((chip_units - 1) | (2UL << 5)) << 24);
+    for(uint8_t i = 0; i < 16; i ++){
+        for(uint8_t b = 0; b < 4; b ++) _sfdp[0x80 + 4 * i + b] = table[i] >> (8 * b);
+    }
+}
+
+void W25Q64FV_SimulatedFlash::violation(const char *description){
+    _counters.violations ++;
+    _last_violation = description;
+    if(_verbose) fprintf(stderr, "[sim %llu us] %s (instruction 0x%02X)\n", (unsigned long long)(host_clock_ns() / 1000), description, _instruction);
+}
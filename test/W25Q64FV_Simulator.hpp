@@ -0,0 +1,450 @@
+/**
+ * @file W25Q64FV_Simulator.hpp
+ * @author Jeremy Dunne
+ * @brief behavioral flash model and simulated SPI transport for host builds of the W25Q64 library
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_SIMULATOR_HPP_
+#define _W25Q64FV_SIMULATOR_HPP_
+
+#include <Arduino.h>
+#include <vector>
+#include "W25Q64FV.hpp"
+
+/********** SETTINGS **********/
+#ifndef W25Q64FV_SIM_SELECT_NS
+#define W25Q64FV_SIM_SELECT_NS      1000 // Chip select assert and release, with the transaction setup around it (ns)
+#endif
+#ifndef W25Q64FV_SIM_POLL_NS
+#define W25Q64FV_SIM_POLL_NS        50 // Cost of checking an asynchronous transfer (ns)
+#endif
+#define W25Q64FV_SIM_UNIQUE_ID      0x5157363446565349ULL // "ISVF64WQ", returned by the unique ID read
+#define W25Q64FV_SIM_SFDP_SIZE      256 // Bytes of SFDP space, the basic table sits at 0x80
+
+/// Simulated Operation Times (us)
+typedef struct{
+    unsigned long page_program; ///<Page program, whatever the length
+    unsigned long sector_erase; ///<4kB sector erase
+    unsigned long block_32k_erase; ///<32kB block erase
+    unsigned long block_64k_erase; ///<64kB block erase
+    unsigned long chip_erase; ///<Chip erase
+    unsigned long write_status; ///<Non-volatile status register write
+    unsigned long suspend; ///<Suspend instruction to the device being free
+    unsigned long suspend_interval; ///<Shortest time from a resume to the next suspend
+    unsigned long reset; ///<Software reset
+    unsigned long release_power_down; ///<Release from power down
+} W25Q64FV_sim_timing_t;
+
+/// Simulator Counters
+typedef struct{
+    unsigned long selects; ///<Chip select assertions
+    unsigned long bytes; ///<Bytes clocked, over any number of lines
+    unsigned long polls; ///<Status register values clocked out, one per byte of a streamed read
+    unsigned long reads; ///<Read instructions, continuous reads included
+    unsigned long read_bytes; ///<Data bytes read
+    unsigned long operations[W25Q64FV_OPERATION_RESET + 1]; ///<Timed operations started, indexed by W25Q64FV_operation_t
+    unsigned long programmed_bytes; ///<Data bytes latched by page programs
+    unsigned long suspends; ///<Operations suspended
+    unsigned long resumes; ///<Operations resumed
+    unsigned long violations; ///<Instructions the part would reject or misread
+} W25Q64FV_sim_counters_t;
+
+/**
+ * @brief Fill in the datasheet times of a part
+ *
+ * @param timing                Times to fill
+ * @param capacity              Density in bytes, scales the chip erase
+ * @param maximum               Use the maximum rather than the typical times
+ * @return (void)
+ */
+void W25Q64FV_sim_default_timing(W25Q64FV_sim_timing_t *timing, uint32_t capacity = W25Q64FV_CAPACITY, bool maximum = false);
+
+/**
+ * @brief Behavioral model of a W25Q serial NOR flash
+ *
+ * Decodes the instructions of W25Q64FV.hpp one byte at a time as a simulated transport
+ * clocks them, against the virtual clock of the host Arduino core:
+ *
+ *  - Programs only clear bits, within the 256 byte page of the address, and erases set
+ *    the aligned sector, block, or chip back to 0xFF
+ *  - Programs, erases, and non-volatile status writes keep BUSY and WEL set for their
+ *    time from W25Q64FV_sim_timing_t, from the release of chip select
+ *  - Erases and programs may be suspended, BUSY clears the suspend time later, and
+ *    resumed with the time they had left. Programs are accepted in an erase suspend
+ *  - Status register 1 and 2 reads, streamed or not, JEDEC and manufacturer IDs, unique
+ *    ID, SFDP, 3 and 4 byte address modes, the volatile status write enable, quad
+ *    enable, continuous read mode of the dual and quad I/O reads, reset, and power down
+ *
+ * Anything the part would reject or answer with undefined data is counted as a
+ * violation rather than stopping the run: an instruction while busy, a program or erase
+ * without WEL, a read of an area being erased or programmed, an erase whose chip select
+ * is not released right after the address, data on the wrong number of lines, quad
+ * without QE, or a suspend too soon after a resume.
+ *
+ */
+class W25Q64FV_SimulatedFlash{
+public:
+    /**
+     * @brief Construct a new erased part
+     *
+     * @param capacity              Density in bytes, a power of two from 1MB to 32MB
+     * @param sfdp                  Answer SFDP reads, else the table reads as 0xFF
+     */
+    W25Q64FV_SimulatedFlash(uint32_t capacity = W25Q64FV_CAPACITY, bool sfdp = true);
+
+    /**
+     * @brief Assert chip select
+     *
+     * @return (void)
+     */
+    void select();
+
+    /**
+     * @brief Release chip select, executing the instruction
+     *
+     * @return (void)
+     */
+    void deselect();
+
+    /**
+     * @brief Exchange a byte
+     *
+     * @param data                  Byte from the host
+     * @param lanes                 Data lines the byte is clocked on
+     * @return uint8_t              Byte to the host
+     */
+    uint8_t exchange(uint8_t data, uint8_t lanes);
+
+    /**
+     * @brief Get the density
+     *
+     * @return uint32_t             Density in bytes
+     */
+    uint32_t capacity() const { return _capacity; }
+
+    /**
+     * @brief Get the array, to set up or check contents without going through the bus
+     *
+     * @return byte*                First byte of the array
+     */
+    byte *memory() { return &_memory[0]; }
+
+    /**
+     * @brief Check if an operation is in progress at the current virtual time
+     *
+     * @return true                 BUSY is set
+     */
+    bool busy();
+
+    /**
+     * @brief Check if an operation is suspended
+     *
+     * @return true                 SUS is set
+     */
+    bool suspended();
+
+    /**
+     * @brief Set the operation times
+     *
+     * @param timing                Times to use from the next operation
+     * @return (void)
+     */
+    void set_timing(const W25Q64FV_sim_timing_t &timing) { _timing = timing; }
+
+    /**
+     * @brief Get the operation times
+     *
+     * @return const W25Q64FV_sim_timing_t&  Times in use
+     */
+    const W25Q64FV_sim_timing_t &timing() const { return _timing; }
+
+    /**
+     * @brief Get the counters
+     *
+     * @return const W25Q64FV_sim_counters_t&  Counters since construction or the last reset
+     */
+    const W25Q64FV_sim_counters_t &counters() const { return _counters; }
+
+    /**
+     * @brief Reset the counters
+     *
+     * @return (void)
+     */
+    void reset_counters() { memset(&_counters, 0, sizeof(_counters)); }
+
+    /**
+     * @brief Get the last violation
+     *
+     * @return const char*          Description, empty if there was none
+     */
+    const char *last_violation() const { return _last_violation; }
+
+    /**
+     * @brief Print every violation to stderr as it happens
+     *
+     * @param enable                Print violations
+     * @return (void)
+     */
+    void set_verbose(bool enable) { _verbose = enable; }
+
+private:
+    std::vector<byte> _memory;          ///< Array
+    uint32_t _capacity;                 ///< Density in bytes
+    byte _sfdp[W25Q64FV_SIM_SFDP_SIZE]; ///< SFDP space
+    W25Q64FV_sim_timing_t _timing;      ///< Operation times
+    W25Q64FV_sim_counters_t _counters;  ///< Counters
+    const char *_last_violation;        ///< Last violation
+    bool _verbose;                      ///< Print violations
+    // registers
+    bool _write_enabled;                ///< WEL
+    uint8_t _status_1;                  ///< Status register 1, without BUSY and WEL
+    uint8_t _status_2;                  ///< Status register 2, without SUS
+    uint8_t _status_2_nv;               ///< Non-volatile status register 2, restored by a reset
+    bool _address_4b;                   ///< 4 byte address mode
+    bool _volatile_enable;              ///< The last instruction was a volatile status write enable
+    bool _reset_enable;                 ///< The last instruction was a reset enable
+    bool _powered_down;                 ///< In power down
+    uint8_t _continuous;                ///< Read instruction repeated by continuous read mode, 0 if none
+    uint64_t _ready_time;               ///< End of a reset or release from power down (ns)
+    // operation in progress
+    W25Q64FV_operation_t _operation;    ///< Operation in progress or suspended
+    uint64_t _operation_end;            ///< Completion time of a running operation (ns)
+    uint32_t _area_start;               ///< First byte the operation modifies
+    uint32_t _area_length;              ///< Bytes the operation modifies
+    bool _suspending;                   ///< A suspend was issued and takes effect at _suspend_time
+    uint64_t _suspend_time;             ///< Time the suspend takes effect (ns)
+    bool _suspended;                    ///< The operation is suspended
+    uint64_t _remaining;                ///< Time the suspended operation has left (ns)
+    uint64_t _resume_time;              ///< Time of the last resume (ns)
+    bool _nested;                       ///< A program issued in a suspend is running
+    uint64_t _nested_end;               ///< Completion time of that program (ns)
+    // transaction
+    bool _selected;                     ///< Chip select asserted
+    uint8_t _instruction;               ///< Instruction of the transaction
+    size_t _index;                      ///< Bytes of the transaction so far, the instruction is byte 0
+    uint32_t _address;                  ///< Address being shifted in
+    uint8_t _mode;                      ///< Mode bits of a dual or quad I/O read
+    bool _mode_reset;                   ///< The transaction is a continuous read mode reset
+    bool _busy_at_start;                ///< BUSY was set when the instruction was clocked
+    byte _latch[W25Q64FV_PAGE_SIZE];    ///< Page program data latches
+    size_t _latched;                    ///< Data bytes clocked into the latches
+    uint8_t _register_data[2];          ///< Status register write data
+    bool _read_violation;               ///< A bad read was already reported this transaction
+
+    /**
+     * @brief Complete or suspend operations whose time has come
+     *
+     * @param now                   Current time (ns)
+     * @return (void)
+     */
+    void update(uint64_t now);
+
+    /**
+     * @brief Get the address length of an instruction
+     *
+     * @param instruction           Instruction
+     * @return uint8_t              Address bytes
+     */
+    uint8_t address_bytes(uint8_t instruction) const;
+
+    /**
+     * @brief Get the bytes before the data phase of a read
+     *
+     * @param instruction           Read instruction
+     * @return size_t               Instruction, address, mode, and dummy bytes
+     */
+    size_t read_header(uint8_t instruction) const;
+
+    /**
+     * @brief Get the data lines a byte of the transaction must be clocked on
+     *
+     * @param index                 Byte of the transaction
+     * @return uint8_t              Data lines
+     */
+    uint8_t expected_lanes(size_t index) const;
+
+    /**
+     * @brief Start a timed operation at the release of chip select
+     *
+     * @param operation             Operation
+     * @param start                 First byte modified
+     * @param length                Bytes modified
+     * @param now                   Current time (ns)
+     * @return (void)
+     */
+    void start(W25Q64FV_operation_t operation, uint32_t start, uint32_t length, uint64_t now);
+
+    /**
+     * @brief Execute the instruction of the transaction at the release of chip select
+     *
+     * @param now                   Current time (ns)
+     * @return (void)
+     */
+    void execute(uint64_t now);
+
+    /**
+     * @brief Check an address against the area of a suspended operation
+     *
+     * @param address               Address
+     * @return true                 The byte is being erased or programmed
+     */
+    bool in_area(uint32_t address) const;
+
+    /**
+     * @brief Build the SFDP header and basic flash parameter table
+     *
+     * @return (void)
+     */
+    void build_sfdp();
+
+    /**
+     * @brief Count a violation
+     *
+     * @param description           What the part would reject
+     * @return (void)
+     */
+    void violation(const char *description);
+};
+
+/**
+ * @brief Transport policy over a simulated flash
+ *
+ * Each byte advances the virtual clock by its time on the bus at the transport clock,
+ * 8 / lanes clocks, and each chip select by W25Q64FV_SIM_SELECT_NS. Asynchronous
+ * transfers behave like DMA: start_transfer() returns at once and transfer_complete()
+ * turns true once the bus time has passed, so work between them overlaps the transfer.
+ * Several transports may share one clock with separate flashes, as chips on one bus.
+ *
+ * @tparam Lanes                Widest transfer wired, 1, 2, or 4
+ */
+template<uint8_t Lanes = 1>
+class W25Q64FV_SimulatedSPI{
+public:
+    static const uint8_t max_lanes = Lanes;    ///< Widest transfer wired
+
+    /**
+     * @brief Construct a new transport
+     *
+     * @param flash                 Simulated flash on the bus
+     * @param clock                 SPI clock speed
+     * @param asynchronous          Overlap start_transfer() with the caller, else complete it before returning
+     */
+    W25Q64FV_SimulatedSPI(W25Q64FV_SimulatedFlash *flash = NULL, uint32_t clock = W25Q64FV_SPI_SPEED, bool asynchronous = true) :
+        _flash(flash), _byte_time(8000000000ULL / clock), _asynchronous(asynchronous), _complete_time(0) {}
+
+    /**
+     * @brief Initialize the bus, nothing to do
+     *
+     * @param cs_pin                Chip select pin
+     */
+    void begin(int cs_pin) { (void)cs_pin; }
+
+    /**
+     * @brief Assert chip select
+     */
+    void select(){
+        host_clock_advance(W25Q64FV_SIM_SELECT_NS / 2);
+        _flash->select();
+    }
+
+    /**
+     * @brief Release chip select, after any asynchronous transfer has finished
+     */
+    void deselect(){
+        uint64_t now = host_clock_ns();
+        if(now < _complete_time) host_clock_advance(_complete_time - now);
+        _flash->deselect();
+        host_clock_advance(W25Q64FV_SIM_SELECT_NS - W25Q64FV_SIM_SELECT_NS / 2);
+    }
+
+    /**
+     * @brief Exchange a single byte
+     *
+     * @param data                  Byte to write
+     * @return uint8_t              Byte read
+     */
+    uint8_t transfer(uint8_t data){
+        uint8_t received = _flash->exchange(data, 1);
+        host_clock_advance(_byte_time);
+        return received;
+    }
+
+    /**
+     * @brief Exchange a buffer
+     *
+     * @param tx                    Data to write, or NULL to clock out zeros
+     * @param rx                    Buffer to read into, or NULL to discard
+     * @param length                Number of bytes
+     */
+    void transfer(const uint8_t *tx, uint8_t *rx, size_t length){
+        transfer(tx, rx, length, 1);
+    }
+
+    /**
+     * @brief Exchange a buffer over multiple data lines
+     *
+     * @param tx                    Data to write, or NULL to clock out zeros
+     * @param rx                    Buffer to read into, or NULL to discard
+     * @param length                Number of bytes
+     * @param lanes                 Number of data lines
+     */
+    void transfer(const uint8_t *tx, uint8_t *rx, size_t length, uint8_t lanes){
+        for(size_t i = 0; i < length; i ++){
+            uint8_t received = _flash->exchange(tx == NULL ? 0 : tx[i], lanes);
+            if(rx != NULL) rx[i] = received;
+            host_clock_advance(_byte_time / lanes);
+        }
+    }
+
+    /**
+     * @brief Begin an asynchronous buffer exchange
+     *
+     * The data moves at once, the bus time passes in the background
+     *
+     * @param tx                    Data to write, or NULL to clock out zeros
+     * @param rx                    Buffer to read into, or NULL to discard
+     * @param length                Number of bytes
+     * @param lanes                 Number of data lines
+     */
+    void start_transfer(const uint8_t *tx, uint8_t *rx, size_t length, uint8_t lanes){
+        if(!_asynchronous){
+            transfer(tx, rx, length, lanes);
+            return;
+        }
+        for(size_t i = 0; i < length; i ++){
+            uint8_t received = _flash->exchange(tx == NULL ? 0 : tx[i], lanes);
+            if(rx != NULL) rx[i] = received;
+        }
+        _complete_time = host_clock_ns() + length * (_byte_time / lanes);
+    }
+
+    /**
+     * @brief Check if the asynchronous exchange is done
+     *
+     * @return true                 Exchange complete
+     */
+    bool transfer_complete(){
+        host_clock_advance(W25Q64FV_SIM_POLL_NS);
+        return host_clock_ns() >= _complete_time;
+    }
+
+    /**
+     * @brief Get the simulated flash
+     *
+     * @return W25Q64FV_SimulatedFlash*     Flash on the bus
+     */
+    W25Q64FV_SimulatedFlash *flash() { return _flash; }
+
+private:
+    W25Q64FV_SimulatedFlash *_flash;    ///< Flash on the bus
+    uint64_t _byte_time;                ///< Time of a byte on one line (ns)
+    bool _asynchronous;                 ///< Overlap asynchronous transfers
+    uint64_t _complete_time;            ///< End of the asynchronous transfer (ns)
+};
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * @file W25Q64FV_Test.hpp
+ * @author Jeremy Dunne
+ * @brief checks and simulated drivers shared by the host tests and benchmarks
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef _W25Q64FV_TEST_HPP_
+#define _W25Q64FV_TEST_HPP_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "W25Q64FV_Simulator.hpp"
+#include "W25Q64FV_impl.hpp"
+
+/// Simulated W25Q64 on a single line bus
+typedef W25Q64FV_Device<W25Q64FV_SimulatedSPI<1> > W25Q64FV_Sim;
+/// Simulated W25Q64 with all four data lines wired
+typedef W25Q64FV_Device<W25Q64FV_SimulatedSPI<4> > W25Q64FV_QuadSim;
+
+static int test_failures = 0;
+
+/// Count a failure if a condition does not hold
+#define CHECK(condition) do{ \
+        if(!(condition)){ \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            test_failures ++; \
+        } \
+    }while(0)
+
+/// Count a failure if two integers differ
+#define CHECK_EQUAL(actual, expected) do{ \
+        unsigned long long _actual = (unsigned long long)(actual); \
+        unsigned long long _expected = (unsigned long long)(expected); \
+        if(_actual != _expected){ \
+            fprintf(stderr, "%s:%d: %s is %llu, expected %llu\n", __FILE__, __LINE__, #actual, _actual, _expected); \
+            test_failures ++; \
+        } \
+    }while(0)
+
+/// Count a failure if an expression does not return W25Q64FV_OK
+#define CHECK_OK(expression) CHECK_EQUAL(expression, W25Q64FV_OK)
+
+/// Count a failure if the simulated part saw anything it would reject
+#define CHECK_NO_VIOLATIONS(model) do{ \
+        if((model).counters().violations != 0){ \
+            fprintf(stderr, "%s:%d: %lu violations, last: %s\n", __FILE__, __LINE__, (model).counters().violations, (model).last_violation()); \
+            test_failures ++; \
+        } \
+    }while(0)
+
+/**
+ * @brief Report the checks and get the exit code
+ *
+ * @param name                  Test name
+ * @return int                  0 if every check held
+ */
+static inline int test_result(const char *name){
+    if(test_failures == 0) printf("%s: passed\n", name);
+    else printf("%s: %d checks failed\n", name, test_failures);
+    return test_failures == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Get the virtual time
+ *
+ * @return double               Time (us)
+ */
+static inline double test_time_us(){
+    return host_clock_ns() / 1000.0;
+}
+
+/**
+ * @brief Get a percentile of a set of samples
+ *
+ * @param samples               Samples, sorted in place
+ * @param percentile            Percentile, 0 to 100
+ * @return double               Sample at the percentile, 0 if there are none
+ */
+static inline double test_percentile(std::vector<double> &samples, double percentile){
+    if(samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    size_t index = (size_t)(percentile / 100.0 * (samples.size() - 1) + 0.5);
+    return samples[index];
+}
+
+/**
+ * @brief Fill a buffer with a repeatable pattern
+ *
+ * @param buffer                Buffer to fill
+ * @param length                Number of bytes
+ * @param seed                  Pattern seed
+ * @return (void)
+ */
+static inline void test_pattern(byte *buffer, size_t length, uint32_t seed){
+    uint32_t state = seed * 2654435761UL + 1;
+    for(size_t i = 0; i < length; i ++){
+        state = state * 1664525UL + 1013904223UL;
+        buffer[i] = state >> 24;
+    }
+}
+
+/**
+ * @brief Draw from a repeatable random sequence
+ *
+ * @param state                 Sequence state, any seed to start
+ * @param range                 Number of values
+ * @return uint32_t             Value from 0 to range - 1
+ */
+static inline uint32_t test_random(uint32_t *state, uint32_t range){
+    *state = *state * 1664525UL + 1013904223UL;
+    return (*state >> 8) % range;
+}
+
+#endif
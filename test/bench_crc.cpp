@@ -0,0 +1,119 @@
+/**
+ * @file bench_crc.cpp
+ * @author Jeremy Dunne
+ * @brief cost of verified writes and reads and of range CRCs against the plain calls
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include <chrono>
+
+#define BENCH_CRC_LENGTH        (64UL * 1024) // Bytes of the largest row
+#define BENCH_CRC_HOST_PASSES   64 // Passes over the buffer timing the CRC on the host CPU
+
+static byte data[BENCH_CRC_LENGTH];
+static byte readback[BENCH_CRC_LENGTH];
+
+/**
+ * @brief Bit at a time CRC-32 to check the table against
+ *
+ * @param data                  Data
+ * @param length                Number of bytes
+ * @return uint32_t             CRC-32
+ */
+static uint32_t reference_crc(const byte *data, size_t length){
+    uint32_t crc = 0xFFFFFFFF;
+    for(size_t i = 0; i < length; i ++){
+        crc ^= data[i];
+        for(uint8_t bit = 0; bit < 8; bit ++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Time the plain and verified calls on one length and print a row
+ *
+ * @param length                Bytes per call
+ * @return (void)
+ */
+static void run(size_t length){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    // plain write against write_verified on erased flash, both waiting for the last page
+    double start = test_time_us();
+    CHECK_OK(flash.write(0, data, length, true));
+    double write = test_time_us() - start;
+    uint32_t crc = 0;
+    start = test_time_us();
+    CHECK_OK(flash.write_verified(BENCH_CRC_LENGTH, data, length, &crc));
+    double write_verified = test_time_us() - start;
+    CHECK_EQUAL(crc, reference_crc(data, length));
+    // plain read against read_verified
+    start = test_time_us();
+    CHECK_OK(flash.read(0, readback, length));
+    double read = test_time_us() - start;
+    start = test_time_us();
+    CHECK_OK(flash.read_verified(BENCH_CRC_LENGTH, readback, length, crc));
+    double read_verified = test_time_us() - start;
+    CHECK(memcmp(readback, data, length) == 0);
+    // CRC of the range without a buffer
+    uint32_t range = 0;
+    start = test_time_us();
+    CHECK_OK(flash.crc32(0, length, &range));
+    double range_time = test_time_us() - start;
+    CHECK_EQUAL(range, crc);
+    printf("%7lu %9.0f %9.0f %7.1f%% %9.0f %9.0f %7.1f%% %9.0f\n", (unsigned long)length, write, write_verified,
+           100 * (write_verified - write) / write, read, read_verified, 100 * (read_verified - read) / read, range_time);
+    // verifying a write costs one read back of it, a verified read costs nothing on the bus
+    CHECK(write_verified < write + read * 1.1 + 50);
+    CHECK(read_verified < read * 1.05 + 10);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_bit_errors(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    // a stuck bit left in the page: the program returns OK but cannot set it
+    model.memory()[300] = 0x00;
+    CHECK(data[300 - 256] != 0x00);
+    CHECK_OK(flash.write(256, data, 256, true));
+    CHECK_EQUAL(flash.write_verified(256, data, 256), W25Q64FV_VERIFY_FAIL);
+    CHECK_EQUAL(flash.read_verified(256, readback, 256, reference_crc(data, 256)), W25Q64FV_VERIFY_FAIL);
+    // a bit flipped after a good write shows up in the range CRC
+    uint32_t crc = 0;
+    CHECK_OK(flash.write_verified(4096, data, 4096, &crc));
+    model.memory()[4096 + 1000] ^= 0x01;
+    uint32_t range = 0;
+    CHECK_OK(flash.crc32(4096, 4096, &range));
+    CHECK(range != crc);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_pattern(data, sizeof(data), 22);
+    // host CPU cost of the table against a bit at a time
+    volatile uint32_t table = 0;
+    volatile uint32_t bitwise = 0;
+    std::chrono::steady_clock::time_point host_start = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < BENCH_CRC_HOST_PASSES; i ++) table = W25Q64FV_crc32(table, data, sizeof(data));
+    double table_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - host_start).count();
+    host_start = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < BENCH_CRC_HOST_PASSES; i ++) bitwise ^= reference_crc(data, sizeof(data));
+    double bitwise_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - host_start).count();
+    CHECK_EQUAL(W25Q64FV_crc32(0, data, sizeof(data)), reference_crc(data, sizeof(data)));
+    printf("host CRC-32, %d entry table: %.2f ns/byte, bit at a time %.2f ns/byte\n", W25Q64FV_CRC_TABLE_SIZE,
+           table_ns / BENCH_CRC_HOST_PASSES / sizeof(data), bitwise_ns / BENCH_CRC_HOST_PASSES / sizeof(data));
+    printf("bus time (us)\n");
+    printf("%7s %9s %9s %8s %9s %9s %8s %9s\n", "bytes", "write", "verified", "cost", "read", "verified", "cost", "crc32");
+    for(size_t length = W25Q64FV_PAGE_SIZE; length <= BENCH_CRC_LENGTH; length *= 4) run(length);
+    test_bit_errors();
+    return test_result("bench_crc");
+}
@@ -0,0 +1,92 @@
+/**
+ * @file bench_erase.cpp
+ * @author Jeremy Dunne
+ * @brief time to clear log partitions, sector loop against the erase_range plan
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Baseline.hpp"
+
+/// Partition to clear
+typedef struct{
+    const char *name; ///<Row name
+    uint32_t start; ///<First byte
+    uint32_t length; ///<Bytes
+} bench_partition_t;
+
+static const bench_partition_t partitions[] = {
+    {"64kB aligned", 0x010000, 0x010000},
+    {"1MB aligned", 0x100000, 0x100000},
+    {"1MB+8kB unaligned", 0x0FF000, 0x102000},
+    {"4MB aligned", 0x400000, 0x400000},
+    {"whole chip", 0x000000, W25Q64FV_CAPACITY},
+};
+
+/**
+ * @brief Dirty a partition and check the model once it is erased
+ *
+ * @param model                 Simulated flash
+ * @param partition             Partition
+ * @param erased                Check rather than dirty
+ * @return (void)
+ */
+static void partition_state(W25Q64FV_SimulatedFlash &model, const bench_partition_t &partition, bool erased){
+    byte *memory = model.memory();
+    if(!erased){
+        memset(memory, 0x00, W25Q64FV_CAPACITY);
+        return;
+    }
+    bool blank = true;
+    for(uint32_t i = partition.start; i < partition.start + partition.length; i ++) blank &= memory[i] == 0xFF;
+    CHECK(blank);
+    // nothing outside the partition is touched
+    if(partition.start > 0) CHECK_EQUAL(memory[partition.start - 1], 0x00);
+    if(partition.start + partition.length < W25Q64FV_CAPACITY) CHECK_EQUAL(memory[partition.start + partition.length], 0x00);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    W25Q64FV_Baseline<W25Q64FV_SimulatedSPI<1> > baseline(bus);
+    CHECK_OK(flash.begin(0));
+
+    printf("partition erase time (ms), typical datasheet times\n");
+    printf("%-18s %12s %12s %12s %12s %8s\n", "", "baseline", "sector loop", "erase_range", "planned", "speedup");
+    for(size_t p = 0; p < sizeof(partitions) / sizeof(partitions[0]); p ++){
+        const bench_partition_t &partition = partitions[p];
+        // first release, erase_sector with its millisecond polling
+        partition_state(model, partition, false);
+        double start = test_time_us();
+        for(uint32_t address = partition.start; address < partition.start + partition.length; address += W25Q64FV_SECTOR_SIZE){
+            CHECK_OK(baseline.erase_sector(address));
+        }
+        double baseline_time = test_time_us() - start;
+        partition_state(model, partition, true);
+        // sector loop on the current driver
+        partition_state(model, partition, false);
+        start = test_time_us();
+        for(uint32_t address = partition.start; address < partition.start + partition.length; address += W25Q64FV_SECTOR_SIZE){
+            CHECK_OK(flash.erase_sector(address));
+        }
+        double loop_time = test_time_us() - start;
+        partition_state(model, partition, true);
+        // mixed 64k, 32k and 4k erases, or a chip erase
+        partition_state(model, partition, false);
+        start = test_time_us();
+        CHECK_OK(flash.erase_range(partition.start, partition.length));
+        double range_time = test_time_us() - start;
+        partition_state(model, partition, true);
+        printf("%-18s %12.1f %12.1f %12.1f %12lu %7.2fx\n", partition.name, baseline_time / 1000, loop_time / 1000,
+               range_time / 1000, flash.erase_range_time(partition.start, partition.length), loop_time / range_time);
+        CHECK(range_time < loop_time);
+        CHECK(loop_time <= baseline_time);
+    }
+    return test_result("bench_erase");
+}
@@ -0,0 +1,164 @@
+/**
+ * @file bench_ftl.cpp
+ * @author Jeremy Dunne
+ * @brief write amplification, wear, and write latency of the FTL under a skewed workload
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_FTL_impl.hpp"
+
+#define BENCH_FTL_START         0x100000 // Start of the region
+#define BENCH_FTL_SECTORS       256 // Physical sectors in the region (1MB)
+#define BENCH_FTL_WRITES        4000 // Writes per row
+#define BENCH_FTL_HOT_PERCENT   90 // Writes that go to the hot sectors
+#define BENCH_FTL_HOT_SECTORS   8 // Logical sectors taking the hot writes
+#define BENCH_FTL_PERIOD_US     80000 // Time between writes (us), serviced in between, above a sector erase plus a copy
+
+typedef W25Q64FV_BasicFTL<W25Q64FV_Sim> W25Q64FV_SimFTL;
+
+static uint16_t arena[W25Q64FV_FTL_ARENA_SIZE(BENCH_FTL_SECTORS * W25Q64FV_SECTOR_SIZE)];
+static byte sector[W25Q64FV_SECTOR_SIZE];
+
+/**
+ * @brief Pick the logical sector of the next write, most go to a few hot ones
+ *
+ * @param random                Random state
+ * @param count                 Logical sectors
+ * @return uint32_t             Logical sector
+ */
+static uint32_t pick(uint32_t *random, uint32_t count){
+    if(test_random(random, 100) < BENCH_FTL_HOT_PERCENT) return test_random(random, BENCH_FTL_HOT_SECTORS);
+    return test_random(random, count);
+}
+
+/**
+ * @brief Print a row of the table
+ *
+ * @param name                  Row name
+ * @param length                Bytes per write
+ * @param latencies             Write latencies (us)
+ * @param model                 Simulated flash
+ * @param max_erases            Most erases of one physical sector
+ * @return double               Write amplification
+ */
+static double row(const char *name, size_t length, std::vector<double> &latencies, W25Q64FV_SimulatedFlash &model,
+                  unsigned long max_erases){
+    double amplification = (double)model.counters().programmed_bytes / (BENCH_FTL_WRITES * length);
+    printf("%-18s %6u %8.2f %7lu %9lu %9.0f %9.0f %9.0f\n", name, (unsigned int)length, amplification,
+           model.counters().operations[W25Q64FV_OPERATION_SECTOR_ERASE], max_erases, test_percentile(latencies, 50),
+           test_percentile(latencies, 99), test_percentile(latencies, 100));
+    CHECK_NO_VIOLATIONS(model);
+    return amplification;
+}
+
+/**
+ * @brief Update sectors in place with a read, erase, and program of the whole sector
+ *
+ * @param length                Bytes per write
+ * @param max_erases            Most erases of one sector
+ * @return double               99th percentile write latency (us)
+ */
+static double in_place(size_t length, unsigned long *max_erases){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    static unsigned long erases[BENCH_FTL_SECTORS];
+    memset(erases, 0, sizeof(erases));
+    *max_erases = 0;
+    std::vector<double> latencies;
+    uint32_t random = 1;
+    model.reset_counters();
+    for(uint32_t i = 0; i < BENCH_FTL_WRITES; i ++){
+        uint32_t logical = pick(&random, BENCH_FTL_SECTORS);
+        uint32_t offset = test_random(&random, W25Q64FV_FTL_SECTOR_SIZE - length + 1);
+        uint32_t address = BENCH_FTL_START + logical * W25Q64FV_SECTOR_SIZE;
+        double start = test_time_us();
+        CHECK_OK(flash.read(address, sector, sizeof(sector)));
+        test_pattern(sector + offset, length, i);
+        CHECK_OK(flash.erase_sector(address, false));
+        CHECK_OK(flash.write(address, sector, sizeof(sector), true));
+        latencies.push_back(test_time_us() - start);
+        if(++ erases[logical] > *max_erases) *max_erases = erases[logical];
+        delayMicroseconds(BENCH_FTL_PERIOD_US);
+    }
+    row("in place", length, latencies, model, *max_erases);
+    return test_percentile(latencies, 99);
+}
+
+/**
+ * @brief Write through the FTL, servicing it between writes or not at all
+ *
+ * @param length                Bytes per write
+ * @param serviced              Call service() between writes
+ * @param amplification         Write amplification
+ * @param max_wear              Most erases of one physical sector
+ * @return double               99th percentile write latency (us)
+ */
+static double translated(size_t length, bool serviced, double *amplification, unsigned long *max_wear){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimFTL ftl(flash, BENCH_FTL_START, BENCH_FTL_SECTORS * W25Q64FV_SECTOR_SIZE, arena);
+    CHECK_OK(ftl.mount());
+    // fill every logical sector once so there is cold data to level
+    for(uint32_t logical = 0; logical < ftl.logical_count(); logical ++){
+        test_pattern(sector, W25Q64FV_FTL_SECTOR_SIZE, logical);
+        CHECK_OK(ftl.write(logical, 0, sector, W25Q64FV_FTL_SECTOR_SIZE));
+        CHECK_OK(ftl.service());
+    }
+    W25Q64FV_ftl_stats_t stats;
+    ftl.get_stats(&stats, true);
+    std::vector<double> latencies;
+    uint32_t random = 1;
+    model.reset_counters();
+    for(uint32_t i = 0; i < BENCH_FTL_WRITES; i ++){
+        uint32_t logical = pick(&random, ftl.logical_count());
+        uint32_t offset = test_random(&random, W25Q64FV_FTL_SECTOR_SIZE - length + 1);
+        test_pattern(sector, length, i);
+        double start = test_time_us();
+        CHECK_OK(ftl.write(logical, offset, sector, length));
+        latencies.push_back(test_time_us() - start);
+        double next = start + BENCH_FTL_PERIOD_US;
+        while(test_time_us() < next){
+            if(serviced) CHECK_OK(ftl.service());
+            delayMicroseconds(500);
+        }
+    }
+    ftl.get_stats(&stats);
+    *max_wear = stats.max_wear;
+    *amplification = row(serviced ? "ftl, serviced" : "ftl, no service", length, latencies, model, stats.max_wear);
+    printf("%-18s %6s %8s %7lu waits, %lu relocations, wear %lu..%lu\n", "", "", "", stats.waits, stats.relocations,
+           stats.min_wear, stats.max_wear);
+    return test_percentile(latencies, 99);
+}
+
+int main(){
+    printf("%d writes, %d%% to %d of %d sectors, one every %d us\n", BENCH_FTL_WRITES, BENCH_FTL_HOT_PERCENT,
+           BENCH_FTL_HOT_SECTORS, BENCH_FTL_SECTORS - W25Q64FV_FTL_RESERVE, BENCH_FTL_PERIOD_US);
+    printf("%-18s %6s %8s %7s %9s %9s %9s %9s\n", "", "bytes", "amplif.", "erases", "max wear", "p50 (us)", "p99 (us)", "max (us)");
+    static const size_t lengths[] = {64, W25Q64FV_FTL_SECTOR_SIZE};
+    for(unsigned int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i ++){
+        double amplification;
+        unsigned long hot_erases;
+        unsigned long max_wear;
+        double naive = in_place(lengths[i], &hot_erases);
+        double serviced = translated(lengths[i], true, &amplification, &max_wear);
+        double unserviced = translated(lengths[i], false, &amplification, &max_wear);
+        // a serviced FTL never waits out an erase, without service every write does
+        CHECK(serviced < W25Q64FV_TIME_SECTOR_ERASE_TYP / 2);
+        CHECK(unserviced > W25Q64FV_TIME_SECTOR_ERASE_TYP);
+        CHECK(naive > W25Q64FV_TIME_SECTOR_ERASE_TYP);
+        // copying the rest of the sector forward costs no more than rewriting it in place
+        CHECK(amplification < 1.1 * W25Q64FV_SECTOR_SIZE / lengths[i]);
+        // and spreads the hot sectors' erases over the region
+        CHECK(max_wear * 4 < hot_erases);
+    }
+    return test_result("bench_ftl");
+}
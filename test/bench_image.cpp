@@ -0,0 +1,116 @@
+/**
+ * @file bench_image.cpp
+ * @author Jeremy Dunne
+ * @brief full against delta image update time for realistic change ratios
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Image_impl.hpp"
+
+#define BENCH_IMAGE_START       0x100000 // Start of the image region
+#define BENCH_IMAGE_LENGTH      (1024UL * 1024) // Bytes of the image
+#define BENCH_IMAGE_CHUNK       256 // Bytes per write() call
+#define BENCH_IMAGE_SECTORS     (BENCH_IMAGE_LENGTH / W25Q64FV_SECTOR_SIZE)
+
+typedef W25Q64FV_BasicImage<W25Q64FV_Sim> W25Q64FV_SimImage;
+
+/// Change pattern of the new image
+typedef struct{
+    const char *name;           ///< Row name
+    unsigned int percent;       ///< Sectors changed (%)
+    bool clustered;             ///< Changed sectors in one run, as after an insertion
+} bench_image_change_t;
+
+static const bench_image_change_t changes[] = {
+    {"unchanged", 0, false},
+    {"1% scattered", 1, false},
+    {"5% scattered", 5, false},
+    {"25% scattered", 25, false},
+    {"25% run", 25, true},
+    {"60% run", 60, true},
+    {"rewritten", 100, true}
+};
+
+static byte old_image[BENCH_IMAGE_LENGTH];
+static byte new_image[BENCH_IMAGE_LENGTH];
+static byte buffer[W25Q64FV_IMAGE_BUFFER_SIZE];
+
+/**
+ * @brief Build the new image from the old one
+ *
+ * @param change                Change pattern
+ * @param random                Random state
+ * @return (void)
+ */
+static void build(const bench_image_change_t *change, uint32_t *random){
+    memcpy(new_image, old_image, sizeof(new_image));
+    uint32_t run_start = test_random(random, BENCH_IMAGE_SECTORS - BENCH_IMAGE_SECTORS * change->percent / 100 + 1);
+    for(uint32_t sector = 0; sector < BENCH_IMAGE_SECTORS; sector ++){
+        bool changed;
+        if(change->clustered) changed = sector >= run_start && sector < run_start + BENCH_IMAGE_SECTORS * change->percent / 100;
+        else changed = test_random(random, 100) < change->percent;
+        if(!changed) continue;
+        // shifted code: most of the sector differs and needs an erase
+        test_pattern(new_image + sector * W25Q64FV_SECTOR_SIZE, W25Q64FV_SECTOR_SIZE, sector + *random);
+    }
+}
+
+/**
+ * @brief Time a full and a delta update of one change pattern and print a row
+ *
+ * @param change                Change pattern
+ * @param random                Random state
+ * @return (void)
+ */
+static void run(const bench_image_change_t *change, uint32_t *random){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    build(change, random);
+    // full: erase the region, then program the whole image
+    memcpy(model.memory() + BENCH_IMAGE_START, old_image, sizeof(old_image));
+    double start = test_time_us();
+    CHECK_OK(flash.erase_range(BENCH_IMAGE_START, BENCH_IMAGE_LENGTH));
+    for(uint32_t i = 0; i < BENCH_IMAGE_LENGTH; i += BENCH_IMAGE_CHUNK){
+        CHECK_OK(flash.write(BENCH_IMAGE_START + i, new_image + i, BENCH_IMAGE_CHUNK, false));
+    }
+    CHECK_OK(flash.wait_until_free());
+    double full = test_time_us() - start;
+    CHECK(memcmp(model.memory() + BENCH_IMAGE_START, new_image, sizeof(new_image)) == 0);
+    // delta: stream the same image through the updater
+    memcpy(model.memory() + BENCH_IMAGE_START, old_image, sizeof(old_image));
+    W25Q64FV_SimImage image(flash, BENCH_IMAGE_START, BENCH_IMAGE_LENGTH, buffer);
+    start = test_time_us();
+    CHECK_OK(image.begin(BENCH_IMAGE_LENGTH));
+    for(uint32_t i = 0; i < BENCH_IMAGE_LENGTH; i += BENCH_IMAGE_CHUNK){
+        CHECK_OK(image.write(new_image + i, BENCH_IMAGE_CHUNK));
+    }
+    CHECK_OK(image.finish());
+    double delta = test_time_us() - start;
+    CHECK(memcmp(model.memory() + BENCH_IMAGE_START, new_image, sizeof(new_image)) == 0);
+    W25Q64FV_image_stats_t stats;
+    image.get_stats(&stats);
+    printf("%-14s %10.0f %10.0f %7.2f %8lu %7lu %7lu\n", change->name, full / 1000, delta / 1000, full / delta,
+           stats.erased, stats.blocks, stats.pages);
+    // a delta update never loses much to a full one, and wins while few sectors change
+    if(change->percent <= 25) CHECK(delta < full);
+    CHECK(delta < full * 1.25);
+    if(!change->clustered) CHECK_EQUAL(stats.blocks, 0);
+    if(change->percent == 100) CHECK(stats.blocks > 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    uint32_t random = 21;
+    test_pattern(old_image, sizeof(old_image), 21);
+    printf("%lu kB image in %d byte chunks\n", BENCH_IMAGE_LENGTH / 1024, BENCH_IMAGE_CHUNK);
+    printf("%-14s %10s %10s %7s %8s %7s %7s\n", "change", "full (ms)", "delta (ms)", "speedup", "erased", "blocks", "pages");
+    for(unsigned int i = 0; i < sizeof(changes) / sizeof(changes[0]); i ++) run(&changes[i], &random);
+    return test_result("bench_image");
+}
@@ -0,0 +1,170 @@
+/**
+ * @file bench_iov.cpp
+ * @author Jeremy Dunne
+ * @brief bytes copied and staging RAM of scatter-gather frames against staging buffers
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Baseline.hpp"
+
+#define BENCH_IOV_FRAMES        2000 // Frames logged per row
+#define BENCH_IOV_SENSORS       100 // Sensor samples per frame
+
+/// Telemetry frame header
+typedef struct{
+    uint32_t time;              ///< Sample time
+    uint16_t id;                ///< Frame number
+    uint16_t count;             ///< Samples in the frame
+} bench_iov_header_t;
+
+#define BENCH_IOV_FRAME         (sizeof(bench_iov_header_t) + BENCH_IOV_SENSORS * sizeof(int16_t) + sizeof(uint32_t))
+
+/// Frame assembly
+typedef enum{
+    BENCH_IOV_PAGE = 0, ///<Pack frames into a page buffer, program full pages with write_page
+    BENCH_IOV_STAGED, ///<Copy each frame into a frame buffer, program it with write
+    BENCH_IOV_SEGMENTS ///<Program the header, samples, and CRC in place with writev
+} bench_iov_t;
+
+static const char *const iov_names[] = {"page buffer", "frame buffer", "writev"};
+
+static bench_iov_header_t header;
+static int16_t sensors[BENCH_IOV_SENSORS];
+static uint32_t crc;
+
+/**
+ * @brief Build frame n in its three parts
+ *
+ * @param frame                 Frame number
+ * @return (void)
+ */
+static void build(uint32_t frame){
+    header.time = frame * 1000;
+    header.id = frame;
+    header.count = BENCH_IOV_SENSORS;
+    for(unsigned int i = 0; i < BENCH_IOV_SENSORS; i ++) sensors[i] = (int16_t)(frame * 31 + i);
+    crc = frame * 2654435761UL;
+}
+
+/**
+ * @brief Log the frames one way and print a row
+ *
+ * @param method                Frame assembly
+ * @param reference             Flash contents of the first row, filled by it
+ * @return unsigned long        Bytes copied by the CPU
+ */
+static unsigned long run(bench_iov_t method, byte *reference){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    W25Q64FV_Baseline<W25Q64FV_SimulatedSPI<1> > baseline(bus);
+    CHECK_OK(flash.begin(0));
+    static byte page[W25Q64FV_PAGE_SIZE];
+    static byte staging[BENCH_IOV_FRAME];
+    size_t staging_size = 0;
+    unsigned long copied = 0;
+    uint32_t address = 0;
+    size_t filled = 0;
+    model.reset_counters();
+    double start = test_time_us();
+    for(uint32_t frame = 0; frame < BENCH_IOV_FRAMES; frame ++){
+        build(frame);
+        W25Q64FV_iovec_t segments[3] = {{&header, sizeof(header)}, {sensors, sizeof(sensors)}, {&crc, sizeof(crc)}};
+        if(method == BENCH_IOV_PAGE){
+            // pack into the page buffer, programming each page as it fills
+            staging_size = sizeof(page);
+            for(unsigned int i = 0; i < 3; i ++){
+                const byte *source = (const byte*)segments[i].base;
+                size_t remaining = segments[i].length;
+                while(remaining > 0){
+                    size_t chunk = W25Q64FV_PAGE_SIZE - filled;
+                    if(chunk > remaining) chunk = remaining;
+                    memcpy(page + filled, source, chunk);
+                    copied += chunk;
+                    filled += chunk;
+                    source += chunk;
+                    remaining -= chunk;
+                    if(filled == W25Q64FV_PAGE_SIZE){
+                        CHECK_OK(baseline.write_page(address, page));
+                        CHECK_OK(baseline.wait_until_free());
+                        address += W25Q64FV_PAGE_SIZE;
+                        filled = 0;
+                    }
+                }
+            }
+        }
+        else if(method == BENCH_IOV_STAGED){
+            staging_size = sizeof(staging);
+            size_t position = 0;
+            for(unsigned int i = 0; i < 3; i ++){
+                memcpy(staging + position, segments[i].base, segments[i].length);
+                position += segments[i].length;
+            }
+            copied += position;
+            CHECK_OK(flash.write(address, staging, position, false));
+            address += position;
+        }
+        else{
+            CHECK_OK(flash.writev(address, segments, 3, false));
+            address += BENCH_IOV_FRAME;
+        }
+    }
+    CHECK_OK(flash.wait_until_free());
+    double elapsed = test_time_us() - start;
+    unsigned long selects = model.counters().selects;
+    // read every frame back into its parts
+    model.reset_counters();
+    uint32_t length = BENCH_IOV_FRAMES * BENCH_IOV_FRAME;
+    if(method == BENCH_IOV_PAGE) length -= length % W25Q64FV_PAGE_SIZE;
+    bool match = true;
+    for(uint32_t frame = 0; frame < length / BENCH_IOV_FRAME; frame ++){
+        bench_iov_header_t read_header;
+        int16_t read_sensors[BENCH_IOV_SENSORS];
+        uint32_t read_crc;
+        uint32_t frame_address = frame * BENCH_IOV_FRAME;
+        if(method == BENCH_IOV_SEGMENTS){
+            W25Q64FV_iovec_t segments[3] = {{&read_header, sizeof(read_header)}, {read_sensors, sizeof(read_sensors)},
+                                            {&read_crc, sizeof(read_crc)}};
+            CHECK_OK(flash.readv(frame_address, segments, 3));
+        }
+        else{
+            CHECK_OK(flash.read(frame_address, staging, BENCH_IOV_FRAME));
+            memcpy(&read_header, staging, sizeof(read_header));
+            memcpy(read_sensors, staging + sizeof(read_header), sizeof(read_sensors));
+            memcpy(&read_crc, staging + sizeof(read_header) + sizeof(read_sensors), sizeof(read_crc));
+            copied += BENCH_IOV_FRAME;
+        }
+        build(frame);
+        match = match && memcmp(&read_header, &header, sizeof(header)) == 0 && memcmp(read_sensors, sensors, sizeof(sensors)) == 0
+            && read_crc == crc;
+    }
+    CHECK(match);
+    unsigned long read_selects = model.counters().selects;
+    size_t ram = method == BENCH_IOV_SEGMENTS ? 3 * sizeof(W25Q64FV_iovec_t) : staging_size;
+    printf("%-14s %10lu %8lu %10.1f %9lu %12lu\n", iov_names[method], copied, (unsigned long)ram,
+           length / 1.024 / elapsed * 1000, selects, read_selects);
+    // the same bytes land on the flash whichever way the frames are assembled
+    if(method == BENCH_IOV_PAGE) memcpy(reference, model.memory(), length);
+    else CHECK(memcmp(reference, model.memory(), length - length % W25Q64FV_PAGE_SIZE) == 0);
+    CHECK_NO_VIOLATIONS(model);
+    return copied;
+}
+
+int main(){
+    static byte reference[BENCH_IOV_FRAMES * BENCH_IOV_FRAME];
+    printf("%d frames of %lu bytes: header, %d samples, CRC\n", BENCH_IOV_FRAMES, (unsigned long)BENCH_IOV_FRAME, BENCH_IOV_SENSORS);
+    printf("%-14s %10s %8s %10s %9s %12s\n", "", "copied", "RAM", "kB/s", "selects", "read selects");
+    unsigned long page = run(BENCH_IOV_PAGE, reference);
+    unsigned long staged = run(BENCH_IOV_STAGED, reference);
+    unsigned long segments = run(BENCH_IOV_SEGMENTS, reference);
+    // every frame byte is copied once to write and once to read, except through the segments
+    CHECK_EQUAL(staged, 2UL * BENCH_IOV_FRAMES * BENCH_IOV_FRAME);
+    CHECK(page > 0);
+    CHECK_EQUAL(segments, 0);
+    return test_result("bench_iov");
+}
@@ -0,0 +1,112 @@
+/**
+ * @file bench_kv.cpp
+ * @author Jeremy Dunne
+ * @brief put and get latency and boot index build time of the key-value store
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_KV_impl.hpp"
+
+#define BENCH_KV_START          0x400000 // Start of the store region
+#define BENCH_KV_SLOTS          1024 // Index entries
+#define BENCH_KV_KEYS           400 // Distinct keys
+#define BENCH_KV_VALUE          32 // Bytes per value
+#define BENCH_KV_OPERATIONS     10000 // Puts per row, each followed by a get
+#define BENCH_KV_PERIOD_US      5000 // Time between puts (us), serviced in between
+
+typedef W25Q64FV_BasicKV<W25Q64FV_Sim> W25Q64FV_SimKV;
+
+static uint32_t index_table[BENCH_KV_SLOTS];
+
+/**
+ * @brief Build the key of an id
+ *
+ * @param id                    Key number
+ * @param key                   Buffer of 16 bytes
+ * @return (void)
+ */
+static void make_key(uint32_t id, char *key){
+    snprintf(key, 16, "sensor.%lu", (unsigned long)id);
+}
+
+/**
+ * @brief Put and get through a store on a region, then time a fresh mount
+ *
+ * @param sectors               Sectors in the region
+ * @param serviced              Call service() between puts
+ * @return (void)
+ */
+static void run(uint32_t sectors, bool serviced){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimKV kv(flash, BENCH_KV_START, sectors * W25Q64FV_SECTOR_SIZE, index_table, BENCH_KV_SLOTS);
+    CHECK_OK(kv.mount());
+    std::vector<double> puts;
+    std::vector<double> gets;
+    byte value[BENCH_KV_VALUE];
+    byte readback[BENCH_KV_VALUE];
+    uint32_t random = 7;
+    model.reset_counters();
+    for(uint32_t i = 0; i < BENCH_KV_OPERATIONS; i ++){
+        // a few keys take most of the updates
+        uint32_t id = test_random(&random, 10) < 8 ? test_random(&random, 20) : test_random(&random, BENCH_KV_KEYS);
+        char key[16];
+        make_key(id, key);
+        test_pattern(value, sizeof(value), i);
+        double start = test_time_us();
+        CHECK_OK(kv.put(key, value, sizeof(value)));
+        puts.push_back(test_time_us() - start);
+        size_t length = 0;
+        start = test_time_us();
+        CHECK_OK(kv.get(key, readback, sizeof(readback), &length));
+        gets.push_back(test_time_us() - start);
+        CHECK(memcmp(readback, value, sizeof(value)) == 0);
+        double next = start + BENCH_KV_PERIOD_US;
+        while(test_time_us() < next){
+            if(serviced) CHECK_OK(kv.service());
+            delayMicroseconds(500);
+        }
+    }
+    unsigned long erases = model.counters().operations[W25Q64FV_OPERATION_SECTOR_ERASE];
+    double put_p99 = test_percentile(puts, 99);
+    printf("%7lu %-11s %9.0f %9.0f %9.0f %9.0f %9.0f %7lu", (unsigned long)sectors, serviced ? "serviced" : "no service",
+           test_percentile(puts, 50), put_p99, test_percentile(puts, 100), test_percentile(gets, 50),
+           test_percentile(gets, 100), erases);
+    // boot: rebuild the index from the records
+    CHECK_OK(flash.wait_until_free());
+    static uint32_t boot_table[BENCH_KV_SLOTS];
+    W25Q64FV_SimKV booted(flash, BENCH_KV_START, sectors * W25Q64FV_SECTOR_SIZE, boot_table, BENCH_KV_SLOTS);
+    model.reset_counters();
+    double start = test_time_us();
+    CHECK_OK(booted.mount());
+    double boot = test_time_us() - start;
+    printf(" %10.0f %8lu\n", boot, model.counters().reads);
+    CHECK_EQUAL(booted.count(), kv.count());
+    // gets take a fixed number of reads whatever the size of the store
+    CHECK(test_percentile(gets, 100) < 500);
+    // a serviced store compacts ahead of the puts and never waits out an erase
+    if(serviced) CHECK(put_p99 < W25Q64FV_TIME_SECTOR_ERASE_TYP / 4);
+    // the boot pass is one read per record, bounded by the region size
+    CHECK(boot < sectors * 20000.0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    printf("%d puts of %d byte values over %d keys, each followed by a get, one every %d us\n",
+           BENCH_KV_OPERATIONS, BENCH_KV_VALUE, BENCH_KV_KEYS, BENCH_KV_PERIOD_US);
+    printf("%7s %-11s %9s %9s %9s %9s %9s %7s %10s %8s\n", "sectors", "", "put p50", "put p99", "put max",
+           "get p50", "get max", "erases", "boot (us)", "reads");
+    static const uint32_t sizes[] = {8, 32, 128};
+    for(unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i ++){
+        run(sizes[i], true);
+        run(sizes[i], false);
+    }
+    return test_result("bench_kv");
+}
@@ -0,0 +1,125 @@
+/**
+ * @file bench_log.cpp
+ * @author Jeremy Dunne
+ * @brief mount time and sustained append rate of a log filling a whole W25Q64
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Baseline.hpp"
+#include "W25Q64FV_Log_impl.hpp"
+
+#define BENCH_LOG_RECORD        100 // Bytes per record
+#define BENCH_LOG_PERIOD_US     1500 // Time between records (us), below the erase bandwidth of 4kB per 45ms
+
+typedef W25Q64FV_BasicLog<W25Q64FV_Sim> W25Q64FV_SimLog;
+
+/**
+ * @brief Find the end of the data the way the hand-rolled logger did
+ *
+ * Reads page after page until one is blank
+ *
+ * @param baseline              First release driver
+ * @return uint32_t             Address of the first blank page
+ */
+static uint32_t linear_scan(W25Q64FV_Baseline<W25Q64FV_SimulatedSPI<1> > &baseline){
+    byte page[W25Q64FV_PAGE_SIZE];
+    for(uint32_t address = 0; address < W25Q64FV_CAPACITY; address += W25Q64FV_PAGE_SIZE){
+        CHECK_OK(baseline.read_page(address, page));
+        bool blank = true;
+        for(unsigned int i = 0; i < W25Q64FV_PAGE_SIZE && blank; i ++) blank = page[i] == 0xFF;
+        if(blank) return address;
+    }
+    return W25Q64FV_CAPACITY;
+}
+
+/**
+ * @brief Time a fresh mount and a linear scan of the log
+ *
+ * @param name                  Row name
+ * @param flash                 Driver
+ * @param model                 Simulated flash
+ * @param head                  Expected head address
+ * @return (void)
+ */
+static void mount_row(const char *name, W25Q64FV_Sim &flash, W25Q64FV_SimulatedFlash &model, uint32_t head){
+    W25Q64FV_Baseline<W25Q64FV_SimulatedSPI<1> > baseline(flash.transport());
+    model.reset_counters();
+    double start = test_time_us();
+    uint32_t end = linear_scan(baseline);
+    double scan_time = test_time_us() - start;
+    unsigned long scan_selects = model.counters().selects;
+    CHECK(end >= head - head % W25Q64FV_PAGE_SIZE);
+    W25Q64FV_SimLog log(flash, 0, W25Q64FV_CAPACITY);
+    model.reset_counters();
+    start = test_time_us();
+    CHECK_OK(log.mount());
+    double mount_time = test_time_us() - start;
+    CHECK_EQUAL(log.head_address(), head);
+    printf("%-14s %12.0f %9lu %12.0f %9lu %9.0fx\n", name, scan_time, scan_selects, mount_time,
+           model.counters().selects, scan_time / mount_time);
+    CHECK(mount_time * 100 < scan_time);
+}
+
+int main(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimLog log(flash, 0, W25Q64FV_CAPACITY);
+    CHECK_OK(log.mount());
+
+    // fill the device, one record every period, with the background erase-ahead
+    byte record[BENCH_LOG_RECORD];
+    std::vector<double> latencies;
+    uint32_t records = 0;
+    uint32_t half_head = 0;
+    uint32_t capacity_records = W25Q64FV_CAPACITY / (BENCH_LOG_RECORD + W25Q64FV_LOG_RECORD_HEADER);
+    model.reset_counters();
+    double start = test_time_us();
+    double next = start;
+    while(log.used_sectors() < W25Q64FV_CAPACITY / W25Q64FV_SECTOR_SIZE - W25Q64FV_LOG_ERASE_AHEAD - 1){
+        test_pattern(record, sizeof(record), records);
+        double append_start = test_time_us();
+        CHECK_OK(log.append(record, sizeof(record)));
+        latencies.push_back(test_time_us() - append_start);
+        records ++;
+        // service until the next record is due
+        next += BENCH_LOG_PERIOD_US;
+        while(test_time_us() < next){
+            CHECK_OK(log.service());
+            delayMicroseconds(100);
+        }
+        if(records == capacity_records / 2){
+            CHECK_OK(log.sync());
+            half_head = log.head_address();
+        }
+    }
+    CHECK_OK(log.sync());
+    double elapsed = test_time_us() - start;
+    unsigned long erases = model.counters().operations[W25Q64FV_OPERATION_SECTOR_ERASE];
+    printf("%lu %d byte records, one every %d us, over %lu sectors\n", (unsigned long)records, BENCH_LOG_RECORD, BENCH_LOG_PERIOD_US,
+           (unsigned long)log.used_sectors());
+    printf("append (us)    p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", test_percentile(latencies, 50),
+           test_percentile(latencies, 99), test_percentile(latencies, 99.9), test_percentile(latencies, 100));
+    printf("sustained      %.1f kB/s, %lu erases, %lu suspends\n", records * BENCH_LOG_RECORD / 1.024 / elapsed * 1000,
+           erases, model.counters().suspends);
+    // no append waits out an erase
+    CHECK(test_percentile(latencies, 100) < W25Q64FV_TIME_SECTOR_ERASE_TYP / 4);
+    CHECK_NO_VIOLATIONS(model);
+
+    // mount against the linear scan, half full and full, once the erase-ahead is done
+    CHECK_OK(flash.wait_until_free());
+    printf("\n%-14s %12s %9s %12s %9s %10s\n", "mount", "scan (us)", "selects", "mount (us)", "selects", "speedup");
+    uint32_t full_head = log.head_address();
+    mount_row("full", flash, model, full_head);
+    // drop the second half to see the half full device
+    memset(model.memory() + half_head, 0xFF, W25Q64FV_CAPACITY - half_head);
+    mount_row("half full", flash, model, half_head);
+    CHECK_NO_VIOLATIONS(model);
+    return test_result("bench_log");
+}
@@ -0,0 +1,89 @@
+/**
+ * @file bench_read.cpp
+ * @author Jeremy Dunne
+ * @brief bytes per transaction of a 1MB dump, page at a time against one streamed read
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Baseline.hpp"
+
+#define BENCH_READ_LENGTH       1048576 // Bytes dumped by each row
+#define BENCH_READ_CHUNK        16384 // Bytes per read() call in the chunked row
+
+static byte image[BENCH_READ_LENGTH];
+static byte dump[BENCH_READ_LENGTH];
+
+/**
+ * @brief Print a row of the table and check the data read back
+ *
+ * @param name                  Row name
+ * @param model                 Simulated flash
+ * @param start                 Virtual time at the start (us)
+ * @return (void)
+ */
+static void row(const char *name, W25Q64FV_SimulatedFlash &model, double start){
+    double elapsed = test_time_us() - start;
+    const W25Q64FV_sim_counters_t &counters = model.counters();
+    printf("%-22s %9lu %12.1f %8lu %10.0f %8.2f\n", name, counters.selects,
+           (double)counters.bytes / counters.selects, counters.polls, elapsed,
+           BENCH_READ_LENGTH / elapsed);
+    CHECK(memcmp(dump, image, BENCH_READ_LENGTH) == 0);
+    CHECK_NO_VIOLATIONS(model);
+    memset(dump, 0, BENCH_READ_LENGTH);
+}
+
+int main(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    W25Q64FV_Baseline<W25Q64FV_SimulatedSPI<1> > baseline(bus);
+    CHECK_OK(flash.begin(0));
+    test_pattern(image, BENCH_READ_LENGTH, 1);
+    memcpy(model.memory(), image, BENCH_READ_LENGTH);
+
+    printf("1MB dump at %d Hz, one line\n", W25Q64FV_SPI_SPEED);
+    printf("%-22s %9s %12s %8s %10s %8s\n", "", "selects", "bytes/select", "polls", "time (us)", "MB/s");
+
+    // first release: a status poll and a 0x03 read of each page, a byte per transfer
+    model.reset_counters();
+    double start = test_time_us();
+    for(uint32_t address = 0; address < BENCH_READ_LENGTH; address += W25Q64FV_PAGE_SIZE){
+        CHECK_OK(baseline.read_page(address, dump + address));
+    }
+    row("baseline read_page", model, start);
+    unsigned long baseline_selects = 2 * (BENCH_READ_LENGTH / W25Q64FV_PAGE_SIZE);
+
+    // read_page loop on the current driver, the idle state is known so nothing polls
+    model.reset_counters();
+    start = test_time_us();
+    for(uint32_t address = 0; address < BENCH_READ_LENGTH; address += W25Q64FV_PAGE_SIZE){
+        CHECK_OK(flash.read_page(address, dump + address));
+    }
+    CHECK_EQUAL(model.counters().polls, 0);
+    row("read_page loop", model, start);
+
+    // chunked reads
+    model.reset_counters();
+    start = test_time_us();
+    for(uint32_t address = 0; address < BENCH_READ_LENGTH; address += BENCH_READ_CHUNK){
+        CHECK_OK(flash.read(address, dump + address, BENCH_READ_CHUNK));
+    }
+    CHECK_EQUAL(model.counters().selects, BENCH_READ_LENGTH / BENCH_READ_CHUNK);
+    row("read 16kB chunks", model, start);
+
+    // the whole dump in one transaction
+    model.reset_counters();
+    start = test_time_us();
+    CHECK_OK(flash.read(0, dump, BENCH_READ_LENGTH));
+    CHECK_EQUAL(model.counters().selects, 1);
+    CHECK(model.counters().selects < baseline_selects);
+    row("read 1MB", model, start);
+
+    printf("bus time only, the per call CPU cost of the page loops is not modelled\n");
+    return test_result("bench_read");
+}
@@ -0,0 +1,135 @@
+/**
+ * @file bench_reader.cpp
+ * @author Jeremy Dunne
+ * @brief small-record replay throughput through the read-ahead cursor
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Baseline.hpp"
+#include "W25Q64FV_Reader_impl.hpp"
+
+#define BENCH_READER_AREA       (256UL * 1024) // Bytes of recorded data
+#define BENCH_READER_WINDOWS    1024 // Bytes of reader buffer, two windows
+#define BENCH_READER_WORK_NS    2000 // Consumer processing per record (ns)
+#define BENCH_READER_LOOKUP     64 // Records between the lookups of the interleaved replay
+
+typedef W25Q64FV_BasicReader<W25Q64FV_Sim> W25Q64FV_SimReader;
+
+/// Replay access pattern
+typedef struct{
+    const char *name;           ///< Row name
+    size_t record;              ///< Bytes per record
+    uint32_t stride;            ///< Distance between records
+    uint32_t records;           ///< Records replayed
+    bool lookups;               ///< Read a record elsewhere every BENCH_READER_LOOKUP records
+} bench_reader_pattern_t;
+
+static const bench_reader_pattern_t patterns[] = {
+    {"16B sequential", 16, 16, 16384, false},
+    {"16B stride 20", 16, 20, 8192, false},
+    {"16B stride 64", 16, 64, 4096, false},
+    {"32B stride 8k", 32, 8192, 32, false},
+    {"16B + lookups", 16, 16, 16384, true}
+};
+
+/// Way the records are read
+typedef enum{
+    BENCH_READER_PAGE = 0, ///<A first-release read_page() per record
+    BENCH_READER_READ, ///<A driver read() per record
+    BENCH_READER_SYNC, ///<The cursor, prefetching with read()
+    BENCH_READER_ASYNC ///<The cursor, prefetching with start_read()
+} bench_reader_method_t;
+
+static const char *const method_names[] = {"read_page", "read", "reader", "reader async"};
+
+static byte data[BENCH_READER_AREA];
+static byte windows[BENCH_READER_WINDOWS];
+
+/**
+ * @brief Replay the records of a pattern one way and print a row
+ *
+ * @param pattern               Access pattern
+ * @param method                Way the records are read
+ * @return double               Throughput of record bytes (kB/s)
+ */
+static double run(const bench_reader_pattern_t *pattern, bench_reader_method_t method){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    W25Q64FV_Baseline<W25Q64FV_SimulatedSPI<1> > baseline(bus);
+    CHECK_OK(flash.begin(0));
+    memcpy(model.memory(), data, sizeof(data));
+    W25Q64FV_SimReader reader(flash, windows, sizeof(windows), method == BENCH_READER_ASYNC);
+    byte page[W25Q64FV_PAGE_SIZE];
+    byte record[64];
+    uint32_t random = 24;
+    bool match = true;
+    model.reset_counters();
+    double start = test_time_us();
+    for(uint32_t i = 0; i < pattern->records; i ++){
+        uint32_t address = i * pattern->stride;
+        if(method == BENCH_READER_PAGE){
+            CHECK_OK(baseline.read_page(address, page));
+            memcpy(record, page, pattern->record);
+        }
+        else if(method == BENCH_READER_READ) CHECK_OK(flash.read(address, record, pattern->record));
+        else{
+            reader.seek(address);
+            CHECK_OK(reader.read(record, pattern->record));
+        }
+        match = match && memcmp(record, data + address, pattern->record) == 0;
+        if(pattern->lookups && i % BENCH_READER_LOOKUP == BENCH_READER_LOOKUP - 1){
+            // an index lookup away from the replay
+            uint32_t lookup = BENCH_READER_AREA / 2 + test_random(&random, BENCH_READER_AREA / 2 - sizeof(record));
+            if(method == BENCH_READER_PAGE){
+                CHECK_OK(baseline.read_page(lookup, page));
+                memcpy(record, page, sizeof(record));
+            }
+            else if(method == BENCH_READER_READ) CHECK_OK(flash.read(lookup, record, sizeof(record)));
+            else CHECK_OK(reader.read(lookup, record, sizeof(record)));
+            match = match && memcmp(record, data + lookup, sizeof(record)) == 0;
+        }
+        // the consumer works on the record while a prefetch may run
+        host_clock_advance(BENCH_READER_WORK_NS);
+    }
+    CHECK_OK(reader.release());
+    double elapsed = test_time_us() - start;
+    CHECK(match);
+    double rate = pattern->record * pattern->records / 1.024 / elapsed * 1000;
+    printf("%-15s %-13s %9.0f %8lu", pattern->name, method_names[method], rate, model.counters().selects);
+    if(method >= BENCH_READER_SYNC){
+        W25Q64FV_reader_stats_t stats;
+        reader.get_stats(&stats);
+        printf(" %6.1f%% %10.1f", 100.0 * stats.hits / (stats.hits + stats.misses), (double)stats.bytes / stats.transactions);
+    }
+    printf("\n");
+    CHECK_NO_VIOLATIONS(model);
+    return rate;
+}
+
+int main(){
+    test_pattern(data, sizeof(data), 24);
+    printf("records replayed with %d ns of work each, %d byte reader buffer\n", BENCH_READER_WORK_NS, BENCH_READER_WINDOWS);
+    printf("%-15s %-13s %9s %8s %7s %10s\n", "pattern", "", "kB/s", "selects", "hits", "B/txn");
+    for(unsigned int i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i ++){
+        double rates[4];
+        for(unsigned int method = BENCH_READER_PAGE; method <= BENCH_READER_ASYNC; method ++){
+            rates[method] = run(&patterns[i], (bench_reader_method_t)method);
+        }
+        // a stream pays one read setup per window rather than per record
+        if(patterns[i].stride - patterns[i].record <= W25Q64FV_READER_MAX_GAP){
+            CHECK(rates[BENCH_READER_SYNC] > 1.1 * rates[BENCH_READER_READ]);
+        }
+        CHECK(rates[BENCH_READER_READ] > rates[BENCH_READER_PAGE]);
+        // off the stream the cursor costs no more than a plain read
+        CHECK(rates[BENCH_READER_SYNC] > 0.97 * rates[BENCH_READER_READ]);
+        // the prefetch overlaps the consumer's work
+        CHECK(rates[BENCH_READER_ASYNC] >= rates[BENCH_READER_SYNC] * 0.99);
+    }
+    return test_result("bench_reader");
+}
@@ -0,0 +1,88 @@
+/**
+ * @file bench_stripe.cpp
+ * @author Jeremy Dunne
+ * @brief write, read, and erase throughput of one to four striped chips
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Stripe_impl.hpp"
+
+#define BENCH_STRIPE_LENGTH     (256UL * 1024) // Bytes written and read per row
+#define BENCH_STRIPE_SECTORS    64 // Stripe sectors erased per row
+
+typedef W25Q64FV_BasicStripe<W25Q64FV_Sim> W25Q64FV_SimStripe;
+
+static byte data[BENCH_STRIPE_LENGTH];
+static byte readback[BENCH_STRIPE_LENGTH];
+
+/**
+ * @brief Time a stripe of count chips and print a row
+ *
+ * @param count                 Number of chips
+ * @param write_rate            Write throughput (kB/s)
+ * @param erase_rate            erase_range() throughput (kB/s)
+ * @return (void)
+ */
+static void run(uint8_t count, double *write_rate, double *erase_rate){
+    W25Q64FV_SimulatedFlash models[W25Q64FV_STRIPE_MAX_CHIPS];
+    W25Q64FV_SimulatedSPI<1> *buses[W25Q64FV_STRIPE_MAX_CHIPS];
+    W25Q64FV_Sim *chips[W25Q64FV_STRIPE_MAX_CHIPS];
+    for(uint8_t i = 0; i < count; i ++){
+        buses[i] = new W25Q64FV_SimulatedSPI<1>(&models[i]);
+        chips[i] = new W25Q64FV_Sim(*buses[i]);
+        CHECK_OK(chips[i]->begin(i));
+    }
+    W25Q64FV_SimStripe stripe(chips, count);
+    uint32_t erase_length = BENCH_STRIPE_SECTORS * stripe.sector_size();
+    // erase_range, each chip on its own plan
+    double start = test_time_us();
+    CHECK_OK(stripe.erase_range(0, erase_length));
+    double range_time = test_time_us() - start;
+    // the same range a stripe sector at a time
+    start = test_time_us();
+    for(uint32_t address = 0; address < erase_length; address += stripe.sector_size()){
+        CHECK_OK(stripe.erase_sector(address, true));
+    }
+    double sector_time = test_time_us() - start;
+    // write then read back, unaligned
+    start = test_time_us();
+    CHECK_OK(stripe.write(5, data, sizeof(data), true));
+    double write_time = test_time_us() - start;
+    start = test_time_us();
+    CHECK_OK(stripe.read(5, readback, sizeof(readback)));
+    double read_time = test_time_us() - start;
+    CHECK(memcmp(data, readback, sizeof(data)) == 0);
+    *write_rate = sizeof(data) / 1.024 / write_time * 1000;
+    *erase_rate = erase_length / 1.024 / range_time * 1000;
+    printf("%5u %10.0f %10.0f %10.0f %12.0f %12.0f\n", count, *write_rate, sizeof(data) / 1.024 / read_time * 1000,
+           erase_length / 1.024 / sector_time * 1000, *erase_rate, range_time / 1000);
+    // the chips run their plans side by side, so the range takes what one chip's share does
+    unsigned long share_time = chips[0]->erase_range_time(0, erase_length / count);
+    CHECK(range_time / 1000 < share_time * 1.05 + 1);
+    for(uint8_t i = 0; i < count; i ++){
+        CHECK_NO_VIOLATIONS(models[i]);
+        delete chips[i];
+        delete buses[i];
+    }
+}
+
+int main(){
+    test_pattern(data, sizeof(data), 16);
+    printf("%lu kB written and read, %d stripe sectors erased\n", BENCH_STRIPE_LENGTH / 1024, BENCH_STRIPE_SECTORS);
+    printf("%5s %10s %10s %10s %12s %12s\n", "chips", "write kB/s", "read kB/s", "sector kB/s", "range kB/s", "range (ms)");
+    double write_one, erase_one;
+    run(1, &write_one, &erase_one);
+    for(uint8_t count = 2; count <= W25Q64FV_STRIPE_MAX_CHIPS; count *= 2){
+        double write_rate, erase_rate;
+        run(count, &write_rate, &erase_rate);
+        // programs and erases overlap across the chips
+        CHECK(write_rate > 0.8 * count * write_one);
+        CHECK(erase_rate > 0.95 * count * erase_one);
+    }
+    return test_result("bench_stripe");
+}
@@ -0,0 +1,88 @@
+/**
+ * @file bench_suspend.cpp
+ * @author Jeremy Dunne
+ * @brief read latency under a background erase workload, waiting against suspending
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Async_impl.hpp"
+
+#define BENCH_SUSPEND_READS         400 // Reads per row
+#define BENCH_SUSPEND_PERIOD_US     7300 // Mean time between reads (us)
+#define BENCH_SUSPEND_READ_LENGTH   64 // Bytes per read
+#define BENCH_SUSPEND_ERASE_SECTORS 64 // Sectors cycled through by the background erases
+#define BENCH_SUSPEND_READ_START    0x100000 // Start of the area the reads come from
+#define BENCH_SUSPEND_TICK_US       100 // Main loop period (us)
+
+typedef W25Q64FV_BasicAsync<W25Q64FV_Sim> W25Q64FV_SimAsync;
+
+/**
+ * @brief Run the workload and print a row of the table
+ *
+ * @param name                  Row name
+ * @param use_suspend           Serve the reads through the engine, which suspends the erase
+ * @return double               99th percentile read latency (us)
+ */
+static double run(const char *name, bool use_suspend){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    test_pattern(model.memory() + BENCH_SUSPEND_READ_START, W25Q64FV_BLOCK_64K_SIZE, 5);
+    W25Q64FV_SimAsync engine(flash);
+    std::vector<double> latencies;
+    uint32_t random = 12345;
+    uint32_t next_sector = 0;
+    unsigned long erased = 0;
+    double start = test_time_us();
+    double arrival = start + BENCH_SUSPEND_PERIOD_US;
+    byte data[BENCH_SUSPEND_READ_LENGTH];
+    while(latencies.size() < BENCH_SUSPEND_READS){
+        // keep the erase queue full
+        while(engine.count() < 2){
+            CHECK(engine.erase_sector(next_sector * W25Q64FV_SECTOR_SIZE) >= 0);
+            next_sector = (next_sector + 1) % BENCH_SUSPEND_ERASE_SECTORS;
+            erased ++;
+        }
+        if(test_time_us() >= arrival){
+            random = random * 1664525UL + 1013904223UL;
+            uint32_t address = BENCH_SUSPEND_READ_START + (random >> 8) % (W25Q64FV_BLOCK_64K_SIZE - BENCH_SUSPEND_READ_LENGTH);
+            W25Q64FV_status_t status = use_suspend ? engine.read(address, data, sizeof(data)) : W25Q64FV_BUSY;
+            if(status == W25Q64FV_BUSY){
+                // wait out the operation, the engine is not polled in the meantime
+                CHECK_OK(flash.wait_until_free());
+                status = flash.read(address, data, sizeof(data));
+            }
+            CHECK_OK(status);
+            CHECK(memcmp(data, model.memory() + address, sizeof(data)) == 0);
+            latencies.push_back(test_time_us() - arrival);
+            // the next arrival, spread from half to one and a half periods
+            random = random * 1664525UL + 1013904223UL;
+            arrival += BENCH_SUSPEND_PERIOD_US / 2 + (random >> 8) % BENCH_SUSPEND_PERIOD_US;
+            continue;
+        }
+        engine.poll();
+        delayMicroseconds(BENCH_SUSPEND_TICK_US);
+    }
+    double elapsed = test_time_us() - start;
+    double p99 = test_percentile(latencies, 99);
+    printf("%-16s %9.0f %9.0f %9.0f %9.0f %12.1f\n", name, test_percentile(latencies, 50), test_percentile(latencies, 90),
+           p99, test_percentile(latencies, 100), (erased - engine.count()) / (elapsed / 1e6));
+    CHECK_EQUAL(model.counters().suspends > 0, use_suspend);
+    CHECK_NO_VIOLATIONS(model);
+    return p99;
+}
+
+int main(){
+    printf("%d byte reads every %d us (mean) under back to back 4kB erases\n", BENCH_SUSPEND_READ_LENGTH, BENCH_SUSPEND_PERIOD_US);
+    printf("%-16s %9s %9s %9s %9s %12s\n", "latency (us)", "p50", "p90", "p99", "max", "erases/s");
+    double wait_p99 = run("wait for erase", false);
+    double suspend_p99 = run("suspend erase", true);
+    CHECK(suspend_p99 * 10 < wait_p99);
+    return test_result("bench_suspend");
+}
@@ -0,0 +1,233 @@
+/**
+ * @file bench_telemetry.cpp
+ * @author Jeremy Dunne
+ * @brief compression ratio and effective write throughput of telemetry on sensor traces
+ *
+ * Each trace is logged twice through the same log, once as raw 32 bit frames packed into
+ * W25Q64FV_TELEMETRY_BLOCK_SIZE byte records and once through the telemetry encoder. The
+ * effective throughput is the raw frame bytes over the bus time of each, the main loop
+ * calling service() after every frame. The host time of append() and read_next() includes
+ * the simulated bus calls, so it bounds the encoder and decoder CPU time from above.
+ *
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Telemetry_impl.hpp"
+#include <chrono>
+#include <math.h>
+
+#define BENCH_TELEMETRY_START   0x100000 // Start of the log region
+#define BENCH_TELEMETRY_LENGTH  (1024UL * 1024) // Length of the log region
+#define BENCH_TELEMETRY_FRAMES  20000 // Frames per trace
+#define BENCH_TELEMETRY_SEEKS   100 // Seeks to random keys per trace
+#define BENCH_TELEMETRY_MAX_CH  10 // Most channels of a trace
+
+typedef W25Q64FV_BasicLog<W25Q64FV_Sim> W25Q64FV_SimLog;
+typedef W25Q64FV_BasicTelemetry<W25Q64FV_Sim> W25Q64FV_SimTelemetry;
+
+/// Sensor trace
+typedef struct{
+    const char *name;           ///< Row name
+    uint8_t channels;           ///< Values per frame, the timestamp first
+    double min_ratio;           ///< Compression ratio the trace must reach
+} bench_telemetry_trace_t;
+
+static const bench_telemetry_trace_t traces[] = {
+    {"IMU 100Hz", 9, 2.0},
+    {"GPS 10Hz", 7, 2.5},
+    {"housekeeping 1Hz", 8, 4.0},
+    {"12 bit ADC noise", 5, 1.2}
+};
+
+static int32_t frames[BENCH_TELEMETRY_FRAMES][BENCH_TELEMETRY_MAX_CH];
+
+/**
+ * @brief Noise of a sensor, roughly gaussian
+ *
+ * @param random                Random state
+ * @param amplitude             Largest deviation
+ * @return int32_t              Noise sample
+ */
+static int32_t noise(uint32_t *random, uint32_t amplitude){
+    uint32_t sum = 0;
+    for(uint8_t i = 0; i < 4; i ++) sum += test_random(random, amplitude + 1);
+    return (int32_t)(sum / 2) - (int32_t)amplitude;
+}
+
+/**
+ * @brief Build the frames of a trace
+ *
+ * @param index                 Trace
+ * @param random                Random state
+ * @return (void)
+ */
+static void build(unsigned int index, uint32_t *random){
+    for(uint32_t i = 0; i < BENCH_TELEMETRY_FRAMES; i ++){
+        int32_t *frame = frames[i];
+        double t = i;
+        switch(index){
+        case 0:
+            // ms timestamp, accelerometer (mg) and gyro (0.1 dps) of a slowly moving board, die temperature
+            frame[0] = i * 10;
+            frame[1] = (int32_t)(80 * sin(t / 300)) + noise(random, 12);
+            frame[2] = (int32_t)(50 * cos(t / 470)) + noise(random, 12);
+            frame[3] = 1000 + noise(random, 12);
+            frame[4] = (int32_t)(30 * sin(t / 150)) + noise(random, 4);
+            frame[5] = noise(random, 4);
+            frame[6] = noise(random, 4);
+            frame[7] = 2500 + (int32_t)(i / 400);
+            frame[8] = 0x0103;
+            break;
+        case 1:
+            // ms timestamp, latitude and longitude (1e-7 deg), altitude (cm), speed (cm/s), satellites, fix
+            frame[0] = i * 100 + (test_random(random, 10) == 0 ? 1 : 0);
+            frame[1] = 473977420 + (int32_t)(i * 11) + noise(random, 3);
+            frame[2] = 85455940 - (int32_t)(i * 7) + noise(random, 3);
+            frame[3] = 40800 + (int32_t)(200 * sin(t / 900)) + noise(random, 20);
+            frame[4] = 1300 + noise(random, 15);
+            frame[5] = 11 + (i / 3000) % 3;
+            frame[6] = 3;
+            break;
+        case 2:
+            // s timestamp, battery (mV), current (mA), two temperatures (0.1 C), counters, flags
+            frame[0] = i;
+            frame[1] = 4150 - (int32_t)(i / 25) + noise(random, 2);
+            frame[2] = 320 + (i % 600 < 60 ? 900 : 0) + noise(random, 3);
+            frame[3] = 215 + (int32_t)(30 * sin(t / 3600));
+            frame[4] = 198 + (int32_t)(25 * sin(t / 3600 + 0.5));
+            frame[5] = i / 60;
+            frame[6] = 0;
+            frame[7] = 0x0011;
+            break;
+        default:
+            // ms timestamp and four channels of full scale noise, the worst case
+            frame[0] = i;
+            for(uint8_t channel = 1; channel < 5; channel ++) frame[channel] = test_random(random, 4096);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Log the raw frames packed into records and return the bus time
+ *
+ * @param trace                 Trace
+ * @return double               Bus time (us)
+ */
+static double run_raw(const bench_telemetry_trace_t *trace){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimLog log(flash, BENCH_TELEMETRY_START, BENCH_TELEMETRY_LENGTH);
+    CHECK_OK(log.format());
+    byte record[W25Q64FV_TELEMETRY_BLOCK_SIZE];
+    size_t frame_bytes = trace->channels * sizeof(int32_t);
+    size_t length = 0;
+    double start = test_time_us();
+    for(uint32_t i = 0; i < BENCH_TELEMETRY_FRAMES; i ++){
+        if(length + frame_bytes > sizeof(record)){
+            CHECK_OK(log.append(record, length));
+            length = 0;
+        }
+        memcpy(record + length, frames[i], frame_bytes);
+        length += frame_bytes;
+        CHECK_OK(log.service());
+    }
+    CHECK_OK(log.append(record, length));
+    CHECK_OK(log.sync());
+    CHECK_OK(flash.wait_until_free());
+    double elapsed = test_time_us() - start;
+    CHECK_NO_VIOLATIONS(model);
+    return elapsed;
+}
+
+/**
+ * @brief Log a trace through the encoder, read it back and print a row
+ *
+ * @param trace                 Trace
+ * @param raw                   Bus time of the raw frames (us)
+ * @return (void)
+ */
+static void run(const bench_telemetry_trace_t *trace, double raw){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimLog log(flash, BENCH_TELEMETRY_START, BENCH_TELEMETRY_LENGTH);
+    CHECK_OK(log.format());
+    W25Q64FV_SimTelemetry telemetry(log, trace->channels);
+    // write, timing append() on the host and the log on the bus
+    double cpu_ns = 0;
+    double start = test_time_us();
+    for(uint32_t i = 0; i < BENCH_TELEMETRY_FRAMES; i ++){
+        std::chrono::steady_clock::time_point host_start = std::chrono::steady_clock::now();
+        CHECK_OK(telemetry.append(frames[i]));
+        cpu_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - host_start).count();
+        CHECK_OK(log.service());
+    }
+    CHECK_OK(telemetry.sync());
+    CHECK_OK(flash.wait_until_free());
+    double encoded = test_time_us() - start;
+    W25Q64FV_telemetry_stats_t stats;
+    telemetry.get_stats(&stats);
+    // read back every frame, the decoder streaming from flash
+    int32_t values[BENCH_TELEMETRY_MAX_CH];
+    uint32_t count = 0;
+    bool match = true;
+    telemetry.rewind();
+    start = test_time_us();
+    std::chrono::steady_clock::time_point host_start = std::chrono::steady_clock::now();
+    while(true){
+        bool valid;
+        W25Q64FV_status_t status = telemetry.read_next(values, &valid);
+        CHECK_OK(status);
+        if(status != W25Q64FV_OK || !valid) break;
+        match = match && count < BENCH_TELEMETRY_FRAMES && memcmp(values, frames[count], trace->channels * sizeof(int32_t)) == 0;
+        count ++;
+    }
+    double decode_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - host_start).count();
+    double decode = test_time_us() - start;
+    CHECK_EQUAL(count, BENCH_TELEMETRY_FRAMES);
+    CHECK(match);
+    // seeks to random keys, each decoding part of a sector
+    uint32_t random = 25;
+    int32_t last = frames[BENCH_TELEMETRY_FRAMES - 1][0];
+    start = test_time_us();
+    for(unsigned int i = 0; i < BENCH_TELEMETRY_SEEKS; i ++){
+        int32_t key = (int32_t)test_random(&random, last + 1);
+        CHECK_OK(telemetry.seek(key));
+        bool valid;
+        CHECK_OK(telemetry.read_next(values, &valid));
+        CHECK(valid && values[0] >= key);
+    }
+    double seek = (test_time_us() - start) / BENCH_TELEMETRY_SEEKS;
+    CHECK_EQUAL(telemetry.seek(last + 1), W25Q64FV_NOT_FOUND);
+    double ratio = (double)stats.raw_bytes / stats.encoded_bytes;
+    double raw_bytes = stats.raw_bytes / 1.024;
+    printf("%-17s %3u %8lu %8lu %6.2f %8.0f %8.0f %6.2f %7.0f %7.0f %8.0f %7.0f\n", trace->name, trace->channels,
+           stats.raw_bytes, stats.encoded_bytes, ratio, raw_bytes / raw * 1000, raw_bytes / encoded * 1000,
+           raw / encoded, cpu_ns / BENCH_TELEMETRY_FRAMES, decode_ns / BENCH_TELEMETRY_FRAMES,
+           raw_bytes / decode * 1000, seek);
+    // smooth channels compress, and the flash time falls with the encoded size
+    CHECK(ratio > trace->min_ratio);
+    CHECK(encoded < raw);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    uint32_t random = 25;
+    printf("%d frames per trace, %d byte blocks\n", BENCH_TELEMETRY_FRAMES, W25Q64FV_TELEMETRY_BLOCK_SIZE);
+    printf("%-17s %3s %8s %8s %6s %8s %8s %6s %7s %7s %8s %7s\n", "trace", "ch", "raw B", "flash B", "ratio",
+           "raw kB/s", "enc kB/s", "gain", "app ns", "rd ns", "rd kB/s", "seek us");
+    for(unsigned int i = 0; i < sizeof(traces) / sizeof(traces[0]); i ++){
+        build(i, &random);
+        run(&traces[i], run_raw(&traces[i]));
+    }
+    return test_result("bench_telemetry");
+}
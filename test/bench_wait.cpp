@@ -0,0 +1,94 @@
+/**
+ * @file bench_wait.cpp
+ * @author Jeremy Dunne
+ * @brief completion wait cost, millisecond polling against the operation-aware wait
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Baseline.hpp"
+
+#define BENCH_WAIT_PAGES        256 // Pages programmed per row
+#define BENCH_WAIT_SECTORS      16 // Sectors erased per row
+
+/// Wait strategy
+typedef enum{
+    BENCH_WAIT_BASELINE = 0, ///<First release, poll every millisecond
+    BENCH_WAIT_ADAPTIVE, ///<Sleep the typical time then back off
+    BENCH_WAIT_CONTINUOUS ///<As adaptive, streaming status register 1
+} bench_wait_t;
+
+static const char *const wait_names[] = {"baseline delay(1)", "adaptive", "adaptive, streamed"};
+
+/**
+ * @brief Program pages and erase sectors with one wait strategy and print a row
+ *
+ * @param wait                  Wait strategy
+ * @param maximum               Run the part at its datasheet maximum times
+ * @return double               Page program throughput (kB/s)
+ */
+static double run(bench_wait_t wait, bool maximum){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    W25Q64FV_Baseline<W25Q64FV_SimulatedSPI<1> > baseline(bus);
+    W25Q64FV_sim_timing_t timing;
+    W25Q64FV_sim_default_timing(&timing, W25Q64FV_CAPACITY, maximum);
+    model.set_timing(timing);
+    CHECK_OK(flash.begin(0));
+    flash.set_continuous_status_poll(wait == BENCH_WAIT_CONTINUOUS);
+    byte page[W25Q64FV_PAGE_SIZE];
+    test_pattern(page, sizeof(page), 8);
+    model.reset_counters();
+    // page programs, each waited for
+    double start = test_time_us();
+    for(uint32_t i = 0; i < BENCH_WAIT_PAGES; i ++){
+        if(wait == BENCH_WAIT_BASELINE){
+            CHECK_OK(baseline.write_page(i * W25Q64FV_PAGE_SIZE, page));
+            CHECK_OK(baseline.wait_until_free());
+        }
+        else{
+            CHECK_OK(flash.write(i * W25Q64FV_PAGE_SIZE, page, sizeof(page), true));
+        }
+    }
+    double program_time = (test_time_us() - start) / BENCH_WAIT_PAGES;
+    unsigned long program_polls = model.counters().polls;
+    // sector erases
+    start = test_time_us();
+    for(uint32_t i = 0; i < BENCH_WAIT_SECTORS; i ++){
+        if(wait == BENCH_WAIT_BASELINE) CHECK_OK(baseline.erase_sector(i * W25Q64FV_SECTOR_SIZE));
+        else CHECK_OK(flash.erase_sector(i * W25Q64FV_SECTOR_SIZE, true));
+    }
+    double erase_time = (test_time_us() - start) / BENCH_WAIT_SECTORS;
+    double throughput = W25Q64FV_PAGE_SIZE / 1.024 / program_time * 1000;
+    printf("%-20s %7s %9.0f %6lu %8lu %7.1f %10.0f %11.0f\n", wait_names[wait], maximum ? "max" : "typical",
+           program_time, timing.page_program, program_polls, throughput, erase_time, erase_time - timing.sector_erase);
+    CHECK_EQUAL(model.memory()[0], 0xFF);
+    CHECK_NO_VIOLATIONS(model);
+    return throughput;
+}
+
+int main(){
+    printf("%d page programs and %d sector erases, each waited for\n", BENCH_WAIT_PAGES, BENCH_WAIT_SECTORS);
+    printf("%-20s %7s %9s %6s %8s %7s %10s %11s\n", "", "part", "page (us)", "tPP", "polls", "kB/s", "erase (us)", "overrun (us)");
+    for(int maximum = 0; maximum <= 1; maximum ++){
+        double baseline = run(BENCH_WAIT_BASELINE, maximum);
+        double adaptive = run(BENCH_WAIT_ADAPTIVE, maximum);
+        double continuous = run(BENCH_WAIT_CONTINUOUS, maximum);
+        printf("%-20s %7s adaptive %.2fx, streamed %.2fx the baseline throughput\n", "", "", adaptive / baseline, continuous / baseline);
+        // past the typical time the backoff may overrun by up to an eighth of it, on a
+        // part at the maximum times that costs what skipping the millisecond grid saves
+        if(!maximum){
+            CHECK(adaptive > 1.3 * baseline);
+            CHECK(continuous > 1.3 * baseline);
+        }
+        else{
+            CHECK(adaptive > 0.9 * baseline);
+        }
+    }
+    return test_result("bench_wait");
+}
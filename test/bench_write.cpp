@@ -0,0 +1,101 @@
+/**
+ * @file bench_write.cpp
+ * @author Jeremy Dunne
+ * @brief sustained write throughput, page at a time against pipelined bulk writes
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Baseline.hpp"
+
+#define BENCH_WRITE_LENGTH      65536 // Bytes written by each row
+#define BENCH_WRITE_PREPARE_US  300 // Time to produce a page of data, sampling and formatting (us)
+
+static byte image[BENCH_WRITE_LENGTH];
+
+/**
+ * @brief Produce the next page of data
+ *
+ * @param address               Address of the page
+ * @param page                  Page to fill
+ * @return (void)
+ */
+static void prepare(uint32_t address, byte *page){
+    delayMicroseconds(BENCH_WRITE_PREPARE_US);
+    memcpy(page, image + address, W25Q64FV_PAGE_SIZE);
+}
+
+/**
+ * @brief Print a row of the table, check the data, and erase it again
+ *
+ * @param name                  Row name
+ * @param model                 Simulated flash
+ * @param start                 Virtual time at the start (us)
+ * @return double               Throughput (kB/s)
+ */
+static double row(const char *name, W25Q64FV_SimulatedFlash &model, double start){
+    double elapsed = test_time_us() - start;
+    double throughput = BENCH_WRITE_LENGTH / 1.024 / elapsed * 1000;
+    printf("%-26s %10.0f %10.1f %8lu\n", name, elapsed, throughput, model.counters().polls);
+    CHECK(memcmp(model.memory(), image, BENCH_WRITE_LENGTH) == 0);
+    CHECK_NO_VIOLATIONS(model);
+    memset(model.memory(), 0xFF, BENCH_WRITE_LENGTH);
+    model.reset_counters();
+    return throughput;
+}
+
+int main(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    W25Q64FV_Baseline<W25Q64FV_SimulatedSPI<1> > baseline(bus);
+    CHECK_OK(flash.begin(0));
+    test_pattern(image, BENCH_WRITE_LENGTH, 2);
+    byte page[W25Q64FV_PAGE_SIZE];
+
+    printf("64kB written a page at a time, %d us to prepare each page\n", BENCH_WRITE_PREPARE_US);
+    printf("%-26s %10s %10s %8s\n", "", "time (us)", "kB/s", "polls");
+    model.reset_counters();
+
+    // first release, as in examples/main.cpp: program the page then wait for it
+    double start = test_time_us();
+    for(uint32_t address = 0; address < BENCH_WRITE_LENGTH; address += W25Q64FV_PAGE_SIZE){
+        prepare(address, page);
+        CHECK_OK(baseline.write_page(address, page));
+        CHECK_OK(baseline.wait_until_free());
+    }
+    double baseline_throughput = row("baseline write_page+wait", model, start);
+
+    // page at a time, waiting for each program before preparing the next page
+    start = test_time_us();
+    for(uint32_t address = 0; address < BENCH_WRITE_LENGTH; address += W25Q64FV_PAGE_SIZE){
+        prepare(address, page);
+        CHECK_OK(flash.write(address, page, W25Q64FV_PAGE_SIZE, true));
+    }
+    double serial_throughput = row("write, hold", model, start);
+
+    // pipelined, the next page is prepared while the previous one programs
+    start = test_time_us();
+    for(uint32_t address = 0; address < BENCH_WRITE_LENGTH; address += W25Q64FV_PAGE_SIZE){
+        prepare(address, page);
+        CHECK_OK(flash.write(address, page, W25Q64FV_PAGE_SIZE, false));
+    }
+    CHECK_OK(flash.wait_until_free());
+    double pipelined_throughput = row("write, no hold", model, start);
+
+    // the whole buffer at once, split at the page boundaries by write
+    start = test_time_us();
+    CHECK_OK(flash.write(0, image, BENCH_WRITE_LENGTH, true));
+    double bulk_throughput = row("write 64kB (no prepare)", model, start);
+
+    printf("pipelined / baseline: %.2fx, pipelined / serial: %.2fx\n",
+           pipelined_throughput / baseline_throughput, pipelined_throughput / serial_throughput);
+    CHECK(serial_throughput > baseline_throughput);
+    CHECK(pipelined_throughput > serial_throughput);
+    CHECK(bulk_throughput > pipelined_throughput);
+    return test_result("bench_write");
+}
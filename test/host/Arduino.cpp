@@ -0,0 +1,128 @@
+/**
+ * @file Arduino.cpp
+ * @author Jeremy Dunne
+ * @brief host stand-in for the Arduino core, for building the library on Linux
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <atomic>
+#include <thread>
+
+HostSerial Serial;
+SPIClass SPI;
+
+static std::atomic<uint64_t> clock_ns(0);
+
+uint64_t host_clock_ns(){
+    return clock_ns.load();
+}
+
+void host_clock_advance(uint64_t time){
+    clock_ns.fetch_add(time);
+}
+
+void host_clock_sleep(uint64_t time){
+    // other threads see the time pass
+    while(time > HOST_CLOCK_SLICE_NS){
+        clock_ns.fetch_add(HOST_CLOCK_SLICE_NS);
+        time -= HOST_CLOCK_SLICE_NS;
+        std::this_thread::yield();
+    }
+    clock_ns.fetch_add(time);
+    std::this_thread::yield();
+}
+
+void host_clock_reset(){
+    clock_ns.store(0);
+}
+
+unsigned long millis(){
+    return clock_ns.fetch_add(HOST_CLOCK_READ_NS) / 1000000;
+}
+
+unsigned long micros(){
+    return clock_ns.fetch_add(HOST_CLOCK_READ_NS) / 1000;
+}
+
+void delay(unsigned long ms){
+    host_clock_sleep((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us){
+    host_clock_sleep((uint64_t)us * 1000);
+}
+
+void pinMode(int pin, int mode){
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(int pin, int value){
+    (void)pin;
+    (void)value;
+}
+
+int digitalRead(int pin){
+    (void)pin;
+    return LOW;
+}
+
+void noInterrupts(){
+}
+
+void interrupts(){
+}
+
+size_t Print::write(const uint8_t *buffer, size_t length){
+    size_t written = 0;
+    while(length --) written += write(*buffer ++);
+    return written;
+}
+
+size_t Print::print(const char *text){
+    return write((const uint8_t*)text, strlen(text));
+}
+
+size_t Print::print(char value){
+    return write((uint8_t)value);
+}
+
+size_t Print::print(int value){
+    return print((long)value);
+}
+
+size_t Print::print(unsigned int value){
+    return print((unsigned long)value);
+}
+
+size_t Print::print(long value){
+    char text[24];
+    snprintf(text, sizeof(text), "%ld", value);
+    return print(text);
+}
+
+size_t Print::print(unsigned long value){
+    char text[24];
+    snprintf(text, sizeof(text), "%lu", value);
+    return print(text);
+}
+
+size_t Print::print(double value){
+    char text[32];
+    snprintf(text, sizeof(text), "%.2f", value);
+    return print(text);
+}
+
+size_t Print::println(){
+    return print("\r\n");
+}
+
+size_t HostSerial::write(uint8_t data){
+    return fputc(data, stdout) == EOF ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file Arduino.h
+ * @author Jeremy Dunne
+ * @brief host stand-in for the Arduino core, for building the library on Linux
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Time is virtual: micros() and millis() read a clock that only moves when the code
+ * waits (delay(), delayMicroseconds()), when a simulated transport clocks the bus, and
+ * by a fixed cost per clock read, so busy loops always make progress. Runs are
+ * reproducible and independent of the host speed.
+ *
+ * The clock is shared by every thread. Threads standing in for interrupts must not
+ * rely on noInterrupts(), which does nothing here.
+ *
+ */
+
+#ifndef _W25Q64FV_HOST_ARDUINO_H_
+#define _W25Q64FV_HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+/********** SETTINGS **********/
+#ifndef HOST_CLOCK_READ_NS
+#define HOST_CLOCK_READ_NS      50 // Cost of a micros() or millis() call (ns)
+#endif
+#ifndef HOST_CLOCK_SLICE_NS
+#define HOST_CLOCK_SLICE_NS     100000 // Longest step of a delay before yielding to other threads (ns)
+#endif
+
+#define HIGH        1
+#define LOW         0
+#define INPUT       0
+#define OUTPUT      1
+#define MSBFIRST    1
+#define LSBFIRST    0
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/**
+ * @brief Get the virtual time, without advancing it
+ *
+ * @return uint64_t             Time since the last reset (ns)
+ */
+uint64_t host_clock_ns();
+
+/**
+ * @brief Move the virtual time forward
+ *
+ * @param time                  Time to advance (ns)
+ * @return (void)
+ */
+void host_clock_advance(uint64_t time);
+
+/**
+ * @brief Move the virtual time forward in slices, yielding to other threads between them
+ *
+ * @param time                  Time to wait (ns)
+ * @return (void)
+ */
+void host_clock_sleep(uint64_t time);
+
+/**
+ * @brief Set the virtual time back to zero
+ *
+ * @return (void)
+ */
+void host_clock_reset();
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+void noInterrupts();
+void interrupts();
+
+/**
+ * @brief Text output, the subset of the Arduino Print class used by the library
+ *
+ */
+class Print{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t length);
+    size_t print(const char *text);
+    size_t print(char value);
+    size_t print(int value);
+    size_t print(unsigned int value);
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(double value);
+    size_t println();
+    template<class T> size_t println(T value) { size_t length = print(value); return length + println(); }
+};
+
+/**
+ * @brief Serial port, written to stdout
+ *
+ */
+class HostSerial : public Print{
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    size_t write(uint8_t data);
+    using Print::write;
+    operator bool() { return true; }
+};
+
+extern HostSerial Serial;
+
+#endif
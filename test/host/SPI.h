@@ -0,0 +1,49 @@
+/**
+ * @file SPI.h
+ * @author Jeremy Dunne
+ * @brief host stand-in for the Arduino SPI library, for building the library on Linux
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Nothing is connected: reads return 0xFF. Only the default W25Q64FV_ArduinoSPI
+ * transport uses it, the host tests talk to the simulator through
+ * W25Q64FV_SimulatedSPI instead.
+ *
+ */
+
+#ifndef _W25Q64FV_HOST_SPI_H_
+#define _W25Q64FV_HOST_SPI_H_
+
+#include <Arduino.h>
+
+#define SPI_MODE0   0x00
+#define SPI_MODE_0  SPI_MODE0
+
+/**
+ * @brief Bus settings of a transaction
+ *
+ */
+class SPISettings{
+public:
+    SPISettings() {}
+    SPISettings(uint32_t clock, uint8_t bit_order, uint8_t data_mode) { (void)clock; (void)bit_order; (void)data_mode; }
+};
+
+/**
+ * @brief SPI peripheral with nothing connected
+ *
+ */
+class SPIClass{
+public:
+    void begin() {}
+    void beginTransaction(SPISettings settings) { (void)settings; }
+    void endTransaction() {}
+    uint8_t transfer(uint8_t data) { (void)data; return 0xFF; }
+    void transfer(void *buffer, size_t length) { memset(buffer, 0xFF, length); }
+};
+
+extern SPIClass SPI;
+
+#endif
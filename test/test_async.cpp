@@ -0,0 +1,104 @@
+/**
+ * @file test_async.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the non-blocking erase/program engine on the simulated part
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Async_impl.hpp"
+
+typedef W25Q64FV_BasicAsync<W25Q64FV_Sim> W25Q64FV_SimAsync;
+typedef W25Q64FV_Device<W25Q64FV_SimulatedSPI<1>, W25Q64FV_FixedGeometry<33554432> > W25Q256FV_Sim;
+
+static W25Q64FV_status_t results[8];
+static int completions = 0;
+
+static void record(int handle, W25Q64FV_status_t status, void *context){
+    (void)context;
+    results[handle] = status;
+    completions ++;
+}
+
+static void test_queue(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimAsync engine(flash);
+    memset(model.memory(), 0x00, 2 * W25Q64FV_SECTOR_SIZE);
+    byte data[1000];
+    test_pattern(data, sizeof(data), 3);
+    completions = 0;
+    CHECK_EQUAL(engine.erase_sector(0, record), 0);
+    CHECK_EQUAL(engine.program(100, data, sizeof(data), record), 1);
+    CHECK_EQUAL(engine.verify(100, data, sizeof(data), record), 2);
+    CHECK_EQUAL(engine.verify(101, data, 10, record), 3);
+    CHECK_EQUAL(engine.count(), 4);
+    while(engine.poll() == W25Q64FV_BUSY) delayMicroseconds(100);
+    CHECK_EQUAL(completions, 4);
+    CHECK_OK(results[0]);
+    CHECK_OK(results[1]);
+    CHECK_OK(results[2]);
+    CHECK_EQUAL(results[3], W25Q64FV_VERIFY_FAIL);
+    CHECK(memcmp(model.memory() + 100, data, sizeof(data)) == 0);
+    CHECK_EQUAL(model.memory()[W25Q64FV_SECTOR_SIZE], 0x00);
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_PAGE_PROGRAM], 5);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_read_suspends(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimAsync engine(flash);
+    test_pattern(model.memory() + W25Q64FV_SECTOR_SIZE, W25Q64FV_PAGE_SIZE, 4);
+    CHECK(engine.erase_block_32(0) >= 0);
+    CHECK_EQUAL(engine.poll(), W25Q64FV_BUSY);
+    CHECK(model.busy());
+    // reads outside the block are served in a suspend, inside it they wait
+    byte page[W25Q64FV_PAGE_SIZE];
+    CHECK_EQUAL(engine.read(0, page, sizeof(page)), W25Q64FV_BUSY);
+    CHECK_OK(engine.read(W25Q64FV_BLOCK_32K_SIZE, page, sizeof(page)));
+    CHECK_EQUAL(model.counters().suspends, 1);
+    CHECK_EQUAL(model.counters().resumes, 1);
+    CHECK(model.busy());
+    while(engine.poll() == W25Q64FV_BUSY) delayMicroseconds(1000);
+    CHECK_EQUAL(model.memory()[W25Q64FV_SECTOR_SIZE], 0xFF);
+    CHECK_OK(engine.read(0, page, sizeof(page)));
+    CHECK_EQUAL(page[0], 0xFF);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_chip_erase_timeout(){
+    // a slow 256 Mbit part takes four times the W25Q64's worst case chip erase
+    W25Q64FV_SimulatedFlash model(33554432);
+    W25Q64FV_sim_timing_t timing;
+    W25Q64FV_sim_default_timing(&timing, 33554432, true);
+    model.set_timing(timing);
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q256FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_BasicAsync<W25Q256FV_Sim> engine(flash);
+    model.memory()[33554432 - 1] = 0x00;
+    completions = 0;
+    results[0] = W25Q64FV_COMMUNICATION_FAIL;
+    CHECK_EQUAL(engine.erase_chip(record), 0);
+    while(engine.poll() == W25Q64FV_BUSY) delay(100);
+    CHECK_EQUAL(completions, 1);
+    CHECK_OK(results[0]);
+    CHECK_EQUAL(model.memory()[33554432 - 1], 0xFF);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_queue();
+    test_read_suspends();
+    test_chip_erase_timeout();
+    return test_result("test_async");
+}
@@ -0,0 +1,100 @@
+/**
+ * @file test_cache.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the write-back sector cache on the simulated part
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Cache_impl.hpp"
+
+typedef W25Q64FV_BasicCache<W25Q64FV_Sim> W25Q64FV_SimCache;
+
+static byte arena[2 * W25Q64FV_SECTOR_SIZE];
+
+static void test_eviction(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimCache cache(flash, arena, 2);
+    // three sectors through two slots
+    for(uint32_t i = 0; i < 99; i ++){
+        CHECK_OK(cache.write((i % 3) * W25Q64FV_SECTOR_SIZE + i * 8, (const byte*)&i, sizeof(i)));
+    }
+    CHECK_OK(cache.flush());
+    W25Q64FV_cache_stats_t stats;
+    cache.get_stats(&stats);
+    CHECK_EQUAL(stats.hits, 0);
+    CHECK_EQUAL(stats.misses, 99);
+    CHECK_EQUAL(stats.evictions, 97);
+    CHECK_EQUAL(stats.flushes, 99);
+    for(uint32_t i = 0; i < 99; i ++){
+        uint32_t value;
+        CHECK_OK(cache.read((i % 3) * W25Q64FV_SECTOR_SIZE + i * 8, (byte*)&value, sizeof(value)));
+        CHECK_EQUAL(value, i);
+    }
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_smart_write_back(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    flash.set_smart_mode(true);
+    W25Q64FV_SimCache cache(flash, arena, 2);
+    byte config[64];
+    memset(config, 0xFF, sizeof(config));
+    // clearing bits is programmed in place
+    config[0] = 0x7F;
+    CHECK_OK(cache.write(0, config, sizeof(config)));
+    CHECK_OK(cache.flush());
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_SECTOR_ERASE], 0);
+    // setting bits erases, the write back leaves the shared setting alone
+    model.reset_counters();
+    config[0] = 0xFF;
+    config[1] = 0x00;
+    CHECK_OK(cache.write(0, config, sizeof(config)));
+    CHECK_OK(cache.flush());
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_SECTOR_ERASE], 1);
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_PAGE_PROGRAM], 1);
+    CHECK(flash.smart_mode());
+    CHECK(memcmp(model.memory(), config, sizeof(config)) == 0);
+    W25Q64FV_cache_stats_t stats;
+    cache.get_stats(&stats);
+    CHECK_EQUAL(stats.flushes, 2);
+    CHECK_EQUAL(stats.in_place_flushes, 1);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_no_slots(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    // an empty arena reads around the cache and never loads into it
+    byte guard[16];
+    memset(guard, 0xA5, sizeof(guard));
+    W25Q64FV_SimCache cache(flash, guard, 0);
+    byte data[100];
+    test_pattern(model.memory(), sizeof(data), 9);
+    CHECK_OK(cache.read(0, data, sizeof(data)));
+    CHECK(memcmp(data, model.memory(), sizeof(data)) == 0);
+    CHECK_EQUAL(cache.write(0, data, sizeof(data)), W25Q64FV_NOT_VALID);
+    CHECK_OK(cache.flush());
+    CHECK_EQUAL(guard[0], 0xA5);
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_SECTOR_ERASE], 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_eviction();
+    test_smart_write_back();
+    test_no_slots();
+    return test_result("test_cache");
+}
@@ -0,0 +1,107 @@
+/**
+ * @file test_ftl.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the wear-leveling flash translation layer on the simulated part
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_FTL_impl.hpp"
+
+typedef W25Q64FV_BasicFTL<W25Q64FV_Sim> W25Q64FV_SimFTL;
+
+#define TEST_FTL_START      0x200000 // Start of the FTL region
+#define TEST_FTL_LENGTH     (32 * W25Q64FV_SECTOR_SIZE) // Length of the FTL region
+#define TEST_FTL_LOGICAL    (32 - W25Q64FV_FTL_RESERVE) // Logical sectors in the region
+
+static uint16_t arena[W25Q64FV_FTL_ARENA_SIZE(TEST_FTL_LENGTH)];
+static byte expected[TEST_FTL_LOGICAL][W25Q64FV_FTL_SECTOR_SIZE];
+
+/**
+ * @brief Check every logical sector reads back as expected
+ *
+ * @param ftl                   Mounted FTL
+ * @return (void)
+ */
+static void check_sectors(W25Q64FV_SimFTL &ftl){
+    static byte buffer[W25Q64FV_FTL_SECTOR_SIZE];
+    for(uint32_t logical = 0; logical < ftl.logical_count(); logical ++){
+        CHECK_OK(ftl.read(logical, 0, buffer, sizeof(buffer)));
+        CHECK(memcmp(buffer, expected[logical], sizeof(buffer)) == 0);
+    }
+}
+
+static void test_write_remount(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimFTL ftl(flash, TEST_FTL_START, TEST_FTL_LENGTH, arena);
+    CHECK_OK(ftl.mount());
+    CHECK_EQUAL(ftl.logical_count(), TEST_FTL_LOGICAL);
+    memset(expected, 0xFF, sizeof(expected));
+    // partial writes, most of them to a few hot sectors
+    byte buffer[64];
+    uint32_t random = 1;
+    for(uint32_t i = 0; i < 2000; i ++){
+        uint32_t logical = test_random(&random, 10) < 9 ? test_random(&random, 4) : test_random(&random, TEST_FTL_LOGICAL);
+        uint32_t offset = test_random(&random, W25Q64FV_FTL_SECTOR_SIZE - sizeof(buffer));
+        test_pattern(buffer, sizeof(buffer), i);
+        memcpy(expected[logical] + offset, buffer, sizeof(buffer));
+        CHECK_OK(ftl.write(logical, offset, buffer, sizeof(buffer)));
+        CHECK_OK(ftl.service());
+        delayMicroseconds(5000);
+    }
+    check_sectors(ftl);
+    // writes landing during a background erase suspended it
+    CHECK(model.counters().suspends > 0);
+    W25Q64FV_ftl_stats_t stats;
+    ftl.get_stats(&stats);
+    CHECK_EQUAL(stats.writes, 2000);
+    CHECK(stats.max_wear - stats.min_wear <= (W25Q64FV_FTL_STATIC_THRESHOLD + 1) << W25Q64FV_FTL_WEAR_SHIFT);
+    // a trimmed sector reads blank
+    CHECK_OK(ftl.trim(0));
+    memset(expected[0], 0xFF, sizeof(expected[0]));
+    CHECK_EQUAL(ftl.write(TEST_FTL_LOGICAL, 0, buffer, 1), W25Q64FV_NOT_VALID);
+    // a fresh mount, with the last erase still running, finds the same data
+    CHECK_OK(ftl.service());
+    static uint16_t remount_arena[W25Q64FV_FTL_ARENA_SIZE(TEST_FTL_LENGTH)];
+    W25Q64FV_SimFTL remounted(flash, TEST_FTL_START, TEST_FTL_LENGTH, remount_arena);
+    CHECK_OK(remounted.mount());
+    check_sectors(remounted);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_burst(){
+    // whole sector writes with no service in between wait on their own erases
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimFTL ftl(flash, TEST_FTL_START, TEST_FTL_LENGTH, arena);
+    CHECK_OK(ftl.mount());
+    memset(expected, 0xFF, sizeof(expected));
+    for(uint32_t i = 0; i < 200; i ++){
+        uint32_t logical = i % 3;
+        test_pattern(expected[logical], W25Q64FV_FTL_SECTOR_SIZE, i);
+        CHECK_OK(ftl.write(logical, 0, expected[logical], W25Q64FV_FTL_SECTOR_SIZE));
+    }
+    check_sectors(ftl);
+    W25Q64FV_ftl_stats_t stats;
+    ftl.get_stats(&stats);
+    CHECK(stats.waits > 0);
+    // 16 data pages, the writing and live states, the stale state of the copy it replaces
+    // (all but the first write of each sector), and a header per erase and per blank sector
+    CHECK_EQUAL(stats.pages, 200 * 19 - 3 + stats.erases + TEST_FTL_LENGTH / W25Q64FV_SECTOR_SIZE);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_write_remount();
+    test_burst();
+    return test_result("test_ftl");
+}
@@ -0,0 +1,166 @@
+/**
+ * @file test_ingest.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the ingest pipeline against a producer thread on the simulated part
+ *
+ * The producer pushes four byte sequence numbers at TEST_INGEST_RATE samples per second
+ * of virtual time, or at the rate given as the first argument.
+ *
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Ingest_impl.hpp"
+#include <atomic>
+#include <thread>
+
+#ifndef TEST_INGEST_RATE
+#define TEST_INGEST_RATE        10000 // Samples per second of the producer
+#endif
+#define TEST_INGEST_SAMPLES     20000 // Samples per run
+#define TEST_INGEST_START       0x10000 // Start of the region
+#define TEST_INGEST_LENGTH      (32 * W25Q64FV_SECTOR_SIZE) // Length of the region
+
+typedef W25Q64FV_BasicIngest<W25Q64FV_Sim> W25Q64FV_SimIngest;
+
+static byte ring[4096];
+
+/// Producer thread state
+typedef struct{
+    W25Q64FV_SimIngest *ingest;     ///< Pipeline to push into
+    double period;                  ///< Time between samples (us)
+    std::atomic<double> due;        ///< Time of the next sample (us)
+    std::atomic<bool> done;         ///< Every sample pushed
+    uint32_t accepted;              ///< Samples the ring took
+} test_producer_t;
+
+/**
+ * @brief Push every sample that is due on the virtual clock, as an ISR would
+ *
+ * @param producer              Producer state
+ * @return (void)
+ */
+static void produce(test_producer_t *producer){
+    double due = producer->due.load();
+    uint32_t sequence = 0;
+    while(sequence < TEST_INGEST_SAMPLES){
+        double now = test_time_us();
+        while(due <= now && sequence < TEST_INGEST_SAMPLES){
+            if(producer->ingest->push((const byte*)&sequence, sizeof(sequence)) == sizeof(sequence)) producer->accepted ++;
+            sequence ++;
+            due += producer->period;
+        }
+        producer->due.store(due);
+        std::this_thread::yield();
+    }
+    producer->done.store(true);
+}
+
+/**
+ * @brief Run the producer thread against the main loop's drain() at a sample rate
+ *
+ * @param rate                  Samples per second
+ * @param stats                 Pipeline statistics
+ * @return uint32_t             Samples stored
+ */
+static uint32_t run(unsigned long rate, W25Q64FV_ingest_stats_t *stats){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    memset(model.memory() + TEST_INGEST_START, 0, TEST_INGEST_LENGTH);
+    W25Q64FV_SimIngest ingest(flash, ring, sizeof(ring), TEST_INGEST_START, TEST_INGEST_LENGTH);
+    test_producer_t producer;
+    producer.ingest = &ingest;
+    producer.period = 1000000.0 / rate;
+    producer.due.store(test_time_us());
+    producer.done.store(false);
+    producer.accepted = 0;
+    std::thread thread(produce, &producer);
+    while(!producer.done.load()){
+        W25Q64FV_status_t status = ingest.drain();
+        CHECK(status == W25Q64FV_OK || status == W25Q64FV_BUSY);
+        // let the producer catch up with the clock before moving it on
+        while(!producer.done.load() && producer.due.load() <= test_time_us()) std::this_thread::yield();
+        delayMicroseconds(10);
+    }
+    thread.join();
+    CHECK_OK(ingest.flush());
+    ingest.get_stats(stats);
+    // the samples that got in are on the flash in order
+    uint32_t stored = (ingest.address() - TEST_INGEST_START) / sizeof(uint32_t);
+    CHECK_EQUAL(stored, producer.accepted);
+    CHECK_EQUAL(stats->dropped, (TEST_INGEST_SAMPLES - producer.accepted) * sizeof(uint32_t));
+    const uint32_t *samples = (const uint32_t*)(model.memory() + TEST_INGEST_START);
+    bool ordered = true;
+    for(uint32_t i = 1; i < stored; i ++) ordered = ordered && samples[i] > samples[i - 1];
+    CHECK(ordered);
+    CHECK(stats->high_water <= sizeof(ring));
+    CHECK_NO_VIOLATIONS(model);
+    printf("%8lu samples/s: %lu stored, high water %lu, dropped %lu, %lu pages, %lu erases\n", rate,
+           (unsigned long)stored, stats->high_water, stats->dropped, stats->pages, stats->erases);
+    return stored;
+}
+
+static void test_rates(unsigned long rate){
+    W25Q64FV_ingest_stats_t stats;
+    // within the erase bandwidth nothing is lost
+    CHECK_EQUAL(run(rate, &stats), TEST_INGEST_SAMPLES);
+    CHECK_EQUAL(stats.dropped, 0);
+    // past it the ring fills and drops, the rest stays in order
+    run(rate * 4, &stats);
+    CHECK(stats.dropped > 0);
+    CHECK_EQUAL(stats.high_water, sizeof(ring));
+}
+
+static void test_not_valid(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    // not a power of two
+    W25Q64FV_SimIngest odd(flash, ring, 3000, TEST_INGEST_START, TEST_INGEST_LENGTH);
+    CHECK_EQUAL(odd.push(ring, 16), 0);
+    CHECK_EQUAL(odd.drain(), W25Q64FV_NOT_VALID);
+    CHECK_EQUAL(odd.flush(), W25Q64FV_NOT_VALID);
+    // smaller than a page
+    W25Q64FV_SimIngest small(flash, ring, 128, TEST_INGEST_START, TEST_INGEST_LENGTH);
+    CHECK_EQUAL(small.drain(), W25Q64FV_NOT_VALID);
+    // not sector aligned
+    W25Q64FV_SimIngest unaligned(flash, ring, sizeof(ring), TEST_INGEST_START + 256, TEST_INGEST_LENGTH);
+    CHECK_EQUAL(unaligned.drain(), W25Q64FV_NOT_VALID);
+}
+
+static void test_flush_erases(){
+    // a flush before any erase ahead starts the page's erase and waits for it
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    memset(model.memory() + TEST_INGEST_START, 0, W25Q64FV_SECTOR_SIZE);
+    W25Q64FV_SimIngest ingest(flash, ring, sizeof(ring), TEST_INGEST_START, TEST_INGEST_LENGTH);
+    byte data[100];
+    test_pattern(data, sizeof(data), 18);
+    CHECK_EQUAL(ingest.push(data, sizeof(data)), sizeof(data));
+    CHECK_OK(ingest.flush());
+    CHECK(memcmp(model.memory() + TEST_INGEST_START, data, sizeof(data)) == 0);
+    W25Q64FV_ingest_stats_t stats;
+    ingest.get_stats(&stats, true);
+    CHECK_EQUAL(stats.erases, 1);
+    CHECK_EQUAL(stats.high_water, sizeof(data));
+    ingest.get_stats(&stats);
+    CHECK_EQUAL(stats.high_water, 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(int argc, char **argv){
+    unsigned long rate = argc > 1 ? strtoul(argv[1], NULL, 10) : TEST_INGEST_RATE;
+    test_not_valid();
+    test_flush_erases();
+    test_rates(rate);
+    return test_result("test_ingest");
+}
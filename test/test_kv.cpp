@@ -0,0 +1,144 @@
+/**
+ * @file test_kv.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the key-value store on the simulated part
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_KV_impl.hpp"
+
+typedef W25Q64FV_BasicKV<W25Q64FV_Sim> W25Q64FV_SimKV;
+
+#define TEST_KV_START       0x300000 // Start of the store region
+#define TEST_KV_LENGTH      (8 * W25Q64FV_SECTOR_SIZE) // Length of the store region
+#define TEST_KV_KEYS        200 // Distinct keys
+#define TEST_KV_SLOTS       512 // Index entries
+
+static uint32_t index_table[TEST_KV_SLOTS];
+static uint32_t values[TEST_KV_KEYS];
+static bool stored[TEST_KV_KEYS];
+
+/**
+ * @brief Check every key reads back its last value, or is missing if removed
+ *
+ * @param kv                    Mounted store
+ * @param others                Keys stored besides the numbered ones
+ * @return (void)
+ */
+static void check_keys(W25Q64FV_SimKV &kv, unsigned int others){
+    unsigned int count = 0;
+    for(uint32_t i = 0; i < TEST_KV_KEYS; i ++){
+        char key[16];
+        snprintf(key, sizeof(key), "cfg.%lu", (unsigned long)i);
+        uint32_t value;
+        size_t length = 0;
+        W25Q64FV_status_t status = kv.get(key, (byte*)&value, sizeof(value), &length);
+        if(!stored[i]){
+            CHECK_EQUAL(status, W25Q64FV_NOT_FOUND);
+            continue;
+        }
+        count ++;
+        CHECK_OK(status);
+        CHECK_EQUAL(length, sizeof(value));
+        CHECK_EQUAL(value, values[i]);
+    }
+    CHECK_EQUAL(kv.count(), count + others);
+}
+
+static void test_put_remount(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimKV kv(flash, TEST_KV_START, TEST_KV_LENGTH, index_table, TEST_KV_SLOTS);
+    CHECK_OK(kv.mount());
+    memset(stored, 0, sizeof(stored));
+    // most updates to a few keys, enough to compact the ring many times over
+    uint32_t random = 3;
+    for(uint32_t i = 0; i < 5000; i ++){
+        uint32_t id = test_random(&random, 10) < 8 ? test_random(&random, 20) : test_random(&random, TEST_KV_KEYS);
+        char key[16];
+        snprintf(key, sizeof(key), "cfg.%lu", (unsigned long)id);
+        if(test_random(&random, 20) == 0){
+            CHECK_OK(kv.remove(key));
+            stored[id] = false;
+        }
+        else{
+            values[id] = random;
+            CHECK_OK(kv.put(key, (const byte*)&values[id], sizeof(values[id])));
+            stored[id] = true;
+        }
+        CHECK_OK(kv.service());
+        delayMicroseconds(5000);
+    }
+    check_keys(kv, 0);
+    // puts landing during a background erase suspended it
+    CHECK(model.counters().suspends > 0);
+    // a value of most of a sector survives the compactions after it
+    static byte blob[3000];
+    static byte readback[3000];
+    test_pattern(blob, sizeof(blob), 1);
+    CHECK_OK(kv.put("blob", blob, sizeof(blob)));
+    for(uint32_t i = 0; i < 200; i ++){
+        char key[16];
+        snprintf(key, sizeof(key), "cfg.%lu", (unsigned long)(i % 20));
+        values[i % 20] = i;
+        stored[i % 20] = true;
+        CHECK_OK(kv.put(key, (const byte*)&values[i % 20], sizeof(values[i % 20])));
+    }
+    // a fresh mount, with the last erase still running, finds the same keys
+    CHECK_OK(kv.service());
+    static uint32_t remount_table[TEST_KV_SLOTS];
+    W25Q64FV_SimKV remounted(flash, TEST_KV_START, TEST_KV_LENGTH, remount_table, TEST_KV_SLOTS);
+    CHECK_OK(remounted.mount());
+    check_keys(remounted, 1);
+    size_t length = 0;
+    CHECK_OK(remounted.get("blob", readback, sizeof(readback), &length));
+    CHECK_EQUAL(length, sizeof(blob));
+    CHECK(memcmp(readback, blob, sizeof(blob)) == 0);
+    CHECK_EQUAL(remounted.put("", blob, 1), W25Q64FV_NOT_VALID);
+    // an absent key is told apart from a bad one
+    CHECK_EQUAL(remounted.get("missing", readback, sizeof(readback), &length), W25Q64FV_NOT_FOUND);
+    CHECK_EQUAL(remounted.get("", readback, sizeof(readback), &length), W25Q64FV_NOT_VALID);
+    char long_key[W25Q64FV_KV_MAX_KEY + 2];
+    memset(long_key, 'k', sizeof(long_key) - 1);
+    long_key[sizeof(long_key) - 1] = 0;
+    CHECK_EQUAL(remounted.get(long_key, readback, sizeof(readback), &length), W25Q64FV_NOT_VALID);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_interrupted_put(){
+    // a put whose commit never landed is dropped at mount, the old value stays
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimKV kv(flash, TEST_KV_START, TEST_KV_LENGTH, index_table, TEST_KV_SLOTS);
+    CHECK_OK(kv.mount());
+    uint32_t value = 1;
+    CHECK_OK(kv.put("key", (const byte*)&value, sizeof(value)));
+    value = 2;
+    CHECK_OK(kv.put("key", (const byte*)&value, sizeof(value)));
+    // set the commit flag of the second record back, it follows the header and the first record
+    byte *flags = model.memory() + TEST_KV_START + W25Q64FV_KV_HEADER_SIZE + W25Q64FV_KV_RECORD_HEADER + 3 + sizeof(value) + 1;
+    CHECK_EQUAL(*flags, (byte)~W25Q64FV_KV_FLAG_UNCOMMITTED);
+    *flags = 0xFF;
+    static uint32_t remount_table[TEST_KV_SLOTS];
+    W25Q64FV_SimKV remounted(flash, TEST_KV_START, TEST_KV_LENGTH, remount_table, TEST_KV_SLOTS);
+    CHECK_OK(remounted.mount());
+    size_t length = 0;
+    CHECK_OK(remounted.get("key", (byte*)&value, sizeof(value), &length));
+    CHECK_EQUAL(value, 1);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_put_remount();
+    test_interrupted_put();
+    return test_result("test_kv");
+}
@@ -0,0 +1,118 @@
+/**
+ * @file test_log.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the append-only log on the simulated part
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Log_impl.hpp"
+
+typedef W25Q64FV_BasicLog<W25Q64FV_Sim> W25Q64FV_SimLog;
+
+#define TEST_LOG_START      0x100000 // Start of the log region
+#define TEST_LOG_LENGTH     (16 * W25Q64FV_SECTOR_SIZE) // Length of the log region
+
+/**
+ * @brief Build record n, a sequence number followed by a pattern
+ *
+ * @param id                    Record number
+ * @param buffer                Buffer of at least 304 bytes
+ * @return size_t               Record length
+ */
+static size_t record(uint32_t id, byte *buffer){
+    size_t length = 4 + 1 + (id * 37) % 300;
+    memcpy(buffer, &id, sizeof(id));
+    test_pattern(buffer + 4, length - 4, id);
+    return length;
+}
+
+/**
+ * @brief Read the log back and check it holds consecutive records up to the last
+ *
+ * @param log                   Mounted log
+ * @param last                  Last record appended
+ * @return uint32_t             Number of records read
+ */
+static uint32_t check_records(W25Q64FV_SimLog &log, uint32_t last){
+    byte buffer[400];
+    byte expected[400];
+    uint32_t count = 0;
+    uint32_t first = 0;
+    log.rewind();
+    while(true){
+        size_t length;
+        W25Q64FV_status_t status = log.read_next(buffer, sizeof(buffer), &length);
+        CHECK_OK(status);
+        if(status != W25Q64FV_OK || length == 0) break;
+        uint32_t id;
+        memcpy(&id, buffer, sizeof(id));
+        if(count == 0) first = id;
+        CHECK_EQUAL(id, first + count);
+        CHECK_EQUAL(length, record(id, expected));
+        CHECK(memcmp(buffer, expected, length) == 0);
+        count ++;
+    }
+    if(count > 0) CHECK_EQUAL(first + count - 1, last);
+    return count;
+}
+
+static void test_append_mount(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimLog log(flash, TEST_LOG_START, TEST_LOG_LENGTH);
+    CHECK_OK(log.mount());
+    CHECK_EQUAL(log.head_address(), TEST_LOG_START + W25Q64FV_LOG_HEADER_SIZE);
+    byte buffer[400];
+    uint32_t id;
+    // enough to wrap the region several times
+    for(id = 0; id < 2000; id ++){
+        CHECK_OK(log.append(buffer, record(id, buffer)));
+        CHECK_OK(log.service());
+        delayMicroseconds(300);
+    }
+    CHECK_OK(log.sync());
+    uint32_t count = check_records(log, id - 1);
+    CHECK(count > 100);
+    // appends landing during a background erase suspended it
+    CHECK(model.counters().suspends > 0);
+    // a fresh mount finds the same head and records
+    uint32_t head = log.head_address();
+    W25Q64FV_SimLog remounted(flash, TEST_LOG_START, TEST_LOG_LENGTH);
+    CHECK_OK(remounted.mount());
+    CHECK_EQUAL(remounted.head_address(), head);
+    CHECK_EQUAL(check_records(remounted, id - 1), count);
+    CHECK_EQUAL(remounted.append(buffer, 0), W25Q64FV_NOT_VALID);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_mount_during_erase(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimLog log(flash, TEST_LOG_START, TEST_LOG_LENGTH);
+    CHECK_OK(log.mount());
+    byte buffer[400];
+    uint32_t id;
+    for(id = 0; id < 300; id ++) CHECK_OK(log.append(buffer, record(id, buffer)));
+    CHECK_OK(log.sync());
+    // leave an erase ahead running, the mount reads around it
+    CHECK_OK(log.service());
+    W25Q64FV_SimLog remounted(flash, TEST_LOG_START, TEST_LOG_LENGTH);
+    CHECK_OK(remounted.mount());
+    CHECK(check_records(remounted, id - 1) > 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_append_mount();
+    test_mount_during_erase();
+    return test_result("test_log");
+}
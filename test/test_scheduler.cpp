@@ -0,0 +1,330 @@
+/**
+ * @file test_scheduler.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the request scheduler against producer threads on the simulated part
+ *
+ * Each subsystem is a thread submitting at its own priority on the virtual clock, with
+ * one request outstanding, while the main loop polls. Prints the latency percentiles of
+ * each priority.
+ *
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Scheduler_impl.hpp"
+#include <atomic>
+#include <thread>
+#include <float.h>
+
+#define TEST_SCHEDULER_CONFIG   0x000000 // Start of the area the readers read
+#define TEST_SCHEDULER_LOG      0x100000 // Start of the area the logger programs
+#define TEST_SCHEDULER_OTA      0x200000 // Start of the area the updater erases and programs
+#define TEST_SCHEDULER_THREADS  4 // Threads of the contention check
+#define TEST_SCHEDULER_READS    2000 // Reads per thread of the contention check
+
+typedef W25Q64FV_BasicScheduler<W25Q64FV_Sim> W25Q64FV_SimScheduler;
+
+/// Subsystem submitting from a thread
+typedef enum{
+    TEST_SCHEDULER_READER = 0, ///<Reads 64 bytes at random from the config area
+    TEST_SCHEDULER_LOGGER, ///<Programs 100 byte records one after the other
+    TEST_SCHEDULER_UPDATER ///<Erases a sector, then programs it whole
+} test_subsystem_t;
+
+/// Producer thread state
+typedef struct{
+    test_subsystem_t subsystem;     ///< What it submits
+    uint8_t priority;               ///< Priority of its requests
+    double period;                  ///< Time between requests (us), 0 for back to back
+    unsigned long requests;         ///< Requests to submit
+    W25Q64FV_SimScheduler *scheduler; ///< Scheduler to submit to
+    std::atomic<double> due;        ///< Time of the next submission (us), DBL_MAX while waiting
+    std::atomic<bool> waiting;      ///< A request is outstanding
+    std::atomic<bool> done;         ///< Every request completed
+    double scheduled;               ///< Time the outstanding request was due (us)
+    double submitted;               ///< Time the outstanding request was submitted (us)
+    std::vector<double> latencies;  ///< Submission to completion (us), by the callback
+    unsigned long failures;         ///< Requests that did not complete OK, by the callback
+    unsigned long mismatches;       ///< Reads that returned the wrong data
+} test_producer_t;
+
+static byte config[W25Q64FV_BLOCK_64K_SIZE];
+static byte log_data[100 * 1000];
+static byte ota_data[W25Q64FV_SECTOR_SIZE];
+
+/**
+ * @brief Completion of a producer's request, run by poll()
+ *
+ * @param handle                Request handle
+ * @param status                Final status
+ * @param context               Producer
+ * @return (void)
+ */
+static void completed(int handle, W25Q64FV_status_t status, void *context){
+    (void)handle;
+    test_producer_t *producer = (test_producer_t*)context;
+    double now = test_time_us();
+    producer->latencies.push_back(now - producer->submitted);
+    if(status != W25Q64FV_OK) producer->failures ++;
+    // set the next submission before releasing the thread, the main loop waits on it
+    double next = producer->scheduled + producer->period;
+    producer->due.store(next > now ? next : now);
+    producer->waiting.store(false);
+}
+
+/**
+ * @brief Submit the producer's requests one at a time as they fall due
+ *
+ * @param producer              Producer state
+ * @return (void)
+ */
+static void produce(test_producer_t *producer){
+    uint32_t random = producer->priority + 1;
+    byte buffer[64];
+    for(unsigned long n = 0; n < producer->requests; n ++){
+        uint32_t address = 0;
+        while(test_time_us() < producer->due.load()) std::this_thread::yield();
+        producer->scheduled = producer->due.load();
+        producer->waiting.store(true);
+        int handle = W25Q64FV_ASYNC_INVALID_HANDLE;
+        while(handle == W25Q64FV_ASYNC_INVALID_HANDLE){
+            producer->submitted = test_time_us();
+            switch(producer->subsystem){
+                case TEST_SCHEDULER_READER:
+                    address = TEST_SCHEDULER_CONFIG + test_random(&random, sizeof(config) - sizeof(buffer));
+                    handle = producer->scheduler->read(address, buffer, sizeof(buffer), producer->priority, completed, producer);
+                    break;
+                case TEST_SCHEDULER_LOGGER:
+                    handle = producer->scheduler->program(TEST_SCHEDULER_LOG + n * 100, log_data + n * 100, 100, producer->priority, completed, producer);
+                    break;
+                default:
+                    address = TEST_SCHEDULER_OTA + (n / 2) * W25Q64FV_SECTOR_SIZE;
+                    if(n % 2 == 0) handle = producer->scheduler->erase_sector(address, producer->priority, completed, producer);
+                    else handle = producer->scheduler->program(address, ota_data, sizeof(ota_data), producer->priority, completed, producer);
+                    break;
+            }
+            // the queue is full, try again once the main loop has moved on
+            if(handle == W25Q64FV_ASYNC_INVALID_HANDLE){
+                producer->due.store(test_time_us() + 100);
+                while(test_time_us() < producer->due.load()) std::this_thread::yield();
+            }
+        }
+        producer->due.store(DBL_MAX);
+        while(producer->waiting.load()) std::this_thread::yield();
+        if(producer->subsystem == TEST_SCHEDULER_READER && memcmp(buffer, config + address - TEST_SCHEDULER_CONFIG, sizeof(buffer)) != 0){
+            producer->mismatches ++;
+        }
+    }
+    producer->due.store(DBL_MAX);
+    producer->done.store(true);
+}
+
+static void test_priorities(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    test_pattern(config, sizeof(config), 23);
+    test_pattern(log_data, sizeof(log_data), 24);
+    test_pattern(ota_data, sizeof(ota_data), 25);
+    memcpy(model.memory() + TEST_SCHEDULER_CONFIG, config, sizeof(config));
+    // the updater's sectors hold an old image
+    memset(model.memory() + TEST_SCHEDULER_OTA, 0, 64 * W25Q64FV_SECTOR_SIZE);
+    W25Q64FV_SimScheduler scheduler(flash);
+    // two config readers, the logger, and the updater, submitting at once
+    static const test_subsystem_t subsystems[] = {TEST_SCHEDULER_READER, TEST_SCHEDULER_READER, TEST_SCHEDULER_LOGGER, TEST_SCHEDULER_UPDATER};
+    static const uint8_t priorities[] = {0, 0, 1, 3};
+    static const double periods[] = {2000, 3000, 2000, 0};
+    static const unsigned long requests[] = {1000, 700, 1000, 128};
+    const unsigned int count = sizeof(subsystems) / sizeof(subsystems[0]);
+    static test_producer_t producers[count];
+    std::thread threads[count];
+    for(unsigned int i = 0; i < count; i ++){
+        producers[i].subsystem = subsystems[i];
+        producers[i].priority = priorities[i];
+        producers[i].period = periods[i];
+        producers[i].requests = requests[i];
+        producers[i].failures = 0;
+        producers[i].mismatches = 0;
+        producers[i].scheduler = &scheduler;
+        producers[i].due.store(test_time_us());
+        producers[i].waiting.store(false);
+        producers[i].done.store(false);
+        threads[i] = std::thread(produce, &producers[i]);
+    }
+    bool suspend_pending = false;
+    while(true){
+        bool done = true;
+        double due = DBL_MAX;
+        for(unsigned int i = 0; i < count; i ++){
+            done = done && producers[i].done.load();
+            if(producers[i].due.load() < due) due = producers[i].due.load();
+        }
+        if(done) break;
+        // let the producers submit what is due before moving the clock on
+        if(due <= test_time_us()){
+            std::this_thread::yield();
+            continue;
+        }
+        W25Q64FV_status_t status = scheduler.poll();
+        CHECK(status == W25Q64FV_OK || status == W25Q64FV_BUSY);
+        // poll() left a suspend taking effect rather than waiting for it
+        suspend_pending = suspend_pending || flash.suspend_pending();
+        delayMicroseconds(20);
+    }
+    for(unsigned int i = 0; i < count; i ++) threads[i].join();
+    CHECK(scheduler.idle());
+    // latency percentiles of each priority
+    std::vector<double> latencies[W25Q64FV_SCHEDULER_PRIORITIES];
+    for(unsigned int i = 0; i < count; i ++){
+        CHECK_EQUAL(producers[i].latencies.size(), producers[i].requests);
+        CHECK_EQUAL(producers[i].failures, 0);
+        CHECK_EQUAL(producers[i].mismatches, 0);
+        latencies[producers[i].priority].insert(latencies[producers[i].priority].end(), producers[i].latencies.begin(), producers[i].latencies.end());
+    }
+    printf("%8s %9s %9s %9s %9s %9s\n", "priority", "requests", "p50 (us)", "p90 (us)", "p99 (us)", "max (us)");
+    for(uint8_t priority = 0; priority < W25Q64FV_SCHEDULER_PRIORITIES; priority ++){
+        if(latencies[priority].empty()) continue;
+        printf("%8u %9lu %9.0f %9.0f %9.0f %9.0f\n", priority, (unsigned long)latencies[priority].size(), test_percentile(latencies[priority], 50),
+               test_percentile(latencies[priority], 90), test_percentile(latencies[priority], 99), test_percentile(latencies[priority], 100));
+    }
+    W25Q64FV_scheduler_stats_t stats;
+    scheduler.get_stats(&stats);
+    printf("%lu suspends, %lu merged programs, %lu aged\n", stats.suspends, stats.merged_programs, stats.aged);
+    // urgent reads suspend the updater's erases and wait for at most a page program
+    CHECK(test_percentile(latencies[0], 99) < W25Q64FV_TIME_SECTOR_ERASE_TYP / 4);
+    CHECK(test_percentile(latencies[0], 50) < test_percentile(latencies[3], 50));
+    CHECK(stats.suspends > 0);
+    CHECK(suspend_pending);
+    CHECK(memcmp(model.memory() + TEST_SCHEDULER_LOG, log_data, sizeof(log_data)) == 0);
+    for(uint32_t sector = 0; sector < 64; sector ++){
+        CHECK(memcmp(model.memory() + TEST_SCHEDULER_OTA + sector * W25Q64FV_SECTOR_SIZE, ota_data, sizeof(ota_data)) == 0);
+    }
+    CHECK_NO_VIOLATIONS(model);
+}
+
+/// Contention check state
+typedef struct{
+    W25Q64FV_SimScheduler *scheduler;   ///< Scheduler to submit to
+    unsigned int thread;                ///< Thread number
+    std::atomic<unsigned long> *completed; ///< Reads completed by every thread
+} test_contender_t;
+
+static byte readback[TEST_SCHEDULER_THREADS][TEST_SCHEDULER_READS][16];
+static std::vector<int> handles;
+
+static void counted(int handle, W25Q64FV_status_t status, void *context){
+    CHECK_OK(status);
+    handles.push_back(handle);
+    ((std::atomic<unsigned long>*)context)->fetch_add(1);
+}
+
+/**
+ * @brief Submit reads as fast as the queue takes them
+ *
+ * @param contender             Thread state
+ * @return (void)
+ */
+static void contend(test_contender_t *contender){
+    for(uint32_t i = 0; i < TEST_SCHEDULER_READS; i ++){
+        uint32_t address = ((contender->thread * TEST_SCHEDULER_READS + i) * 16) % sizeof(config);
+        while(contender->scheduler->read(address, readback[contender->thread][i], 16, contender->thread % W25Q64FV_SCHEDULER_PRIORITIES,
+                                         counted, contender->completed) == W25Q64FV_ASYNC_INVALID_HANDLE){
+            std::this_thread::yield();
+        }
+    }
+}
+
+static void test_contention(){
+    // every request submitted at once from several threads completes exactly once
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    memcpy(model.memory(), config, sizeof(config));
+    W25Q64FV_SimScheduler scheduler(flash);
+    std::atomic<unsigned long> completed(0);
+    handles.clear();
+    test_contender_t contenders[TEST_SCHEDULER_THREADS];
+    std::thread threads[TEST_SCHEDULER_THREADS];
+    for(unsigned int i = 0; i < TEST_SCHEDULER_THREADS; i ++){
+        contenders[i].scheduler = &scheduler;
+        contenders[i].thread = i;
+        contenders[i].completed = &completed;
+        threads[i] = std::thread(contend, &contenders[i]);
+    }
+    while(completed.load() < TEST_SCHEDULER_THREADS * TEST_SCHEDULER_READS){
+        scheduler.poll();
+        std::this_thread::yield();
+    }
+    for(unsigned int i = 0; i < TEST_SCHEDULER_THREADS; i ++) threads[i].join();
+    CHECK(scheduler.idle());
+    std::sort(handles.begin(), handles.end());
+    CHECK_EQUAL(handles.size(), TEST_SCHEDULER_THREADS * TEST_SCHEDULER_READS);
+    CHECK(std::adjacent_find(handles.begin(), handles.end()) == handles.end());
+    bool match = true;
+    for(uint32_t thread = 0; thread < TEST_SCHEDULER_THREADS; thread ++){
+        for(uint32_t i = 0; i < TEST_SCHEDULER_READS; i ++){
+            uint32_t address = ((thread * TEST_SCHEDULER_READS + i) * 16) % sizeof(config);
+            match = match && memcmp(readback[thread][i], config + address, 16) == 0;
+        }
+    }
+    CHECK(match);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static int timeout_status;
+static unsigned int timeout_callbacks;
+
+static void timed_out(int handle, W25Q64FV_status_t status, void *context){
+    (void)handle;
+    (void)context;
+    timeout_status = status;
+    timeout_callbacks ++;
+}
+
+static void test_timeout(){
+    // a page program that outlasts its maximum time fails the program it belongs to,
+    // pages left included, and the scheduler carries on once the device is free
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_sim_timing_t timing;
+    W25Q64FV_sim_default_timing(&timing);
+    timing.page_program = 50000;
+    model.set_timing(timing);
+    W25Q64FV_SimScheduler scheduler(flash);
+    timeout_callbacks = 0;
+    double deadline = test_time_us() + 1000000;
+    CHECK(scheduler.program(TEST_SCHEDULER_LOG, log_data, 4 * W25Q64FV_PAGE_SIZE, 1, timed_out) != W25Q64FV_ASYNC_INVALID_HANDLE);
+    while(timeout_callbacks == 0 && test_time_us() < deadline){
+        scheduler.poll();
+        delayMicroseconds(100);
+    }
+    CHECK_EQUAL(timeout_callbacks, 1);
+    CHECK_EQUAL(timeout_status, W25Q64FV_TIMEOUT);
+    CHECK(scheduler.idle());
+    CHECK_EQUAL(model.counters().programmed_bytes, W25Q64FV_PAGE_SIZE);
+    // the next request waits for the device, then completes
+    byte buffer[32];
+    CHECK(scheduler.read(TEST_SCHEDULER_CONFIG, buffer, sizeof(buffer), 0, timed_out) != W25Q64FV_ASYNC_INVALID_HANDLE);
+    while(timeout_callbacks == 1 && test_time_us() < deadline){
+        scheduler.poll();
+        delayMicroseconds(100);
+    }
+    CHECK_EQUAL(timeout_callbacks, 2);
+    CHECK_EQUAL(timeout_status, W25Q64FV_OK);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_priorities();
+    test_contention();
+    test_timeout();
+    return test_result("test_scheduler");
+}
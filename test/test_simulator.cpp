@@ -0,0 +1,272 @@
+/**
+ * @file test_simulator.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the flash model and the driver running on it
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+
+/// Simulated W25Q256 on a single line bus
+typedef W25Q64FV_Device<W25Q64FV_SimulatedSPI<1>, W25Q64FV_FixedGeometry<33554432> > W25Q256FV_Sim;
+/// Simulated part sized from SFDP
+typedef W25Q64FV_Device<W25Q64FV_SimulatedSPI<1>, W25Q64FV_SFDPGeometry> W25QXX_Sim;
+
+/**
+ * @brief Clock a transaction straight into the model
+ *
+ * @param model                 Simulated flash
+ * @param bytes                 Bytes of the transaction
+ * @param length                Number of bytes
+ * @return (void)
+ */
+static void raw(W25Q64FV_SimulatedFlash &model, const uint8_t *bytes, size_t length){
+    model.select();
+    for(size_t i = 0; i < length; i ++) model.exchange(bytes[i], 1);
+    model.deselect();
+}
+
+static void test_identify(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    byte manufacturer = 0, type = 0, density = 0;
+    CHECK_OK(flash.get_jedec(&manufacturer, &type, &density));
+    CHECK_EQUAL(manufacturer, 0xEF);
+    CHECK_EQUAL(type, 0x40);
+    CHECK_EQUAL(density, 0x17);
+    CHECK_NO_VIOLATIONS(model);
+    // a fixed geometry refuses a different part
+    W25Q64FV_SimulatedFlash larger(16777216);
+    W25Q64FV_SimulatedSPI<1> larger_bus(&larger);
+    W25Q64FV_Sim mismatched(larger_bus);
+    CHECK_EQUAL(mismatched.begin(0), W25Q64FV_NOT_VALID);
+}
+
+static void test_nor(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    byte data = 0xF0;
+    CHECK_OK(flash.write(100, &data, 1, true));
+    // programming only clears bits
+    data = 0x0F;
+    CHECK_OK(flash.write(100, &data, 1, true));
+    CHECK_EQUAL(model.memory()[100], 0x00);
+    data = 0xFF;
+    CHECK_OK(flash.write(100, &data, 1, true));
+    CHECK_OK(flash.read(100, &data, 1));
+    CHECK_EQUAL(data, 0x00);
+    // an erase sets the whole aligned sector
+    memset(model.memory() + 4090, 0x00, 12);
+    CHECK_OK(flash.erase_sector(100));
+    CHECK_EQUAL(model.memory()[100], 0xFF);
+    CHECK_EQUAL(model.memory()[4095], 0xFF);
+    CHECK_EQUAL(model.memory()[4096], 0x00);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_page_wrap(){
+    W25Q64FV_SimulatedFlash model;
+    const uint8_t enable[1] = {W25Q64FV_INSTRUCTION_WRITE_ENABLE};
+    uint8_t program[4 + 32];
+    program[0] = W25Q64FV_INSTRUCTION_PAGE_PROGRAM;
+    program[1] = 0x00;
+    program[2] = 0x01;
+    program[3] = 0xF0;
+    for(uint8_t i = 0; i < 32; i ++) program[4 + i] = i;
+    raw(model, enable, sizeof(enable));
+    raw(model, program, sizeof(program));
+    // the address wraps to the start of the page
+    CHECK_EQUAL(model.memory()[0x1FF], 15);
+    CHECK_EQUAL(model.memory()[0x100], 16);
+    CHECK_EQUAL(model.memory()[0x10F], 31);
+    CHECK_EQUAL(model.memory()[0x200], 0xFF);
+    CHECK(model.busy());
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_violations(){
+    W25Q64FV_SimulatedFlash model;
+    const uint8_t program[5] = {W25Q64FV_INSTRUCTION_PAGE_PROGRAM, 0, 0, 0, 0x00};
+    const uint8_t enable[1] = {W25Q64FV_INSTRUCTION_WRITE_ENABLE};
+    const uint8_t erase[5] = {W25Q64FV_INSTRUCTION_SECTOR_4K_ERASE, 0, 0, 0, 0};
+    const uint8_t read[6] = {W25Q64FV_INSTRUCTION_FAST_READ, 0, 0, 0, 0, 0};
+    // program without the write enable latch
+    raw(model, program, sizeof(program));
+    CHECK_EQUAL(model.counters().violations, 1);
+    CHECK_EQUAL(model.memory()[0], 0xFF);
+    // erase with a byte after the address
+    raw(model, enable, sizeof(enable));
+    raw(model, erase, sizeof(erase));
+    CHECK_EQUAL(model.counters().violations, 2);
+    CHECK(!model.busy());
+    // read while busy
+    raw(model, erase, 4);
+    CHECK(model.busy());
+    raw(model, read, sizeof(read));
+    CHECK_EQUAL(model.counters().violations, 3);
+    // anything else while busy
+    raw(model, enable, sizeof(enable));
+    CHECK_EQUAL(model.counters().violations, 4);
+}
+
+static void test_timing(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    double start = test_time_us();
+    CHECK_OK(flash.erase_sector(4096, false));
+    CHECK(model.busy());
+    CHECK_OK(flash.wait_until_free());
+    double elapsed = test_time_us() - start;
+    CHECK(elapsed >= W25Q64FV_TIME_SECTOR_ERASE_TYP && elapsed < W25Q64FV_TIME_SECTOR_ERASE_TYP + 100);
+    byte page[W25Q64FV_PAGE_SIZE];
+    test_pattern(page, sizeof(page), 1);
+    start = test_time_us();
+    CHECK_OK(flash.write(4096, page, sizeof(page), true));
+    elapsed = test_time_us() - start;
+    // the data phase, 0.4 us a byte at 20 MHz, then the program
+    CHECK(elapsed >= W25Q64FV_TIME_PAGE_PROGRAM_TYP + 102 && elapsed < W25Q64FV_TIME_PAGE_PROGRAM_TYP + 150);
+    CHECK_EQUAL(memcmp(model.memory() + 4096, page, sizeof(page)), 0);
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_SECTOR_ERASE], 1);
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_PAGE_PROGRAM], 1);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_suspend(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    memset(model.memory() + 0x20000, 0x5A, 16);
+    double start = test_time_us();
+    CHECK_OK(flash.erase_sector(0x10000, false));
+    delay(10);
+    CHECK_OK(flash.suspend());
+    double suspend_time = test_time_us();
+    CHECK(model.suspended());
+    CHECK(!model.busy());
+    // reads outside the erase are served
+    byte data[16];
+    CHECK_OK(flash.read(0x20000, data, sizeof(data)));
+    CHECK_EQUAL(data[15], 0x5A);
+    // the suspend clears the latch, the program sets it again
+    CHECK_OK(flash.write(0x20100, data, sizeof(data), true));
+    CHECK_EQUAL(model.memory()[0x2010F], 0x5A);
+    CHECK_NO_VIOLATIONS(model);
+    delay(5);
+    double paused = test_time_us() - suspend_time;
+    CHECK_OK(flash.resume());
+    CHECK(model.busy());
+    CHECK_OK(flash.wait_until_free());
+    // the erase keeps the time it had left
+    double elapsed = test_time_us() - start - paused;
+    CHECK(elapsed >= W25Q64FV_TIME_SECTOR_ERASE_TYP && elapsed < W25Q64FV_TIME_SECTOR_ERASE_TYP + 200);
+    CHECK_EQUAL(model.counters().suspends, 1);
+    CHECK_EQUAL(model.counters().resumes, 1);
+    CHECK_NO_VIOLATIONS(model);
+    // reading the sector being erased is undefined
+    CHECK_OK(flash.erase_sector(0x10000, false));
+    CHECK_OK(flash.suspend());
+    CHECK_OK(flash.read(0x10000, data, sizeof(data)));
+    CHECK_EQUAL(model.counters().violations, 1);
+}
+
+static void test_four_byte_address(){
+    W25Q64FV_SimulatedFlash model(33554432);
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q256FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    byte data[16];
+    byte check[16];
+    test_pattern(data, sizeof(data), 2);
+    CHECK_OK(flash.write(0x1400000, data, sizeof(data), true));
+    CHECK_EQUAL(memcmp(model.memory() + 0x1400000, data, sizeof(data)), 0);
+    CHECK_OK(flash.read(0x1400000, check, sizeof(check)));
+    CHECK_EQUAL(memcmp(check, data, sizeof(data)), 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_sfdp(){
+    W25Q64FV_SimulatedFlash model(16777216);
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25QXX_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    CHECK_EQUAL(flash.capacity(), 16777216);
+    CHECK_EQUAL(flash.operation_time(W25Q64FV_OPERATION_SECTOR_ERASE), 48000);
+    CHECK_EQUAL(flash.operation_time(W25Q64FV_OPERATION_PAGE_PROGRAM), 704);
+    CHECK_EQUAL(flash.operation_time(W25Q64FV_OPERATION_CHIP_ERASE), 40000000);
+    // without a table the part is sized from the JEDEC ID
+    W25Q64FV_SimulatedFlash plain(16777216, false);
+    W25Q64FV_SimulatedSPI<1> plain_bus(&plain);
+    W25QXX_Sim fallback(plain_bus);
+    CHECK_OK(fallback.begin(0));
+    CHECK_EQUAL(fallback.capacity(), 16777216);
+    CHECK_EQUAL(fallback.operation_time(W25Q64FV_OPERATION_SECTOR_ERASE), W25Q64FV_TIME_SECTOR_ERASE_TYP);
+    CHECK_NO_VIOLATIONS(model);
+    CHECK_NO_VIOLATIONS(plain);
+}
+
+static void test_quad(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<4> bus(&model);
+    W25Q64FV_QuadSim flash(bus);
+    CHECK_OK(flash.begin(0));
+    CHECK_OK(flash.set_io_mode(W25Q64FV_IO_QUAD_IO, true));
+    byte data[1000];
+    byte check[1000];
+    test_pattern(data, sizeof(data), 3);
+    CHECK_OK(flash.write(0x3010, data, sizeof(data), true));
+    CHECK_EQUAL(memcmp(model.memory() + 0x3010, data, sizeof(data)), 0);
+    for(int i = 0; i < 2; i ++){
+        memset(check, 0, sizeof(check));
+        double start = test_time_us();
+        CHECK_OK(flash.read(0x3010, check, sizeof(check)));
+        // four lines, 0.1 us a byte
+        CHECK(test_time_us() - start < 110);
+        CHECK_EQUAL(memcmp(check, data, sizeof(data)), 0);
+    }
+    CHECK_OK(flash.set_io_mode(W25Q64FV_IO_SINGLE));
+    CHECK_OK(flash.read(0x3010, check, sizeof(check)));
+    CHECK_EQUAL(memcmp(check, data, sizeof(data)), 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_asynchronous(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    test_pattern(model.memory(), 4096, 4);
+    static byte data[4096];
+    double start = test_time_us();
+    CHECK_OK(flash.start_read(0, data, sizeof(data)));
+    CHECK(test_time_us() - start < 10);
+    CHECK_EQUAL(flash.finish_read(false), W25Q64FV_BUSY);
+    CHECK_OK(flash.finish_read(true));
+    CHECK(test_time_us() - start >= sizeof(data) * 0.4);
+    CHECK_EQUAL(memcmp(data, model.memory(), sizeof(data)), 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_identify();
+    test_nor();
+    test_page_wrap();
+    test_violations();
+    test_timing();
+    test_suspend();
+    test_four_byte_address();
+    test_sfdp();
+    test_quad();
+    test_asynchronous();
+    return test_result("test_simulator");
+}
@@ -0,0 +1,67 @@
+/**
+ * @file test_smart.cpp
+ * @author Jeremy Dunne
+ * @brief checks of smart mode and the writes that bypass it
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+
+static void test_skips(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    flash.set_smart_mode(true);
+    // a blank sector is not erased
+    CHECK_OK(flash.erase_sector(0));
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_SECTOR_ERASE], 0);
+    // only the changed span of a page is programmed
+    byte data[W25Q64FV_PAGE_SIZE];
+    memset(data, 0xFF, sizeof(data));
+    data[10] = 0x7F;
+    data[20] = 0x3F;
+    CHECK_OK(flash.write(0, data, sizeof(data), true));
+    CHECK_EQUAL(model.counters().programmed_bytes, 11);
+    CHECK_OK(flash.write(0, data, sizeof(data), true));
+    CHECK_EQUAL(model.counters().operations[W25Q64FV_OPERATION_PAGE_PROGRAM], 1);
+    // setting bits needs an erase
+    data[10] = 0xFF;
+    CHECK_EQUAL(flash.write(0, data, sizeof(data), true), W25Q64FV_NOT_VALID);
+    W25Q64FV_smart_stats_t stats;
+    flash.get_smart_stats(&stats);
+    CHECK_EQUAL(stats.skipped_erases, 1);
+    CHECK_EQUAL(stats.skipped_pages, 1);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_write_erased(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    flash.set_smart_mode(true);
+    byte data[2 * W25Q64FV_PAGE_SIZE];
+    test_pattern(data, sizeof(data), 6);
+    // no compare reads, whole pages programmed, and smart mode left on
+    model.reset_counters();
+    CHECK_OK(flash.write_erased(100, data, sizeof(data), true));
+    CHECK_EQUAL(model.counters().reads, 0);
+    CHECK_EQUAL(model.counters().programmed_bytes, sizeof(data));
+    CHECK(flash.smart_mode());
+    CHECK(memcmp(model.memory() + 100, data, sizeof(data)) == 0);
+    W25Q64FV_smart_stats_t stats;
+    flash.get_smart_stats(&stats);
+    CHECK_EQUAL(stats.skipped_bytes, 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_skips();
+    test_write_erased();
+    return test_result("test_smart");
+}
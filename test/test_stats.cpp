@@ -0,0 +1,148 @@
+/**
+ * @file test_stats.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the driver statistics against the simulator's own counters
+ *
+ * Built with W25Q64FV_ENABLE_STATS set, against a copy of the library built the same way.
+ *
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+
+#if !W25Q64FV_ENABLE_STATS
+#error "test_stats must be built with W25Q64FV_ENABLE_STATS"
+#endif
+
+/**
+ * @brief Get the histogram bucket of a time
+ *
+ * @param time                  Time (us)
+ * @return uint8_t              Bucket, 0 for 0 us and i for [2^(i-1), 2^i) us
+ */
+static uint8_t bucket(unsigned long time){
+    uint8_t index = 0;
+    while(time > 0 && index < W25Q64FV_STATS_BUCKETS - 1){
+        time >>= 1;
+        index ++;
+    }
+    return index;
+}
+
+/**
+ * @brief Count the entries of a histogram
+ *
+ * @param stats                 Driver statistics
+ * @param histogram             Histogram
+ * @return unsigned long        Entries in every bucket
+ */
+static unsigned long entries(const W25Q64FV_stats_t &stats, W25Q64FV_histogram_t histogram){
+    unsigned long total = 0;
+    for(uint8_t i = 0; i < W25Q64FV_STATS_BUCKETS; i ++) total += stats.histograms[histogram][i];
+    return total;
+}
+
+/**
+ * @brief Check the driver's counters agree with the simulated part's
+ *
+ * @param stats                 Driver statistics
+ * @param model                 Simulated part
+ * @return (void)
+ */
+static void check_counters(const W25Q64FV_stats_t &stats, W25Q64FV_SimulatedFlash &model){
+    for(uint8_t i = W25Q64FV_OPERATION_PAGE_PROGRAM; i <= W25Q64FV_OPERATION_RESET; i ++){
+        CHECK_EQUAL(stats.operations[i], model.counters().operations[i]);
+    }
+    CHECK_EQUAL(stats.reads, model.counters().reads);
+    CHECK_EQUAL(stats.bytes, model.counters().bytes);
+    CHECK_EQUAL(stats.selects, model.counters().selects);
+    CHECK_EQUAL(stats.polls, model.counters().polls);
+}
+
+static void test_sequence(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_stats_t stats;
+    flash.get_stats(&stats, true);
+    model.reset_counters();
+    // one sector erase and three page programs, each waited on
+    byte data[3 * W25Q64FV_PAGE_SIZE];
+    test_pattern(data, sizeof(data), 19);
+    CHECK_OK(flash.erase_sector(0, true));
+    CHECK_OK(flash.write(0, data, sizeof(data), true));
+    // one read, timed here as well
+    byte readback[4096];
+    unsigned long start = micros();
+    CHECK_OK(flash.read(0, readback, sizeof(readback)));
+    unsigned long read_time = micros() - start;
+    CHECK(memcmp(readback, data, sizeof(data)) == 0);
+    flash.get_stats(&stats);
+    check_counters(stats, model);
+    CHECK_EQUAL(stats.operations[W25Q64FV_OPERATION_SECTOR_ERASE], 1);
+    CHECK_EQUAL(stats.operations[W25Q64FV_OPERATION_PAGE_PROGRAM], 3);
+    CHECK_EQUAL(stats.reads, 1);
+    CHECK(stats.polls >= 4);
+    CHECK_EQUAL(stats.timeouts, 0);
+    // completions are observed within a poll of the typical times, inside the same power of two
+    CHECK_EQUAL(stats.histograms[W25Q64FV_HISTOGRAM_ERASE][bucket(W25Q64FV_TIME_SECTOR_ERASE_TYP)], 1);
+    CHECK_EQUAL(entries(stats, W25Q64FV_HISTOGRAM_ERASE), 1);
+    CHECK_EQUAL(stats.histograms[W25Q64FV_HISTOGRAM_PROGRAM][bucket(W25Q64FV_TIME_PAGE_PROGRAM_TYP)], 3);
+    CHECK_EQUAL(entries(stats, W25Q64FV_HISTOGRAM_PROGRAM), 3);
+    // the read's own timing brackets the driver's by a clock read at most
+    CHECK_EQUAL(entries(stats, W25Q64FV_HISTOGRAM_READ), 1);
+    CHECK(stats.histograms[W25Q64FV_HISTOGRAM_READ][bucket(read_time)] == 1 || stats.histograms[W25Q64FV_HISTOGRAM_READ][bucket(read_time) - 1] == 1);
+    // every wait that found the device busy is timed, the last bucket stays empty
+    CHECK(entries(stats, W25Q64FV_HISTOGRAM_WAIT) >= 4);
+    CHECK_EQUAL(entries(stats, W25Q64FV_HISTOGRAM_VERIFY), 0);
+    CHECK_EQUAL(stats.histograms[W25Q64FV_HISTOGRAM_WAIT][W25Q64FV_STATS_BUCKETS - 1], 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_timeout_and_verify(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_stats_t stats;
+    flash.get_stats(&stats, true);
+    model.reset_counters();
+    // a wait shorter than the erase times out and is timed, then the erase completes
+    CHECK_OK(flash.erase_sector(0, false));
+    CHECK_EQUAL(flash.wait_until_free(1), W25Q64FV_TIMEOUT);
+    CHECK_OK(flash.wait_until_free());
+    byte data[W25Q64FV_PAGE_SIZE];
+    test_pattern(data, sizeof(data), 19);
+    CHECK_OK(flash.write_verified(0, data, sizeof(data)));
+    // a smart write of the same data compares and programs nothing
+    flash.set_smart_mode(true);
+    CHECK_OK(flash.write(0, data, sizeof(data), true));
+    flash.get_stats(&stats, true);
+    check_counters(stats, model);
+    CHECK_EQUAL(stats.timeouts, 1);
+    CHECK_EQUAL(entries(stats, W25Q64FV_HISTOGRAM_ERASE), 1);
+    CHECK_EQUAL(entries(stats, W25Q64FV_HISTOGRAM_VERIFY), 1);
+    CHECK_EQUAL(entries(stats, W25Q64FV_HISTOGRAM_PROGRAM), 1);
+    // the timed out wait took at least its limit
+    unsigned long long_waits = 0;
+    for(uint8_t i = bucket(1000); i < W25Q64FV_STATS_BUCKETS; i ++) long_waits += stats.histograms[W25Q64FV_HISTOGRAM_WAIT][i];
+    CHECK(long_waits >= 2);
+    // a reset leaves nothing behind
+    flash.get_stats(&stats);
+    CHECK_EQUAL(stats.timeouts, 0);
+    CHECK_EQUAL(stats.selects, 0);
+    CHECK_EQUAL(stats.operations[W25Q64FV_OPERATION_SECTOR_ERASE], 0);
+    for(uint8_t h = 0; h < W25Q64FV_HISTOGRAM_COUNT; h ++) CHECK_EQUAL(entries(stats, (W25Q64FV_histogram_t)h), 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_sequence();
+    test_timeout_and_verify();
+    return test_result("test_stats");
+}
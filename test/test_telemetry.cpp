@@ -0,0 +1,199 @@
+/**
+ * @file test_telemetry.cpp
+ * @author Jeremy Dunne
+ * @brief checks of the compressed telemetry encode and decode on the simulated part
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+#include "W25Q64FV_Telemetry_impl.hpp"
+
+typedef W25Q64FV_BasicLog<W25Q64FV_Sim> W25Q64FV_SimLog;
+typedef W25Q64FV_BasicTelemetry<W25Q64FV_Sim> W25Q64FV_SimTelemetry;
+
+#define TEST_TELEMETRY_START    0x100000 // Start of the log region
+#define TEST_TELEMETRY_LENGTH   (64 * W25Q64FV_SECTOR_SIZE) // Length of the log region
+#define TEST_TELEMETRY_CHANNELS 10 // Values per frame, two bytes of bitmask
+#define TEST_TELEMETRY_FRAMES   6000 // Frames per run
+
+static int32_t frames[TEST_TELEMETRY_FRAMES][TEST_TELEMETRY_CHANNELS];
+
+/**
+ * @brief Build the frames: a jittered timestamp, noisy and slow channels, and extremes
+ *
+ * @param random                Random state
+ * @return (void)
+ */
+static void build(uint32_t *random){
+    int32_t key = -50000;
+    for(uint32_t i = 0; i < TEST_TELEMETRY_FRAMES; i ++){
+        int32_t *frame = frames[i];
+        // mostly a fixed step, with jitter, repeated keys and a gap
+        uint32_t roll = test_random(random, 100);
+        if(roll == 99) key += 100000;
+        else if(roll >= 15) key += 10;
+        else if(roll >= 5) key += 9 + test_random(random, 3);
+        frame[0] = key;
+        frame[1] = (int32_t)test_random(random, 2000) - 1000;
+        frame[2] = i / 50;
+        frame[3] = -(int32_t)(i / 3);
+        frame[4] = 12345;
+        frame[5] = i % 7 == 0 ? (int32_t)test_random(random, 0x7FFFFFFF) : (i > 0 ? frames[i - 1][5] : 0);
+        // full scale swings overflow a 32 bit difference
+        frame[6] = i % 2 ? INT32_MAX : INT32_MIN;
+        frame[7] = i % 500 == 0 ? INT32_MIN : 0;
+        frame[8] = (int32_t)(i * 1000003UL);
+        frame[9] = (int32_t)test_random(random, 16) - 8;
+    }
+}
+
+/**
+ * @brief Read every frame back from the read cursor and check it against the built ones
+ *
+ * @param telemetry             Telemetry stream, positioned at a frame
+ * @param first                 Index of the frame at the cursor
+ * @return uint32_t             Number of frames read
+ */
+static uint32_t check_frames(W25Q64FV_SimTelemetry &telemetry, uint32_t first){
+    int32_t values[TEST_TELEMETRY_CHANNELS];
+    uint32_t count = 0;
+    bool match = true;
+    while(true){
+        bool valid;
+        W25Q64FV_status_t status = telemetry.read_next(values, &valid);
+        CHECK_OK(status);
+        if(status != W25Q64FV_OK || !valid) break;
+        if(first + count >= TEST_TELEMETRY_FRAMES){
+            match = false;
+            break;
+        }
+        match = match && memcmp(values, frames[first + count], sizeof(values)) == 0;
+        count ++;
+    }
+    CHECK(match);
+    return count;
+}
+
+static void test_round_trip(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimLog log(flash, TEST_TELEMETRY_START, TEST_TELEMETRY_LENGTH);
+    CHECK_OK(log.format());
+    W25Q64FV_SimTelemetry telemetry(log, TEST_TELEMETRY_CHANNELS);
+    for(uint32_t i = 0; i < TEST_TELEMETRY_FRAMES; i ++){
+        CHECK_OK(telemetry.append(frames[i]));
+        // a sync now and then starts a block early
+        if(i % 1000 == 500) CHECK_OK(telemetry.sync());
+    }
+    // frames of the open block are not visible yet
+    telemetry.rewind();
+    CHECK(check_frames(telemetry, 0) < TEST_TELEMETRY_FRAMES);
+    CHECK_OK(telemetry.sync());
+    telemetry.rewind();
+    CHECK_EQUAL(check_frames(telemetry, 0), TEST_TELEMETRY_FRAMES);
+    W25Q64FV_telemetry_stats_t stats;
+    telemetry.get_stats(&stats);
+    CHECK_EQUAL(stats.frames, TEST_TELEMETRY_FRAMES);
+    CHECK_EQUAL(stats.raw_bytes, TEST_TELEMETRY_FRAMES * sizeof(frames[0]));
+    CHECK(stats.encoded_bytes < stats.raw_bytes);
+    // every log sector starts on a keyframe
+    CHECK(stats.blocks >= log.used_sectors());
+    // a fresh mount decodes the same frames
+    W25Q64FV_SimLog remounted(flash, TEST_TELEMETRY_START, TEST_TELEMETRY_LENGTH);
+    CHECK_OK(remounted.mount());
+    W25Q64FV_SimTelemetry reader(remounted, TEST_TELEMETRY_CHANNELS);
+    reader.rewind();
+    CHECK_EQUAL(check_frames(reader, 0), TEST_TELEMETRY_FRAMES);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_seek(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimLog log(flash, TEST_TELEMETRY_START, TEST_TELEMETRY_LENGTH);
+    CHECK_OK(log.format());
+    W25Q64FV_SimTelemetry telemetry(log, TEST_TELEMETRY_CHANNELS);
+    for(uint32_t i = 0; i < TEST_TELEMETRY_FRAMES; i ++) CHECK_OK(telemetry.append(frames[i]));
+    CHECK_OK(telemetry.sync());
+    int32_t values[TEST_TELEMETRY_CHANNELS];
+    bool valid;
+    // keys inside the log land on the first frame at or after them
+    uint32_t random = 25;
+    int32_t first = frames[0][0];
+    int32_t last = frames[TEST_TELEMETRY_FRAMES - 1][0];
+    for(unsigned int i = 0; i < 200; i ++){
+        int32_t key = first + (int32_t)test_random(&random, last - first + 1);
+        uint32_t expected = 0;
+        while(frames[expected][0] < key) expected ++;
+        CHECK_OK(telemetry.seek(key));
+        CHECK_OK(telemetry.read_next(values, &valid));
+        CHECK(valid);
+        CHECK(memcmp(values, frames[expected], sizeof(values)) == 0);
+    }
+    // the cursor carries on from the found frame to the end
+    uint32_t middle = TEST_TELEMETRY_FRAMES / 2;
+    while(middle > 0 && frames[middle - 1][0] == frames[middle][0]) middle --;
+    CHECK_OK(telemetry.seek(frames[middle][0]));
+    CHECK_EQUAL(check_frames(telemetry, middle), TEST_TELEMETRY_FRAMES - middle);
+    // a key before the oldest frame finds the oldest frame
+    CHECK_OK(telemetry.seek(INT32_MIN));
+    CHECK_EQUAL(check_frames(telemetry, 0), TEST_TELEMETRY_FRAMES);
+    // the last key is found, one past it is not
+    CHECK_OK(telemetry.seek(last));
+    CHECK_OK(telemetry.read_next(values, &valid));
+    CHECK(valid);
+    CHECK_EQUAL(values[0], last);
+    CHECK_EQUAL(telemetry.seek(last + 1), W25Q64FV_NOT_FOUND);
+    CHECK_OK(telemetry.read_next(values, &valid));
+    CHECK(!valid);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_empty_and_not_valid(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    W25Q64FV_SimLog log(flash, TEST_TELEMETRY_START, TEST_TELEMETRY_LENGTH);
+    CHECK_OK(log.format());
+    W25Q64FV_SimTelemetry telemetry(log, 2);
+    int32_t values[2];
+    bool valid;
+    // nothing to find in an empty log
+    CHECK_EQUAL(telemetry.seek(0), W25Q64FV_NOT_FOUND);
+    telemetry.rewind();
+    CHECK_OK(telemetry.read_next(values, &valid));
+    CHECK(!valid);
+    // the key must not decrease
+    values[0] = 100;
+    values[1] = 1;
+    CHECK_OK(telemetry.append(values));
+    values[0] = 99;
+    CHECK_EQUAL(telemetry.append(values), W25Q64FV_NOT_VALID);
+    values[0] = 100;
+    CHECK_OK(telemetry.append(values));
+    CHECK_OK(telemetry.sync());
+    CHECK_OK(telemetry.seek(100));
+    CHECK_OK(telemetry.read_next(values, &valid));
+    CHECK(valid);
+    CHECK_EQUAL(values[0], 100);
+    CHECK_EQUAL(values[1], 1);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    uint32_t random = 25;
+    build(&random);
+    test_round_trip();
+    test_seek();
+    test_empty_and_not_valid();
+    return test_result("test_telemetry");
+}
@@ -0,0 +1,117 @@
+/**
+ * @file test_transactions.cpp
+ * @author Jeremy Dunne
+ * @brief exact chip select, byte, and status poll counts of the driver's sequences
+ * @version 0.1
+ * @date 2022-05-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "W25Q64FV_Test.hpp"
+
+/// Check the transactions of the last sequence, then start counting the next
+#define CHECK_TRANSACTIONS(model, select_count, byte_count, poll_count) do{ \
+        CHECK_EQUAL((model).counters().selects, select_count); \
+        CHECK_EQUAL((model).counters().bytes, byte_count); \
+        CHECK_EQUAL((model).counters().polls, poll_count); \
+        (model).reset_counters(); \
+    }while(0)
+
+static void test_erase(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    model.reset_counters();
+    // write enable, erase and address, one poll after sleeping the typical time
+    CHECK_OK(flash.erase_sector(0, true));
+    CHECK_TRANSACTIONS(model, 3, 1 + 4 + 2, 1);
+    CHECK_OK(flash.erase_block_64(W25Q64FV_BLOCK_64K_SIZE, true));
+    CHECK_TRANSACTIONS(model, 3, 1 + 4 + 2, 1);
+    // a 64k block and a sector
+    CHECK_OK(flash.erase_range(2 * W25Q64FV_BLOCK_64K_SIZE, W25Q64FV_BLOCK_64K_SIZE + W25Q64FV_SECTOR_SIZE));
+    CHECK_TRANSACTIONS(model, 6, 2 * (1 + 4 + 2), 2);
+    // without a hold, the typical time answers busy() and nothing is polled
+    CHECK_OK(flash.erase_sector(0, false));
+    CHECK_TRANSACTIONS(model, 2, 1 + 4, 0);
+    CHECK(flash.busy());
+    byte page[W25Q64FV_PAGE_SIZE];
+    CHECK_EQUAL(flash.read_page(0, page), W25Q64FV_BUSY);
+    CHECK_TRANSACTIONS(model, 0, 0, 0);
+    CHECK_OK(flash.wait_until_free());
+    CHECK_TRANSACTIONS(model, 1, 2, 1);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_program(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    byte data[600];
+    test_pattern(data, sizeof(data), 7);
+    model.reset_counters();
+    // write enable, program with its address, one poll
+    CHECK_OK(flash.write(0, data, W25Q64FV_PAGE_SIZE, true));
+    CHECK_TRANSACTIONS(model, 3, 1 + 4 + W25Q64FV_PAGE_SIZE + 2, 1);
+    // three pages, 212 + 256 + 132 bytes, each waited for before the next
+    CHECK_OK(flash.write(300, data, sizeof(data), true));
+    CHECK_TRANSACTIONS(model, 9, 3 * (1 + 4 + 2) + sizeof(data), 3);
+    // without a hold the last page is not polled
+    CHECK_OK(flash.write(1024, data, 10, false));
+    CHECK_TRANSACTIONS(model, 2, 1 + 4 + 10, 0);
+    CHECK_OK(flash.wait_until_free());
+    CHECK_TRANSACTIONS(model, 1, 2, 1);
+    CHECK(memcmp(model.memory() + 300, data, sizeof(data)) == 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_read(){
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    CHECK_OK(flash.begin(0));
+    byte data[W25Q64FV_PAGE_SIZE];
+    model.reset_counters();
+    // fast read, address, and dummy byte, no poll of a device known to be free
+    CHECK_OK(flash.read(0, data, 100));
+    CHECK_TRANSACTIONS(model, 1, 1 + 3 + 1 + 100, 0);
+    CHECK_OK(flash.read_page(0, data));
+    CHECK_TRANSACTIONS(model, 1, 1 + 3 + W25Q64FV_PAGE_SIZE, 0);
+    CHECK_OK(flash.read(0, data, 0));
+    CHECK_TRANSACTIONS(model, 0, 0, 0);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+static void test_slow_part(){
+    // a part at the datasheet maximums is polled with backoff, one chip select per poll
+    W25Q64FV_SimulatedFlash model;
+    W25Q64FV_SimulatedSPI<1> bus(&model);
+    W25Q64FV_Sim flash(bus);
+    W25Q64FV_sim_timing_t timing;
+    W25Q64FV_sim_default_timing(&timing, W25Q64FV_CAPACITY, true);
+    model.set_timing(timing);
+    CHECK_OK(flash.begin(0));
+    model.reset_counters();
+    CHECK_OK(flash.erase_sector(0, true));
+    unsigned long polls = model.counters().polls;
+    CHECK(polls > 1);
+    CHECK_TRANSACTIONS(model, 2 + polls, 5 + 2 * polls, polls);
+    // streamed, the polls share one chip select
+    flash.set_continuous_status_poll(true);
+    CHECK_OK(flash.erase_sector(0, true));
+    polls = model.counters().polls;
+    CHECK(polls > 1);
+    CHECK_TRANSACTIONS(model, 3, 5 + 1 + polls, polls);
+    CHECK_NO_VIOLATIONS(model);
+}
+
+int main(){
+    test_erase();
+    test_program();
+    test_read();
+    test_slow_part();
+    return test_result("test_transactions");
+}